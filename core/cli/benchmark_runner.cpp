@@ -0,0 +1,356 @@
+#include "benchmark_runner.hpp"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QTextStream>
+#include <algorithm>
+
+static QTextStream& out()
+{
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+static QTextStream& err()
+{
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+BenchmarkRunner::BenchmarkRunner(
+    std::shared_ptr<Settings> settings,
+    std::shared_ptr<Settings> presets,
+    FormatSupportLoader& formatSupportLoader,
+    MetadataLoader& metadataLoader,
+    MediaEncoder& encoder,
+    HardwareEncoderProbe& hardwareProbe
+)
+    : settings(std::move(settings))
+    , presets(std::move(presets))
+    , formatSupportLoader(formatSupportLoader)
+    , metadataLoader(metadataLoader)
+    , encoder(encoder)
+    , hardwareProbe(hardwareProbe)
+    , qualityMeter(new QualityMeter(this))
+{
+    connect(&formatSupportLoader, &FormatSupportLoader::queryCompleted, this, &BenchmarkRunner::HandleFormatsQueryResult);
+    connect(&metadataLoader, &MetadataLoader::loadAsyncComplete, this, &BenchmarkRunner::ReceiveMediaMetadata);
+    connect(&encoder, &MediaEncoder::jobStarted, this, &BenchmarkRunner::HandleStart);
+    connect(&encoder, &MediaEncoder::jobResourceUsage, this, &BenchmarkRunner::HandleResourceUsage);
+    connect(&encoder, &MediaEncoder::jobSucceeded, this, &BenchmarkRunner::HandleSuccess);
+    connect(&encoder, &MediaEncoder::jobFailed, this, &BenchmarkRunner::HandleFailure);
+}
+
+void BenchmarkRunner::Start(const Config& config)
+{
+    this->config = config;
+    compiledPresets = PresetOptions::compileAll(*presets, config.presetNames);
+
+    // encodes running side by side would slow each other down
+    encoder.setMaxConcurrentJobs(1);
+    encoder.setMeasuresResourceUsage(true);
+    encoder.setReusesResults(false);
+    // repetitions of a preset only differ in timing, not in the bitrate the calibration would keep moving
+    encoder.setLearnsSizes(false);
+
+    formatSupportLoader.QuerySupportedFormatsAsync();
+}
+
+void BenchmarkRunner::HandleFormatsQueryResult(const std::variant<QSharedPointer<FormatSupport>, Message>& maybeFormats)
+{
+    if (std::holds_alternative<Message>(maybeFormats))
+    {
+        const Message& error = std::get<Message>(maybeFormats);
+        err() << "ffmpeg: " << error.title << Qt::endl << error.message << Qt::endl;
+        emit finished(1);
+        return;
+    }
+
+    const bool isRefresh = formats != nullptr;
+    formats = std::get<QSharedPointer<FormatSupport>>(maybeFormats);
+
+    if (isRefresh)
+        return;
+
+    if (!config.preferHardwareEncoders)
+    {
+        LoadClips();
+        return;
+    }
+
+    connect(&hardwareProbe, &HardwareEncoderProbe::probeCompleted, this, &BenchmarkRunner::LoadClips, Qt::SingleShotConnection);
+    hardwareProbe.ProbeAsync(formats);
+}
+
+void BenchmarkRunner::LoadClips()
+{
+    for (const QString& path : std::as_const(config.clipPaths))
+        pendingProbes.insert(metadataLoader.loadAsync(path), path);
+}
+
+void BenchmarkRunner::ReceiveMediaMetadata(const int requestId, const QString& path, MetadataResult result)
+{
+    if (!pendingProbes.remove(requestId))
+        return;
+
+    if (std::holds_alternative<Message>(result))
+        err() << QDir::toNativeSeparators(path) << ": " << std::get<Message>(result).message << Qt::endl;
+    else
+        clipsMetadata.insert(path, std::get<Metadata>(result));
+
+    if (!pendingProbes.isEmpty())
+        return;
+
+    // clips are run in the order given, so that the report reads like the command line
+    for (const QString& clipPath : std::as_const(config.clipPaths))
+    {
+        if (!clipsMetadata.contains(clipPath))
+            continue;
+
+        for (const QString& presetName : std::as_const(config.presetNames))
+        {
+            for (int repetition = 1; repetition <= config.repeatCount; repetition++)
+                runs.append({ .clipPath = clipPath, .presetName = presetName, .repetition = repetition });
+        }
+    }
+
+    RunNext();
+}
+
+void BenchmarkRunner::RunNext()
+{
+    if (++currentRun >= runs.size())
+    {
+        WriteReport();
+        return;
+    }
+
+    Run& run = runs[currentRun];
+    const Metadata metadata = clipsMetadata.value(run.clipPath);
+    const QString outputName = QString("%1_%2_%3").arg(QFileInfo(run.clipPath).completeBaseName(), run.presetName, QString::number(run.repetition));
+
+    EncoderOptionsBuilder builder;
+    builder.useMetadata(metadata)
+        .inputFrom(run.clipPath)
+        .outputTo(QDir(outputDir.path()).filePath(outputName))
+        .withResourceLimits(ResourceLimits::fromSettings(*settings))
+        .withMinVideoBitrate(settings->get("Main/dMinBitrateVideoKbps").toDouble())
+        .withMinAudioBitrate(settings->get("Main/dMinBitrateAudioKbps").toDouble())
+        .withMaxAudioBitrate(settings->get("Main/dMaxBitrateAudioKbps").toDouble());
+
+    const std::variant<PresetOptions, QStringList>& preset = compiledPresets[run.presetName];
+    QStringList errors = std::holds_alternative<QStringList>(preset)
+                           ? std::get<QStringList>(preset)
+                           : std::get<PresetOptions>(preset).apply(builder, *formats, metadata, config.preferHardwareEncoders ? &hardwareProbe : nullptr);
+    const auto maybeOptions = builder.build();
+
+    if (std::holds_alternative<QList<QString>>(maybeOptions))
+        errors.append(std::get<QList<QString>>(maybeOptions));
+
+    if (!errors.isEmpty())
+    {
+        run.error = errors.join(" ");
+        EndRun();
+        return;
+    }
+
+    const EncoderOptions& options = std::get<EncoderOptions>(maybeOptions);
+    run.videoCodec = options.videoCodec.has_value() ? options.videoCodec->libraryName : "";
+    run.targetSizeKb = options.sizeKbps.has_value() ? optional(*options.sizeKbps / 8) : std::nullopt;
+
+    runTimer.start();
+    currentJobId = encoder.Encode(options);
+}
+
+void BenchmarkRunner::HandleStart(const int jobId)
+{
+    // the options are computed when the job starts, which is what the wall time should count from
+    if (jobId == currentJobId)
+        runTimer.start();
+}
+
+void BenchmarkRunner::HandleResourceUsage(const int jobId, const ResourceUsage& usage)
+{
+    if (jobId == currentJobId)
+        runs[currentRun].usage = usage;
+}
+
+void BenchmarkRunner::HandleSuccess(const int jobId, const EncoderOptions& options, const MediaEncoder::ComputedOptions& computed, const EncodedOutput& output)
+{
+    Q_UNUSED(computed)
+
+    if (jobId != currentJobId)
+        return;
+
+    currentJobId.reset();
+    Run& run = runs[currentRun];
+    run.wallSeconds = runTimer.elapsed() / 1000.0;
+    run.outputSizeKb = output.sizeBytes / 1000.0;
+
+    const QString outputPath = output.path;
+    const bool isComparable = options.videoCodec.has_value() && !options.speed.has_value();
+
+    if (!config.metric.has_value() || !isComparable)
+    {
+        EndRun(outputPath);
+        return;
+    }
+
+    connect(qualityMeter, &QualityMeter::measured, this, [this, outputPath](optional<double> score)
+            {
+        runs[currentRun].score = score;
+        EndRun(outputPath); }, Qt::SingleShotConnection);
+
+    const Metadata& metadata = options.inputMetadata;
+    qualityMeter->MeasureAsync(*config.metric, outputPath,
+                               { .path = run.clipPath, .width = static_cast<int>(metadata.width), .height = static_cast<int>(metadata.height),
+                                 .fps = options.fps.has_value() ? optional<double>(*options.fps) : std::nullopt });
+}
+
+void BenchmarkRunner::HandleFailure(const int jobId, const QString& error, const QString& errorDetails)
+{
+    Q_UNUSED(errorDetails)
+
+    if (jobId != currentJobId)
+        return;
+
+    currentJobId.reset();
+    runs[currentRun].error = error;
+    EndRun();
+}
+
+void BenchmarkRunner::EndRun(const QString& outputPath)
+{
+    if (!outputPath.isEmpty())
+        QFile::remove(outputPath);
+
+    PrintRun(runs.at(currentRun));
+
+    // deferred so that the encoder is done with the previous job before the next one is queued
+    QMetaObject::invokeMethod(this, &BenchmarkRunner::RunNext, Qt::QueuedConnection);
+}
+
+void BenchmarkRunner::PrintRun(const Run& run)
+{
+    const QString name = QString("[%1/%2] %3 / %4 #%5")
+                             .arg(QString::number(currentRun + 1), QString::number(runs.size()), QFileInfo(run.clipPath).fileName(),
+                                  run.presetName, QString::number(run.repetition));
+
+    if (!run.error.isEmpty())
+    {
+        err() << name << ": " << run.error << Qt::endl;
+        return;
+    }
+
+    out() << QString("%1: %2 s wall | %3 s cpu | %4 MB peak | %5 kB")
+                 .arg(name, QString::number(run.wallSeconds, 'f', 2), QString::number(run.usage.cpuSeconds(), 'f', 2),
+                      QString::number(run.usage.peakRssKb / 1024.0, 'f', 1), QString::number(qRound(run.outputSizeKb)))
+          << (run.score.has_value() ? QString(" | %1 %2").arg(QualityMeter::metricName(*config.metric), QString::number(*run.score, 'f', 3)) : QString())
+          << Qt::endl;
+}
+
+void BenchmarkRunner::WriteReport()
+{
+    QSaveFile file(config.reportPath);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        err() << QDir::toNativeSeparators(config.reportPath) << ": " << file.errorString() << Qt::endl;
+        emit finished(1);
+        return;
+    }
+
+    file.write(config.reportPath.endsWith(".json", Qt::CaseInsensitive) ? jsonReport() : csvReport());
+
+    if (!file.commit())
+    {
+        err() << QDir::toNativeSeparators(config.reportPath) << ": " << file.errorString() << Qt::endl;
+        emit finished(1);
+        return;
+    }
+
+    out() << QString("Report written to %1").arg(QDir::toNativeSeparators(config.reportPath)) << Qt::endl;
+
+    const bool hasFailures = std::any_of(runs.begin(), runs.end(), [](const Run& run)
+                                         { return !run.error.isEmpty(); });
+    emit finished(hasFailures || runs.isEmpty() ? 1 : 0);
+}
+
+QByteArray BenchmarkRunner::csvReport() const
+{
+    const auto quote = [](QString value)
+    {
+        return QString(R"("%1")").arg(value.replace('"', R"("")"));
+    };
+    const auto number = [](const optional<double> value, const int precision)
+    {
+        return value.has_value() ? QString::number(*value, 'f', precision) : QString();
+    };
+
+    QStringList lines { "clip,preset,run,video_codec,wall_seconds,cpu_seconds,peak_rss_kb,target_size_kb,output_size_kb,size_ratio,score,error" };
+
+    for (const Run& run : runs)
+    {
+        const bool isDone = run.error.isEmpty();
+        const optional<double> sizeRatio = isDone && run.targetSizeKb.has_value() ? optional(run.outputSizeKb / *run.targetSizeKb) : std::nullopt;
+
+        lines.append(QStringList {
+            quote(run.clipPath),
+            quote(run.presetName),
+            QString::number(run.repetition),
+            run.videoCodec,
+            isDone ? number(run.wallSeconds, 3) : "",
+            isDone ? number(run.usage.cpuSeconds(), 3) : "",
+            isDone ? QString::number(run.usage.peakRssKb) : "",
+            number(run.targetSizeKb, 1),
+            isDone ? number(run.outputSizeKb, 1) : "",
+            number(sizeRatio, 4),
+            number(run.score, 4),
+            quote(run.error),
+        }.join(','));
+    }
+
+    return lines.join('\n').toUtf8() + '\n';
+}
+
+QByteArray BenchmarkRunner::jsonReport() const
+{
+    QJsonArray results;
+
+    for (const Run& run : runs)
+    {
+        QJsonObject result {
+            { "clip", run.clipPath },
+            { "preset", run.presetName },
+            { "run", run.repetition },
+            { "videoCodec", run.videoCodec },
+        };
+
+        if (!run.error.isEmpty())
+        {
+            result["error"] = run.error;
+            results.append(result);
+            continue;
+        }
+
+        result["wallSeconds"] = run.wallSeconds;
+        result["cpuSeconds"] = run.usage.cpuSeconds();
+        result["peakRssKb"] = run.usage.peakRssKb;
+        result["outputSizeKb"] = run.outputSizeKb;
+
+        if (run.targetSizeKb.has_value())
+        {
+            result["targetSizeKb"] = *run.targetSizeKb;
+            result["sizeRatio"] = run.outputSizeKb / *run.targetSizeKb;
+        }
+        if (run.score.has_value())
+            result[QualityMeter::metricName(*config.metric)] = *run.score;
+
+        results.append(result);
+    }
+
+    return QJsonDocument(results).toJson();
+}
@@ -0,0 +1,106 @@
+#ifndef BENCHMARK_RUNNER_H
+#define BENCHMARK_RUNNER_H
+
+#include "core/encoder/encoder.hpp"
+#include "core/encoder/quality_meter.hpp"
+#include "core/formats/format_support_loader.hpp"
+#include "core/formats/hardware_encoder_probe.hpp"
+#include "core/formats/metadata_loader.hpp"
+#include "core/settings/settings.hpp"
+#include "preset_options.hpp"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QTemporaryDir>
+#include <di.hpp>
+
+//!
+//! \brief Encodes a corpus of clips with several presets, and reports what each encode cost and how close it got.
+//! \details Encodes run one at a time so that they do not compete for the machine. The report is written as JSON
+//! when its path ends in .json, as CSV otherwise. Outputs are removed once measured.
+//!
+class BenchmarkRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    BOOST_DI_INJECT(
+        BenchmarkRunner,
+        (named = di_settings) std::shared_ptr<Settings> settings,
+        (named = di_presets) std::shared_ptr<Settings> presets,
+        FormatSupportLoader& formatSupportLoader,
+        MetadataLoader& metadataLoader,
+        MediaEncoder& encoder,
+        HardwareEncoderProbe& hardwareProbe
+    );
+
+    struct Config
+    {
+        QStringList presetNames;
+        QStringList clipPaths;
+        QString reportPath;
+        int repeatCount = 1;
+        //! Scores each output against its clip; outputs of presets that change the speed are not scored.
+        optional<QualityMeter::Metric> metric;
+        bool preferHardwareEncoders = true;
+    };
+
+    void Start(const Config& config);
+
+signals:
+    void finished(int exitCode);
+
+private:
+    struct Run
+    {
+        QString clipPath;
+        QString presetName;
+        int repetition;
+        QString videoCodec;
+        double wallSeconds = 0;
+        ResourceUsage usage;
+        optional<double> targetSizeKb;
+        double outputSizeKb = 0;
+        optional<double> score;
+        QString error;
+    };
+
+    void HandleFormatsQueryResult(const std::variant<QSharedPointer<FormatSupport>, Message>& maybeFormats);
+    void LoadClips();
+    void ReceiveMediaMetadata(int requestId, const QString& path, MetadataResult result);
+    void RunNext();
+    void HandleStart(int jobId);
+    void HandleResourceUsage(int jobId, const ResourceUsage& usage);
+    void HandleSuccess(int jobId, const EncoderOptions& options, const MediaEncoder::ComputedOptions& computed, const EncodedOutput& output);
+    void HandleFailure(int jobId, const QString& error, const QString& errorDetails);
+    void EndRun(const QString& outputPath = {});
+    void WriteReport();
+
+    [[nodiscard]] QByteArray csvReport() const;
+    [[nodiscard]] QByteArray jsonReport() const;
+    void PrintRun(const Run& run);
+
+    std::shared_ptr<Settings> settings;
+    std::shared_ptr<Settings> presets;
+    FormatSupportLoader& formatSupportLoader;
+    MetadataLoader& metadataLoader;
+    MediaEncoder& encoder;
+    HardwareEncoderProbe& hardwareProbe;
+    QualityMeter* qualityMeter;
+
+    Config config;
+    //! The presets of the run, read once for every input they encode.
+    QHash<QString, std::variant<PresetOptions, QStringList>> compiledPresets;
+    QSharedPointer<FormatSupport> formats;
+    QHash<int, QString> pendingProbes;
+    QHash<QString, Metadata> clipsMetadata;
+    QTemporaryDir outputDir;
+
+    QList<Run> runs;
+    qsizetype currentRun = -1;
+    optional<int> currentJobId;
+    QElapsedTimer runTimer;
+};
+
+#endif
@@ -0,0 +1,346 @@
+#include "cli_runner.hpp"
+
+#include "farm_client.hpp"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QTextStream>
+
+static QTextStream& out()
+{
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+static QTextStream& err()
+{
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+CliRunner::CliRunner(
+    std::shared_ptr<Settings> settings,
+    std::shared_ptr<Settings> presets,
+    FormatSupportLoader& formatSupportLoader,
+    MetadataLoader& metadataLoader,
+    MediaFileScanner& mediaScanner,
+    MediaEncoder& encoder,
+    HardwareEncoderProbe& hardwareProbe,
+    TelemetryRecorder& telemetry,
+    MetricsServer& metricsServer,
+    FarmCoordinator& farmCoordinator
+)
+    : settings(std::move(settings))
+    , presets(std::move(presets))
+    , formatSupportLoader(formatSupportLoader)
+    , metadataLoader(metadataLoader)
+    , mediaScanner(mediaScanner)
+    , encoder(encoder)
+    , hardwareProbe(hardwareProbe)
+    , telemetry(telemetry)
+    , metricsServer(metricsServer)
+    , farmCoordinator(farmCoordinator)
+    , watcher(new QFileSystemWatcher(this))
+    , scanTimer(new QTimer(this))
+{
+    // files dropped in the watched folder are only picked up once they stop growing
+    scanTimer->setSingleShot(true);
+    scanTimer->setInterval(scanDelayMs);
+
+    connect(scanTimer, &QTimer::timeout, this, &CliRunner::ScanWatchDir);
+    connect(watcher, &QFileSystemWatcher::directoryChanged, scanTimer, qOverload<>(&QTimer::start));
+
+    connect(&formatSupportLoader, &FormatSupportLoader::queryCompleted, this, &CliRunner::HandleFormatsQueryResult);
+    connect(&metadataLoader, &MetadataLoader::loadAsyncComplete, this, &CliRunner::ReceiveMediaMetadata);
+    connect(&mediaScanner, &MediaFileScanner::finished, this, &CliRunner::CheckFinished);
+    connect(&mediaScanner, &MediaFileScanner::mediaFound, this, [this](const QStringList& paths)
+            {
+        for (const QString& path : paths)
+            Enqueue(path); });
+    connect(&encoder, &MediaEncoder::jobProgressUpdate, this, &CliRunner::HandleProgress);
+    connect(&encoder, &MediaEncoder::jobSucceeded, this, &CliRunner::HandleSuccess);
+    connect(&encoder, &MediaEncoder::jobFailed, this, &CliRunner::HandleFailure);
+    connect(&encoder, &MediaEncoder::queueFinished, this, &CliRunner::CheckFinished);
+    connect(&farmCoordinator, &FarmCoordinator::capabilitiesFound, &encoder, &MediaEncoder::setWorkerCapabilities);
+}
+
+void CliRunner::Start(const Config& config)
+{
+    this->config = config;
+    compiledPresets = PresetOptions::compileAll(*presets, config.presetNames);
+
+    encoder.setThreadsPerJob(settings->get("Main/iThreadsPerEncoder").toInt());
+    const QStringList remoteWorkers = settings->get("Main/sRemoteWorkers").toStringList();
+    if (settings->get("Main/sRemoteWorkerProtocol").toString() == "sme")
+    {
+        encoder.setRemoteWorkers(remoteWorkers, FarmClient::commandTemplate(settings->get("Main/bRemoteWorkerStreamsInput").toBool()));
+
+        // nothing goes to a worker before it says what it can run
+        for (const QString& host : remoteWorkers)
+            encoder.setWorkerCapabilities(host, { .slotsCount = 0 });
+        farmCoordinator.Discover(remoteWorkers);
+    }
+    else
+    {
+        encoder.setRemoteWorkers(remoteWorkers, settings->get("Main/sRemoteWorkerCommand").toString());
+    }
+    encoder.setInProcessEncoding(settings->get("Main/bInProcessEncoding").toBool());
+    encoder.setStagingDirectory(settings->get("Main/sStagingDirectory").toString());
+
+    const QString telemetryLog = settings->get("Main/sTelemetryLog").toString();
+    const int metricsPort = config.metricsPort.value_or(settings->get("Main/iMetricsPort").toInt());
+    telemetry.setLogPath(telemetryLog);
+
+    // CPU time and memory are only known from ffmpeg processes run with -benchmark
+    if (!telemetryLog.isEmpty() || metricsPort > 0)
+        encoder.setMeasuresResourceUsage(true);
+
+    if (metricsPort > 0)
+    {
+        const QHostAddress address(settings->get("Main/sMetricsAddress").toString());
+        if (const optional<Message> error = metricsServer.Listen(address, static_cast<quint16>(metricsPort)))
+        {
+            PrintError("metrics", error->title, error->message);
+            emit finished(1);
+            return;
+        }
+    }
+
+    formatSupportLoader.QuerySupportedFormatsAsync();
+}
+
+void CliRunner::HandleFormatsQueryResult(const std::variant<QSharedPointer<FormatSupport>, Message>& maybeFormats)
+{
+    if (std::holds_alternative<Message>(maybeFormats))
+    {
+        const Message& error = std::get<Message>(maybeFormats);
+        PrintError("ffmpeg", error.title, error.message + "\n" + error.details);
+        emit finished(1);
+        return;
+    }
+
+    // a refresh after ffmpeg changed only matters to inputs that were not queued yet
+    const bool isRefresh = formats != nullptr;
+    formats = std::get<QSharedPointer<FormatSupport>>(maybeFormats);
+
+    if (isRefresh)
+        return;
+
+    if (!config.preferHardwareEncoders)
+    {
+        BeginProcessing();
+        return;
+    }
+
+    connect(&hardwareProbe, &HardwareEncoderProbe::probeCompleted, this, &CliRunner::BeginProcessing, Qt::SingleShotConnection);
+    hardwareProbe.ProbeAsync(formats);
+}
+
+void CliRunner::BeginProcessing()
+{
+    isProcessing = true;
+
+    QStringList folders;
+    for (const QString& path : std::as_const(config.inputPaths))
+    {
+        if (QFileInfo(path).isDir())
+            folders.append(path);
+        else
+            Enqueue(path);
+    }
+
+    // the first files found are probed and encoded while the rest of the folders are walked
+    if (!folders.isEmpty())
+        mediaScanner.ScanAsync(folders);
+
+    if (!config.watchDir.isEmpty())
+    {
+        watcher->addPath(config.watchDir);
+        out() << tr("Watching %1 for new files").arg(QDir::toNativeSeparators(config.watchDir)) << Qt::endl;
+        ScanWatchDir();
+        return;
+    }
+
+    CheckFinished();
+}
+
+void CliRunner::ScanWatchDir()
+{
+    bool hasGrowingFiles = false;
+    const QFileInfoList files = QDir(config.watchDir).entryInfoList(QDir::Files | QDir::NoDotAndDotDot | QDir::Readable, QDir::Time | QDir::Reversed);
+
+    for (const QFileInfo& file : files)
+    {
+        const QString path = file.absoluteFilePath();
+        if (seenFiles.contains(path))
+            continue;
+
+        if (growingFiles.value(path, -1) != file.size() || file.size() == 0)
+        {
+            growingFiles.insert(path, file.size());
+            hasGrowingFiles = true;
+            continue;
+        }
+
+        growingFiles.remove(path);
+        seenFiles.insert(path);
+
+        // files encoded by a previous run are skipped after a restart
+        if (!hasOutput(path))
+            Enqueue(path);
+    }
+
+    if (hasGrowingFiles)
+        scanTimer->start();
+}
+
+void CliRunner::Enqueue(const QString& inputPath)
+{
+    pendingProbes.insert(metadataLoader.loadAsync(inputPath), inputPath);
+}
+
+void CliRunner::ReceiveMediaMetadata(const int requestId, const QString& path, MetadataResult result)
+{
+    if (!pendingProbes.remove(requestId))
+        return;
+
+    if (std::holds_alternative<Message>(result))
+    {
+        const Message& error = std::get<Message>(result);
+        PrintError(path, error.title, error.message);
+        failuresCount++;
+        CheckFinished();
+        return;
+    }
+
+    const Metadata metadata = std::get<Metadata>(result);
+    std::vector<EncoderOptions> variants;
+
+    for (const QString& presetName : std::as_const(config.presetNames))
+    {
+        EncoderOptionsBuilder builder;
+
+        builder.useMetadata(metadata)
+            .inputFrom(path)
+            .outputTo(outputPathFor(path, presetName))
+            .withChunkedEncoding(settings->get("Preferences/parallelSegmentsCheckBox").toBool())
+            .withResumableEncoding(settings->get("Main/bResumableEncodes").toBool())
+            .withComplexityAnalysis(settings->get("Preferences/analyzeComplexityCheckBox").toBool())
+            .withResourceLimits(ResourceLimits::fromSettings(*settings))
+            .withMinVideoBitrate(settings->get("Main/dMinBitrateVideoKbps").toDouble())
+            .withMinAudioBitrate(settings->get("Main/dMinBitrateAudioKbps").toDouble())
+            .withMaxAudioBitrate(settings->get("Main/dMaxBitrateAudioKbps").toDouble());
+
+        const std::variant<PresetOptions, QStringList>& preset = compiledPresets[presetName];
+        QStringList errors = std::holds_alternative<QStringList>(preset)
+                               ? std::get<QStringList>(preset)
+                               : std::get<PresetOptions>(preset).apply(builder, *formats, metadata, config.preferHardwareEncoders ? &hardwareProbe : nullptr);
+
+        if (config.targetQuality.has_value())
+            builder.withTargetQuality(*config.targetQuality);
+
+        if (config.trimStartSeconds.has_value() || config.trimEndSeconds.has_value())
+            builder.withTrim(config.trimStartSeconds, config.trimEndSeconds).withSmartCut(config.smartCut);
+
+        if (!config.trackActions.isEmpty())
+            builder.withTrackActions(config.trackActions);
+
+        const auto maybeOptions = builder.build();
+
+        if (std::holds_alternative<QList<QString>>(maybeOptions))
+            errors.append(std::get<QList<QString>>(maybeOptions));
+
+        if (!errors.isEmpty())
+        {
+            PrintError(path, tr("Invalid encoding options for preset '%1'").arg(presetName), errors.join("\n"));
+            failuresCount++;
+            continue;
+        }
+
+        variants.push_back(std::get<EncoderOptions>(maybeOptions));
+    }
+
+    if (variants.empty())
+    {
+        CheckFinished();
+        return;
+    }
+
+    for (const int jobId : encoder.EncodeVariants(variants))
+        jobInputs.insert(jobId, path);
+
+    out() << tr("Queued %1").arg(QDir::toNativeSeparators(path)) << Qt::endl;
+}
+
+void CliRunner::HandleProgress(const int jobId, const EncodingProgress& progress)
+{
+    // one line per percent is plenty for logs
+    const int percent = static_cast<int>(progress.percent);
+    if (lastReportedPercents.value(jobId, -1) == percent)
+        return;
+
+    lastReportedPercents.insert(jobId, percent);
+    out() << QString("[%1] %2% | %3x | ETA %4s")
+                 .arg(QFileInfo(jobInputs.value(jobId)).fileName(), QString::number(percent), QString::number(progress.speed, 'f', 2),
+                      progress.etaSeconds.has_value() ? QString::number(qRound(*progress.etaSeconds)) : "?")
+          << Qt::endl;
+}
+
+void CliRunner::HandleSuccess(const int jobId, const EncoderOptions& options, const MediaEncoder::ComputedOptions& computed, const EncodedOutput& output)
+{
+    Q_UNUSED(options)
+    Q_UNUSED(computed)
+
+    out() << tr("Done %1 -> %2 (%3 kB)")
+                 .arg(QDir::toNativeSeparators(jobInputs.take(jobId)), QDir::toNativeSeparators(output.path), QString::number(output.sizeBytes / 1000))
+          << Qt::endl;
+    lastReportedPercents.remove(jobId);
+}
+
+void CliRunner::HandleFailure(const int jobId, const QString& error, const QString& errorDetails)
+{
+    PrintError(jobInputs.take(jobId), error, errorDetails);
+    lastReportedPercents.remove(jobId);
+    failuresCount++;
+}
+
+void CliRunner::CheckFinished()
+{
+    if (!isProcessing || !config.watchDir.isEmpty() || mediaScanner.isScanning() || !pendingProbes.isEmpty() || !encoder.isIdle())
+        return;
+
+    emit finished(failuresCount > 0 ? 1 : 0);
+}
+
+QString CliRunner::outputPathFor(const QString& inputPath, const QString& presetName) const
+{
+    const QFileInfo input(inputPath);
+    const QString presetSuffix = config.presetNames.size() > 1 ? "_" + presetName : "";
+
+    // the extension comes from the container, so one given by the user is dropped
+    if (!config.outputPath.isEmpty())
+    {
+        const QFileInfo output(config.outputPath);
+        return output.dir().filePath(output.completeBaseName() + presetSuffix);
+    }
+
+    const QDir folder = config.outputDir.isEmpty() ? input.dir() : QDir(config.outputDir);
+    const QString suffix = settings->get("Preferences/outputFileNameLineEdit").toString();
+
+    return folder.filePath((suffix.isEmpty() ? input.completeBaseName() : input.completeBaseName() + "_" + suffix) + presetSuffix);
+}
+
+bool CliRunner::hasOutput(const QString& inputPath) const
+{
+    const QFileInfo output(outputPathFor(inputPath, config.presetNames.value(0)));
+    // the output of a ladder is a folder
+    return !output.dir().entryList({ output.fileName() + ".*" }, QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot).isEmpty();
+}
+
+void CliRunner::PrintError(const QString& path, const QString& error, const QString& details)
+{
+    err() << QDir::toNativeSeparators(path) << ": " << error << Qt::endl;
+
+    if (!details.trimmed().isEmpty())
+        err() << details.trimmed() << Qt::endl;
+}
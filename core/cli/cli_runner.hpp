@@ -0,0 +1,122 @@
+#ifndef CLI_RUNNER_H
+#define CLI_RUNNER_H
+
+#include "core/encoder/encoder.hpp"
+#include "core/formats/format_support_loader.hpp"
+#include "core/formats/hardware_encoder_probe.hpp"
+#include "core/formats/media_file_scanner.hpp"
+#include "core/formats/metadata_loader.hpp"
+#include "core/settings/settings.hpp"
+#include "core/telemetry/telemetry_recorder.hpp"
+#include "farm_coordinator.hpp"
+#include "metrics_server.hpp"
+#include "preset_options.hpp"
+
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QTimer>
+#include <di.hpp>
+
+//!
+//! \brief Encodes files from the command line with a preset, or every file dropped in a watched folder.
+//!
+class CliRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    BOOST_DI_INJECT(
+        CliRunner,
+        (named = di_settings) std::shared_ptr<Settings> settings,
+        (named = di_presets) std::shared_ptr<Settings> presets,
+        FormatSupportLoader& formatSupportLoader,
+        MetadataLoader& metadataLoader,
+        MediaFileScanner& mediaScanner,
+        MediaEncoder& encoder,
+        HardwareEncoderProbe& hardwareProbe,
+        TelemetryRecorder& telemetry,
+        MetricsServer& metricsServer,
+        FarmCoordinator& farmCoordinator
+    );
+
+    struct Config
+    {
+        //! Several presets encode one output each, from a single decode of the input; see MediaEncoder::EncodeVariants().
+        QStringList presetNames;
+        //! Files to encode; folders are walked for the media files they hold.
+        QStringList inputPaths;
+        //! Output of a single input, with or without extension.
+        QString outputPath;
+        //! Folder for the outputs; next to each input when empty.
+        QString outputDir;
+        //! Folder to encode new files from, until interrupted. Outputs must go elsewhere.
+        QString watchDir;
+        bool preferHardwareEncoders = true;
+        //! Encodes to the smallest size reaching this VMAF score, in place of the size of the preset.
+        optional<double> targetQuality;
+        //! Keeps the part of every input between these times, in seconds.
+        optional<double> trimStartSeconds;
+        optional<double> trimEndSeconds;
+        //! Re-encodes only around the trim points; see EncoderOptions::smartCut.
+        bool smartCut = false;
+        //! Streams of every input to encode, copy or drop, by index; see TrackPlan::forStreams.
+        QHash<int, TrackPlan::Action> trackActions;
+        //! Serves metrics on this port, in place of the one of the settings; zero serves none.
+        optional<quint16> metricsPort;
+    };
+
+    void Start(const Config& config);
+
+signals:
+    void finished(int exitCode);
+
+private:
+    void HandleFormatsQueryResult(const std::variant<QSharedPointer<FormatSupport>, Message>& maybeFormats);
+    void BeginProcessing();
+    void ScanWatchDir();
+    void Enqueue(const QString& inputPath);
+    void ReceiveMediaMetadata(int requestId, const QString& path, MetadataResult result);
+    void HandleProgress(int jobId, const EncodingProgress& progress);
+    void HandleSuccess(int jobId, const EncoderOptions& options, const MediaEncoder::ComputedOptions& computed, const EncodedOutput& output);
+    void HandleFailure(int jobId, const QString& error, const QString& errorDetails);
+    void CheckFinished();
+
+    //! The preset name is appended when encoding with several, so that outputs do not overwrite each other.
+    [[nodiscard]] QString outputPathFor(const QString& inputPath, const QString& presetName) const;
+    [[nodiscard]] bool hasOutput(const QString& inputPath) const;
+    void PrintError(const QString& path, const QString& error, const QString& details = "");
+
+    std::shared_ptr<Settings> settings;
+    std::shared_ptr<Settings> presets;
+    FormatSupportLoader& formatSupportLoader;
+    MetadataLoader& metadataLoader;
+    MediaFileScanner& mediaScanner;
+    MediaEncoder& encoder;
+    HardwareEncoderProbe& hardwareProbe;
+    TelemetryRecorder& telemetry;
+    MetricsServer& metricsServer;
+    FarmCoordinator& farmCoordinator;
+
+    Config config;
+    //! The presets of the run, read once for every input they encode.
+    QHash<QString, std::variant<PresetOptions, QStringList>> compiledPresets;
+    QSharedPointer<FormatSupport> formats;
+    bool isProcessing = false;
+    int failuresCount = 0;
+
+    QHash<int, QString> pendingProbes;
+    QHash<int, QString> jobInputs;
+    QHash<int, int> lastReportedPercents;
+
+    QFileSystemWatcher* watcher;
+    QTimer* scanTimer;
+    QSet<QString> seenFiles;
+    //! Files still being written to the watched folder, with the last size seen.
+    QHash<QString, qint64> growingFiles;
+
+    static constexpr int scanDelayMs = 2000;
+};
+
+#endif
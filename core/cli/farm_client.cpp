@@ -0,0 +1,229 @@
+#include "farm_client.hpp"
+
+#include "core/encoder/result_cache.hpp"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QJsonArray>
+#include <QTcpSocket>
+#include <QTextStream>
+#include <cstdio>
+
+static QTextStream& err()
+{
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+//! Passed through as bytes, as a chunk may end within a character.
+static void relay(FILE* stream, const QByteArray& bytes)
+{
+    std::fwrite(bytes.constData(), 1, bytes.size(), stream);
+    std::fflush(stream);
+}
+
+FarmClient::FarmClient(std::shared_ptr<Settings> settings)
+    : settings(std::move(settings))
+    , socket(new QTcpSocket(this))
+    , timeout(new QTimer(this))
+{
+    timeout->setSingleShot(true);
+    timeout->setInterval(connectTimeoutMs);
+
+    connect(timeout, &QTimer::timeout, this, [this]
+            { Fail("The worker did not answer."); });
+    connect(socket, &QTcpSocket::connected, this, &FarmClient::SendRequest);
+    connect(socket, &QTcpSocket::readyRead, this, &FarmClient::Read);
+    connect(socket, &QTcpSocket::bytesWritten, this, &FarmClient::StreamInput);
+    connect(socket, &QTcpSocket::errorOccurred, this, [this]
+            { Fail(socket->errorString()); });
+}
+
+void FarmClient::Start(const QString& address, const QStringList& arguments, const bool streamsInput)
+{
+    this->arguments = arguments;
+    this->streamsInput = streamsInput;
+
+    // commands are built as ffmpeg [...] -i "input" [...] "output" -y
+    const qsizetype inputOption = arguments.indexOf("-i");
+    inputIndex = inputOption >= 0 && inputOption + 1 < arguments.size() ? inputOption + 1 : -1;
+    outputIndex = arguments.size() > 2 && arguments.last() == "-y" ? arguments.size() - 2 : -1;
+
+    // nothing to bring back from a pass that only gathers statistics
+    if (outputIndex >= 0 && QStringList { "/dev/null", "NUL", "-" }.contains(arguments.at(outputIndex)))
+        outputIndex = -1;
+
+    if (arguments.isEmpty())
+    {
+        Fail("No command to run.");
+        return;
+    }
+
+    const auto [host, port] = FarmProtocol::parseAddress(address);
+    timeout->start();
+    socket->connectToHost(host, port);
+}
+
+QString FarmClient::commandTemplate(const bool streamsInput)
+{
+    return QString(R"("%1" --run-on %2%3)")
+        .arg(QDir::toNativeSeparators(QCoreApplication::applicationFilePath()), "%1", streamsInput ? " --stream-input" : "");
+}
+
+void FarmClient::SendRequest()
+{
+    // once connected, the encode takes as long as it takes
+    timeout->stop();
+
+    QJsonObject request {
+        { "type", "run" },
+        { "token", settings->get("Main/sWorkerToken").toString() },
+        { "arguments", QJsonArray::fromStringList(arguments) },
+    };
+
+    if (streamsInput && inputIndex >= 0)
+    {
+        // the key of the cache, so that the parts of one input are streamed once to each worker
+        const QString key = ResultCache::keyFor(arguments.at(inputIndex), "");
+        if (key.isEmpty())
+        {
+            Fail("Could not read " + QDir::toNativeSeparators(arguments.at(inputIndex)) + ".");
+            return;
+        }
+
+        request.insert("inputIndex", inputIndex);
+        request.insert("inputKey", key);
+    }
+
+    if (outputIndex >= 0)
+        request.insert("outputIndex", outputIndex);
+
+    socket->write(FarmProtocol::frame(FarmProtocol::Kind::Request, request));
+}
+
+void FarmClient::Read()
+{
+    buffer += socket->readAll();
+
+    const optional<QList<FarmProtocol::Frame>> frames = FarmProtocol::takeFrames(buffer);
+    if (!frames.has_value())
+    {
+        Fail("The worker sent something it should not have.");
+        return;
+    }
+
+    for (const FarmProtocol::Frame& frame : *frames)
+    {
+        if (isDone)
+            return;
+
+        switch (frame.kind)
+        {
+        case FarmProtocol::Kind::Reply:
+        {
+            const QJsonObject reply = FarmProtocol::json(frame);
+            if (reply.contains("error"))
+            {
+                Fail(reply.value("error").toString());
+                return;
+            }
+
+            if (reply.value("needsInput").toBool())
+            {
+                input = std::make_unique<QFile>(arguments.at(inputIndex));
+                if (!input->open(QIODevice::ReadOnly))
+                {
+                    Fail("Could not read " + QDir::toNativeSeparators(input->fileName()) + ": " + input->errorString());
+                    return;
+                }
+
+                StreamInput();
+            }
+            break;
+        }
+        case FarmProtocol::Kind::Stdout:
+            relay(stdout, frame.payload);
+            break;
+        case FarmProtocol::Kind::Stderr:
+            relay(stderr, frame.payload);
+            break;
+        case FarmProtocol::Kind::OutputData:
+            if (!output)
+            {
+                output = std::make_unique<QSaveFile>(arguments.at(outputIndex));
+                if (!output->open(QIODevice::WriteOnly))
+                {
+                    Fail("Could not write " + QDir::toNativeSeparators(output->fileName()) + ": " + output->errorString());
+                    return;
+                }
+            }
+
+            if (output->write(frame.payload) != frame.payload.size())
+            {
+                Fail("Could not write " + QDir::toNativeSeparators(output->fileName()) + ": " + output->errorString());
+                return;
+            }
+            break;
+        case FarmProtocol::Kind::Exit:
+            Exit(FarmProtocol::json(frame).value("exitCode").toInt(1));
+            return;
+        default:
+            Fail("The worker sent something it should not have.");
+            return;
+        }
+    }
+}
+
+void FarmClient::StreamInput()
+{
+    if (!input || isDone)
+        return;
+
+    // read as the worker takes it, so that a large input is not held in memory
+    while (socket->bytesToWrite() < FarmProtocol::maxBufferedBytes && !input->atEnd())
+    {
+        const QByteArray chunk = input->read(FarmProtocol::chunkBytes);
+        if (chunk.isEmpty())
+        {
+            Fail("Could not read " + QDir::toNativeSeparators(input->fileName()) + ": " + input->errorString());
+            return;
+        }
+
+        socket->write(FarmProtocol::frame(FarmProtocol::Kind::InputData, chunk));
+    }
+
+    if (input->atEnd())
+    {
+        input.reset();
+        socket->write(FarmProtocol::frame(FarmProtocol::Kind::InputEnd, QByteArray()));
+    }
+}
+
+void FarmClient::Exit(int exitCode)
+{
+    isDone = true;
+
+    if (exitCode == 0 && output && !output->commit())
+    {
+        err() << "Could not write " << QDir::toNativeSeparators(output->fileName()) << ": " << output->errorString() << Qt::endl;
+        exitCode = 1;
+    }
+
+    output.reset();
+    socket->disconnectFromHost();
+    emit finished(exitCode);
+}
+
+void FarmClient::Fail(const QString& error)
+{
+    if (isDone)
+        return;
+
+    isDone = true;
+    timeout->stop();
+    output.reset();
+    socket->abort();
+
+    err() << error << Qt::endl;
+    emit finished(1);
+}
@@ -0,0 +1,63 @@
+#ifndef FARM_CLIENT_H
+#define FARM_CLIENT_H
+
+#include "core/settings/settings.hpp"
+#include "farm_protocol.hpp"
+
+#include <QFile>
+#include <QObject>
+#include <QSaveFile>
+#include <QTimer>
+#include <di.hpp>
+#include <memory>
+
+class QTcpSocket;
+
+//!
+//! \brief Runs one ffmpeg command on a FarmWorker as if it ran here, for MediaEncoder to start in place of ffmpeg.
+//! \details What ffmpeg prints on the worker is printed here, on the same channel, so that the progress and logs of
+//! the job read as they do locally; its output is written to the path of the command, and its exit code is the one
+//! of this process. Killing it ends the encode on the worker.
+//!
+class FarmClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    BOOST_DI_INJECT(FarmClient, (named = di_settings) std::shared_ptr<Settings> settings);
+
+    //! \param address The worker, as host or host:port.
+    //! \param streamsInput Sends the input to the worker, for one that cannot reach it at its path.
+    void Start(const QString& address, const QStringList& arguments, bool streamsInput);
+
+    //! The command, for sRemoteWorkerCommand, which runs ffmpeg commands through this client on the worker named by %1.
+    [[nodiscard]] static QString commandTemplate(bool streamsInput);
+
+signals:
+    void finished(int exitCode);
+
+private:
+    void SendRequest();
+    void Read();
+    void StreamInput();
+    void Exit(int exitCode);
+    void Fail(const QString& error);
+
+    std::shared_ptr<Settings> settings;
+    QTcpSocket* socket;
+    QTimer* timeout;
+
+    QStringList arguments;
+    bool streamsInput = false;
+    qsizetype inputIndex = -1;
+    qsizetype outputIndex = -1;
+    QByteArray buffer;
+    std::unique_ptr<QFile> input;
+    //! Replaces the output only once the worker has written all of it.
+    std::unique_ptr<QSaveFile> output;
+    bool isDone = false;
+
+    static constexpr int connectTimeoutMs = 10000;
+};
+
+#endif
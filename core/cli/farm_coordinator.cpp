@@ -0,0 +1,85 @@
+#include "farm_coordinator.hpp"
+
+#include "farm_protocol.hpp"
+
+#include <QTcpSocket>
+#include <QTextStream>
+#include <QTimer>
+
+static QTextStream& err()
+{
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+FarmCoordinator::FarmCoordinator(std::shared_ptr<Settings> settings)
+    : settings(std::move(settings))
+{
+}
+
+void FarmCoordinator::Discover(const QStringList& hosts)
+{
+    for (const QString& host : hosts)
+        Ask(host);
+}
+
+void FarmCoordinator::Ask(const QString& host)
+{
+    auto* socket = new QTcpSocket(this);
+    auto* timeout = new QTimer(socket);
+    auto buffer = std::make_shared<QByteArray>();
+
+    // whichever of the answer, an error or the timeout comes first settles it
+    const auto settle = [this, host, socket, timeout](const optional<WorkerCapabilities>& capabilities, const QString& error)
+    {
+        timeout->stop();
+        socket->disconnect(this);
+        socket->abort();
+        socket->deleteLater();
+
+        if (capabilities.has_value())
+        {
+            emit capabilitiesFound(host, *capabilities);
+            return;
+        }
+
+        err() << host << ": " << error << Qt::endl;
+        emit capabilitiesFound(host, { .slotsCount = 0 });
+        QTimer::singleShot(retryDelayMs, this, [this, host]
+                           { Ask(host); });
+    };
+
+    timeout->setSingleShot(true);
+    connect(timeout, &QTimer::timeout, this, [settle]
+            { settle({}, "The worker did not answer."); });
+    connect(socket, &QTcpSocket::errorOccurred, this, [settle, socket]
+            { settle({}, socket->errorString()); });
+    connect(socket, &QTcpSocket::connected, this, [this, socket]
+            { socket->write(FarmProtocol::frame(FarmProtocol::Kind::Request, QJsonObject {
+                                                                                  { "type", "capabilities" },
+                                                                                  { "token", settings->get("Main/sWorkerToken").toString() },
+                                                                              })); });
+    connect(socket, &QTcpSocket::readyRead, this, [settle, socket, buffer]
+            {
+        *buffer += socket->readAll();
+
+        const optional<QList<FarmProtocol::Frame>> frames = FarmProtocol::takeFrames(*buffer);
+        if (!frames.has_value() || (!frames->isEmpty() && frames->first().kind != FarmProtocol::Kind::Reply))
+        {
+            settle({}, "The worker sent something it should not have.");
+            return;
+        }
+
+        if (frames->isEmpty())
+            return;
+
+        const QJsonObject reply = FarmProtocol::json(frames->first());
+        if (reply.contains("error"))
+            settle({}, reply.value("error").toString());
+        else
+            settle(WorkerCapabilities::fromJson(reply), {}); });
+
+    const auto [address, port] = FarmProtocol::parseAddress(host);
+    timeout->start(answerTimeoutMs);
+    socket->connectToHost(address, port);
+}
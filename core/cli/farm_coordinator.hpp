@@ -0,0 +1,37 @@
+#ifndef FARM_COORDINATOR_H
+#define FARM_COORDINATOR_H
+
+#include "core/encoder/worker_capabilities.hpp"
+#include "core/settings/settings.hpp"
+
+#include <QObject>
+#include <di.hpp>
+
+//!
+//! \brief Finds out what each FarmWorker of the farm can run, for MediaEncoder to match jobs against.
+//! \details A worker that cannot be reached is reported with no slots, so that nothing is sent to it, and asked
+//! again after a while, for one that was started late or restarted.
+//!
+class FarmCoordinator : public QObject
+{
+    Q_OBJECT
+
+public:
+    BOOST_DI_INJECT(FarmCoordinator, (named = di_settings) std::shared_ptr<Settings> settings);
+
+    //! \param hosts Workers, as host or host:port.
+    void Discover(const QStringList& hosts);
+
+signals:
+    void capabilitiesFound(const QString& host, const WorkerCapabilities& capabilities);
+
+private:
+    void Ask(const QString& host);
+
+    std::shared_ptr<Settings> settings;
+
+    static constexpr int answerTimeoutMs = 10000;
+    static constexpr int retryDelayMs = 30000;
+};
+
+#endif
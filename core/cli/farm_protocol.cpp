@@ -0,0 +1,59 @@
+#include "farm_protocol.hpp"
+
+#include <QJsonDocument>
+#include <QtEndian>
+
+QByteArray FarmProtocol::frame(const Kind kind, const QByteArray& payload)
+{
+    QByteArray frame(5, Qt::Uninitialized);
+    frame[0] = static_cast<char>(kind);
+    qToBigEndian(static_cast<quint32>(payload.size()), frame.data() + 1);
+
+    return frame + payload;
+}
+
+QByteArray FarmProtocol::frame(const Kind kind, const QJsonObject& payload)
+{
+    return frame(kind, QJsonDocument(payload).toJson(QJsonDocument::Compact));
+}
+
+optional<QList<FarmProtocol::Frame>> FarmProtocol::takeFrames(QByteArray& buffer)
+{
+    static const QByteArray kinds = "QAIEORFX";
+    QList<Frame> frames;
+    qsizetype offset = 0;
+
+    while (buffer.size() - offset >= 5)
+    {
+        const char kind = buffer.at(offset);
+        const quint32 size = qFromBigEndian<quint32>(buffer.constData() + offset + 1);
+
+        if (!kinds.contains(kind) || size > maxPayloadBytes)
+            return {};
+        if (buffer.size() - offset - 5 < qsizetype(size))
+            break;
+
+        frames.append({ static_cast<Kind>(kind), buffer.mid(offset + 5, size) });
+        offset += 5 + size;
+    }
+
+    buffer.remove(0, offset);
+    return frames;
+}
+
+QJsonObject FarmProtocol::json(const Frame& frame)
+{
+    return QJsonDocument::fromJson(frame.payload).object();
+}
+
+std::pair<QString, quint16> FarmProtocol::parseAddress(const QString& address)
+{
+    const qsizetype separator = address.lastIndexOf(':');
+    bool isPort = false;
+    const quint16 port = separator > 0 ? address.sliced(separator + 1).toUShort(&isPort) : 0;
+
+    if (!isPort || port == 0)
+        return { address, defaultPort };
+
+    return { address.first(separator), port };
+}
@@ -0,0 +1,60 @@
+#ifndef FARM_PROTOCOL_H
+#define FARM_PROTOCOL_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+#include <optional>
+
+using std::optional;
+
+//!
+//! \brief The frames FarmClient, FarmCoordinator and FarmWorker exchange over TCP.
+//! \details A frame is its kind as a byte, the size of its payload as 4 big-endian bytes, and the payload.
+//! A connection serves one request, sent first as JSON:
+//! - {"type": "capabilities"} is answered with the WorkerCapabilities of the worker, as JSON.
+//! - {"type": "run", "arguments": [...]} runs ffmpeg with the arguments, relaying what it prints, and ends with
+//!   its exit code. With "inputIndex" and "inputKey", the argument at that index is an input the worker asks for
+//!   when it has none of that key yet, which is then streamed to it; with "outputIndex", the argument at that index
+//!   is an output the worker writes aside and streams back. Other paths are used as they are.
+//! Requests carry the token of the farm, which workers refuse any request without.
+//!
+struct FarmProtocol
+{
+    enum class Kind : char
+    {
+        Request = 'Q',
+        Reply = 'A',
+        InputData = 'I',
+        InputEnd = 'E',
+        Stdout = 'O',
+        Stderr = 'R',
+        OutputData = 'F',
+        Exit = 'X'
+    };
+
+    struct Frame
+    {
+        Kind kind;
+        QByteArray payload;
+    };
+
+    [[nodiscard]] static QByteArray frame(Kind kind, const QByteArray& payload);
+    [[nodiscard]] static QByteArray frame(Kind kind, const QJsonObject& payload);
+    //! Takes the complete frames off the start of the buffer, leaving the incomplete one. Empty when the buffer holds
+    //! a frame no peer sends, after which the connection is closed.
+    [[nodiscard]] static optional<QList<Frame>> takeFrames(QByteArray& buffer);
+    [[nodiscard]] static QJsonObject json(const Frame& frame);
+
+    //! Splits "host" or "host:port", taking defaultPort for the former.
+    [[nodiscard]] static std::pair<QString, quint16> parseAddress(const QString& address);
+
+    static constexpr quint16 defaultPort = 7878;
+    //! Files are streamed in chunks of this size, with no more than a few of them buffered at once.
+    static constexpr qsizetype chunkBytes = 256 * 1024;
+    static constexpr qsizetype maxPayloadBytes = 4 * chunkBytes;
+    static constexpr qint64 maxBufferedBytes = 4 * chunkBytes;
+};
+
+#endif
@@ -0,0 +1,447 @@
+#include "farm_worker.hpp"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QHostAddress>
+#include <QJsonArray>
+#include <QRegularExpression>
+#include <QSysInfo>
+#include <QTcpSocket>
+#include <QTextStream>
+#include <QThread>
+#include <algorithm>
+
+static QTextStream& out()
+{
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+static QTextStream& err()
+{
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+FarmWorker::FarmWorker(
+    std::shared_ptr<Settings> settings,
+    FormatSupportLoader& formatSupportLoader,
+    HardwareEncoderProbe& hardwareProbe,
+    PlatformInfo& platformInfo
+)
+    : settings(std::move(settings))
+    , formatSupportLoader(formatSupportLoader)
+    , hardwareProbe(hardwareProbe)
+    , platformInfo(platformInfo)
+    , server(new QTcpServer(this))
+{
+    connect(server, &QTcpServer::newConnection, this, &FarmWorker::Accept);
+    connect(&formatSupportLoader, &FormatSupportLoader::queryCompleted, this, &FarmWorker::HandleFormatsQueryResult);
+}
+
+void FarmWorker::Start()
+{
+    token = settings->get("Main/sWorkerToken").toString();
+
+    if (!inputsDirectory.isValid())
+    {
+        err() << "Could not create a folder for inputs: " << inputsDirectory.errorString() << Qt::endl;
+        emit finished(1);
+        return;
+    }
+
+    formatSupportLoader.QuerySupportedFormatsAsync();
+}
+
+void FarmWorker::HandleFormatsQueryResult(const std::variant<QSharedPointer<FormatSupport>, Message>& maybeFormats)
+{
+    if (std::holds_alternative<Message>(maybeFormats))
+    {
+        const Message& error = std::get<Message>(maybeFormats);
+        err() << error.title << Qt::endl << error.message << Qt::endl;
+        emit finished(1);
+        return;
+    }
+
+    // encoders are advertised once; a worker whose ffmpeg changed is restarted
+    const bool isRefresh = formats != nullptr;
+    formats = std::get<QSharedPointer<FormatSupport>>(maybeFormats);
+
+    if (isRefresh)
+        return;
+
+    connect(&hardwareProbe, &HardwareEncoderProbe::probeCompleted, this, [this]
+            {
+        connect(&platformInfo, &PlatformInfo::detected, this, &FarmWorker::DescribeHost, Qt::SingleShotConnection);
+        platformInfo.DetectAsync(); }, Qt::SingleShotConnection);
+    hardwareProbe.ProbeAsync(formats);
+}
+
+void FarmWorker::DescribeHost()
+{
+    const int configuredSlots = settings->get("Main/iWorkerSlots").toInt();
+    const int threadsPerJob = settings->get("Main/iThreadsPerEncoder").toInt();
+
+    // jobs left to take every core only run one at a time
+    capabilities.slotsCount = configuredSlots > 0 ? configuredSlots
+                            : threadsPerJob > 0 ? qMax(1, QThread::idealThreadCount() / threadsPerJob)
+                                                : 1;
+    capabilities.hardwareDevices = platformInfo.hardwareDevices();
+    capabilities.platform = QSysInfo::prettyProductName();
+
+    for (const QList<Codec>* codecs : { &formats->videoCodecs, &formats->audioCodecs })
+    {
+        for (const Codec& codec : *codecs)
+        {
+            if (!HardwareEncoderProbe::isHardwareEncoder(codec.libraryName) || hardwareProbe.isWorking(codec.libraryName))
+                capabilities.encoders.append(codec.libraryName);
+        }
+    }
+
+    Listen();
+}
+
+void FarmWorker::Listen()
+{
+    const QHostAddress address(settings->get("Main/sWorkerAddress").toString());
+    const quint16 port = static_cast<quint16>(settings->get("Main/iWorkerPort").toInt());
+
+    if (!server->listen(address, port))
+    {
+        err() << "Listening on " << address.toString() << ":" << port << " failed: " << server->errorString() << Qt::endl;
+        emit finished(1);
+        return;
+    }
+
+    if (token.isEmpty() && !address.isLoopback())
+        err() << "Warning: serving on " << address.toString() << " with no sWorkerToken; anyone reaching it can run ffmpeg here." << Qt::endl;
+
+    out() << "Serving on " << address.toString() << ":" << server->serverPort() << " with " << capabilities.slotsCount
+          << " slots and " << capabilities.encoders.size() << " encoders" << Qt::endl;
+}
+
+void FarmWorker::Accept()
+{
+    while (QTcpSocket* socket = server->nextPendingConnection())
+    {
+        sessions.insert(socket, std::make_shared<Session>());
+
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]
+                { Read(socket); });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]
+                { Close(socket); });
+    }
+}
+
+void FarmWorker::Read(QTcpSocket* socket)
+{
+    const std::shared_ptr<Session> session = sessions.value(socket);
+    if (!session)
+        return;
+
+    session->buffer += socket->readAll();
+
+    const optional<QList<FarmProtocol::Frame>> frames = FarmProtocol::takeFrames(session->buffer);
+    if (!frames.has_value())
+    {
+        Close(socket);
+        return;
+    }
+
+    for (const FarmProtocol::Frame& frame : *frames)
+    {
+        // a frame may have ended the session
+        if (!sessions.contains(socket))
+            return;
+
+        switch (frame.kind)
+        {
+        case FarmProtocol::Kind::Request:
+            HandleRequest(socket, FarmProtocol::json(frame));
+            break;
+        case FarmProtocol::Kind::InputData:
+            HandleInputData(socket, frame);
+            break;
+        case FarmProtocol::Kind::InputEnd:
+            HandleInputEnd(socket);
+            break;
+        default:
+            Close(socket);
+            return;
+        }
+    }
+}
+
+void FarmWorker::HandleRequest(QTcpSocket* socket, const QJsonObject& request)
+{
+    Session& session = *sessions.value(socket);
+    static const QRegularExpression keyPattern("^[0-9a-f]+$");
+
+    // one request per connection
+    if (!session.arguments.isEmpty() || session.isRunning)
+    {
+        Close(socket);
+        return;
+    }
+
+    if (!token.isEmpty() && request.value("token").toString() != token)
+    {
+        socket->write(FarmProtocol::frame(FarmProtocol::Kind::Reply, QJsonObject { { "error", "The token of the farm is wrong." } }));
+        socket->disconnectFromHost();
+        return;
+    }
+
+    const QString type = request.value("type").toString();
+    if (type == "capabilities")
+    {
+        socket->write(FarmProtocol::frame(FarmProtocol::Kind::Reply, capabilities.toJson()));
+        socket->disconnectFromHost();
+        return;
+    }
+
+    for (const QJsonValue& argument : request.value("arguments").toArray())
+        session.arguments.append(argument.toString());
+
+    session.inputIndex = request.value("inputIndex").toInt(-1);
+    session.inputKey = request.value("inputKey").toString();
+    session.outputIndex = request.value("outputIndex").toInt(-1);
+
+    // the key names the file the input is kept in
+    const auto isArgument = [&session](const qsizetype index)
+    { return index == -1 || (index > 0 && index < session.arguments.size()); };
+    if (type != "run" || session.arguments.isEmpty() || !isArgument(session.inputIndex) || !isArgument(session.outputIndex)
+        || (session.inputIndex > 0 && !keyPattern.match(session.inputKey).hasMatch()))
+    {
+        Close(socket);
+        return;
+    }
+
+    if (session.outputIndex > 0)
+    {
+        session.outputDirectory = std::make_unique<QTemporaryDir>();
+        session.outputPath = QDir(session.outputDirectory->path()).filePath(QFileInfo(session.arguments.at(session.outputIndex)).fileName());
+        session.arguments[session.outputIndex] = session.outputPath;
+    }
+
+    const bool needsInput = session.inputIndex > 0 && !inputPaths.contains(session.inputKey);
+    socket->write(FarmProtocol::frame(FarmProtocol::Kind::Reply, QJsonObject { { "needsInput", needsInput } }));
+
+    if (!needsInput)
+    {
+        if (session.inputIndex > 0)
+        {
+            inputKeys.move(inputKeys.indexOf(session.inputKey), inputKeys.size() - 1);
+            session.arguments[session.inputIndex] = inputPaths.value(session.inputKey);
+        }
+
+        Run(socket);
+        return;
+    }
+
+    // named after the connection too, as another one may be streaming the same input
+    session.partialInput = std::make_unique<QFile>(
+        inputsDirectory.filePath(QString("%1.%2.part").arg(session.inputKey, QString::number(reinterpret_cast<quintptr>(socket)))));
+    if (!session.partialInput->open(QIODevice::WriteOnly))
+    {
+        socket->write(FarmProtocol::frame(FarmProtocol::Kind::Stderr, "Could not write the input: " + session.partialInput->errorString().toUtf8() + "\n"));
+        End(socket, 1);
+    }
+}
+
+void FarmWorker::HandleInputData(QTcpSocket* socket, const FarmProtocol::Frame& frame)
+{
+    Session& session = *sessions.value(socket);
+
+    if (!session.partialInput)
+    {
+        Close(socket);
+        return;
+    }
+
+    if (session.partialInput->write(frame.payload) != frame.payload.size())
+    {
+        socket->write(FarmProtocol::frame(FarmProtocol::Kind::Stderr, "Could not write the input: " + session.partialInput->errorString().toUtf8() + "\n"));
+        session.partialInput->remove();
+        session.partialInput.reset();
+        End(socket, 1);
+    }
+}
+
+void FarmWorker::HandleInputEnd(QTcpSocket* socket)
+{
+    Session& session = *sessions.value(socket);
+
+    if (!session.partialInput)
+    {
+        Close(socket);
+        return;
+    }
+
+    session.partialInput->close();
+
+    // another connection may have kept the same input meanwhile
+    if (inputPaths.contains(session.inputKey))
+    {
+        session.partialInput->remove();
+    }
+    else
+    {
+        EvictInputs();
+
+        const QString path = inputPathFor(session.inputKey, session.arguments.at(session.inputIndex));
+        QFile::remove(path);
+        if (!session.partialInput->rename(path))
+        {
+            socket->write(FarmProtocol::frame(FarmProtocol::Kind::Stderr, "Could not keep the input: " + session.partialInput->errorString().toUtf8() + "\n"));
+            session.partialInput->remove();
+            session.partialInput.reset();
+            End(socket, 1);
+            return;
+        }
+
+        inputKeys.append(session.inputKey);
+        inputPaths.insert(session.inputKey, path);
+    }
+
+    session.partialInput.reset();
+    session.arguments[session.inputIndex] = inputPaths.value(session.inputKey);
+    Run(socket);
+}
+
+void FarmWorker::Run(QTcpSocket* socket)
+{
+    Session& session = *sessions.value(socket);
+
+    // owned by the connection, so that ffmpeg is killed when the client goes away
+    session.ffmpeg = new QProcess(socket);
+    session.isRunning = true;
+
+    connect(session.ffmpeg, &QProcess::readyReadStandardOutput, socket, [socket, ffmpeg = session.ffmpeg]
+            { socket->write(FarmProtocol::frame(FarmProtocol::Kind::Stdout, ffmpeg->readAllStandardOutput())); });
+    connect(session.ffmpeg, &QProcess::readyReadStandardError, socket, [socket, ffmpeg = session.ffmpeg]
+            { socket->write(FarmProtocol::frame(FarmProtocol::Kind::Stderr, ffmpeg->readAllStandardError())); });
+    connect(session.ffmpeg, &QProcess::finished, this, [this, socket](const int exitCode, const QProcess::ExitStatus exitStatus)
+            { HandleFinished(socket, exitCode, exitStatus); });
+    connect(session.ffmpeg, &QProcess::errorOccurred, this, [this, socket](const QProcess::ProcessError error)
+            {
+        if (error != QProcess::FailedToStart)
+            return;
+
+        socket->write(FarmProtocol::frame(FarmProtocol::Kind::Stderr, QByteArray("ffmpeg could not be started on the worker.\n")));
+        End(socket, 1); });
+
+    out() << socket->peerAddress().toString() << ": running " << QFileInfo(session.outputPath).fileName() << Qt::endl;
+
+    // the program is always ffmpeg, whatever the client named
+    session.ffmpeg->start("ffmpeg", session.arguments.sliced(1));
+}
+
+void FarmWorker::HandleFinished(QTcpSocket* socket, const int exitCode, const QProcess::ExitStatus exitStatus)
+{
+    const std::shared_ptr<Session> session = sessions.value(socket);
+    if (!session)
+        return;
+
+    session->isRunning = false;
+    session->exitCode = exitStatus == QProcess::CrashExit ? 1 : exitCode;
+
+    if (const QByteArray rest = session->ffmpeg->readAllStandardOutput(); !rest.isEmpty())
+        socket->write(FarmProtocol::frame(FarmProtocol::Kind::Stdout, rest));
+    if (const QByteArray rest = session->ffmpeg->readAllStandardError(); !rest.isEmpty())
+        socket->write(FarmProtocol::frame(FarmProtocol::Kind::Stderr, rest));
+
+    out() << socket->peerAddress().toString() << ": " << QFileInfo(session->outputPath).fileName() << " exited with " << session->exitCode << Qt::endl;
+
+    if (session->exitCode != 0 || session->outputIndex <= 0)
+    {
+        End(socket, session->exitCode);
+        return;
+    }
+
+    session->output = std::make_unique<QFile>(session->outputPath);
+    if (!session->output->open(QIODevice::ReadOnly))
+    {
+        socket->write(FarmProtocol::frame(FarmProtocol::Kind::Stderr, "Could not read the output: " + session->output->errorString().toUtf8() + "\n"));
+        End(socket, 1);
+        return;
+    }
+
+    // sent as the client takes it, so that a large output is not held in memory
+    connect(socket, &QTcpSocket::bytesWritten, this, [this, socket]
+            { StreamOutput(socket); });
+    StreamOutput(socket);
+}
+
+void FarmWorker::StreamOutput(QTcpSocket* socket)
+{
+    const std::shared_ptr<Session> session = sessions.value(socket);
+    if (!session || !session->output)
+        return;
+
+    while (socket->bytesToWrite() < FarmProtocol::maxBufferedBytes && !session->output->atEnd())
+    {
+        const QByteArray chunk = session->output->read(FarmProtocol::chunkBytes);
+        if (chunk.isEmpty())
+        {
+            socket->write(FarmProtocol::frame(FarmProtocol::Kind::Stderr, "Could not read the output: " + session->output->errorString().toUtf8() + "\n"));
+            session->output.reset();
+            End(socket, 1);
+            return;
+        }
+
+        socket->write(FarmProtocol::frame(FarmProtocol::Kind::OutputData, chunk));
+    }
+
+    if (session->output->atEnd())
+    {
+        session->output.reset();
+        End(socket, session->exitCode);
+    }
+}
+
+void FarmWorker::End(QTcpSocket* socket, const int exitCode)
+{
+    socket->write(FarmProtocol::frame(FarmProtocol::Kind::Exit, QJsonObject { { "exitCode", exitCode } }));
+    socket->disconnectFromHost();
+}
+
+void FarmWorker::Close(QTcpSocket* socket)
+{
+    // taken first, as aborting emits disconnected again
+    const std::shared_ptr<Session> session = sessions.take(socket);
+    if (!session)
+        return;
+
+    if (session->ffmpeg != nullptr)
+        session->ffmpeg->disconnect(this);
+    if (session->partialInput)
+        session->partialInput->remove();
+
+    socket->abort();
+    socket->deleteLater();
+}
+
+void FarmWorker::EvictInputs()
+{
+    for (qsizetype i = 0; i < inputKeys.size() && inputKeys.size() >= maxKeptInputs;)
+    {
+        const QString& key = inputKeys.at(i);
+        const bool isUsed = std::any_of(sessions.cbegin(), sessions.cend(), [&key](const std::shared_ptr<Session>& session)
+                                        { return session->inputKey == key; });
+        if (isUsed)
+        {
+            i++;
+            continue;
+        }
+
+        QFile::remove(inputPaths.take(key));
+        inputKeys.removeAt(i);
+    }
+}
+
+QString FarmWorker::inputPathFor(const QString& key, const QString& originalPath) const
+{
+    // the extension is kept, for the few formats ffmpeg only tells apart by it
+    const QString suffix = QFileInfo(originalPath).suffix();
+    return inputsDirectory.filePath(suffix.isEmpty() ? key : key + "." + suffix);
+}
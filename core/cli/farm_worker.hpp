@@ -0,0 +1,103 @@
+#ifndef FARM_WORKER_H
+#define FARM_WORKER_H
+
+#include "core/encoder/worker_capabilities.hpp"
+#include "core/formats/format_support_loader.hpp"
+#include "core/formats/hardware_encoder_probe.hpp"
+#include "core/settings/settings.hpp"
+#include "core/utils/platform_info.hpp"
+#include "farm_protocol.hpp"
+
+#include <QFile>
+#include <QHash>
+#include <QObject>
+#include <QProcess>
+#include <QTcpServer>
+#include <QTemporaryDir>
+#include <di.hpp>
+#include <memory>
+
+class QTcpSocket;
+
+//!
+//! \brief Runs the ffmpeg commands of remote MediaEncoders on this host, as a worker of the farm.
+//! \details Once its encoders, their hardware and its devices are known, it listens on sWorkerAddress and
+//! iWorkerPort and answers the requests of FarmProtocol. Inputs streamed to it are kept by key, a few at a time, so
+//! that the parts of one input chunked across the farm are only sent once. It runs whatever it is sent: the slots
+//! it advertises are what coordinators keep to, and the token is what keeps others out.
+//!
+class FarmWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    BOOST_DI_INJECT(
+        FarmWorker,
+        (named = di_settings) std::shared_ptr<Settings> settings,
+        FormatSupportLoader& formatSupportLoader,
+        HardwareEncoderProbe& hardwareProbe,
+        PlatformInfo& platformInfo
+    );
+
+    void Start();
+
+signals:
+    //! Only emitted when the worker cannot serve; it serves until interrupted otherwise.
+    void finished(int exitCode);
+
+private:
+    struct Session
+    {
+        QByteArray buffer;
+        bool isRunning = false;
+        QStringList arguments;
+        qsizetype inputIndex = -1;
+        QString inputKey;
+        //! Where the input streamed in is written, until it is complete.
+        std::unique_ptr<QFile> partialInput;
+        qsizetype outputIndex = -1;
+        //! Holds the output until it is streamed back.
+        std::unique_ptr<QTemporaryDir> outputDirectory;
+        QString outputPath;
+        QProcess* ffmpeg = nullptr;
+        std::unique_ptr<QFile> output;
+        int exitCode = 0;
+    };
+
+    void HandleFormatsQueryResult(const std::variant<QSharedPointer<FormatSupport>, Message>& maybeFormats);
+    void DescribeHost();
+    void Listen();
+    void Accept();
+    void Read(QTcpSocket* socket);
+    void HandleRequest(QTcpSocket* socket, const QJsonObject& request);
+    void HandleInputData(QTcpSocket* socket, const FarmProtocol::Frame& frame);
+    void HandleInputEnd(QTcpSocket* socket);
+    void Run(QTcpSocket* socket);
+    void HandleFinished(QTcpSocket* socket, int exitCode, QProcess::ExitStatus exitStatus);
+    void StreamOutput(QTcpSocket* socket);
+    void End(QTcpSocket* socket, int exitCode);
+    void Close(QTcpSocket* socket);
+    //! Makes room for another input, leaving those of running sessions.
+    void EvictInputs();
+    [[nodiscard]] QString inputPathFor(const QString& key, const QString& originalPath) const;
+
+    std::shared_ptr<Settings> settings;
+    FormatSupportLoader& formatSupportLoader;
+    HardwareEncoderProbe& hardwareProbe;
+    PlatformInfo& platformInfo;
+
+    QTcpServer* server;
+    QSharedPointer<FormatSupport> formats;
+    WorkerCapabilities capabilities;
+    QString token;
+    //! Shared, as a session owns files that cannot be copied with it.
+    QHash<QTcpSocket*, std::shared_ptr<Session>> sessions;
+    QTemporaryDir inputsDirectory;
+    //! Keys of the inputs kept, least recently used first, and their paths.
+    QStringList inputKeys;
+    QHash<QString, QString> inputPaths;
+
+    static constexpr qsizetype maxKeptInputs = 8;
+};
+
+#endif
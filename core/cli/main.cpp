@@ -0,0 +1,209 @@
+#include "benchmark_runner.hpp"
+#include "cli_runner.hpp"
+#include "farm_client.hpp"
+#include "farm_worker.hpp"
+#include "core/formats/ffmpeg_format_support_loader.hpp"
+#include "core/settings/ini_settings.hpp"
+#include "thirdparty/boost-di/di.hpp"
+
+namespace di = boost::di;
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QProcess>
+#include <QTextStream>
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("Simple Media Encoder");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Encodes media files with a preset of presets.ini, without a window.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("inputs", "Files to encode, or folders to encode the media files of.", "[inputs...]");
+
+    const QCommandLineOption presetOption({ "p", "preset" }, "Preset to encode with; repeat it to encode one output per preset from a single decode, or to benchmark several.", "name", "Default");
+    const QCommandLineOption outputOption({ "o", "output" }, "Output of a single input. The extension comes from the container.", "path");
+    const QCommandLineOption outputDirOption({ "d", "output-dir" }, "Folder for the outputs, instead of next to each input.", "folder");
+    const QCommandLineOption watchOption({ "w", "watch" }, "Encode every new file of a folder until interrupted.", "folder");
+    const QCommandLineOption softwareOption("software", "Use encoders as named in the preset, without preferring hardware ones.");
+    const QCommandLineOption targetVmafOption("target-vmaf", "Encode to the smallest size reaching this VMAF score, instead of the size of the preset.", "score");
+    const QCommandLineOption benchmarkOption("benchmark", "Encode the inputs with every preset and write measures to a CSV or JSON report.", "report");
+    const QCommandLineOption repeatOption("repeat", "Times each benchmark encode is run.", "count", "1");
+    const QCommandLineOption metricOption("metric", "Score benchmark outputs against their input with vmaf or ssim.", "metric");
+    const QCommandLineOption fromOption("from", "Start each output at this time of its input, in seconds or as [hh:]mm:ss.", "time");
+    const QCommandLineOption toOption("to", "End each output at this time of its input, in seconds or as [hh:]mm:ss.", "time");
+    const QCommandLineOption smartCutOption("smart-cut", "Only re-encode the GOPs around the trim points, and copy the video between them.");
+    const QCommandLineOption tracksOption("tracks", "Encode, copy or drop streams of each input by index, as in 1=copy,3=drop; others keep the first video and audio streams only.", "list");
+    const QCommandLineOption metricsPortOption("metrics-port", "Serve Prometheus metrics of the encodes on this port, instead of the one of the settings.", "port");
+    const QCommandLineOption serveWorkerOption("serve-worker", "Run the encodes of other hosts as a worker of the farm, on the address and port of the settings, until interrupted.");
+    const QCommandLineOption runOnOption("run-on", "Run the ffmpeg command given as the arguments on this worker of the farm; encoders start this themselves.", "host[:port]");
+    const QCommandLineOption streamInputOption("stream-input", "With --run-on, send the input to the worker, for one that cannot reach it at its path.");
+    parser.addOptions({ presetOption, outputOption, outputDirOption, watchOption, softwareOption, targetVmafOption, benchmarkOption, repeatOption, metricOption,
+                        fromOption, toOption, smartCutOption, tracksOption, metricsPortOption, serveWorkerOption, runOnOption, streamInputOption });
+    parser.process(app);
+
+    QTextStream err(stderr);
+
+    // configuration lives next to the executable, so that it can be run from anywhere
+    const QDir appDir(QCoreApplication::applicationDirPath());
+
+    // opened once and shared, as each store holds its own snapshot of the file
+    const auto settings = std::make_shared<IniSettings>(appDir.filePath("config.ini"), appDir.filePath("config_default.ini"));
+    const auto presets = std::make_shared<IniSettings>(appDir.filePath("presets.ini"));
+
+    const auto injector = make_injector(
+        di::bind<Settings>.named(di_settings).to([settings]
+                                                 { return settings; }),
+        di::bind<Settings>.named(di_presets).to([presets]
+                                                { return presets; }),
+        di::bind<FormatSupportLoader>.to<FFmpegFormatSupportLoader>()
+    );
+
+    if (parser.isSet(serveWorkerOption))
+    {
+        const auto worker = injector.create<std::shared_ptr<FarmWorker>>();
+        QObject::connect(worker.get(), &FarmWorker::finished, &app, [](const int exitCode)
+                         { QCoreApplication::exit(exitCode); });
+        QMetaObject::invokeMethod(worker.get(), [&worker]
+                                  { worker->Start(); }, Qt::QueuedConnection);
+
+        return app.exec();
+    }
+
+    if (parser.isSet(runOnOption))
+    {
+        // the command comes as one argument, quoted as it would be run locally
+        const QStringList arguments = QProcess::splitCommand(parser.positionalArguments().join(' '));
+        if (arguments.isEmpty())
+        {
+            err << "--run-on needs the ffmpeg command to run." << Qt::endl;
+            return 2;
+        }
+
+        const auto client = injector.create<std::shared_ptr<FarmClient>>();
+        QObject::connect(client.get(), &FarmClient::finished, &app, [](const int exitCode)
+                         { QCoreApplication::exit(exitCode); });
+        QMetaObject::invokeMethod(client.get(), [&client, &parser, &runOnOption, &streamInputOption, &arguments]
+                                  { client->Start(parser.value(runOnOption), arguments, parser.isSet(streamInputOption)); }, Qt::QueuedConnection);
+
+        return app.exec();
+    }
+
+    if (parser.isSet(benchmarkOption))
+    {
+        const optional<QualityMeter::Metric> metric = QualityMeter::metricFromName(parser.value(metricOption));
+        if (parser.isSet(metricOption) && !metric.has_value())
+        {
+            err << "--metric must be vmaf or ssim." << Qt::endl;
+            return 2;
+        }
+
+        const BenchmarkRunner::Config config {
+            .presetNames = parser.values(presetOption),
+            .clipPaths = parser.positionalArguments(),
+            .reportPath = parser.value(benchmarkOption),
+            .repeatCount = qMax(1, parser.value(repeatOption).toInt()),
+            .metric = metric,
+            .preferHardwareEncoders = !parser.isSet(softwareOption),
+        };
+
+        if (config.clipPaths.isEmpty())
+        {
+            err << "Nothing to benchmark: give reference clips." << Qt::endl;
+            parser.showHelp(2);
+        }
+
+        const auto runner = injector.create<std::shared_ptr<BenchmarkRunner>>();
+        QObject::connect(runner.get(), &BenchmarkRunner::finished, &app, [](const int exitCode)
+                         { QCoreApplication::exit(exitCode); });
+        QMetaObject::invokeMethod(runner.get(), [&runner, &config]
+                                  { runner->Start(config); }, Qt::QueuedConnection);
+
+        return app.exec();
+    }
+
+    // times read as seconds, or as colon-separated minutes and hours before them
+    const auto parseTime = [](const QString& text) -> optional<double>
+    {
+        double seconds = 0;
+        for (const QString& field : text.split(':'))
+        {
+            bool ok = false;
+            const double value = field.toDouble(&ok);
+            if (!ok || value < 0)
+                return {};
+
+            seconds = seconds * 60 + value;
+        }
+
+        return seconds;
+    };
+
+    const optional<double> trimStart = parser.isSet(fromOption) ? parseTime(parser.value(fromOption)) : std::nullopt;
+    const optional<double> trimEnd = parser.isSet(toOption) ? parseTime(parser.value(toOption)) : std::nullopt;
+    if ((parser.isSet(fromOption) && !trimStart.has_value()) || (parser.isSet(toOption) && !trimEnd.has_value()))
+    {
+        err << "--from and --to take a time such as 90, 1:30 or 0:01:30.5." << Qt::endl;
+        return 2;
+    }
+
+    bool isTargetQualityValid = true;
+    const optional<double> targetQuality = parser.isSet(targetVmafOption) ? optional(parser.value(targetVmafOption).toDouble(&isTargetQualityValid)) : std::nullopt;
+    if (targetQuality.has_value() && (!isTargetQualityValid || *targetQuality <= 0 || *targetQuality > 100))
+    {
+        err << "--target-vmaf takes a score above 0 and up to 100, such as 93." << Qt::endl;
+        return 2;
+    }
+
+    const optional<QHash<int, TrackPlan::Action>> trackActions = parser.isSet(tracksOption) ? TrackPlan::parseActions(parser.value(tracksOption)) : std::nullopt;
+    if (parser.isSet(tracksOption) && !trackActions.has_value())
+    {
+        err << "--tracks takes a list of stream indexes and actions, such as 1=copy,3=drop; actions are encode, copy or drop." << Qt::endl;
+        return 2;
+    }
+
+    const CliRunner::Config config {
+        .presetNames = parser.values(presetOption),
+        .inputPaths = parser.positionalArguments(),
+        .outputPath = parser.value(outputOption),
+        .outputDir = parser.value(outputDirOption),
+        .watchDir = parser.isSet(watchOption) ? QDir(parser.value(watchOption)).absolutePath() : "",
+        .preferHardwareEncoders = !parser.isSet(softwareOption),
+        .targetQuality = targetQuality,
+        .trimStartSeconds = trimStart,
+        .trimEndSeconds = trimEnd,
+        .smartCut = parser.isSet(smartCutOption),
+        .trackActions = trackActions.value_or(QHash<int, TrackPlan::Action> {}),
+        .metricsPort = parser.isSet(metricsPortOption) ? optional<quint16>(parser.value(metricsPortOption).toUShort()) : std::nullopt,
+    };
+
+    if (config.inputPaths.isEmpty() && config.watchDir.isEmpty())
+    {
+        err << "Nothing to encode: give input files or a folder to watch." << Qt::endl;
+        parser.showHelp(2);
+    }
+
+    if (!config.outputPath.isEmpty() && config.inputPaths.size() != 1)
+    {
+        err << "--output needs exactly one input; use --output-dir for several." << Qt::endl;
+        return 2;
+    }
+
+    // outputs written to the watched folder would be picked up as new inputs
+    if (!config.watchDir.isEmpty() && (config.outputDir.isEmpty() || QDir(config.outputDir).absolutePath() == config.watchDir))
+    {
+        err << "--watch needs an --output-dir other than the watched folder." << Qt::endl;
+        return 2;
+    }
+
+    const auto runner = injector.create<std::shared_ptr<CliRunner>>();
+    QObject::connect(runner.get(), &CliRunner::finished, &app, [](const int exitCode)
+                     { QCoreApplication::exit(exitCode); });
+    QMetaObject::invokeMethod(runner.get(), [&runner, &config]
+                              { runner->Start(config); }, Qt::QueuedConnection);
+
+    return app.exec();
+}
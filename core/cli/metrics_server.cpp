@@ -0,0 +1,87 @@
+#include "metrics_server.hpp"
+
+#include <QTcpSocket>
+
+MetricsServer::MetricsServer(TelemetryRecorder& recorder)
+    : recorder(recorder)
+    , server(new QTcpServer(this))
+{
+    connect(server, &QTcpServer::newConnection, this, &MetricsServer::Accept);
+}
+
+optional<Message> MetricsServer::Listen(const QHostAddress& address, const quint16 port)
+{
+    if (server->listen(address, port))
+        return {};
+
+    return Message(Severity::Error, tr("Could not serve metrics."),
+                   tr("Listening on %1:%2 failed: %3").arg(address.toString(), QString::number(port), server->errorString()));
+}
+
+void MetricsServer::Accept()
+{
+    while (QTcpSocket* socket = server->nextPendingConnection())
+    {
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]
+                { Answer(socket); });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]
+                {
+            requests.remove(socket);
+            socket->deleteLater(); });
+    }
+}
+
+void MetricsServer::Answer(QTcpSocket* socket)
+{
+    QByteArray& request = requests[socket];
+    request += socket->readAll();
+
+    // the body of a GET is empty, so the request is complete once its headers are
+    if (!request.contains("\r\n\r\n") && request.size() < maxRequestBytes)
+        return;
+
+    const qsizetype lineEnd = request.indexOf("\r\n");
+    const QList<QByteArray> requestLine = (lineEnd >= 0 ? request.first(lineEnd) : request).split(' ');
+    const bool isScrape = requestLine.size() >= 2 && requestLine.at(0) == "GET"
+                       && (requestLine.at(1) == "/metrics" || requestLine.at(1).startsWith("/metrics?"));
+
+    const QByteArray body = isScrape ? render(recorder.totals(), recorder.jobsInFlight()) : QByteArray("Not found\n");
+    const QByteArray status = isScrape ? "200 OK" : "404 Not Found";
+    const QByteArray contentType = isScrape ? "text/plain; version=0.0.4; charset=utf-8" : "text/plain; charset=utf-8";
+
+    socket->write("HTTP/1.1 " + status + "\r\nContent-Type: " + contentType + "\r\nContent-Length: " + QByteArray::number(body.size())
+                  + "\r\nConnection: close\r\n\r\n" + body);
+    requests.remove(socket);
+
+    // one request per connection, so that whatever a client sends after it is not answered again
+    disconnect(socket, &QTcpSocket::readyRead, this, nullptr);
+    socket->disconnectFromHost();
+}
+
+QByteArray MetricsServer::render(const TelemetryRecorder::Totals& totals, const qsizetype jobsInFlight)
+{
+    QByteArray text;
+
+    const auto metric = [&text](const QByteArray& name, const QByteArray& type, const QByteArray& help, const double value)
+    {
+        text += "# HELP " + name + " " + help + "\n# TYPE " + name + " " + type + "\n" + name + " " + QByteArray::number(value, 'g', 12) + "\n";
+    };
+
+    text += "# HELP sme_jobs_total Jobs that ended, by outcome.\n# TYPE sme_jobs_total counter\n";
+
+    // every outcome is exported from the start, so that rates over them do not begin with a gap
+    for (const char* outcome : { "done", "failed", "cancelled" })
+        text += QByteArray("sme_jobs_total{outcome=\"") + outcome + "\"} " + QByteArray::number(totals.jobsByOutcome.value(outcome)) + "\n";
+
+    metric("sme_jobs_in_flight", "gauge", "Jobs queued or encoding.", static_cast<double>(jobsInFlight));
+    metric("sme_probe_seconds_total", "counter", "Wall time spent probing inputs with ffprobe.", totals.probeSeconds);
+    metric("sme_queue_wait_seconds_total", "counter", "Wall time jobs waited before encoding.", totals.queueWaitSeconds);
+    metric("sme_encode_seconds_total", "counter", "Wall time jobs spent encoding.", totals.encodeSeconds);
+    metric("sme_media_seconds_total", "counter", "Duration of the media encoded.", totals.mediaSeconds);
+    metric("sme_cpu_seconds_total", "counter", "CPU time of measured ffmpeg processes.", totals.cpuSeconds);
+    metric("sme_output_bytes_total", "counter", "Size of the outputs written.", static_cast<double>(totals.outputBytes));
+    metric("sme_last_realtime_factor", "gauge", "Media seconds encoded per wall second, by the last job that succeeded.", totals.lastRealtimeFactor);
+    metric("sme_last_average_fps", "gauge", "Average frames per second of the last job that succeeded.", totals.lastAverageFps);
+
+    return text;
+}
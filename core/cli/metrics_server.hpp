@@ -0,0 +1,44 @@
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include "core/notifier/message.hpp"
+#include "core/telemetry/telemetry_recorder.hpp"
+
+#include <QHash>
+#include <QHostAddress>
+#include <QObject>
+#include <QTcpServer>
+
+class QTcpSocket;
+
+//!
+//! \brief Serves the totals of a TelemetryRecorder over HTTP, in the text format Prometheus scrapes.
+//! \details Only GET /metrics is answered, one request per connection. It is meant for a local network or a
+//! sidecar: there is no authentication, so it listens on the loopback interface unless told otherwise.
+//!
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MetricsServer(TelemetryRecorder& recorder);
+
+    //! Starts answering scrapes; the error, if the port cannot be bound.
+    [[nodiscard]] optional<Message> Listen(const QHostAddress& address, quint16 port);
+
+    //! The exposition of the totals, with a HELP and TYPE line per metric.
+    [[nodiscard]] static QByteArray render(const TelemetryRecorder::Totals& totals, qsizetype jobsInFlight);
+
+private:
+    void Accept();
+    void Answer(QTcpSocket* socket);
+
+    TelemetryRecorder& recorder;
+    QTcpServer* server;
+    QHash<QTcpSocket*, QByteArray> requests;
+
+    //! Requests are a line and a few headers; anything longer is not a scraper.
+    static constexpr qsizetype maxRequestBytes = 8192;
+};
+
+#endif
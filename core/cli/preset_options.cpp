@@ -0,0 +1,141 @@
+#include "preset_options.hpp"
+
+std::variant<PresetOptions, QStringList> PresetOptions::compile(const Settings& presets, const QString& presetName)
+{
+    if (!presets.groups().contains(presetName))
+        return QStringList { QObject::tr("No preset named '%1' in %2.").arg(presetName, presets.fileName()) };
+
+    PresetOptions preset;
+    const auto get = [&presets, &presetName](const QString& key)
+    { return presets.get(presetName + "/" + key); };
+
+    // renditions are listed with commas, which the settings read as a list
+    const QString ladderFormat = get("ladderFormat").toString();
+    if (!ladderFormat.isEmpty())
+    {
+        const optional<StreamingLadder::Format> format = StreamingLadder::formatFromName(ladderFormat);
+        const QString renditionsList = get("ladderRenditions").toStringList().join(',');
+        const optional<QList<StreamingLadder::Rendition>> renditions = StreamingLadder::parseRenditions(renditionsList);
+        const int segmentSeconds = get("ladderSegmentSeconds").toInt();
+
+        if (!format.has_value())
+            return QStringList { QObject::tr("Ladder format '%1' is neither hls nor dash.").arg(ladderFormat) };
+        if (!renditions.has_value())
+            return QStringList { QObject::tr("Ladder renditions '%1' are not like 1280x720:2800 or 1280x720@30:2800.").arg(renditionsList) };
+
+        preset.ladder = StreamingLadder { .format = *format, .renditions = *renditions, .segmentSeconds = segmentSeconds > 0 ? segmentSeconds : 6 };
+    }
+
+    preset.videoCodecName = get("videoCodecComboBox").toString();
+    preset.audioCodecName = get("audioCodecComboBox").toString();
+    preset.containerName = get("containerComboBox").toString();
+    preset.targetSizeKbps = sizeKbps(get("fileSizeSpinBox").toDouble(), get("fileSizeUnitComboBox").toString());
+    preset.audioQualityPercent = get("audioQualitySlider").toInt() / 100.0;
+    preset.audioChannelsCount = get("audioChannelCountSpinbox").toInt();
+    preset.outputWidth = get("widthSpinBox").toInt();
+    preset.outputHeight = get("heightSpinBox").toInt();
+    preset.aspectRatio = QPoint(get("aspectRatioSpinBoxH").toInt(), get("aspectRatioSpinBoxV").toInt());
+    preset.fps = get("fpsSpinBox").toInt();
+    preset.speed = get("speedSpinBox").toDouble();
+    preset.customArguments = get("customCommandTextEdit").toString();
+    preset.twoPass = get("twoPassCheckBox").toBool();
+
+    return preset;
+}
+
+QHash<QString, std::variant<PresetOptions, QStringList>> PresetOptions::compileAll(const Settings& presets, const QStringList& presetNames)
+{
+    QHash<QString, std::variant<PresetOptions, QStringList>> compiled;
+
+    for (const QString& presetName : presetNames)
+        compiled.insert(presetName, compile(presets, presetName));
+
+    return compiled;
+}
+
+QStringList PresetOptions::apply(EncoderOptionsBuilder& builder, const FormatSupport& formats, const Metadata& metadata,
+                                 const HardwareEncoderProbe* hardwareProbe) const
+{
+    QStringList errors;
+
+    // streams the input does not have are left out, as the main window does with its stream selection
+    if (metadata.width > 0)
+    {
+        const optional<Codec> videoCodec = findCodec(formats.videoCodecs, videoCodecName, false);
+
+        if (!videoCodec.has_value())
+        {
+            errors.append(QObject::tr("Video codec '%1' is not supported by this ffmpeg.").arg(videoCodecName));
+        }
+        else if (hardwareProbe != nullptr && videoCodec->libraryName != "copy")
+        {
+            const HardwareEncoderProbe::ResolvedEncoder resolved = hardwareProbe->resolveEncoder(*videoCodec);
+            builder.withVideoCodec(resolved.codec);
+
+            if (resolved.acceleration.has_value())
+                builder.withHardwareAcceleration(*resolved.acceleration);
+        }
+        else
+        {
+            builder.withVideoCodec(*videoCodec);
+        }
+    }
+
+    if (!metadata.audioCodec.isEmpty())
+    {
+        if (const optional<Codec> audioCodec = findCodec(formats.audioCodecs, audioCodecName, true); audioCodec.has_value())
+            builder.withAudioCodec(*audioCodec);
+        else
+            errors.append(QObject::tr("Audio codec '%1' is not supported by this ffmpeg.").arg(audioCodecName));
+    }
+
+    const auto container = std::find_if(formats.containers.begin(), formats.containers.end(), [this](const Container& container)
+                                        { return container.formatName == containerName; });
+
+    if (container != formats.containers.end())
+        builder.withContainer(*container);
+    else
+        errors.append(QObject::tr("Container '%1' is not supported by this ffmpeg.").arg(containerName));
+
+    if (ladder.has_value())
+        builder.withLadder(*ladder);
+
+    builder.withTargetOutputSize(targetSizeKbps)
+        .withAudioQuality(audioQualityPercent)
+        .withAudioChannelsCount(audioChannelsCount)
+        .withOutputWidth(outputWidth)
+        .withOutputHeight(outputHeight)
+        .withAspectRatio(aspectRatio)
+        .atFps(fps)
+        .atSpeed(speed)
+        .withCustomArguments(customArguments)
+        .withTwoPass(twoPass);
+
+    return errors;
+}
+
+optional<Codec> PresetOptions::findCodec(const QList<Codec>& codecs, const QString& libraryName, const bool isAudio)
+{
+    // passing “copy” as codec name will make ffmpeg use the same codec as the input file
+    if (libraryName == "Passthrough")
+        return Codec { .displayName = "Passthrough", .libraryName = "copy", .isAudioCodec = isAudio };
+
+    for (const Codec& codec : codecs)
+    {
+        if (codec.libraryName == libraryName)
+            return codec;
+    }
+
+    return {};
+}
+
+double PresetOptions::sizeKbps(const double size, const QString& unit)
+{
+    if (unit == "Kilobytes")
+        return size * 8;
+
+    if (unit == "Gigabytes")
+        return size * 8e+6;
+
+    return size * 8000;
+}
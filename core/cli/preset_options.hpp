@@ -0,0 +1,51 @@
+#ifndef PRESET_OPTIONS_H
+#define PRESET_OPTIONS_H
+
+#include "core/encoder/encoder_options_builder.hpp"
+#include "core/formats/format_support.hpp"
+#include "core/formats/hardware_encoder_probe.hpp"
+#include "core/settings/settings.hpp"
+
+#include <QHash>
+#include <QPoint>
+#include <variant>
+
+//!
+//! \brief A group of presets.ini read once into typed values, which fill an EncoderOptionsBuilder the way the main
+//! window does from its controls.
+//! \details Keys are the names of the controls they are saved from, e.g. videoCodecComboBox or fileSizeSpinBox.
+//! Presets may also describe a streaming ladder, which has no control: ladderFormat (hls or dash), ladderRenditions
+//! (see StreamingLadder::parseRenditions()) and ladderSegmentSeconds.
+//!
+class PresetOptions
+{
+public:
+    //! Reads the preset, or returns the errors found in it that do not depend on an input.
+    [[nodiscard]] static std::variant<PresetOptions, QStringList> compile(const Settings& presets, const QString& presetName);
+    //! Compiles each of the presets once, for runs encoding many inputs with them.
+    [[nodiscard]] static QHash<QString, std::variant<PresetOptions, QStringList>> compileAll(const Settings& presets, const QStringList& presetNames);
+
+    //! Returns the errors found along the way. hardwareProbe may be null, in which case encoders are used as named.
+    QStringList apply(EncoderOptionsBuilder& builder, const FormatSupport& formats, const Metadata& metadata, const HardwareEncoderProbe* hardwareProbe) const;
+
+private:
+    static optional<Codec> findCodec(const QList<Codec>& codecs, const QString& libraryName, bool isAudio);
+    static double sizeKbps(double size, const QString& unit);
+
+    QString videoCodecName;
+    QString audioCodecName;
+    QString containerName;
+    optional<StreamingLadder> ladder;
+    double targetSizeKbps = 0;
+    double audioQualityPercent = 0;
+    int audioChannelsCount = 0;
+    int outputWidth = 0;
+    int outputHeight = 0;
+    QPoint aspectRatio;
+    int fps = 0;
+    double speed = 0;
+    QString customArguments;
+    bool twoPass = false;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include "animated_image.hpp"
+
+bool AnimatedImage::isAnimatedImage(const Codec& videoCodec)
+{
+    return videoCodec.libraryName == "gif" || videoCodec.libraryName == "libwebp_anim";
+}
+
+QList<AnimatedImage::Attempt> AnimatedImage::planAttempts(const EncoderOptions& options, const optional<double> sizeKbps)
+{
+    const Metadata& metadata = options.inputMetadata;
+    const double speed = options.speed.value_or(1);
+
+    // the frame rate of the options is of the input, as for other encoders
+    const double inputFps = metadata.frameRate > 0 ? metadata.frameRate : maxFps;
+    const double fps = options.fps.has_value() ? *options.fps * speed : qMin(inputFps * speed, maxFps);
+
+    int width = qMin(static_cast<int>(metadata.width), maxWidth);
+    if (options.outputWidth.has_value())
+        width = *options.outputWidth;
+    else if (options.outputHeight.has_value() && metadata.height > 0)
+        width = static_cast<int>(*options.outputHeight * metadata.width / metadata.height);
+
+    Attempt attempt { fps, width & ~1 };
+    if (!sizeKbps.has_value())
+        return { attempt };
+
+    // frames dropped cost less to the eye than pixels, down to a rate that still reads as motion
+    const double budgetBytes = *sizeKbps * 125;
+    while (estimatedSizeBytes(options, attempt) > budgetBytes)
+    {
+        if (attempt.fps > minFps)
+            attempt.fps = qMax(minFps, attempt.fps * downscaleFactor);
+        else if (attempt.width > minWidth)
+            attempt.width = qMax(minWidth, static_cast<int>(attempt.width * downscaleFactor)) & ~1;
+        else
+            break;
+    }
+
+    QList<Attempt> attempts { attempt };
+    while (attempts.size() < attemptsCount && attempt.width > minWidth)
+    {
+        attempt.width = qMax(minWidth, static_cast<int>(attempt.width * downscaleFactor)) & ~1;
+        attempts.append(attempt);
+    }
+
+    return attempts;
+}
+
+QString AnimatedImage::paletteParams(const EncoderOptions& options, const Attempt& attempt)
+{
+    // colors are picked from what changes between frames, which the rectangles of paletteuse then redraw
+    return QString(R"(-filter:v "%1,palettegen=stats_mode=diff")").arg(frameFilters(options, attempt));
+}
+
+QString AnimatedImage::encodeParams(const EncoderOptions& options, const Attempt& attempt)
+{
+    // an ordered dither compresses far better than error diffusion, whose noise changes in every frame
+    if (usesPalette(*options.videoCodec))
+        return QString(R"(-filter_complex "[0:v]%1[frames];[frames][1:v]paletteuse=dither=bayer:bayer_scale=5:diff_mode=rectangle" -loop 0)")
+            .arg(frameFilters(options, attempt));
+
+    return QString(R"(-filter:v "%1" -loop 0)").arg(frameFilters(options, attempt));
+}
+
+QString AnimatedImage::frameFilters(const EncoderOptions& options, const Attempt& attempt)
+{
+    QStringList filters;
+    if (options.speed.has_value())
+        filters.append(QString("setpts=%1*PTS").arg(QString::number(1.0 / *options.speed)));
+
+    filters.append("fps=" + QString::number(attempt.fps));
+    filters.append(QString("scale=%1:-2:flags=lanczos").arg(attempt.width));
+
+    return filters.join(',');
+}
+
+double AnimatedImage::estimatedSizeBytes(const EncoderOptions& options, const Attempt& attempt)
+{
+    // rough figures for camera footage: a GIF takes about 3 bits per pixel it redraws, a lossy WebP a tenth of that
+    const double bytesPerPixel = usesPalette(*options.videoCodec) ? 0.4 : 0.04;
+    const Metadata& metadata = options.inputMetadata;
+    const double height = metadata.width > 0 ? attempt.width * metadata.height / metadata.width : attempt.width;
+    const double durationSeconds = metadata.durationSeconds / options.speed.value_or(1);
+
+    return attempt.width * height * attempt.fps * durationSeconds * bytesPerPixel;
+}
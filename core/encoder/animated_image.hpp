@@ -0,0 +1,57 @@
+#ifndef ANIMATED_IMAGE_H
+#define ANIMATED_IMAGE_H
+
+#include "core/formats/codec.hpp"
+#include "encoder_options.hpp"
+
+#include <QList>
+#include <QString>
+#include <optional>
+
+using std::optional;
+
+//!
+//! \brief Encodes to GIF or animated WebP at the frame rate and width that fit the size target, through a palette for GIF.
+//! \details Neither encoder has a bitrate to aim at: a GIF weighs what its frames make it weigh, whatever -b:v says.
+//! The frame rate, then the width, are lowered until an estimate of the output fits the target, and when the
+//! output is still too large, it is encoded again smaller. A GIF's palette is generated once, in a pass of its own
+//! over every frame kept, and each attempt maps its frames to it; the colors do not depend on the size.
+//!
+struct AnimatedImage
+{
+    //! One try at the size target, in frames per second of the output and pixels.
+    struct Attempt
+    {
+        double fps = 0;
+        int width = 0;
+    };
+
+    [[nodiscard]] static bool isAnimatedImage(const Codec& videoCodec);
+    [[nodiscard]] static bool usesPalette(const Codec& videoCodec) { return videoCodec.libraryName == "gif"; }
+
+    //! The attempts at the size target, largest first; a single one without a target. A frame rate or size asked for
+    //! is the largest tried.
+    [[nodiscard]] static QList<Attempt> planAttempts(const EncoderOptions& options, optional<double> sizeKbps);
+    //! The filters of the pass writing the palette.
+    [[nodiscard]] static QString paletteParams(const EncoderOptions& options, const Attempt& attempt);
+    //! The filters of the encode; those of a GIF read the palette as the second input.
+    [[nodiscard]] static QString encodeParams(const EncoderOptions& options, const Attempt& attempt);
+    //! What the output may weigh before the next attempt is encoded.
+    [[nodiscard]] static qint64 maxSizeBytes(const double sizeKbps) { return static_cast<qint64>(sizeKbps * 125 * (1 + sizeTolerance)); }
+
+    static constexpr double maxFps = 15;
+    static constexpr double minFps = 8;
+    static constexpr int maxWidth = 640;
+    static constexpr int minWidth = 120;
+    static constexpr int attemptsCount = 4;
+    //! The width of each attempt after the first, relative to the one before.
+    static constexpr double downscaleFactor = 0.8;
+    static constexpr double sizeTolerance = 0.05;
+
+private:
+    //! The frames speed changed, sampled at the rate and scaled to the width of the attempt.
+    [[nodiscard]] static QString frameFilters(const EncoderOptions& options, const Attempt& attempt);
+    [[nodiscard]] static double estimatedSizeBytes(const EncoderOptions& options, const Attempt& attempt);
+};
+
+#endif
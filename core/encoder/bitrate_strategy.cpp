@@ -0,0 +1,85 @@
+#include "bitrate_strategy.hpp"
+
+#include <QHash>
+#include <QtMath>
+
+double BitrateStrategy::audioBitrateKbps(const double quality, const int channelsCount) const
+{
+    // hearing resolves bitrates on a log scale, so the curve is geometric rather than linear
+    const double perChannelKbps = minAudioKbpsPerChannel * qPow(maxAudioKbpsPerChannel / minAudioKbpsPerChannel, qBound(0.0, quality, 1.0));
+    return perChannelKbps * qPow(qMax(1, channelsCount), channelExponent);
+}
+
+optional<double> BitrateStrategy::transparentVideoBitrateKbps(const EncoderOptions& options) const
+{
+    const QSizeF size = outputSize(options);
+    if (!videoEfficiency.has_value() || size.isEmpty())
+        return {};
+
+    return size.width() * size.height() * outputFrameRate(options) * transparentBitsPerPixel * *videoEfficiency / 1000;
+}
+
+BitrateStrategy BitrateStrategy::forEncoder(const QString& libraryName)
+{
+    // audio curves are per channel, video efficiencies relative to libx264
+    static const QHash<QString, BitrateStrategy> strategies = {
+        { "libopus", { .minAudioKbpsPerChannel = 6, .maxAudioKbpsPerChannel = 64, .channelExponent = 0.8 } },
+        { "opus", { .minAudioKbpsPerChannel = 6, .maxAudioKbpsPerChannel = 64, .channelExponent = 0.8 } },
+        { "aac", { .minAudioKbpsPerChannel = 16, .maxAudioKbpsPerChannel = 112, .channelExponent = 0.85 } },
+        { "libfdk_aac", { .minAudioKbpsPerChannel = 12, .maxAudioKbpsPerChannel = 96, .channelExponent = 0.85 } },
+        { "libvorbis", { .minAudioKbpsPerChannel = 16, .maxAudioKbpsPerChannel = 96, .channelExponent = 0.85 } },
+        { "libmp3lame", { .minAudioKbpsPerChannel = 24, .maxAudioKbpsPerChannel = 160, .channelExponent = 0.9 } },
+        { "ac3", { .minAudioKbpsPerChannel = 32, .maxAudioKbpsPerChannel = 128, .channelExponent = 0.9 } },
+        { "eac3", { .minAudioKbpsPerChannel = 24, .maxAudioKbpsPerChannel = 112, .channelExponent = 0.9 } },
+        // lossless encoders ignore the bitrate, which only estimates what is left for the video
+        { "flac", { .minAudioKbpsPerChannel = 350, .maxAudioKbpsPerChannel = 350 } },
+        { "alac", { .minAudioKbpsPerChannel = 350, .maxAudioKbpsPerChannel = 350 } },
+
+        { "libx264", { .videoEfficiency = 1 } },
+        { "libx264rgb", { .videoEfficiency = 1 } },
+        { "libx265", { .videoEfficiency = 0.65 } },
+        { "libvpx", { .videoEfficiency = 1.15 } },
+        { "libvpx-vp9", { .videoEfficiency = 0.7 } },
+        { "libaom-av1", { .videoEfficiency = 0.55 } },
+        { "libsvtav1", { .videoEfficiency = 0.6 } },
+        { "librav1e", { .videoEfficiency = 0.6 } },
+        { "mpeg4", { .videoEfficiency = 1.6 } },
+        { "libxvid", { .videoEfficiency = 1.5 } },
+        { "mpeg2video", { .videoEfficiency = 2 } },
+    };
+
+    if (strategies.contains(libraryName))
+        return strategies.value(libraryName);
+
+    // hardware encoders are named after their codec, and trade some efficiency for speed
+    static const QHash<QString, BitrateStrategy> codecs = {
+        { "aac", strategies.value("aac") },
+        { "mp3", strategies.value("libmp3lame") },
+        { "h264", { .videoEfficiency = 1.15 } },
+        { "hevc", { .videoEfficiency = 0.75 } },
+        { "vp9", { .videoEfficiency = 0.8 } },
+        { "av1", { .videoEfficiency = 0.65 } },
+    };
+
+    const QString codec = libraryName.section('_', 0, 0);
+    return codecs.value(codec, {});
+}
+
+QSizeF BitrateStrategy::outputSize(const EncoderOptions& options)
+{
+    const Metadata& metadata = options.inputMetadata;
+    const double aspectRatio = metadata.width > 0 && metadata.height > 0 ? metadata.height / metadata.width : 9.0 / 16;
+
+    const double width = options.outputWidth.has_value() ? *options.outputWidth
+                       : options.outputHeight.has_value() ? *options.outputHeight / aspectRatio
+                                                          : metadata.width;
+    const double height = options.outputHeight.has_value() ? *options.outputHeight : width * aspectRatio;
+
+    return { width, height };
+}
+
+double BitrateStrategy::outputFrameRate(const EncoderOptions& options)
+{
+    const Metadata& metadata = options.inputMetadata;
+    return options.fps.has_value() ? *options.fps : metadata.frameRate > 0 ? metadata.frameRate : 30;
+}
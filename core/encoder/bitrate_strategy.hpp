@@ -0,0 +1,41 @@
+#ifndef BITRATE_STRATEGY_H
+#define BITRATE_STRATEGY_H
+
+#include "encoder_options.hpp"
+
+#include <QSizeF>
+#include <QString>
+#include <optional>
+
+using std::optional;
+
+//!
+//! \brief How many bits an encoder needs for a given quality, so that size budgets are not spent past transparency.
+//! \details Audio follows a curve per codec, from the lowest usable bitrate of a channel to the one where the codec
+//! is transparent; further channels cost less, as encoders code them jointly. Video efficiency is the share of the
+//! H.264 bitrate another encoder needs to look the same.
+//!
+struct BitrateStrategy
+{
+    double minAudioKbpsPerChannel = 16;
+    double maxAudioKbpsPerChannel = 128;
+    //! The bitrate grows with channels to this power: 1 codes each channel on its own.
+    double channelExponent = 1;
+    //! Empty for encoders whose efficiency is unknown, whose video bitrate is then left as the size target sets it.
+    optional<double> videoEfficiency = {};
+
+    //! \param quality From 0, the lowest usable bitrate, to 1, where the codec is transparent.
+    [[nodiscard]] double audioBitrateKbps(double quality, int channelsCount) const;
+    //! The video bitrate past which the output looks no better, at the ceiling typical H.264 needs per pixel.
+    [[nodiscard]] optional<double> transparentVideoBitrateKbps(const EncoderOptions& options) const;
+
+    [[nodiscard]] static BitrateStrategy forEncoder(const QString& libraryName);
+    //! The size of the output frames, from the requested size and the aspect ratio of the input.
+    [[nodiscard]] static QSizeF outputSize(const EncoderOptions& options);
+    [[nodiscard]] static double outputFrameRate(const EncoderOptions& options);
+
+    //! Bits per pixel and frame past which H.264 at a medium preset is visually transparent.
+    static constexpr double transparentBitsPerPixel = 0.15;
+};
+
+#endif
@@ -0,0 +1,206 @@
+#include "chunked_encode.hpp"
+#include "encode_job.hpp"
+
+#include <algorithm>
+
+ChunkedEncode::ChunkedEncode(const EncoderOptions& options, QObject* parent)
+    : QObject(parent)
+    , options(options)
+    , ffprobe(new QProcess(this))
+{
+    connect(ffprobe, &QProcess::finished, this, &ChunkedEncode::EndProbe);
+    connect(ffprobe, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error)
+            {
+        // without keyframes the input is simply encoded in one piece
+        if (error == QProcess::FailedToStart)
+            emit planned({}); });
+}
+
+void ChunkedEncode::PlanAsync(const int segmentsCount)
+{
+    this->segmentsCount = segmentsCount;
+
+    // packet flags come from the demuxer, so no frame has to be decoded
+    ffprobe->startCommand(QString(R"(ffprobe -v error -select_streams v:0 -show_entries packet=pts_time,flags -of csv=p=0 "%1")")
+                              .arg(options.inputPath));
+}
+
+void ChunkedEncode::PlanSmartCutAsync()
+{
+    isSmartCut = true;
+    PlanAsync(0);
+}
+
+void ChunkedEncode::EndProbe(const int exitCode, const QProcess::ExitStatus exitStatus)
+{
+    if (exitStatus == QProcess::CrashExit || exitCode != 0)
+    {
+        emit planned({});
+        return;
+    }
+
+    // segments are ranges of the trimmed input, so keyframes are taken from its start
+    const double trimStart = options.trimStartSeconds.value_or(0);
+    QList<double> keyframes;
+    for (const double keyframe : parseKeyframes(ffprobe->readAllStandardOutput()))
+    {
+        if (keyframe >= trimStart - keyframeSeekMarginSeconds)
+            keyframes.append(qMax(0.0, keyframe - trimStart));
+    }
+
+    const double durationSeconds = options.inputMetadata.durationSeconds;
+    emit planned(isSmartCut ? planSmartCut(keyframes, durationSeconds) : planSegments(keyframes, durationSeconds, segmentsCount));
+}
+
+QList<double> ChunkedEncode::parseKeyframes(const QByteArray& ffprobeOutput)
+{
+    QList<double> keyframes;
+
+    for (const QByteArray& line : ffprobeOutput.split('\n'))
+    {
+        // lines look like "12.345000,K__"
+        const qsizetype separator = line.indexOf(',');
+        if (separator <= 0 || !line.sliced(separator + 1).contains('K'))
+            continue;
+
+        bool ok = false;
+        const double time = line.first(separator).toDouble(&ok);
+        if (ok)
+            keyframes.append(time);
+    }
+
+    // packets are in decoding order, which differs from presentation order with B-frames
+    std::sort(keyframes.begin(), keyframes.end());
+    return keyframes;
+}
+
+QList<ChunkedEncode::Segment> ChunkedEncode::planSegments(const QList<double>& keyframes, const double durationSeconds, int segmentsCount)
+{
+    segmentsCount = qMin(segmentsCount, static_cast<int>(durationSeconds / minSegmentSeconds));
+    if (segmentsCount < 2 || keyframes.isEmpty())
+        return {};
+
+    QList<double> cuts { 0 };
+
+    for (int i = 1; i < segmentsCount; i++)
+    {
+        const double target = durationSeconds * i / segmentsCount;
+        const auto after = std::lower_bound(keyframes.begin(), keyframes.end(), target);
+
+        double keyframe = after != keyframes.end() ? *after : keyframes.last();
+        if (after != keyframes.begin() && (after == keyframes.end() || target - *(after - 1) < *after - target))
+            keyframe = *(after - 1);
+
+        // sparse keyframes can merge neighbouring cuts, or leave a segment too short to be worth it
+        if (keyframe - cuts.last() >= minSegmentSeconds / 2 && durationSeconds - keyframe >= minSegmentSeconds / 2)
+            cuts.append(keyframe);
+    }
+
+    if (cuts.size() < 2)
+        return {};
+
+    QList<Segment> segments;
+    for (qsizetype i = 0; i < cuts.size(); i++)
+    {
+        const bool isLast = i == cuts.size() - 1;
+        segments.append({ .startSeconds = cuts.at(i), .durationSeconds = isLast ? optional<double>() : cuts.at(i + 1) - cuts.at(i) });
+    }
+
+    return segments;
+}
+
+QList<ChunkedEncode::Segment> ChunkedEncode::planSmartCut(const QList<double>& keyframes, const double durationSeconds)
+{
+    const auto first = std::lower_bound(keyframes.begin(), keyframes.end(), 0.0);
+    const auto afterLast = std::upper_bound(keyframes.begin(), keyframes.end(), durationSeconds);
+    if (first == keyframes.end() || afterLast == keyframes.begin())
+        return {};
+
+    const double copyStart = *first;
+    const double copyEnd = *(afterLast - 1);
+    if (copyEnd - copyStart < minCopiedSeconds)
+        return {};
+
+    QList<Segment> segments;
+
+    // a trim point on a keyframe leaves nothing to encode on its side
+    if (copyStart > keyframeSeekMarginSeconds)
+        segments.append({ .startSeconds = 0, .durationSeconds = copyStart });
+
+    const bool hasTail = durationSeconds - copyEnd > keyframeSeekMarginSeconds;
+    segments.append({ .startSeconds = copyStart + keyframeSeekMarginSeconds,
+                      .durationSeconds = hasTail ? optional(copyEnd - copyStart - keyframeSeekMarginSeconds) : std::nullopt,
+                      .copiesVideo = true });
+
+    if (hasTail)
+        segments.append({ .startSeconds = copyEnd, .durationSeconds = {} });
+
+    return segments;
+}
+
+void ChunkedEncode::AddPart(EncodeJob* part, const double weightSeconds)
+{
+    const qsizetype index = partsState.size();
+    partsState.append({ part, weightSeconds, {} });
+    remainingParts++;
+
+    connect(part, &EncodeJob::progressUpdate, this, [this, index](const EncodingProgress& progress)
+            {
+        partsState[index].progress = progress;
+        EmitProgress(); });
+    connect(part, &EncodeJob::succeeded, this, [this, index]
+            {
+        partsState[index].progress = { .percent = 100, .encodedSeconds = partsState.at(index).progress.encodedSeconds,
+                                       .totalSizeBytes = partsState.at(index).progress.totalSizeBytes };
+
+        if (--remainingParts == 0)
+            emit partsSucceeded(); });
+    connect(part, &EncodeJob::failed, this, &ChunkedEncode::partFailed);
+}
+
+QList<EncodeJob*> ChunkedEncode::parts() const
+{
+    QList<EncodeJob*> jobs;
+
+    for (const Part& part : partsState)
+    {
+        if (part.job)
+            jobs.append(part.job.data());
+    }
+
+    return jobs;
+}
+
+void ChunkedEncode::EmitProgress()
+{
+    double totalWeight = 0;
+    double doneWeight = 0;
+    double remainingSeconds = 0;
+    EncodingProgress progress;
+
+    for (const Part& part : std::as_const(partsState))
+    {
+        totalWeight += part.weightSeconds;
+        doneWeight += part.weightSeconds * part.progress.percent / 100;
+        remainingSeconds += part.weightSeconds * (100 - part.progress.percent) / 100;
+
+        progress.fps += part.progress.fps;
+        progress.speed += part.progress.speed;
+        progress.totalSizeBytes += part.progress.totalSizeBytes;
+        progress.encodedSeconds += part.progress.encodedSeconds;
+    }
+
+    if (totalWeight <= 0)
+        return;
+
+    progress.percent = doneWeight * (100 - stitchingPercent) / totalWeight;
+
+    // parts that are still queued make this optimistic, but it settles as they start
+    if (progress.speed > 0)
+        progress.etaSeconds = remainingSeconds / progress.speed;
+
+    if (progress.encodedSeconds > 0)
+        progress.bitrateKbps = progress.totalSizeBytes / 125.0 / progress.encodedSeconds;
+
+    emit progressUpdate(progress);
+}
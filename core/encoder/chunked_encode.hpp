@@ -0,0 +1,92 @@
+#ifndef CHUNKED_ENCODE_H
+#define CHUNKED_ENCODE_H
+
+#include "encoder_options.hpp"
+#include "encoding_progress.hpp"
+
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QProcess>
+
+class EncodeJob;
+
+//!
+//! \brief Splits the encoding of one input into segments cut at keyframes, so that they can be encoded in parallel.
+//! \details The parts themselves are created and scheduled by MediaEncoder; this only plans them
+//! and follows their progress until all of them are done, after which they are stitched together.
+//! A smart cut is planned the same way: the video between the first and last keyframe within the trim is a segment
+//! copied as it is, and only the partial GOPs on either side of it are encoded.
+//!
+class ChunkedEncode : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Segment
+    {
+        double startSeconds;
+        //! Empty for the last segment, which runs to the end of the input.
+        optional<double> durationSeconds;
+        //! Copied from the input rather than encoded; it starts at a keyframe.
+        bool copiesVideo = false;
+    };
+
+    ChunkedEncode(const EncoderOptions& options, QObject* parent = nullptr);
+
+    //! Reads the keyframes of the input and plans up to segmentsCount segments of at least minSegmentSeconds.
+    void PlanAsync(int segmentsCount);
+    //! Reads the keyframes of the input and plans the segments of a smart cut.
+    void PlanSmartCutAsync();
+
+    //! Follows a part of the encode; its weight is the amount of media seconds it processes.
+    void AddPart(EncodeJob* part, double weightSeconds);
+    //! The parts that were not deleted yet.
+    [[nodiscard]] QList<EncodeJob*> parts() const;
+
+    static QList<double> parseKeyframes(const QByteArray& ffprobeOutput);
+    static QList<Segment> planSegments(const QList<double>& keyframes, double durationSeconds, int segmentsCount);
+    //! The encoded head up to the first keyframe, the copied video up to the last one, and the encoded tail.
+    //! Empty when fewer than minCopiedSeconds could be copied. Keyframes are from the start of the trimmed input.
+    static QList<Segment> planSmartCut(const QList<double>& keyframes, double durationSeconds);
+
+    static constexpr double minSegmentSeconds = 30;
+    //! Share of the reported progress left for stitching the parts together.
+    static constexpr double stitchingPercent = 2;
+    //! Audio encodes far faster than video, so its part weighs this much per second.
+    static constexpr double audioWeight = 0.05;
+    //! Copying only reads and writes packets, so a copied segment weighs this much per second.
+    static constexpr double copyWeight = 0.01;
+    //! Less copied video than this saves too little to be worth joining three parts.
+    static constexpr double minCopiedSeconds = 1;
+    //! Copies seek this far past their keyframe, so that a time rounded by ffprobe does not land on the one before.
+    static constexpr double keyframeSeekMarginSeconds = 0.001;
+
+signals:
+    //! Empty means the input is not worth splitting.
+    void planned(const QList<ChunkedEncode::Segment>& segments);
+    void progressUpdate(const EncodingProgress& progress);
+    void partsSucceeded();
+    void partFailed(QString error, QString errorDetails = "");
+
+private:
+    void EndProbe(int exitCode, QProcess::ExitStatus exitStatus);
+    void EmitProgress();
+
+    const EncoderOptions options;
+    int segmentsCount = 0;
+    bool isSmartCut = false;
+    QProcess* ffprobe;
+
+    struct Part
+    {
+        QPointer<EncodeJob> job;
+        double weightSeconds;
+        EncodingProgress progress;
+    };
+
+    QList<Part> partsState;
+    int remainingParts = 0;
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include "complexity_analyzer.hpp"
+#include "bitrate_strategy.hpp"
+
+#include <QRegularExpression>
+#include <cmath>
+
+ComplexityAnalyzer::ComplexityAnalyzer(const EncoderOptions& options, QObject* parent)
+    : QObject(parent)
+    , options(options)
+    , ffmpeg(new QProcess(this))
+{
+    // the statistics are printed at the info level, on stderr
+    ffmpeg->setProcessChannelMode(QProcess::MergedChannels);
+
+    connect(ffmpeg, &QProcess::finished, this, &ComplexityAnalyzer::EndAnalysis);
+    connect(ffmpeg, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error)
+            {
+        if (error == QProcess::FailedToStart)
+            emit analyzed({}); });
+}
+
+void ComplexityAnalyzer::AnalyzeAsync()
+{
+    if (isAborted)
+    {
+        QMetaObject::invokeMethod(this, [this]
+                                  { emit analyzed({}); }, Qt::QueuedConnection);
+        return;
+    }
+
+    const QString filters = QString("fps=%1,scale=%2:-2,signalstats,metadata=print:key=lavfi.signalstats.YDIF")
+                                .arg(QString::number(samplesPerSecond), QString::number(sampleWidth));
+
+    // only the part kept by a trim is encoded, so only it is measured
+    QStringList rangeParams;
+    if (options.trimStartSeconds.has_value())
+        rangeParams << "-ss" << QString::number(*options.trimStartSeconds, 'f', 6);
+    if (options.trimEndSeconds.has_value())
+        rangeParams << "-t" << QString::number(*options.trimEndSeconds - options.trimStartSeconds.value_or(0), 'f', 6);
+
+    ffmpeg->startCommand(QString(R"(ffmpeg -hide_banner -nostats %1 -i "%2" -map 0:v:0 -an -sn -vf %3 -f null -)")
+                             .arg(rangeParams.join(' '), options.inputPath, filters));
+}
+
+void ComplexityAnalyzer::Abort()
+{
+    isAborted = true;
+
+    // finished() follows with a crash exit, which reports no complexity
+    ffmpeg->kill();
+}
+
+void ComplexityAnalyzer::EndAnalysis(const int exitCode, const QProcess::ExitStatus exitStatus)
+{
+    if (exitStatus == QProcess::CrashExit || exitCode != 0)
+    {
+        emit analyzed({});
+        return;
+    }
+
+    const optional<double> motion = parseMotion(QString::fromUtf8(ffmpeg->readAll()));
+    emit analyzed(motion.has_value() ? optional(complexityFromMotion(*motion)) : std::nullopt);
+}
+
+optional<double> ComplexityAnalyzer::parseMotion(const QString& log)
+{
+    static const QRegularExpression difference(R"(lavfi\.signalstats\.YDIF=([0-9.]+))");
+
+    double total = 0;
+    int count = 0;
+
+    for (const QRegularExpressionMatch& match : difference.globalMatch(log))
+    {
+        // the first sample has nothing to be compared with
+        if (count++ > 0)
+            total += match.captured(1).toDouble();
+    }
+
+    if (count < 2)
+        return {};
+
+    return total / (count - 1);
+}
+
+double ComplexityAnalyzer::complexityFromMotion(const double motion)
+{
+    // bits needed grow slower than motion, as the encoder finds most of it with motion vectors
+    return qBound(minComplexity, std::sqrt(motion / referenceMotion), maxComplexity);
+}
+
+double ComplexityAnalyzer::neededVideoBitrateKbps(const EncoderOptions& options, const double complexity)
+{
+    const QSizeF size = BitrateStrategy::outputSize(options);
+    const double fps = BitrateStrategy::outputFrameRate(options);
+    const double efficiency = options.videoCodec.has_value() ? BitrateStrategy::forEncoder(options.videoCodec->libraryName).videoEfficiency.value_or(1) : 1;
+
+    return size.width() * size.height() * fps * referenceBitsPerPixel * efficiency * complexity / 1000;
+}
+
+QList<double> ComplexityAnalyzer::distributeBudget(const QList<Demand>& demands)
+{
+    double budget = 0;
+    for (const Demand& demand : demands)
+        budget += demand.targetSizeKbps;
+
+    QList<optional<double>> cappedSizes(demands.size());
+    double videoScale = 1;
+
+    // each input is also held to its own target; what the capped ones leave goes to the others, which may cap more
+    for (bool hasNewCaps = true; hasNewCaps;)
+    {
+        double uncappedBudget = budget;
+        double audio = 0;
+        double neededVideo = 0;
+
+        for (qsizetype i = 0; i < demands.size(); i++)
+        {
+            if (cappedSizes.at(i).has_value())
+            {
+                uncappedBudget -= *cappedSizes.at(i);
+                continue;
+            }
+
+            audio += demands.at(i).audioSizeKbps;
+            neededVideo += demands.at(i).neededVideoSizeKbps;
+        }
+
+        // audio is not worth starving, so only the video share is scaled down
+        videoScale = neededVideo > 0 ? qMin(1.0, qMax(0.0, uncappedBudget - audio) / neededVideo) : 1;
+
+        hasNewCaps = false;
+        for (qsizetype i = 0; i < demands.size(); i++)
+        {
+            const Demand& demand = demands.at(i);
+            if (!cappedSizes.at(i).has_value() && demand.audioSizeKbps + demand.neededVideoSizeKbps * videoScale > demand.targetSizeKbps)
+            {
+                cappedSizes[i] = demand.targetSizeKbps;
+                hasNewCaps = true;
+            }
+        }
+    }
+
+    QList<double> sizes;
+    for (qsizetype i = 0; i < demands.size(); i++)
+        sizes.append(cappedSizes.at(i).value_or(demands.at(i).audioSizeKbps + demands.at(i).neededVideoSizeKbps * videoScale));
+
+    return sizes;
+}
@@ -0,0 +1,64 @@
+#ifndef COMPLEXITY_ANALYZER_H
+#define COMPLEXITY_ANALYZER_H
+
+#include "encoder_options.hpp"
+
+#include <QList>
+#include <QObject>
+#include <QProcess>
+
+//!
+//! \brief Estimates how demanding the video of an input is to encode, from a fast low resolution decode.
+//! \details A few frames per second are scaled down and compared with signalstats; the mean difference between
+//! them measures motion, which is what costs the most bits. A complexity of 1 is typical footage:
+//! a slideshow is well below it, a game capture above.
+//!
+class ComplexityAnalyzer : public QObject
+{
+    Q_OBJECT
+
+public:
+    ComplexityAnalyzer(const EncoderOptions& options, QObject* parent = nullptr);
+
+    void AnalyzeAsync();
+    //! Stops the analysis, or keeps it from starting; analyzed() then reports no complexity.
+    void Abort();
+
+    //! What one input of a batch asks for, all in kilobits over its whole duration.
+    struct Demand
+    {
+        double targetSizeKbps;
+        double audioSizeKbps;
+        double neededVideoSizeKbps;
+    };
+
+    [[nodiscard]] static optional<double> parseMotion(const QString& log);
+    [[nodiscard]] static double complexityFromMotion(double motion);
+    //! The video bitrate under which the quality would visibly drop, for content of the given complexity.
+    [[nodiscard]] static double neededVideoBitrateKbps(const EncoderOptions& options, double complexity);
+    //! Splits the sum of the targets so that no input gets more than it needs or than its own target, and the
+    //! shortfall is shared in proportion to what each needs. Returns the size of each input, in the same order.
+    [[nodiscard]] static QList<double> distributeBudget(const QList<Demand>& demands);
+
+    static constexpr double samplesPerSecond = 2;
+    static constexpr int sampleWidth = 320;
+    //! Mean luma difference between samples of typical footage.
+    static constexpr double referenceMotion = 8;
+    //! Bits per pixel and frame that typical footage needs to look clean.
+    static constexpr double referenceBitsPerPixel = 0.1;
+    static constexpr double minComplexity = 0.2;
+    static constexpr double maxComplexity = 2;
+
+signals:
+    //! Empty when the input could not be analyzed, in which case the targets are used as they are.
+    void analyzed(optional<double> complexity);
+
+private:
+    void EndAnalysis(int exitCode, QProcess::ExitStatus exitStatus);
+
+    const EncoderOptions options;
+    QProcess* ffmpeg;
+    bool isAborted = false;
+};
+
+#endif
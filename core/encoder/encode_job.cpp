@@ -0,0 +1,588 @@
+#include "encode_job.hpp"
+#include "result_cache.hpp"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QThread>
+#include <QTimer>
+#include <QVariant>
+#include <filesystem>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <csignal>
+#include <sys/resource.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <sched.h>
+#endif
+
+namespace
+{
+//! Renames when both paths are on one file system; otherwise copies next to the destination first, and renames
+//! the copy, so that the output never appears there half written. Returns the error, if any.
+QString moveFile(const QString& from, const QString& to)
+{
+    namespace fs = std::filesystem;
+    const fs::path source(from.toStdU16String());
+    const fs::path target(to.toStdU16String());
+    std::error_code error;
+
+    fs::rename(source, target, error);
+    if (!error)
+        return {};
+
+    const fs::path partial = target.parent_path() / (target.filename().u16string() + u".sme-part");
+    fs::copy_file(source, partial, fs::copy_options::overwrite_existing, error);
+    if (!error)
+        fs::rename(partial, target, error);
+
+    if (error)
+    {
+        std::error_code ignored;
+        fs::remove(partial, ignored);
+        return QString::fromStdString(error.message()) + "\n\n" + from + " -> " + to;
+    }
+
+    fs::remove(source, error);
+    return {};
+}
+}
+
+EncodeJob::EncodeJob(const int id, const EncoderOptions& options, QObject* parent)
+    : QObject(parent)
+    , jobId(id)
+    , jobOptions(options)
+    , isChunkingAllowed(options.chunked || options.smartCut)
+    , ffmpeg(new QProcess(this))
+{
+    ffmpeg->setProcessChannelMode(QProcess::SeparateChannels);
+
+    connect(ffmpeg, &QProcess::readyReadStandardOutput, this, &EncodeJob::ReadProgress);
+    connect(ffmpeg, &QProcess::readyReadStandardError, this, &EncodeJob::ReadLog);
+    connect(ffmpeg, &QProcess::started, this, [this]
+            {
+#ifdef Q_OS_WIN
+        ApplyResourceLimits();
+#endif
+        if (isPaused)
+            SuspendProcess(true); });
+    connect(ffmpeg, &QProcess::finished, this, &EncodeJob::EndCompression);
+    connect(ffmpeg, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error)
+            {
+        // other errors are followed by finished(), which reports them
+        if (error != QProcess::FailedToStart)
+            return;
+
+        if (isCancelled)
+            emit cancelled();
+        else
+            emit failed(tr("Process %1").arg(QVariant::fromValue(error).toString()), command); });
+}
+
+EncodeJob::~EncodeJob()
+{
+    for (QThread* thread : findChildren<QThread*>(Qt::FindDirectChildrenOnly))
+        thread->wait();
+}
+
+void EncodeJob::Prepare(const MediaEncoder::ComputedOptions& computed, const QStringList& commands, const QString& outputPath)
+{
+    this->computedOptions = computed;
+    this->passCommands = commands;
+    this->jobOutputPath = outputPath;
+}
+
+void EncodeJob::setStrategy(EncoderStrategy* engine, const EncoderStrategy::Request& request)
+{
+    strategy = engine;
+    strategyRequest = request;
+    strategy->setParent(this);
+
+    connect(strategy, &EncoderStrategy::progressUpdate, this, [this](const EncodingProgress& progress)
+            {
+        pendingProgress = progress;
+        EmitProgress(false); });
+    connect(strategy, &EncoderStrategy::succeeded, this, &EncodeJob::EmitOutput);
+    connect(strategy, &EncoderStrategy::failed, this, &EncodeJob::failed);
+    connect(strategy, &EncoderStrategy::stopped, this, [this]
+            {
+        RemoveOutput();
+        emit cancelled(); });
+}
+
+void EncodeJob::Start()
+{
+    currentPass = 0;
+    usage = {};
+    runTimer.start();
+    setState(JobState::Encoding);
+
+    if (strategy != nullptr)
+    {
+        strategy->setPaused(isPaused);
+        strategy->Start(strategyRequest);
+        return;
+    }
+
+    StartPass();
+}
+
+void EncodeJob::Cancel()
+{
+    if (isCancelled)
+        return;
+
+    isCancelled = true;
+    emit stateChanged(state());
+
+    if (!isRunning())
+        return;
+
+    if (strategy != nullptr)
+    {
+        strategy->Stop();
+        return;
+    }
+
+    // a stopped process would never read the request
+    if (isPaused)
+        SuspendProcess(false);
+
+    // quitting lets ffmpeg release its devices and, through ssh, stops it on a remote worker too
+    ffmpeg->write("q");
+    QTimer::singleShot(cancelTimeoutMs, ffmpeg, &QProcess::kill);
+}
+
+void EncodeJob::Pause()
+{
+    if (isPaused || isCancelled)
+        return;
+
+    isPaused = true;
+    if (strategy != nullptr)
+        strategy->setPaused(true);
+    if (ffmpeg->state() == QProcess::Running)
+        SuspendProcess(true);
+
+    emit stateChanged(state());
+}
+
+void EncodeJob::Resume()
+{
+    if (!isPaused || isCancelled)
+        return;
+
+    isPaused = false;
+    if (strategy != nullptr)
+        strategy->setPaused(false);
+    if (ffmpeg->state() == QProcess::Running)
+        SuspendProcess(false);
+
+    emit stateChanged(state());
+}
+
+void EncodeJob::setState(const JobState state)
+{
+    step = state;
+    emit stateChanged(this->state());
+}
+
+JobState EncodeJob::state() const
+{
+    if (isCancelled)
+        return JobState::Cancelled;
+    if (isPaused && step != JobState::Done && step != JobState::Failed)
+        return JobState::Paused;
+
+    return step;
+}
+
+void EncodeJob::SuspendProcess(const bool suspended)
+{
+#ifdef Q_OS_WIN
+    // Windows has no signal for it, but ntdll suspends or resumes every thread of a process at once
+    using ProcessCall = LONG(NTAPI*)(HANDLE);
+    const auto call = reinterpret_cast<ProcessCall>(
+        GetProcAddress(GetModuleHandleW(L"ntdll.dll"), suspended ? "NtSuspendProcess" : "NtResumeProcess"));
+    const HANDLE process = OpenProcess(PROCESS_SUSPEND_RESUME, FALSE, static_cast<DWORD>(ffmpeg->processId()));
+
+    if (process == nullptr)
+        return;
+    if (call != nullptr)
+        call(process);
+
+    CloseHandle(process);
+#else
+    ::kill(static_cast<pid_t>(ffmpeg->processId()), suspended ? SIGSTOP : SIGCONT);
+#endif
+}
+
+QString EncodeJob::scratchPath()
+{
+    if (!scratchDir)
+    {
+        scratchDir = scratchBaseDir.isEmpty()
+            ? std::make_unique<QTemporaryDir>()
+            : std::make_unique<QTemporaryDir>(QDir(scratchBaseDir).filePath(".sme-XXXXXX"));
+    }
+
+    return scratchDir->path();
+}
+
+void EncodeJob::setProgressRange(double fromPercent, double toPercent)
+{
+    progressFromPercent = fromPercent;
+    progressToPercent = toPercent;
+}
+
+void EncodeJob::StartPass()
+{
+    command = passCommands.at(currentPass);
+    progressBuffer.clear();
+    logBuffer.clear();
+    logLines.clear();
+    pendingProgress = {};
+
+#ifndef Q_OS_WIN
+    ApplyResourceLimits();
+#endif
+
+    if (remoteCommand.isEmpty())
+        ffmpeg->startCommand(command);
+    else
+        ffmpeg->start(remoteCommand.first(), remoteCommand.sliced(1) << command);
+}
+
+void EncodeJob::ApplyResourceLimits()
+{
+    // a remote process runs on cores, and under limits, of its own host
+    if (!remoteCommand.isEmpty())
+        return;
+
+    const ResourceLimits& limits = jobOptions.resources;
+
+#ifdef Q_OS_WIN
+    const HANDLE process = OpenProcess(PROCESS_SET_INFORMATION | PROCESS_SET_QUOTA | PROCESS_TERMINATE, FALSE,
+                                       static_cast<DWORD>(ffmpeg->processId()));
+    if (process == nullptr)
+        return;
+
+    if (limits.priority != ResourceLimits::Priority::Normal)
+        SetPriorityClass(process, limits.priority == ResourceLimits::Priority::Idle ? IDLE_PRIORITY_CLASS : BELOW_NORMAL_PRIORITY_CLASS);
+
+    if (!assignedCores.isEmpty())
+    {
+        DWORD_PTR mask = 0;
+        for (const int core : assignedCores)
+            mask |= core < 64 ? DWORD_PTR(1) << core : 0;
+
+        SetProcessAffinityMask(process, mask);
+    }
+
+    if (limits.memoryLimitMb.has_value())
+    {
+        // the job object lives on as long as the process it holds, once its handle is closed
+        const HANDLE jobObject = CreateJobObjectW(nullptr, nullptr);
+        JOBOBJECT_EXTENDED_LIMIT_INFORMATION information {};
+        information.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_PROCESS_MEMORY;
+        information.ProcessMemoryLimit = static_cast<SIZE_T>(*limits.memoryLimitMb) * 1024 * 1024;
+
+        if (jobObject != nullptr)
+        {
+            SetInformationJobObject(jobObject, JobObjectExtendedLimitInformation, &information, sizeof(information));
+            AssignProcessToJobObject(jobObject, process);
+            CloseHandle(jobObject);
+        }
+    }
+
+    CloseHandle(process);
+#else
+    const int niceness = ResourceLimits::niceness(limits.priority);
+    const optional<rlim_t> memoryBytes = limits.memoryLimitMb.has_value() ? optional(static_cast<rlim_t>(*limits.memoryLimitMb) * 1024 * 1024) : std::nullopt;
+#ifdef Q_OS_LINUX
+    const bool isPinned = !assignedCores.isEmpty();
+    cpu_set_t cores;
+    CPU_ZERO(&cores);
+    for (const int core : assignedCores)
+        CPU_SET(core, &cores);
+#endif
+
+    // runs in the child between fork and exec, where only system calls are safe
+    ffmpeg->setChildProcessModifier([=]
+                                    {
+        if (niceness > 0)
+            setpriority(PRIO_PROCESS, 0, niceness);
+#ifdef Q_OS_LINUX
+        if (isPinned)
+            sched_setaffinity(0, sizeof(cores), &cores);
+#endif
+        if (memoryBytes.has_value())
+        {
+            const rlimit limit { *memoryBytes, *memoryBytes };
+            setrlimit(RLIMIT_AS, &limit);
+        } });
+#endif
+}
+
+void EncodeJob::ReadProgress()
+{
+    progressBuffer += ffmpeg->readAllStandardOutput();
+
+    qsizetype lineEnd;
+    while ((lineEnd = progressBuffer.indexOf('\n')) >= 0)
+    {
+        ParseProgressLine(progressBuffer.first(lineEnd).trimmed());
+        progressBuffer.remove(0, lineEnd + 1);
+    }
+}
+
+void EncodeJob::ReadLog()
+{
+    logBuffer += ffmpeg->readAllStandardError();
+
+    qsizetype lineEnd;
+    while ((lineEnd = logBuffer.indexOf('\n')) >= 0)
+    {
+        const QString line = QString::fromUtf8(logBuffer.first(lineEnd)).trimmed();
+        logBuffer.remove(0, lineEnd + 1);
+
+        if (line.startsWith("bench:"))
+            ParseBenchmarkLine(line);
+        else if (!line.isEmpty())
+            logLines.push(line);
+    }
+}
+
+void EncodeJob::ParseBenchmarkLine(const QString& line)
+{
+    // lines look like "bench: utime=1.234s stime=0.056s rtime=1.000s" and "bench: maxrss=123456KiB"
+    static const QRegularExpression value(R"((\w+)=([0-9.]+))");
+
+    for (const QRegularExpressionMatch& match : value.globalMatch(line))
+    {
+        const QString key = match.captured(1);
+        const double amount = match.captured(2).toDouble();
+
+        if (key == "utime")
+            usage.userSeconds += amount;
+        else if (key == "stime")
+            usage.systemSeconds += amount;
+        else if (key == "maxrss")
+            usage.peakRssKb = qMax(usage.peakRssKb, static_cast<qint64>(amount));
+    }
+}
+
+void EncodeJob::ParseProgressLine(const QByteArray& line)
+{
+    const qsizetype separator = line.indexOf('=');
+    if (separator <= 0)
+        return;
+
+    const QByteArrayView key = QByteArrayView(line).first(separator);
+    const QByteArrayView value = QByteArrayView(line).sliced(separator + 1);
+    bool ok = false;
+
+    // values are "N/A" until ffmpeg has enough data, in which case the previous ones are kept
+    if (key == "out_time_us")
+    {
+        const qint64 microseconds = value.toLongLong(&ok);
+        if (ok)
+            pendingProgress.encodedSeconds = microseconds / 1e6;
+    }
+    else if (key == "fps")
+    {
+        const double fps = value.toDouble(&ok);
+        if (ok)
+            pendingProgress.fps = fps;
+    }
+    else if (key == "speed")
+    {
+        const double speed = value.trimmed().chopped(value.endsWith('x') ? 1 : 0).toDouble(&ok);
+        if (ok)
+            pendingProgress.speed = speed;
+    }
+    else if (key == "total_size")
+    {
+        const qint64 size = value.toLongLong(&ok);
+        if (ok)
+            pendingProgress.totalSizeBytes = size;
+    }
+    else if (key == "bitrate")
+    {
+        const double bitrate = value.trimmed().chopped(value.endsWith("kbits/s") ? 7 : 0).toDouble(&ok);
+        if (ok)
+            pendingProgress.bitrateKbps = bitrate;
+    }
+    else if (key == "progress")
+    {
+        EmitProgress(value == "end");
+    }
+}
+
+void EncodeJob::EmitProgress(bool isPassComplete)
+{
+    const double expectedSeconds = durationSeconds.value_or(jobOptions.inputMetadata.durationSeconds / jobOptions.speed.value_or(1));
+    const double passCount = qMax(qsizetype(1), passCommands.size());
+
+    const double passPercent = isPassComplete || expectedSeconds <= 0
+        ? 100
+        : qMin(100.0, pendingProgress.encodedSeconds * 100 / expectedSeconds);
+
+    const double jobPercent = (currentPass * 100 + passPercent) / passCount;
+    pendingProgress.percent = progressFromPercent + jobPercent * (progressToPercent - progressFromPercent) / 100;
+
+    if (pendingProgress.speed > 0 && expectedSeconds > 0)
+    {
+        const double remainingSeconds = expectedSeconds - pendingProgress.encodedSeconds
+                                      + (passCount - currentPass - 1) * expectedSeconds;
+        pendingProgress.etaSeconds = qMax(0.0, remainingSeconds / pendingProgress.speed);
+    }
+
+    lastProgress = pendingProgress;
+    emit progressUpdate(lastProgress);
+}
+
+void EncodeJob::EndCompression(const int exitCode, const QProcess::ExitStatus exitStatus)
+{
+    if (isCancelled)
+    {
+        // ffmpeg closes the output properly when it quits, but a cut encode is of no use
+        if (currentPass == passCommands.size() - 1)
+            RemoveOutput();
+
+        emit cancelled();
+        return;
+    }
+
+    if (exitStatus == QProcess::CrashExit || exitCode != 0)
+    {
+        const QString output = log();
+        emit failed(MediaEncoder::parseOutput(output), command + "\n\n" + output);
+        return;
+    }
+
+    if (++currentPass < passCommands.size())
+    {
+        StartPass();
+        return;
+    }
+
+    // the earlier passes wrote files the fallback reads, so only the last one is run again
+    if (!fallbackCommands.isEmpty() && QFileInfo(jobOutputPath).size() > fallbackSizeLimitBytes)
+    {
+        currentPass = passCommands.size() - 1;
+        passCommands[currentPass] = fallbackCommands.takeFirst();
+        StartPass();
+        return;
+    }
+
+    EmitOutput();
+}
+
+void EncodeJob::EmitOutput()
+{
+    // the last progress block reports the size of the finished file, which spares opening it
+    qint64 sizeBytes = lastProgress.totalSizeBytes;
+
+    // a ladder writes its segments through muxers of their own, which the progress does not count
+    if (jobOptions.ladder.has_value() && QFileInfo::exists(jobOutputPath))
+        sizeBytes = StreamingLadder::sizeBytes(QFileInfo(jobOutputPath).absolutePath());
+
+    if (sizeBytes <= 0)
+    {
+        const QFileInfo media(jobOutputPath);
+        if (!media.exists())
+        {
+            emit failed("Could not open the compressed media.", jobOutputPath);
+            return;
+        }
+
+        sizeBytes = media.size();
+    }
+
+    if (destinationPath.isEmpty())
+    {
+        emit succeeded({ jobOutputPath, sizeBytes });
+        return;
+    }
+
+    PublishAsync(sizeBytes);
+}
+
+void EncodeJob::RemoveOutput() const
+{
+    // the folder is named after the output, with the extension of the ladder, so nothing else is in it
+    if (jobOptions.ladder.has_value())
+        QDir(QFileInfo(jobOutputPath).absolutePath()).removeRecursively();
+    else
+        QFile::remove(jobOutputPath);
+}
+
+void EncodeJob::PublishAsync(const qint64 sizeBytes)
+{
+    isMoving = true;
+    emit encoded();
+
+    auto error = std::make_shared<QString>();
+    QThread* mover = QThread::create([from = jobOutputPath, to = destinationPath, error]
+                                     { *error = moveFile(from, to); });
+    mover->setParent(this);
+
+    connect(mover, &QThread::finished, this, [this, mover, error, sizeBytes]
+            {
+        mover->deleteLater();
+        isMoving = false;
+
+        if (!error->isEmpty())
+        {
+            emit failed(tr("Could not move the compressed media to its destination."), *error);
+            return;
+        }
+
+        jobOutputPath = destinationPath;
+        destinationPath.clear();
+        emit succeeded({ jobOutputPath, sizeBytes }); });
+
+    mover->start();
+}
+
+void EncodeJob::ReuseAsync(const QString& resultPath)
+{
+    runTimer.start();
+    isMoving = true;
+    emit encoded();
+
+    auto error = std::make_shared<QString>();
+    QThread* linker = QThread::create([from = resultPath, to = jobOutputPath, error]
+                                      { *error = ResultCache::linkOrCopy(from, to); });
+    linker->setParent(this);
+
+    connect(linker, &QThread::finished, this, [this, linker, error]
+            {
+        linker->deleteLater();
+        isMoving = false;
+
+        if (!error->isEmpty())
+        {
+            emit failed(tr("Could not reuse the previous output of this encode."), *error);
+            return;
+        }
+
+        isReusedResult = true;
+        emit succeeded({ jobOutputPath, QFileInfo(jobOutputPath).size() }); });
+
+    linker->start();
+}
+
+QString EncodeJob::log() const
+{
+    QStringList lines = logLines.toList();
+
+    if (!logBuffer.isEmpty())
+        lines.append(QString::fromUtf8(logBuffer));
+
+    return lines.join("\n");
+}
@@ -0,0 +1,191 @@
+#ifndef ENCODE_JOB_H
+#define ENCODE_JOB_H
+
+#include "core/utils/ring_buffer.hpp"
+#include "encoded_output.hpp"
+#include "encoder.hpp"
+#include "encoder_options.hpp"
+#include "encoder_strategy.hpp"
+#include "encoding_progress.hpp"
+#include "job_state.hpp"
+#include "resource_usage.hpp"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QObject>
+#include <QProcess>
+#include <QTemporaryDir>
+
+//!
+//! \brief A single encoding of one input, backed by its own ffmpeg process.
+//! \details Jobs are created and scheduled by MediaEncoder; they only report back through their signals.
+//! Commands are expected to write -progress blocks to stdout; stderr is kept as a log of bounded size.
+//! Pausing stops the process in place; on a remote worker, it only stops the local end of the connection.
+//! A job given an EncoderStrategy runs through it instead, without any process.
+//! A job given a destination writes to a staging folder, and moves the output there on a worker thread once done.
+//!
+class EncodeJob : public QObject
+{
+    Q_OBJECT
+
+public:
+    EncodeJob(int id, const EncoderOptions& options, QObject* parent = nullptr);
+    //! Waits for the output to be moved into place, as one cut short would be left half copied.
+    ~EncodeJob() override;
+
+    //! Sets the commands to run in turn; progress is spread evenly across them.
+    void Prepare(const MediaEncoder::ComputedOptions& computed, const QStringList& commands, const QString& outputPath);
+    //! Commands run in turn in place of the last one, for as long as the output it wrote is larger than the limit.
+    //! The last output is kept when none of them fits.
+    void setFallbacks(const QStringList& commands, qint64 maxSizeBytes)
+    {
+        fallbackCommands = commands;
+        fallbackSizeLimitBytes = maxSizeBytes;
+    }
+    //! Runs the request through the engine, which the job takes ownership of, in place of the commands.
+    void setStrategy(EncoderStrategy* engine, const EncoderStrategy::Request& request);
+    void Start();
+    [[nodiscard]] bool isPrepared() const { return !passCommands.isEmpty() || strategy != nullptr; }
+    [[nodiscard]] bool isRunning() const
+    {
+        return ffmpeg->state() != QProcess::NotRunning || (strategy != nullptr && strategy->isRunning());
+    }
+
+    //! Asks ffmpeg to quit, and kills it if it has not after cancelTimeoutMs; cancelled() follows its exit.
+    //! Without a running process, the job is only marked as cancelled.
+    void Cancel();
+    //! Suspends the process, if any; one started while paused is suspended as soon as it runs.
+    void Pause();
+    void Resume();
+    //! The step the job is at; Paused and Cancelled are set through Pause() and Cancel() instead.
+    void setState(JobState state);
+    [[nodiscard]] JobState state() const;
+
+    //! A temporary directory removed along with the job, for pass logs and other intermediate files.
+    QString scratchPath();
+    //! Where the scratch directory is created; must be called before the first scratchPath().
+    void setScratchBaseDir(const QString& baseDir) { scratchBaseDir = baseDir; }
+
+    //! Moves the output there once written, from the staging path given to Prepare(); encoded() is emitted in between.
+    void setDestinationPath(const QString& path) { destinationPath = path; }
+    //! Whether the output is being moved to its destination, which can no longer be cancelled.
+    [[nodiscard]] bool isPublishing() const { return isMoving; }
+
+    //! Identifies the encode in the ResultCache; empty when it is not cached.
+    void setResultKey(const QString& key) { cacheKey = key; }
+    [[nodiscard]] const QString& resultKey() const { return cacheKey; }
+    //! Links or copies a cached result to the output path given to Prepare(), in place of encoding; encoded() is
+    //! emitted meanwhile, as for a staged output.
+    void ReuseAsync(const QString& resultPath);
+    //! Whether the output came from the ResultCache rather than from encoding.
+    [[nodiscard]] bool isReused() const { return isReusedResult; }
+
+    //! The duration of the output this job produces, when it only encodes part of the input.
+    void setDurationSeconds(double seconds) { durationSeconds = seconds; }
+    //! Maps the job's progress onto a sub-range of the reported percentage.
+    void setProgressRange(double fromPercent, double toPercent);
+
+    //! The constant quality level found for the job, used in place of a bitrate; see QualitySearch.
+    void setQualityLevel(int level) { quality = level; }
+    [[nodiscard]] optional<int> qualityLevel() const { return quality; }
+
+    //! The share of its batch's size targets this job gets, in place of the size target of its options.
+    void setSizeBudget(double sizeKbps) { sizeBudget = sizeKbps; }
+    [[nodiscard]] optional<double> sizeBudgetKbps() const { return sizeBudget; }
+
+    [[nodiscard]] bool allowsChunking() const { return isChunkingAllowed; }
+    void disableChunking() { isChunkingAllowed = false; }
+
+    //! Whether the job may run on a remote worker, which then needs access to the same paths.
+    [[nodiscard]] bool allowsRemote() const { return isRemoteAllowed; }
+    void setRemoteAllowed(bool allowed) { isRemoteAllowed = allowed; }
+    //! Runs the commands through a program such as ssh, which receives each command as its last argument.
+    void setRemoteCommand(const QStringList& commandPrefix) { remoteCommand = commandPrefix; }
+
+    //! Pins local processes to these cores, on top of the priority and memory limit of the options.
+    void setAssignedCores(const QList<int>& cores) { assignedCores = cores; }
+
+    //! Removes the output of a cut encode: its file, or the folder of a ladder.
+    void RemoveOutput() const;
+
+    [[nodiscard]] int id() const { return jobId; }
+    [[nodiscard]] const EncoderOptions& options() const { return jobOptions; }
+    [[nodiscard]] const MediaEncoder::ComputedOptions& computed() const { return computedOptions; }
+    [[nodiscard]] const QString& outputPath() const { return jobOutputPath; }
+    [[nodiscard]] const EncodingProgress& progress() const { return lastProgress; }
+    //! Filled from the bench: lines of the log, when the commands were run with -benchmark.
+    [[nodiscard]] const ResourceUsage& resourceUsage() const { return usage; }
+    //! Wall time since the job was last started.
+    [[nodiscard]] double elapsedSeconds() const { return runTimer.isValid() ? runTimer.elapsed() / 1000.0 : 0; }
+
+signals:
+    void progressUpdate(const EncodingProgress& progress);
+    //! Emitted once the output is at its final path.
+    void succeeded(const EncodedOutput& output);
+    //! Emitted when a staged output is written and only has to be moved, so that the job no longer needs its slot.
+    void encoded();
+    void failed(QString error, QString errorDetails = "");
+    void cancelled();
+    void stateChanged(JobState state);
+
+private:
+    void StartPass();
+    void ReadProgress();
+    void ReadLog();
+    void ParseProgressLine(const QByteArray& line);
+    void ParseBenchmarkLine(const QString& line);
+    void EmitProgress(bool isPassComplete);
+    void EndCompression(int exitCode, QProcess::ExitStatus exitStatus);
+    void EmitOutput();
+    void PublishAsync(qint64 sizeBytes);
+    void SuspendProcess(bool suspended);
+    //! On Windows, limits the process once started; elsewhere, sets up the child to limit itself before exec.
+    void ApplyResourceLimits();
+    [[nodiscard]] QString log() const;
+
+    const int jobId;
+    const EncoderOptions jobOptions;
+    MediaEncoder::ComputedOptions computedOptions;
+    QString jobOutputPath;
+    QString destinationPath;
+    QString cacheKey;
+    QStringList passCommands;
+    QStringList fallbackCommands;
+    qint64 fallbackSizeLimitBytes = 0;
+    EncoderStrategy* strategy = nullptr;
+    EncoderStrategy::Request strategyRequest;
+    qsizetype currentPass = 0;
+    QString command;
+    std::unique_ptr<QTemporaryDir> scratchDir;
+    QString scratchBaseDir;
+    optional<double> durationSeconds;
+    double progressFromPercent = 0;
+    double progressToPercent = 100;
+    optional<double> sizeBudget;
+    optional<int> quality;
+    JobState step = JobState::Queued;
+    bool isPaused = false;
+    bool isCancelled = false;
+    bool isMoving = false;
+    bool isReusedResult = false;
+    bool isChunkingAllowed;
+    bool isRemoteAllowed = false;
+    QStringList remoteCommand;
+    QList<int> assignedCores;
+
+    QProcess* ffmpeg;
+    QElapsedTimer runTimer;
+
+    QByteArray progressBuffer;
+    EncodingProgress pendingProgress;
+    EncodingProgress lastProgress;
+    ResourceUsage usage;
+
+    QByteArray logBuffer;
+    RingBuffer<QString> logLines { maxLogLines };
+
+    static constexpr qsizetype maxLogLines = 200;
+    static constexpr int cancelTimeoutMs = 5000;
+};
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef ENCODED_OUTPUT_H
+#define ENCODED_OUTPUT_H
+
+#include <QString>
+#include <QtGlobal>
+
+//!
+//! \brief The file a job wrote, once it is at its final path.
+//! \details The size is the one ffmpeg reported in its last progress block, so that the file, which may be
+//! on a network share, is not opened or stat'ed again to tell it.
+//!
+struct EncodedOutput
+{
+    QString path;
+    qint64 sizeBytes = 0;
+};
+
+#endif
@@ -1,132 +1,1613 @@
 #include "encoder.hpp"
+#include "bitrate_strategy.hpp"
+#include "encode_job.hpp"
+#include "strategies/default_encoder_strategy.hpp"
+#include "stream_copy_planner.hpp"
 
+#include <QCoreApplication>
+#include <QCryptographicHash>
 #include <QFile>
+#include <QFileInfo>
 #include <QJsonDocument>
 #include <QRegularExpression>
 #include <QStringBuilder>
+#include <QThread>
 #include <QTime>
+#include <QTimer>
 #include <QVariant>
+#include <utility>
 
 #include "core/formats/metadata.hpp"
+#include "core/notifier/message.hpp"
 
-MediaEncoder::MediaEncoder()
+MediaEncoder::MediaEncoder(std::shared_ptr<SizeCalibration> sizeCalibration, std::shared_ptr<QualityLevelCache> qualityLevels,
+                           std::shared_ptr<ResultCache> results)
+    : sizeCalibration(std::move(sizeCalibration))
+    , qualityLevels(std::move(qualityLevels))
+    , results(std::move(results))
+    , progressTimer(new QTimer(this))
 {
-    ffmpeg->setProcessChannelMode(QProcess::MergedChannels);
-    connect(ffmpeg, &QProcess::errorOccurred, [this](QProcess::ProcessError error)
-            { emit encodingFailed(tr("Process %1").arg(QVariant::fromValue(error).toString())); });
+    progressTimer->setSingleShot(true);
+    progressTimer->setInterval(progressIntervalMs);
+    connect(progressTimer, &QTimer::timeout, this, &MediaEncoder::FlushProgress);
+
+    for (int core = 0; core < QThread::idealThreadCount(); core++)
+        freeCores.append(core);
+
+    setThreadsPerJob(defaultThreadsPerJob);
+}
+
+int MediaEncoder::Encode(const EncoderOptions& options, const optional<int> jobId)
+{
+    return EncodeBatch({ options }, jobId).first();
+}
+
+QList<int> MediaEncoder::EncodeBatch(const std::vector<EncoderOptions>& batch, const optional<int> firstJobId)
+{
+    QList<int> ids;
+    QList<EncodeJob*> analyzedJobs;
+
+    for (const EncoderOptions& options : batch)
+    {
+        const optional<int> jobId = firstJobId.has_value() ? optional<int>(*firstJobId + static_cast<int>(ids.size())) : std::nullopt;
+        EncodeJob* job = CreateJob(options, jobId);
+        job->setRemoteAllowed(runsRemotely(options));
+        ids.append(job->id());
+
+        if (options.analyzeComplexity)
+        {
+            job->setState(JobState::Probing);
+            analyzedJobs.append(job);
+        }
+        else
+            pendingJobs.push_back(job);
+
+        emit jobQueued(job->id(), job->options());
+    }
+
+    if (!analyzedJobs.isEmpty())
+    {
+        auto complexities = std::make_shared<QHash<EncodeJob*, double>>();
+        auto remaining = std::make_shared<qsizetype>(analyzedJobs.size());
+
+        for (EncodeJob* job : analyzedJobs)
+        {
+            auto* analyzer = new ComplexityAnalyzer(job->options(), job);
+            analyzingJobs.append(job);
+
+            connect(analyzer, &ComplexityAnalyzer::analyzed, this, [this, job, analyzer, analyzedJobs, complexities, remaining](optional<double> complexity)
+                    {
+                analyzer->deleteLater();
+                runningAnalyses--;
+                if (complexity.has_value())
+                    complexities->insert(job, *complexity);
+
+                if (--*remaining == 0)
+                    AllocateSizeBudgets(analyzedJobs, *complexities);
+
+                StartAnalyses(); });
+
+            pendingAnalyses.push_back(analyzer);
+        }
+
+        StartAnalyses();
+    }
+
+    // deferred so that no job signal is emitted before the caller knows the job id
+    QMetaObject::invokeMethod(this, &MediaEncoder::ScheduleJobs, Qt::QueuedConnection);
+
+    return ids;
+}
+
+QList<int> MediaEncoder::EncodeVariants(const std::vector<EncoderOptions>& variants)
+{
+    QList<int> ids(static_cast<qsizetype>(variants.size()));
+    QList<qsizetype> sharedIndexes;
+
+    for (qsizetype i = 0; i < ids.size(); i++)
+    {
+        const EncoderOptions& options = variants.at(i);
+        const bool needsOwnDecode = options.inputPath != variants.front().inputPath || options.twoPass || options.analyzeComplexity
+                                 || options.targetQuality.has_value() || options.resumable || options.ladder.has_value()
+                                 || options.trimStartSeconds.has_value() || options.trimEndSeconds.has_value() || options.tracks.has_value()
+                                 || (options.videoCodec.has_value() && AnimatedImage::isAnimatedImage(*options.videoCodec));
+
+        if (needsOwnDecode)
+            ids[i] = Encode(options);
+        else
+            sharedIndexes.append(i);
+    }
+
+    if (sharedIndexes.size() == 1)
+        ids[sharedIndexes.first()] = Encode(variants.at(sharedIndexes.first()));
+    if (sharedIndexes.size() < 2)
+        return ids;
+
+    QList<EncodeJob*> riders;
+    for (const qsizetype i : sharedIndexes)
+    {
+        // splitting at keyframes would take a decode per segment again
+        EncodeJob* job = CreateJob(variants.at(i));
+        job->disableChunking();
+        ids[i] = job->id();
+        riders.append(job);
+
+        emit jobQueued(job->id(), job->options());
+    }
+
+    EncodeJob* carrier = riders.takeFirst();
+    sharedDecodes.insert(carrier, riders);
+    coordinatingJobs.append(riders);
+    pendingJobs.push_back(carrier);
+
+    connect(carrier, &EncodeJob::progressUpdate, this, [this, carrier](const EncodingProgress& progress)
+            {
+        for (const EncodeJob* rider : sharedDecodes.value(carrier))
+            ReportProgress(rider->id(), progress); });
+
+    QMetaObject::invokeMethod(this, &MediaEncoder::ScheduleJobs, Qt::QueuedConnection);
+
+    return ids;
+}
+
+int MediaEncoder::Preview(const EncoderOptions& options, const optional<int> reservedId)
+{
+    const int previewId = reservedId.has_value() ? *reservedId : nextJobId++;
+
+    const auto maybeOutputPath = ResolveOutputPath(options);
+    if (std::holds_alternative<Message>(maybeOutputPath))
+    {
+        const QString error = std::get<Message>(maybeOutputPath).message;
+        QMetaObject::invokeMethod(this, [this, previewId, error]
+                                  { emit previewFailed(previewId, error); }, Qt::QueuedConnection);
+        return previewId;
+    }
+
+    // a sample at the size-derived bitrate would not show what the quality target encodes at
+    const optional<int> qualityLevel = options.targetQuality.has_value() ? qualityLevels->levelFor(options) : std::nullopt;
+    if (options.targetQuality.has_value() && !qualityLevel.has_value())
+    {
+        const QString error = tr("A preview at a target quality needs the quality level of the input, which its first encode searches for.");
+        QMetaObject::invokeMethod(this, [this, previewId, error]
+                                  { emit previewFailed(previewId, error); }, Qt::QueuedConnection);
+        return previewId;
+    }
+
+    auto* preview = new PreviewEncode(options, this);
+    const QString suffix = QFileInfo(std::get<QString>(maybeOutputPath)).suffix();
+    const double speedFactor = options.speed.value_or(1);
+    const QList<PreviewEncode::Sample> samples = PreviewEncode::planSamples(options.inputMetadata.durationSeconds);
+    QList<EncodeJob*> parts;
+    optional<ComputedOptions> computed;
+
+    for (qsizetype i = 0; i < samples.size(); i++)
+    {
+        const PreviewEncode::Sample& sample = samples.at(i);
+        const QString path = QDir(preview->scratchPath()).filePath(QString("sample_%1.%2").arg(i).arg(suffix));
+
+        auto* part = new EncodeJob(nextJobId++, options, this);
+        part->disableChunking();
+        part->setScratchBaseDir(preview->scratchPath());
+        part->setDurationSeconds(sample.durationSeconds / speedFactor);
+        if (qualityLevel.has_value())
+            part->setQualityLevel(*qualityLevel);
+
+        // the bitrate is the one of the full encode, so that the projected size is what it would produce
+        if (!computed.has_value())
+            computed = ComputeOptions(part);
+
+        part->Prepare(*computed, BuildCommands(part, *computed, path, { sample.startSeconds, sample.durationSeconds }), path);
+
+        connect(part, &EncodeJob::succeeded, this, [this, part]
+                { EndCompression(part); });
+        connect(part, &EncodeJob::failed, this, [this, part]
+                { EndCompression(part); });
+
+        preview->AddSample(part, sample);
+        parts.append(part);
+    }
+
+    connect(preview, &PreviewEncode::completed, this, [this, previewId, preview](const PreviewEncode::Result& result)
+            {
+        emit previewCompleted(previewId, result);
+        preview->deleteLater(); });
+    connect(preview, &PreviewEncode::failed, this, [this, previewId, preview](const QString& error, const QString& errorDetails)
+            {
+        for (EncodeJob* part : preview->parts())
+            DiscardJob(part);
+
+        emit previewFailed(previewId, error, errorDetails);
+        preview->deleteLater();
+
+        ScheduleJobs();
+        if (isIdle())
+            emit queueFinished(); });
+
+    // a preview is waited on, so it goes ahead of the queue
+    pendingJobs.insert(pendingJobs.begin(), parts.begin(), parts.end());
+    QMetaObject::invokeMethod(this, &MediaEncoder::ScheduleJobs, Qt::QueuedConnection);
+
+    return previewId;
+}
+
+EncodeJob* MediaEncoder::CreateJob(const EncoderOptions& options, const optional<int> jobId)
+{
+    auto* job = new EncodeJob(jobId.has_value() ? *jobId : nextJobId++, options, this);
+    jobs.insert(job->id(), job);
+
+    connect(job, &EncodeJob::stateChanged, this, [this, job](JobState state)
+            { emit jobStateChanged(job->id(), state); });
+    connect(job, &EncodeJob::progressUpdate, this, [this, job](const EncodingProgress& progress)
+            { ReportProgress(job->id(), progress); });
+    connect(job, &EncodeJob::encoded, this, [this, job]
+            {
+        // the move only waits on storage, so the next job gets the slot
+        runningJobs.removeOne(job);
+        ReleaseCores(job);
+        coordinatingJobs.removeOne(job);
+        publishingJobs.append(job);
+        ScheduleJobs(); });
+    connect(job, &EncodeJob::succeeded, this, [this, job](const EncodedOutput& output)
+            {
+        // a reused output says nothing new about the encoder, and is in the cache already
+        if (!job->resultKey().isEmpty() && !job->isReused())
+            results->Store(job->resultKey(), output.path);
+        if (learnsSizes && !job->isReused() && job->computed().requestedSizeKbps.has_value())
+            sizeCalibration->Record(job->options(), *job->computed().requestedSizeKbps, output.sizeBytes / 125.0);
+        job->setState(JobState::Done);
+        pendingProgress.remove(job->id());
+        if (measuresResourceUsage)
+            emit jobResourceUsage(job->id(), job->resourceUsage());
+        emit jobSucceeded(job->id(), job->options(), job->computed(), output);
+        EndSharedDecode(job, JobState::Done);
+        EndCompression(job); });
+    connect(job, &EncodeJob::failed, this, [this, job](const QString& error, const QString& errorDetails)
+            {
+        job->setState(JobState::Failed);
+        pendingProgress.remove(job->id());
+        emit jobFailed(job->id(), error, errorDetails);
+        EndSharedDecode(job, JobState::Failed, error, errorDetails);
+        EndCompression(job); });
+    connect(job, &EncodeJob::cancelled, this, [this, job]
+            {
+        pendingProgress.remove(job->id());
+        emit jobCancelled(job->id());
+        EndSharedDecode(job, JobState::Cancelled);
+        EndCompression(job); });
+
+    return job;
+}
+
+void MediaEncoder::StartAnalyses()
+{
+    // analyses decode the whole input, so they are held to the same limit as jobs
+    while (!pendingAnalyses.empty() && runningAnalyses < maxJobs)
+    {
+        ComplexityAnalyzer* analyzer = pendingAnalyses.front();
+        pendingAnalyses.pop_front();
+        runningAnalyses++;
+
+        analyzer->AnalyzeAsync();
+    }
+}
+
+void MediaEncoder::AllocateSizeBudgets(const QList<EncodeJob*>& batch, const QHash<EncodeJob*, double>& complexities)
+{
+    QList<EncodeJob*> analyzed;
+    QList<ComplexityAnalyzer::Demand> demands;
+
+    for (EncodeJob* job : batch)
+    {
+        analyzingJobs.removeOne(job);
+
+        // cancelled while its batch was analyzed, which waited on it; it ends once the batch is queued
+        if (job->state() == JobState::Cancelled)
+        {
+            QMetaObject::invokeMethod(job, [job]
+                                      { emit job->cancelled(); }, Qt::QueuedConnection);
+            continue;
+        }
+
+        job->setState(JobState::Queued);
+        pendingJobs.push_back(job);
+
+        // an input that could not be analyzed keeps its own target, out of the pool
+        if (!complexities.contains(job))
+            continue;
+
+        const EncoderOptions& options = job->options();
+        const double durationSeconds = options.inputMetadata.durationSeconds;
+        ComputedOptions audio;
+        if (options.audioCodec.has_value())
+            computeAudioBitrate(options, audio);
+
+        analyzed.append(job);
+        demands.append({
+            .targetSizeKbps = *options.sizeKbps,
+            .audioSizeKbps = audio.audioBitrateKbps.value_or(0) * durationSeconds,
+            .neededVideoSizeKbps = ComplexityAnalyzer::neededVideoBitrateKbps(options, complexities.value(job)) * durationSeconds,
+        });
+    }
+
+    const QList<double> sizes = ComplexityAnalyzer::distributeBudget(demands);
+    for (qsizetype i = 0; i < analyzed.size(); i++)
+        analyzed.at(i)->setSizeBudget(sizes.at(i));
+
+    ScheduleJobs();
+}
+
+void MediaEncoder::setThreadsPerJob(const int threadsCount)
+{
+    threadsPerJob = qMax(1, threadsCount);
+    maxJobs = qMax(1, QThread::idealThreadCount() / threadsPerJob);
+    QMetaObject::invokeMethod(this, &MediaEncoder::ScheduleJobs, Qt::QueuedConnection);
+}
+
+void MediaEncoder::setMaxConcurrentJobs(const int count)
+{
+    maxJobs = qMax(1, count);
+    threadsPerJob = qMax(1, QThread::idealThreadCount() / maxJobs);
+    QMetaObject::invokeMethod(this, &MediaEncoder::ScheduleJobs, Qt::QueuedConnection);
+}
+
+void MediaEncoder::setRemoteWorkers(const QStringList& hosts, const QString& commandTemplate)
+{
+    remoteWorkers = hosts;
+    remoteWorkers.removeAll({});
+    remoteWorkerCommand = commandTemplate;
+    QMetaObject::invokeMethod(this, &MediaEncoder::ScheduleJobs, Qt::QueuedConnection);
+}
+
+void MediaEncoder::setWorkerCapabilities(const QString& host, const WorkerCapabilities& capabilities)
+{
+    workerCapabilities.insert(host, capabilities);
+    QMetaObject::invokeMethod(this, &MediaEncoder::ScheduleJobs, Qt::QueuedConnection);
+}
+
+bool MediaEncoder::Cancel(const int jobId)
+{
+    // the outputs of a shared decode are written by the same process, so they are cancelled together
+    EncodeJob* job = carrierOf(jobs.value(jobId));
+    if (job == nullptr || job->state() == JobState::Cancelled || job->isPublishing())
+        return false;
+
+    DiscardParts(job);
+
+    if (const auto it = std::find(pendingJobs.begin(), pendingJobs.end(), job); it != pendingJobs.end())
+        pendingJobs.erase(it);
+
+    if (auto* analyzer = job->findChild<ComplexityAnalyzer*>(Qt::FindDirectChildrenOnly))
+        analyzer->Abort();
+
+    job->Cancel();
+
+    // a job with no process to wait on ends right away, unless its batch still waits on its analysis
+    if (!job->isRunning() && !analyzingJobs.contains(job))
+    {
+        QMetaObject::invokeMethod(job, [job]
+                                  { emit job->cancelled(); }, Qt::QueuedConnection);
+    }
+
+    return true;
+}
+
+bool MediaEncoder::Pause(const int jobId)
+{
+    EncodeJob* job = carrierOf(jobs.value(jobId));
+    if (job == nullptr || job->state() == JobState::Paused || job->state() == JobState::Cancelled)
+        return false;
+
+    for (EncodeJob* part : partsOf(job) + sharedDecodes.value(job))
+        part->Pause();
+
+    job->Pause();
+    return true;
+}
+
+bool MediaEncoder::Resume(const int jobId)
+{
+    EncodeJob* job = carrierOf(jobs.value(jobId));
+    if (job == nullptr || job->state() != JobState::Paused)
+        return false;
+
+    for (EncodeJob* part : partsOf(job) + sharedDecodes.value(job))
+        part->Resume();
+
+    job->Resume();
+
+    // the job, or its parts, may have been held in the queue
+    QMetaObject::invokeMethod(this, &MediaEncoder::ScheduleJobs, Qt::QueuedConnection);
+    return true;
+}
+
+optional<JobState> MediaEncoder::jobState(const int jobId) const
+{
+    const EncodeJob* job = jobs.value(jobId);
+    return job != nullptr ? optional(job->state()) : std::nullopt;
+}
+
+optional<EncoderOptions> MediaEncoder::jobOptions(const int jobId) const
+{
+    const EncodeJob* job = jobs.value(jobId);
+    return job != nullptr ? optional(job->options()) : std::nullopt;
+}
+
+void MediaEncoder::ScheduleJobs()
+{
+    // paused jobs keep their place, and are passed over until resumed
+    const auto isStartable = [](const EncodeJob* job)
+    { return job->state() != JobState::Paused; };
+
+    // starting a job may queue its parts ahead of the others, so the queue is searched again every time
+    for (auto it = std::find_if(pendingJobs.begin(), pendingJobs.end(), isStartable); it != pendingJobs.end();
+         it = std::find_if(pendingJobs.begin(), pendingJobs.end(), isStartable))
+    {
+        EncodeJob* job = *it;
+
+        if (const QString host = job->allowsRemote() ? remoteWorkerFor(job) : ""; !host.isEmpty())
+        {
+            pendingJobs.erase(it);
+            remoteJobs.insert(job, host);
+            job->setRemoteCommand(QProcess::splitCommand(remoteWorkerCommand.arg(host)));
+
+            StartCompression(job);
+            continue;
+        }
+
+        // jobs start in order, so one waiting for cores holds back the ones behind it
+        const QList<int> cores = coresFor(job);
+        if (runningJobs.size() >= maxJobs || cores.isEmpty())
+            break;
+
+        pendingJobs.erase(it);
+        runningJobs.append(job);
+
+        for (const int core : cores)
+            freeCores.removeOne(core);
+        reservedCores.insert(job, cores);
+        job->setAssignedCores(cores);
+
+        StartCompression(job);
+    }
+}
+
+QList<int> MediaEncoder::coresFor(const EncodeJob* job) const
+{
+    const ResourceLimits& limits = job->options().resources;
+    const qsizetype allowedCount = limits.allowedCores.isEmpty() ? QThread::idealThreadCount() : limits.allowedCores.size();
+    const qsizetype neededCount = qBound(qsizetype(1), qsizetype(limits.threadsCount.value_or(threadsPerJob)), allowedCount);
+
+    QList<int> cores;
+    for (const int core : freeCores)
+    {
+        if (limits.allowedCores.isEmpty() || limits.allowedCores.contains(core))
+            cores.append(core);
+    }
+
+    // with nothing running every allowed core is free, so a job always fits an idle machine
+    return cores.size() >= neededCount ? cores.first(neededCount) : QList<int>();
+}
+
+void MediaEncoder::ReleaseCores(EncodeJob* job)
+{
+    freeCores.append(reservedCores.take(job));
+    std::sort(freeCores.begin(), freeCores.end());
+}
+
+QString MediaEncoder::remoteWorkerFor(const EncodeJob* job) const
+{
+    const QList<QString> busyWorkers = remoteJobs.values();
+    QString bestHost;
+    double bestScore = 0;
+
+    for (const QString& host : remoteWorkers)
+    {
+        const auto capabilities = workerCapabilities.constFind(host);
+        const bool isAdvertised = capabilities != workerCapabilities.cend();
+        const int slotsCount = isAdvertised ? capabilities->slotsCount : 1;
+        const qsizetype busyCount = busyWorkers.count(host);
+
+        if (busyCount >= slotsCount || (isAdvertised && !capabilities->supports(job->options())))
+            continue;
+
+        // the emptiest worker goes first, so that jobs spread over the farm rather than fill its first hosts
+        double score = 1 + static_cast<double>(slotsCount - busyCount) / slotsCount;
+
+        // workers with hardware are kept for the jobs it encodes, which no other worker can take
+        if (isAdvertised && !capabilities->hardwareDevices.isEmpty() && !capabilities->accelerates(job->options()))
+            score -= 1;
+
+        if (score > bestScore)
+        {
+            bestHost = host;
+            bestScore = score;
+        }
+    }
+
+    return bestHost;
+}
+
+bool MediaEncoder::runsRemotely(const EncoderOptions& options)
+{
+    // both passes read the statistics file, which one worker writes where the other cannot read it, as do those of a palette
+    return !options.chunked && !options.smartCut && !options.resumable && !options.targetQuality.has_value() && !options.ladder.has_value()
+        && !options.twoPass && !(options.videoCodec.has_value() && AnimatedImage::usesPalette(*options.videoCodec));
+}
+
+void MediaEncoder::StartCompression(EncodeJob* job)
+{
+    if (!job->isPrepared())
+    {
+        if (job->options().targetQuality.has_value() && !job->qualityLevel().has_value())
+        {
+            // a source encoded before with the same options already had its level searched
+            if (const optional<int> level = qualityLevels->levelFor(job->options()); level.has_value())
+            {
+                job->setQualityLevel(*level);
+            }
+            else
+            {
+                StartQualitySearch(job);
+                return;
+            }
+        }
+
+        if (reusesResults && results->isEnabled() && ReuseResult(job))
+            return;
+
+        // a copied video is not encoded, so there is nothing to split
+        // a smart cut is split to copy most of the video, however few slots there are
+        const bool isSmartCut = job->allowsChunking() && cutsSmartly(job->options());
+        if (isSmartCut || (job->allowsChunking() && maxJobs + remoteWorkers.size() >= 2 && !ComputeOptions(job).copiesVideo))
+        {
+            StartChunkedCompression(job);
+            return;
+        }
+
+        if (job->options().resumable)
+        {
+            StartResumableCompression(job);
+            return;
+        }
+
+        if (!PrepareCompression(job))
+            return;
+    }
+
+    job->Start();
+}
+
+bool MediaEncoder::PrepareCompression(EncodeJob* job)
+{
+    if (sharedDecodes.contains(job))
+        return PrepareSharedDecode(job);
+
+    const EncoderOptions& options = job->options();
+    const ComputedOptions computed = ComputeOptions(job);
+
+    emit jobStarted(job->id(), computed);
+
+    const auto maybeOutputPath = ResolveOutputPath(options);
+    if (std::holds_alternative<Message>(maybeOutputPath))
+    {
+        emit job->failed(std::get<Message>(maybeOutputPath).message);
+        return false;
+    }
+
+    // a ladder is a folder of segments, which would be moved from staging file by file; it is written in place
+    if (options.ladder.has_value())
+    {
+        const QString& playlistPath = std::get<QString>(maybeOutputPath);
+        QDir().mkpath(QFileInfo(playlistPath).absolutePath());
+
+        job->Prepare(computed, { BuildLadderCommand(options, computed, playlistPath) }, playlistPath);
+        return true;
+    }
+
+    const QString outputPath = StageOutput(job, std::get<QString>(maybeOutputPath));
+    // rewriting the file to move the index costs little on local storage, unlike on the destination
+    const bool isFastStart = outputPath != std::get<QString>(maybeOutputPath) && supportsFastStart(options.container);
+
+    // measured jobs need a process of their own, and remote ones run on another host
+    EncoderStrategy* strategy = isInProcessEncoding && !measuresResourceUsage && !remoteJobs.contains(job)
+                              ? DefaultEncoderStrategy::createFor(options, computed, job)
+                              : nullptr;
+
+    if (strategy != nullptr)
+    {
+        EncoderStrategy::Request request = BuildStrategyRequest(options, computed, outputPath);
+        request.fastStart = isFastStart;
+
+        job->Prepare(computed, {}, outputPath);
+        job->setStrategy(strategy, request);
+        return true;
+    }
+
+    job->Prepare(computed, BuildCommands(job, computed, outputPath, {}, StreamSelection::All, {}, isFastStart ? "-movflags +faststart" : ""), outputPath);
+
+    // an animated image still too large is encoded again smaller, from the palette of the first attempt
+    if (!computed.copiesVideo && options.videoCodec.has_value() && AnimatedImage::isAnimatedImage(*options.videoCodec)
+        && computed.targetSizeKbps.has_value())
+    {
+        QStringList fallbacks;
+        const qsizetype attemptsCount = AnimatedImage::planAttempts(options, computed.targetSizeKbps).size();
+        for (int i = 1; i < attemptsCount; i++)
+        {
+            ComputedOptions attempt = computed;
+            attempt.animatedImageAttempt = i;
+            fallbacks.append(BuildCommands(job, attempt, outputPath, {}, StreamSelection::All, {}, "").last());
+        }
+
+        job->setFallbacks(fallbacks, AnimatedImage::maxSizeBytes(*computed.targetSizeKbps));
+    }
+
+    return true;
+}
+
+bool MediaEncoder::PrepareSharedDecode(EncodeJob* carrier)
+{
+    QList<EncodeJob*> outputs = sharedDecodes.value(carrier);
+    outputs.prepend(carrier);
+
+    QList<ComputedOptions> computed;
+    QStringList outputPaths;
+    double longestSeconds = 0;
+
+    for (EncodeJob* job : outputs)
+    {
+        const EncoderOptions& options = job->options();
+        computed.append(ComputeOptions(job));
+        emit jobStarted(job->id(), computed.last());
+
+        const auto maybeOutputPath = ResolveOutputPath(options);
+        if (std::holds_alternative<Message>(maybeOutputPath))
+        {
+            // no output can be written without the others, as they come out of a single process
+            emit carrier->failed(std::get<Message>(maybeOutputPath).message);
+            return false;
+        }
+
+        outputPaths.append(std::get<QString>(maybeOutputPath));
+        longestSeconds = qMax(longestSeconds, options.inputMetadata.durationSeconds / options.speed.value_or(1));
+    }
+
+    for (qsizetype i = 1; i < outputs.size(); i++)
+    {
+        outputs.at(i)->Prepare(computed.at(i), {}, outputPaths.at(i));
+        outputs.at(i)->setState(JobState::Encoding);
+    }
+
+    // progress follows the longest output, which is the last to be done
+    carrier->setDurationSeconds(longestSeconds);
+    carrier->Prepare(computed.first(), { BuildSharedDecodeCommand(outputs, computed, outputPaths) }, outputPaths.first());
+    return true;
+}
+
+void MediaEncoder::EndSharedDecode(EncodeJob* carrier, const JobState outcome, const QString& error, const QString& errorDetails)
+{
+    // the other outputs end the way the process that wrote them did
+    for (EncodeJob* rider : sharedDecodes.take(carrier))
+    {
+        if (outcome == JobState::Done)
+        {
+            // the progress of the process only tells the size of the first output
+            const QFileInfo media(rider->outputPath());
+            if (media.exists())
+                emit rider->succeeded({ media.filePath(), media.size() });
+            else
+                emit rider->failed(tr("Could not open the compressed media."), rider->outputPath());
+        }
+        else if (outcome == JobState::Cancelled)
+        {
+            if (!rider->outputPath().isEmpty())
+                rider->RemoveOutput();
+
+            rider->Cancel();
+            emit rider->cancelled();
+        }
+        else
+        {
+            // what the process wrote before failing is cut short
+            if (!rider->outputPath().isEmpty())
+                rider->RemoveOutput();
+
+            emit rider->failed(error, errorDetails);
+        }
+    }
+}
+
+EncodeJob* MediaEncoder::carrierOf(EncodeJob* job) const
+{
+    for (auto it = sharedDecodes.cbegin(); it != sharedDecodes.cend(); ++it)
+    {
+        if (it.value().contains(job))
+            return it.key();
+    }
+
+    return job;
+}
+
+bool MediaEncoder::ReuseResult(EncodeJob* job)
+{
+    const EncoderOptions& options = job->options();
+
+    // a ladder is a folder, and the outputs of a shared decode come from the process of another job
+    if (options.ladder.has_value() || sharedDecodes.contains(job))
+        return false;
+
+    // errors are reported once the job is prepared for encoding
+    const auto maybeOutputPath = ResolveOutputPath(options);
+    if (std::holds_alternative<Message>(maybeOutputPath))
+        return false;
+
+    const QString& outputPath = std::get<QString>(maybeOutputPath);
+    const ComputedOptions computed = ComputeOptions(job);
+    job->setResultKey(ResultCache::keyFor(options.inputPath, resultParametersOf(job, computed)));
+
+    // ffmpeg writes through an existing file, which may be a link to a result this encode is about to differ from
+    if (QFileInfo(outputPath).canonicalFilePath() != QFileInfo(options.inputPath).canonicalFilePath())
+        ResultCache::Detach(outputPath);
+
+    const optional<QString> result = results->lookup(job->resultKey());
+    if (!result.has_value())
+        return false;
+
+    emit jobStarted(job->id(), computed);
+    job->Prepare(computed, {}, outputPath);
+    job->setState(JobState::Encoding);
+    job->ReuseAsync(*result);
+    return true;
+}
+
+QString MediaEncoder::resultParametersOf(const EncodeJob* job, const ComputedOptions& computed) const
+{
+    const EncoderOptions& options = job->options();
+
+    // the bitrate drifts as the size calibration learns, while the size it was computed for stays
+    ComputedOptions canonical = computed;
+    canonical.videoBitrateKbps.reset();
+    canonical.requestedSizeKbps.reset();
+
+    // the thread count only changes how fast the encode runs
+    static const QRegularExpression threadsParam(R"(-threads \d+)");
+    const QString baseParams = BuildBaseParams(options, canonical).remove(threadsParam);
+
+    return QStringList {
+        baseParams,
+        BuildVideoFilterParams(options, canonical),
+        BuildAudioFilterParams(options, canonical),
+        options.customArguments.value_or(""),
+        computed.targetSizeKbps.has_value() ? "size=" + QString::number(*computed.targetSizeKbps) : "",
+        options.twoPass ? "twopass" : "",
+        options.tracks.has_value() ? options.tracks->params(true, true) : "",
+        options.trimStartSeconds.has_value() ? "from=" + QString::number(*options.trimStartSeconds, 'f', 6) : "",
+        options.trimEndSeconds.has_value() ? "to=" + QString::number(*options.trimEndSeconds, 'f', 6) : "",
+        // a smart cut keeps the input's own frames in its middle
+        options.smartCut ? "smartcut" : "",
+        options.container.extensions.value(0),
+    }
+        .join('|');
+}
+
+void MediaEncoder::StartChunkedCompression(EncodeJob* job)
+{
+    // the job only coordinates its parts, which take the slots
+    runningJobs.removeOne(job);
+    ReleaseCores(job);
+    coordinatingJobs.append(job);
+    job->setState(JobState::Probing);
+
+    auto* chunk = new ChunkedEncode(job->options(), job);
+
+    connect(chunk, &ChunkedEncode::planned, this, [this, job, chunk](const QList<ChunkedEncode::Segment>& segments)
+            { EnqueueSegments(job, chunk, segments); });
+
+    if (cutsSmartly(job->options()))
+        chunk->PlanSmartCutAsync();
+    else
+        chunk->PlanAsync(maxJobs + remoteWorkers.size());
+}
+
+void MediaEncoder::StartResumableCompression(EncodeJob* job)
+{
+    // the job only coordinates the run writing its segments, which takes the slot
+    runningJobs.removeOne(job);
+    ReleaseCores(job);
+    coordinatingJobs.append(job);
+
+    const EncoderOptions& options = job->options();
+    ComputedOptions computed = ComputeOptions(job);
+
+    const auto maybeOutputPath = ResolveOutputPath(options);
+    if (std::holds_alternative<Message>(maybeOutputPath))
+    {
+        emit jobStarted(job->id(), computed);
+        emit job->failed(std::get<Message>(maybeOutputPath).message);
+        return;
+    }
+
+    const QString outputPath = std::get<QString>(maybeOutputPath);
+    auto* resume = new ResumableEncode(outputPath, resumeFingerprintOf(job, computed), job);
+    resume->Load();
+
+    // the segments already written were encoded at the bitrate of the first run, which the calibration has moved since
+    if (resume->videoBitrateKbps().has_value() && computed.videoBitrateKbps.has_value())
+    {
+        computed.videoBitrateKbps = resume->videoBitrateKbps();
+        computed.requestedSizeKbps.reset();
+    }
+    else
+    {
+        resume->setVideoBitrateKbps(computed.videoBitrateKbps);
+    }
+
+    emit jobStarted(job->id(), computed);
+    job->Prepare(computed, {}, outputPath);
+    job->setState(JobState::Encoding);
+
+    // checkpoints are only worth keeping until the output is written
+    connect(job, &EncodeJob::succeeded, resume, &ResumableEncode::Discard);
+
+    // interrupted while concatenating, so every segment is already there
+    if (resume->isComplete())
+    {
+        StitchSegments(job, resume->segmentPaths(), {});
+        return;
+    }
+
+    if (!resume->BeginRun())
+    {
+        emit job->failed(tr("Could not write the manifest of the resumable encode."), ResumableEncode::directoryFor(outputPath));
+        return;
+    }
+
+    const double speedFactor = options.speed.value_or(1);
+    const double outputSeconds = options.inputMetadata.durationSeconds / speedFactor;
+    const double resumeSeconds = resume->resumeSeconds();
+    const double encodingPercent = 100 - ChunkedEncode::stitchingPercent;
+    const InputRange range = resumeSeconds > 0 ? InputRange { resumeSeconds * speedFactor, {} } : InputRange {};
+
+    auto* part = new EncodeJob(nextJobId++, options, this);
+    part->disableChunking();
+    part->setDurationSeconds(qMax(0.0, outputSeconds - resumeSeconds));
+    part->setProgressRange(outputSeconds > 0 ? qMin(resumeSeconds / outputSeconds, 1.0) * encodingPercent : 0, encodingPercent);
+
+    // ffmpeg creates the list as it starts, and only closes the last segment once it is done
+    part->Prepare(computed, BuildCommands(part, computed, resume->segmentPattern(), range, StreamSelection::All, "segment", resume->muxerParams(resume->nextSegmentNumber(), options.videoCodec.has_value())), resume->listPath());
+    resume->setPart(part);
+
+    connect(part, &EncodeJob::progressUpdate, this, [this, job, resume](const EncodingProgress& progress)
+            {
+        resume->Checkpoint();
+        ReportProgress(job->id(), progress); });
+    connect(part, &EncodeJob::succeeded, this, [this, job, part, resume]
+            {
+        EndCompression(part);
+        resume->Complete();
+        StitchSegments(job, resume->segmentPaths(), {}); });
+    connect(part, &EncodeJob::failed, this, [this, job, part, resume](const QString& error, const QString& errorDetails)
+            {
+        // the segments it closed stay, for the next start of the job to resume from
+        resume->Checkpoint();
+        EndCompression(part);
+        emit job->failed(error, errorDetails); });
+
+    // the scheduler searches the queue again, so the run starts in the slot the job just left
+    pendingJobs.push_front(part);
 }
 
-MediaEncoder::~MediaEncoder()
+QString MediaEncoder::resumeFingerprintOf(const EncodeJob* job, const ComputedOptions& computed) const
 {
-    delete ffmpeg;
-    delete ffprobe;
+    const EncoderOptions& options = job->options();
+    const QFileInfo input(options.inputPath);
+
+    // the budget shared with a batch depends on what else was queued, while the bitrate is kept by the manifest
+    ComputedOptions canonical = computed;
+    canonical.targetSizeKbps = options.sizeKbps;
+
+    const QString key = QString("%1|%2|%3").arg(resultParametersOf(job, canonical), QString::number(input.size()), QString::number(input.lastModified().toMSecsSinceEpoch()));
+
+    return QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha256).toHex();
 }
 
-void MediaEncoder::Encode(const EncoderOptions& options)
+void MediaEncoder::StartQualitySearch(EncodeJob* job)
 {
-    const Metadata metadata = options.inputMetadata;
+    // the job only coordinates its samples, which take the slots
+    runningJobs.removeOne(job);
+    ReleaseCores(job);
+    coordinatingJobs.append(job);
+    job->setState(JobState::Probing);
 
-    ComputedOptions computed;
+    const EncoderOptions& options = job->options();
+    const QualityScale scale = *QualityScale::forEncoder(options.videoCodec->libraryName);
+    const qsizetype samplesCount = PreviewEncode::planSamples(options.inputMetadata.durationSeconds, QualitySearch::samplesCount,
+                                                              QualitySearch::sampleSeconds).size();
 
-    if (options.audioCodec.has_value())
+    // rounds try as many levels as there are slots to encode their samples at once
+    auto* search = new QualitySearch(options, scale, static_cast<int>(maxJobs / samplesCount), job);
+
+    connect(search, &QualitySearch::roundCompleted, this, [this, job, search]
+            {
+        EnqueueQualityProbes(job, search);
+        ScheduleJobs(); });
+    connect(search, &QualitySearch::failed, this, [this, job, search](const QString& error, const QString& errorDetails)
+            {
+        for (EncodeJob* part : search->parts())
+            DiscardJob(part);
+
+        emit job->failed(error, errorDetails); });
+
+    EnqueueQualityProbes(job, search);
+}
+
+void MediaEncoder::EnqueueQualityProbes(EncodeJob* job, QualitySearch* search)
+{
+    const EncoderOptions& options = job->options();
+    const QList<int> levels = search->nextLevels();
+
+    if (levels.isEmpty())
     {
-        if (!computeAudioBitrate(options, computed))
-            return;
+        qualityLevels->Record(options, search->result());
+        job->setQualityLevel(search->result());
+        search->deleteLater();
+
+        // back ahead of the queue, to be encoded at the level found
+        coordinatingJobs.removeOne(job);
+        job->setState(JobState::Queued);
+        pendingJobs.push_front(job);
+        return;
     }
 
-    if (options.videoCodec.has_value() && options.sizeKbps.has_value())
+    const double speedFactor = options.speed.value_or(1);
+    QList<EncodeJob*> parts;
+
+    for (const int level : levels)
     {
-        ComputeVideoBitrate(options, computed, metadata);
+        for (qsizetype i = 0; i < search->samples().size(); i++)
+        {
+            const PreviewEncode::Sample& sample = search->samples().at(i);
+            const QString path = QDir(search->scratchPath()).filePath(QString("level%1_sample%2.mkv").arg(level).arg(i));
+
+            auto* part = new EncodeJob(nextJobId++, options, this);
+            part->disableChunking();
+            part->setScratchBaseDir(search->scratchPath());
+            part->setDurationSeconds(sample.durationSeconds / speedFactor);
+            part->setQualityLevel(level);
+            if (job->state() == JobState::Paused)
+                part->Pause();
+
+            const ComputedOptions computed = ComputeOptions(part);
+            part->Prepare(computed, BuildCommands(part, computed, path, { sample.startSeconds, sample.durationSeconds }, StreamSelection::VideoOnly, "matroska"), path);
+
+            connect(part, &EncodeJob::succeeded, this, [this, part]
+                    { EndCompression(part); });
+            connect(part, &EncodeJob::failed, this, [this, part]
+                    { EndCompression(part); });
+
+            search->AddProbe(level, part, sample);
+            parts.append(part);
+        }
     }
 
-    StartCompression(options, computed, metadata);
+    pendingJobs.insert(pendingJobs.begin(), parts.begin(), parts.end());
 }
 
-void MediaEncoder::StartCompression(const EncoderOptions& options, const ComputedOptions& computed, const Metadata& metadata)
+void MediaEncoder::EnqueueSegments(EncodeJob* job, ChunkedEncode* chunk, const QList<ChunkedEncode::Segment>& segments)
 {
-    emit encodingStarted(computed.videoBitrateKbps.value_or(0), computed.audioBitrateKbps.value_or(0));
+    if (segments.isEmpty())
+    {
+        // not worth splitting, so it goes back in line to be encoded as a whole
+        coordinatingJobs.removeOne(job);
+        job->disableChunking();
+        job->setState(JobState::Queued);
+        pendingJobs.push_front(job);
+        ScheduleJobs();
+        return;
+    }
+
+    const EncoderOptions& options = job->options();
+    const ComputedOptions computed = ComputeOptions(job);
+
+    emit jobStarted(job->id(), computed);
+
+    const auto maybeOutputPath = ResolveOutputPath(options);
+    if (std::holds_alternative<Message>(maybeOutputPath))
+    {
+        emit job->failed(std::get<Message>(maybeOutputPath).message);
+        return;
+    }
+
+    const QString outputPath = std::get<QString>(maybeOutputPath);
+    job->Prepare(computed, {}, outputPath);
+    job->setState(JobState::Encoding);
+
+    // remote workers write their parts next to the output, where they can reach them
+    if (!remoteWorkers.isEmpty())
+        job->setScratchBaseDir(QFileInfo(outputPath).absolutePath());
+
+    const QDir scratchDir(job->scratchPath());
+    const double speedFactor = options.speed.value_or(1);
+    const double inputSeconds = options.inputMetadata.durationSeconds;
+    QList<EncodeJob*> parts;
+    QStringList segmentPaths;
+    QString audioPath;
+
+    const auto createPart = [&](const QString& path, const double outputSeconds, const double weightSeconds, const InputRange& range, const StreamSelection streams, const QString& formatName, const ComputedOptions& partComputed)
+    {
+        auto* part = new EncodeJob(nextJobId++, options, this);
+        part->disableChunking();
+        part->setRemoteAllowed(true);
+        part->setScratchBaseDir(scratchDir.path());
+        part->setDurationSeconds(outputSeconds);
+        if (job->state() == JobState::Paused)
+            part->Pause();
+        part->Prepare(partComputed, BuildCommands(part, partComputed, path, range, streams, formatName), path);
+
+        // connected before the chunk, so that the slot is free by the time it reacts
+        connect(part, &EncodeJob::succeeded, this, [this, part]
+                { EndCompression(part); });
+        connect(part, &EncodeJob::failed, this, [this, part]
+                { EndCompression(part); });
+
+        chunk->AddPart(part, weightSeconds);
+        parts.append(part);
+    };
+
+    for (qsizetype i = 0; i < segments.size(); i++)
+    {
+        const ChunkedEncode::Segment& segment = segments.at(i);
+        const double segmentSeconds = segment.durationSeconds.value_or(inputSeconds - segment.startSeconds);
+        const QString path = scratchDir.filePath(QString("segment_%1.%2").arg(i, 3, 10, QChar('0')).arg(QFileInfo(outputPath).suffix()));
+
+        // the copied middle of a smart cut is written as it is, between ends encoded alike
+        ComputedOptions segmentComputed = computed;
+        segmentComputed.copiesVideo = segment.copiesVideo;
+        const double weightSeconds = segment.copiesVideo ? segmentSeconds * ChunkedEncode::copyWeight : segmentSeconds;
+
+        // parts keep the same per-second bitrate, so each gets the share of the size matching its duration
+        createPart(path, segmentSeconds / speedFactor, weightSeconds, { segment.startSeconds, segment.durationSeconds }, StreamSelection::VideoOnly, {}, segmentComputed);
+        segmentPaths.append(path);
+    }
 
-    QString baseParams = BuildBaseParams(options, computed);
-    QString videoFiltersParams = BuildVideoFilterParams(options, computed);
-    QString audioFiltersParams = BuildAudioFilterParams(options, computed);
+    if (options.audioCodec.has_value())
+    {
+        audioPath = scratchDir.filePath("audio.mka");
+
+        // audio is encoded in one piece, as cutting it would leave gaps at the seams
+        createPart(audioPath, inputSeconds / speedFactor, inputSeconds * ChunkedEncode::audioWeight, {}, StreamSelection::AudioOnly, "matroska", computed);
+    }
+
+    connect(chunk, &ChunkedEncode::progressUpdate, this, [this, job](const EncodingProgress& progress)
+            { ReportProgress(job->id(), progress); });
+    connect(chunk, &ChunkedEncode::partsSucceeded, this, [this, job, segmentPaths, audioPath]
+            { StitchSegments(job, segmentPaths, audioPath); });
+    connect(chunk, &ChunkedEncode::partFailed, this, [this, job, chunk](const QString& error, const QString& errorDetails)
+            { FailChunkedCompression(job, chunk, error, errorDetails); });
+
+    // parts go ahead of the queue, so that the job finishes as soon as possible
+    pendingJobs.insert(pendingJobs.begin(), parts.begin(), parts.end());
+    ScheduleJobs();
+}
+
+void MediaEncoder::StitchSegments(EncodeJob* job, const QStringList& segmentPaths, const QString& audioPath)
+{
+    const QString listPath = QDir(job->scratchPath()).filePath("segments.txt");
+    QFile list(listPath);
 
-    const auto maybeFileExtension = extensionForContainer(options.container);
-    if (std::holds_alternative<Message>(maybeFileExtension))
+    if (!list.open(QIODevice::WriteOnly | QIODevice::Text))
     {
-        emit encodingFailed(std::get<Message>(maybeFileExtension).message);
+        emit job->failed(tr("Could not write the list of segments."), list.errorString());
         return;
     }
 
-    const QString fileExtension = std::get<QString>(maybeFileExtension);
-    QString outputPath = options.outputPath + "." + fileExtension;
+    for (QString path : segmentPaths)
+        list.write(QString("file '%1'\n").arg(path.replace("'", R"('\'')")).toUtf8());
 
-    const QString command = QString(R"(ffmpeg -i "%2" %3 %4 %5 %6 "%7" -y)")
-                                .arg(options.inputPath, baseParams, videoFiltersParams, audioFiltersParams, *options.customArguments, outputPath);
+    list.close();
 
-    *processUpdateConnection = connect(ffmpeg, &QProcess::readyRead, [metadata, this]()
-                                       { UpdateProgress(metadata.durationSeconds); });
+    const QString outputPath = StageOutput(job, job->outputPath());
+    const bool isFastStart = outputPath != job->outputPath() && supportsFastStart(job->options().container);
 
-    *processFinishedConnection = connect(ffmpeg, &QProcess::finished, [=, this](const int exitCode)
-                                         { EndCompression(options, computed, outputPath, command, exitCode); });
+    QStringList params {
+        "ffmpeg",
+        progressParams,
+        QString(R"(-f concat -safe 0 -i "%1")").arg(listPath),
+        audioPath.isEmpty() ? "" : QString(R"(-i "%1" -map 0:v -map 1:a)").arg(audioPath),
+        "-c copy",
+        isFastStart ? "-movflags +faststart" : "",
+        QString("-f %1").arg(job->options().container.formatName),
+        QString(R"("%1" -y)").arg(outputPath),
+    };
+    params.removeAll({});
 
-    ffmpeg->startCommand(command);
+    job->setProgressRange(100 - ChunkedEncode::stitchingPercent, 100);
+    job->Prepare(job->computed(), { params.join(" ") }, outputPath);
+    job->Start();
 }
 
-void MediaEncoder::UpdateProgress(double mediaDuration)
+void MediaEncoder::FailChunkedCompression(EncodeJob* job, ChunkedEncode* chunk, const QString& error, const QString& errorDetails)
 {
-    QString line = QString(ffmpeg->readAll());
-    QRegularExpression regex("time=([0-9][0-9]:[0-9][0-9]:[0-9][0-9].[0-9][0-9])");
-    QRegularExpressionMatch match = regex.match(line);
+    for (EncodeJob* part : chunk->parts())
+        DiscardJob(part);
 
-    output += line;
+    emit job->failed(error, errorDetails);
+}
 
-    if (!match.hasMatch())
-        return;
+void MediaEncoder::EndCompression(EncodeJob* job)
+{
+    job->disconnect(this);
+    jobs.remove(job->id());
+    runningJobs.removeOne(job);
+    ReleaseCores(job);
+    remoteJobs.remove(job);
+    coordinatingJobs.removeOne(job);
+    publishingJobs.removeOne(job);
+    analyzingJobs.removeOne(job);
+    job->deleteLater();
+
+    ScheduleJobs();
 
-    QTime timestamp = QTime::fromString(match.captured(1));
-    int currentDuration = timestamp.second() + timestamp.minute() * 60 + timestamp.hour() * 3600;
-    int progressPercent = currentDuration * 100 / mediaDuration;
+    if (isIdle())
+        emit queueFinished();
+}
+
+void MediaEncoder::DiscardJob(EncodeJob* job)
+{
+    job->disconnect();
+
+    if (const auto it = std::find(pendingJobs.begin(), pendingJobs.end(), job); it != pendingJobs.end())
+        pendingJobs.erase(it);
 
-    emit encodingProgressUpdate(progressPercent);
+    runningJobs.removeOne(job);
+    ReleaseCores(job);
+    remoteJobs.remove(job);
+
+    // deleting the job also kills its process
+    job->deleteLater();
 }
 
-void MediaEncoder::EndCompression(const EncoderOptions& options, const ComputedOptions& computed, QString outputPath, QString command, int exitCode)
+void MediaEncoder::DiscardParts(EncodeJob* job)
 {
-    if (exitCode != 0)
+    for (EncodeJob* part : partsOf(job))
+        DiscardJob(part);
+
+    // the coordinator goes too, so that nothing it still has running queues more parts
+    if (auto* chunk = job->findChild<ChunkedEncode*>(Qt::FindDirectChildrenOnly))
+    {
+        chunk->disconnect(this);
+        chunk->deleteLater();
+    }
+    if (auto* search = job->findChild<QualitySearch*>(Qt::FindDirectChildrenOnly))
     {
-        disconnect(*processUpdateConnection);
-        disconnect(*processFinishedConnection);
+        search->disconnect(this);
+        search->deleteLater();
+    }
 
-        emit encodingFailed(parseOutput(), command + "\n\n" + output);
-        output.clear();
-        return;
+    // a cancelled encode is not resumed, so its checkpoints go along with the job
+    if (auto* resume = job->findChild<ResumableEncode*>(Qt::FindDirectChildrenOnly))
+        resume->Discard();
+}
+
+QList<EncodeJob*> MediaEncoder::partsOf(const EncodeJob* job)
+{
+    // parts are tracked by the coordinator of their job, which is a child of it
+    if (const auto* chunk = job->findChild<ChunkedEncode*>(Qt::FindDirectChildrenOnly))
+        return chunk->parts();
+    if (const auto* search = job->findChild<QualitySearch*>(Qt::FindDirectChildrenOnly))
+        return search->parts();
+    if (const auto* resume = job->findChild<ResumableEncode*>(Qt::FindDirectChildrenOnly))
+        return resume->parts();
+
+    return {};
+}
+
+MediaEncoder::ComputedOptions MediaEncoder::ComputeOptions(const EncodeJob* job)
+{
+    const EncoderOptions& options = job->options();
+    ComputedOptions computed;
+
+    if (options.audioCodec.has_value())
+        computeAudioBitrate(options, computed);
+
+    const StreamCopyPlanner::Plan plan = StreamCopyPlanner::plan(options, computed.audioBitrateKbps);
+    computed.qualityLevel = job->qualityLevel();
+    computed.copiesVideo = plan.copiesVideo;
+    computed.copiesAudio = plan.copiesAudio;
+
+    // the plan compares the first stream of each type, which has to be the only one the codec of its type applies to
+    if (options.tracks.has_value())
+    {
+        computed.copiesVideo = computed.copiesVideo && (options.videoCodec->libraryName == "copy" || options.tracks->encodesFirstOnly("video"));
+        computed.copiesAudio = computed.copiesAudio && (options.audioCodec->libraryName == "copy" || options.tracks->encodesFirstOnly("audio"));
     }
 
-    QFile media(outputPath);
-    if (!media.open(QIODevice::ReadOnly))
+    // a copied stream keeps its own bitrate, which the video budget has to leave room for
+    if (computed.copiesAudio)
+        computed.audioBitrateKbps = options.inputMetadata.audioBitrateKbps;
+
+    // an animated image meets its size with its frame rate and width, having no bitrate to aim at
+    if (options.videoCodec.has_value() && options.sizeKbps.has_value() && !computed.copiesVideo && AnimatedImage::isAnimatedImage(*options.videoCodec))
+        computed.targetSizeKbps = job->sizeBudgetKbps().value_or(*options.sizeKbps);
+    else if (options.videoCodec.has_value() && options.sizeKbps.has_value() && !computed.copiesVideo)
+        ComputeVideoBitrate(options, computed, options.inputMetadata, job->sizeBudgetKbps().value_or(*options.sizeKbps));
+
+    return computed;
+}
+
+std::variant<QString, Message> MediaEncoder::ResolveOutputPath(const EncoderOptions& options) const
+{
+    if (options.ladder.has_value())
+        return options.ladder->playlistPath(options.outputPath + "." + options.ladder->extension());
+
+    if (options.container.extensions.isEmpty())
     {
-        disconnect(*processUpdateConnection);
-        disconnect(*processFinishedConnection);
-        emit encodingFailed("Could not open the compressed media.", media.errorString());
-        output.clear();
-        media.close();
-        return;
+        return Message(
+            Severity::Critical,
+            tr("Failed to query file extension for container"),
+            tr("FFmpeg did not return a file extension for container %1.")
+                .arg(options.container.formatName)
+        );
+    }
+
+    return options.outputPath + "." + options.container.extensions.first();
+}
+
+QString MediaEncoder::StageOutput(EncodeJob* job, const QString& outputPath) const
+{
+    // remote workers write where the output goes, as they cannot reach the local folder
+    if (stagingDirectory.isEmpty() || remoteJobs.contains(job))
+        return outputPath;
+
+    QDir().mkpath(stagingDirectory);
+    job->setDestinationPath(outputPath);
+
+    // the extension is kept last, for ffmpeg to tell the format from it; the process id keeps instances apart
+    const QString stagedName = QString("sme-%1-%2-%3").arg(QCoreApplication::applicationPid()).arg(job->id()).arg(QFileInfo(outputPath).fileName());
+    return QDir(stagingDirectory).filePath(stagedName);
+}
+
+QStringList MediaEncoder::BuildCommands(EncodeJob* job, const ComputedOptions& computed, const QString& outputPath,
+                                        const InputRange& range, const StreamSelection streams, const QString& formatName,
+                                        const QString& muxerParams) const
+{
+    const EncoderOptions& options = job->options();
+    const bool hasVideo = streams != StreamSelection::AudioOnly;
+    const bool hasAudio = streams != StreamSelection::VideoOnly;
+
+    const QString inputParams = hasVideo && !computed.copiesVideo ? BuildInputParams(options) : "";
+    const QString input = QString(R"(%1 -i "%2")").arg(BuildRangeParams(options, range), options.inputPath).trimmed();
+    const bool isAnimatedImage = hasVideo && !computed.copiesVideo && options.videoCodec.has_value() && AnimatedImage::isAnimatedImage(*options.videoCodec);
+    const QString palettePath = isAnimatedImage && AnimatedImage::usesPalette(*options.videoCodec) ? QDir(job->scratchPath()).filePath("palette.png") : "";
+    const QString paletteInput = palettePath.isEmpty() ? "" : QString(R"(-i "%1")").arg(palettePath);
+    const QString baseParams = BuildBaseParams(options, computed);
+    const QString videoFiltersParams = hasVideo && !computed.copiesVideo ? BuildVideoFilterParams(options, computed) : "";
+    const QString audioFiltersParams = hasAudio && !computed.copiesAudio ? BuildAudioFilterParams(options, computed) : "";
+    const QString streamsParam = !hasAudio ? "-an" : !hasVideo ? "-vn" : "";
+    const QString tracksParams = options.tracks.has_value() ? options.tracks->params(hasVideo, hasAudio) : "";
+    const QString formatParam = formatName.isEmpty() ? "" : "-f " + formatName;
+    const QString customParams = options.customArguments.value_or("");
+
+    const auto joinParams = [](QStringList params)
+    {
+        params.removeAll({});
+        return params.join(" ");
+    };
+
+    const QString globalParams = BuildGlobalParams(options);
+
+    QStringList commands;
+    QString passParams;
+
+    // made once from every frame kept, at the rate and size of the first attempt, for every attempt to map to
+    if (!palettePath.isEmpty())
+    {
+        const AnimatedImage::Attempt firstAttempt = AnimatedImage::planAttempts(options, computed.targetSizeKbps).first();
+        commands.append(joinParams({ "ffmpeg", globalParams, inputParams, input, AnimatedImage::paletteParams(options, firstAttempt),
+                                     QString(R"(-an -f image2 -update 1 "%1" -y)").arg(palettePath) }));
+    }
+
+    if (hasVideo && !computed.copiesVideo && options.twoPass && supportsTwoPass(*options.videoCodec))
+    {
+        const QString passLogFile = QDir(job->scratchPath()).filePath("ffmpeg2pass");
+        passParams = QString(R"(-pass 2 -passlogfile "%1")").arg(passLogFile);
+
+        // the first pass only gathers statistics, so audio and output are discarded
+        commands.append(joinParams({ "ffmpeg", globalParams, inputParams, input, baseParams,
+                                     options.tracks.has_value() ? options.tracks->params(true, false) : "", videoFiltersParams, customParams,
+                                     QString(R"(-an -pass 1 -passlogfile "%1")").arg(passLogFile),
+                                     QString("-f null %1 -y").arg(QString(IS_WINDOWS ? "NUL" : "/dev/null")) }));
+    }
+
+    commands.append(joinParams({ "ffmpeg", globalParams, inputParams, input, paletteInput, baseParams, tracksParams, videoFiltersParams, audioFiltersParams,
+                                 passParams, streamsParam, formatParam, muxerParams, customParams, QString(R"("%1" -y)").arg(outputPath) }));
+
+    return commands;
+}
+
+QString MediaEncoder::BuildSharedDecodeCommand(const QList<EncodeJob*>& outputs, const QList<ComputedOptions>& computed,
+                                               const QStringList& outputPaths) const
+{
+    const EncoderOptions& lead = outputs.first()->options();
+    const bool hasVideo = !lead.inputMetadata.videoCodec.isEmpty();
+    const bool hasAudio = !lead.inputMetadata.audioCodec.isEmpty();
+
+    const auto joinParams = [](QStringList params)
+    {
+        params.removeAll({});
+        return params.join(" ");
+    };
+
+    // the input is decoded once for all outputs, so frames only stay on the GPU when every output can take them there
+    bool sharesAcceleration = true;
+    bool isOnDevice = true;
+    for (const EncodeJob* job : outputs)
+    {
+        const optional<const HardwareAcceleration>& acceleration = job->options().hardwareAcceleration;
+        sharesAcceleration &= acceleration.has_value() == lead.hardwareAcceleration.has_value()
+                           && (!acceleration.has_value() || acceleration->hwaccel == lead.hardwareAcceleration->hwaccel);
+        isOnDevice &= keepsFramesOnDevice(job->options());
+    }
+    isOnDevice &= sharesAcceleration;
+
+    QString inputParams;
+    if (isOnDevice)
+        inputParams = BuildInputParams(lead);
+    else if (sharesAcceleration && lead.hardwareAcceleration.has_value())
+        inputParams = QStringList(lead.hardwareAcceleration->deviceParams + QStringList { "-hwaccel", lead.hardwareAcceleration->hwaccel }).join(" ");
+
+    QStringList videoLabels;
+    QStringList audioLabels;
+    QStringList branches;
+    QStringList outputsParams;
+
+    for (qsizetype i = 0; i < outputs.size(); i++)
+    {
+        const EncoderOptions& options = outputs.at(i)->options();
+        const ComputedOptions& outputComputed = computed.at(i);
+        QStringList maps;
+
+        if (hasVideo && options.videoCodec.has_value() && outputComputed.copiesVideo)
+        {
+            maps.append("-map 0:v:0");
+        }
+        else if (hasVideo && options.videoCodec.has_value())
+        {
+            const QString label = QString("v%1").arg(i);
+            const QString filters = BuildVideoFilters(options, isOnDevice).join(',');
+
+            videoLabels.append(QString("[%1]").arg(label));
+            branches.append(QString("[%1]%2[%1out]").arg(label, filters.isEmpty() ? "null" : filters));
+            maps.append(QString("-map [%1out]").arg(label));
+        }
+
+        if (hasAudio && options.audioCodec.has_value() && outputComputed.copiesAudio)
+        {
+            maps.append("-map 0:a:0");
+        }
+        else if (hasAudio && options.audioCodec.has_value())
+        {
+            const QString label = QString("a%1").arg(i);
+            const QString filters = BuildAudioFilters(options).join(',');
+
+            audioLabels.append(QString("[%1]").arg(label));
+            branches.append(QString("[%1]%2[%1out]").arg(label, filters.isEmpty() ? "anull" : filters));
+            maps.append(QString("-map [%1out]").arg(label));
+        }
+
+        outputsParams.append(joinParams({ maps.join(" "), BuildBaseParams(options, outputComputed), options.customArguments.value_or(""),
+                                          QString(R"("%1" -y)").arg(outputPaths.at(i)) }));
+    }
+
+    QStringList graph;
+    if (!videoLabels.isEmpty())
+        graph.append(QString("[0:v:0]split=%1%2").arg(QString::number(videoLabels.size()), videoLabels.join("")));
+    if (!audioLabels.isEmpty())
+        graph.append(QString("[0:a:0]asplit=%1%2").arg(QString::number(audioLabels.size()), audioLabels.join("")));
+    graph.append(branches);
+
+    return joinParams({ "ffmpeg", BuildGlobalParams(lead), videoLabels.isEmpty() ? "" : inputParams,
+                        QString(R"(-i "%1")").arg(lead.inputPath),
+                        graph.isEmpty() ? "" : QString(R"(-filter_complex "%1")").arg(graph.join(';')),
+                        outputsParams.join(" ") });
+}
+
+QString MediaEncoder::BuildLadderCommand(const EncoderOptions& options, const ComputedOptions& computed, const QString& playlistPath) const
+{
+    const StreamingLadder& ladder = *options.ladder;
+    const QString directory = QFileInfo(playlistPath).absolutePath();
+    const bool hasAudio = options.audioCodec.has_value() && !options.inputMetadata.audioCodec.isEmpty();
+
+    const auto joinParams = [](QStringList params)
+    {
+        params.removeAll({});
+        return params.join(" ");
+    };
+
+    // every rendition is scaled, so frames only stay on the GPU when it has a scaler
+    const optional<const HardwareAcceleration>& acceleration = options.hardwareAcceleration;
+    const bool isOnDevice = acceleration.has_value() && !acceleration->outputFormat.isEmpty() && !acceleration->scaleFilter.isEmpty();
+    const QString scaler = isOnDevice ? acceleration->scaleFilter : "scale";
+
+    QString inputParams;
+    if (isOnDevice)
+        inputParams = QStringList(acceleration->deviceParams + QStringList { "-hwaccel", acceleration->hwaccel, "-hwaccel_output_format", acceleration->outputFormat }).join(" ");
+    else if (acceleration.has_value())
+        inputParams = QStringList(acceleration->deviceParams + QStringList { "-hwaccel", acceleration->hwaccel }).join(" ");
+
+    // retiming applies to all renditions alike, so it runs once ahead of the split
+    QStringList sharedFilters;
+    if (options.speed.has_value())
+        sharedFilters.append(QString("setpts=%1*PTS").arg(QString::number(1.0 / *options.speed)));
+    sharedFilters.append(QString("split=%1").arg(ladder.renditions.size()));
+
+    QStringList labels;
+    QStringList branches;
+    QStringList maps;
+    QStringList videoParams { "-c:v " + options.videoCodec->libraryName };
+
+    for (qsizetype i = 0; i < ladder.renditions.size(); i++)
+    {
+        const StreamingLadder::Rendition& rendition = ladder.renditions.at(i);
+        const QString label = QString("r%1").arg(i);
+        const QString stream = QString::number(i);
+
+        // the side left at 0 follows the aspect ratio, rounded to the even size most encoders need
+        QStringList filters { QString("%1=%2:%3").arg(scaler, rendition.width > 0 ? QString::number(rendition.width) : "-2",
+                                                      rendition.height > 0 ? QString::number(rendition.height) : "-2") };
+        if (options.aspectRatio.has_value())
+            filters.append(QString("setsar=%1/%2").arg(QString::number(options.aspectRatio->y()), QString::number(options.aspectRatio->x())));
+        else if (rendition.width > 0 && rendition.height > 0)
+            filters.append("setsar=1/1");
+        if (rendition.fps.has_value())
+            filters.append("fps=" + QString::number(*rendition.fps));
+
+        labels.append(QString("[%1]").arg(label));
+        branches.append(QString("[%1]%2[%1out]").arg(label, filters.join(',')));
+        maps.append(QString("-map [%1out]").arg(label));
+
+        // a bounded buffer keeps every segment close to the bitrate the playlist announces
+        const double bitrateKbps = rendition.videoBitrateKbps;
+        videoParams.append(QString("-b:v:%1 %2k -maxrate:v:%1 %3k -bufsize:v:%1 %4k")
+                               .arg(stream, QString::number(bitrateKbps), QString::number(qRound(bitrateKbps * maxrateFactor)),
+                                    QString::number(qRound(bitrateKbps * 2))));
+    }
+
+    videoParams.append(ladder.keyframeParams());
+
+    QStringList audioParams;
+    if (hasAudio)
+    {
+        const QStringList audioFilters = BuildAudioFilters(options);
+
+        maps.append("-map 0:a:0");
+        audioParams = QStringList {
+            computed.copiesAudio ? "-c:a copy" : "-c:a " + options.audioCodec->libraryName,
+            computed.audioBitrateKbps.has_value() && !computed.copiesAudio ? "-b:a " + QString::number(*computed.audioBitrateKbps) + "k" : "",
+            options.audioChannelsCount.has_value() && !computed.copiesAudio ? "-ac " + QString::number(*options.audioChannelsCount) : "",
+            audioFilters.isEmpty() || computed.copiesAudio ? "" : "-filter:a " + audioFilters.join(','),
+        };
     }
 
-    media.close();
-    disconnect(*processUpdateConnection);
-    disconnect(*processFinishedConnection);
-    emit encodingSucceeded(options, computed, media);
-    output.clear();
+    const QString graph = QString("[0:v:0]%1%2;%3").arg(sharedFilters.join(','), labels.join(""), branches.join(';'));
+    const QString threadsParam = options.resources.threadsCount.has_value() ? "-threads " + QString::number(*options.resources.threadsCount) : "";
+    const bool usesTransportStream = options.container.formatName == "mpegts";
+
+    return joinParams({ "ffmpeg", BuildGlobalParams(options), inputParams, BuildRangeParams(options, {}), QString(R"(-i "%1")").arg(options.inputPath),
+                        QString(R"(-filter_complex "%1")").arg(graph), maps.join(" "), joinParams(videoParams), joinParams(audioParams),
+                        threadsParam, ladder.muxerParams(directory, hasAudio, usesTransportStream), options.customArguments.value_or(""),
+                        QString(R"("%1" -y)").arg(ladder.muxerOutputPath(directory)) });
+}
+
+QString MediaEncoder::BuildRangeParams(const EncoderOptions& options, const InputRange& range)
+{
+    const double trimStart = options.trimStartSeconds.value_or(0);
+    const double startSeconds = trimStart + range.startSeconds.value_or(0);
+
+    optional<double> durationSeconds = range.durationSeconds;
+    if (!durationSeconds.has_value() && options.trimEndSeconds.has_value())
+        durationSeconds = *options.trimEndSeconds - startSeconds;
+
+    QStringList params;
+    if (range.startSeconds.has_value() || trimStart > 0)
+        params.append("-ss " + QString::number(startSeconds, 'f', 6));
+    if (durationSeconds.has_value())
+        params.append("-t " + QString::number(*durationSeconds, 'f', 6));
+
+    return params.join(" ");
+}
+
+EncoderStrategy::Request MediaEncoder::BuildStrategyRequest(const EncoderOptions& options, const ComputedOptions& computed,
+                                                             const QString& outputPath) const
+{
+    const optional<QualityScale> qualityScale = computed.qualityLevel.has_value() && options.videoCodec.has_value()
+                                              ? QualityScale::forEncoder(options.videoCodec->libraryName)
+                                              : std::nullopt;
+
+    return {
+        .inputPath = options.inputPath,
+        .outputPath = outputPath,
+        .formatName = options.container.formatName,
+        .videoEncoder = options.videoCodec.has_value() ? optional(options.videoCodec->libraryName) : std::nullopt,
+        .audioEncoder = options.audioCodec.has_value() ? optional(options.audioCodec->libraryName) : std::nullopt,
+        .videoBitrateKbps = qualityScale.has_value() ? std::nullopt : computed.videoBitrateKbps,
+        .audioBitrateKbps = computed.audioBitrateKbps,
+        .videoQualityParams = qualityScale.has_value() ? qualityScale->params(*computed.qualityLevel) : "",
+        .videoFilters = BuildVideoFilters(options, false).join(','),
+        .audioFilters = BuildAudioFilters(options).join(','),
+        .audioChannelsCount = options.audioChannelsCount.has_value() ? optional(*options.audioChannelsCount) : std::nullopt,
+        .threadsCount = options.resources.threadsCount,
+        .durationSeconds = options.inputMetadata.durationSeconds / options.speed.value_or(1),
+    };
+}
+
+QString MediaEncoder::BuildGlobalParams(const EncoderOptions& options) const
+{
+    QStringList params { progressParams };
+
+    if (measuresResourceUsage)
+        params.append("-benchmark");
+    if (options.resources.filterThreadsCount.has_value())
+        params.append("-filter_threads " + QString::number(*options.resources.filterThreadsCount));
+
+    return params.join(" ");
+}
+
+QString MediaEncoder::BuildInputParams(const EncoderOptions& options) const
+{
+    if (!options.hardwareAcceleration.has_value())
+        return "";
+
+    const HardwareAcceleration& acceleration = *options.hardwareAcceleration;
+    QStringList params = acceleration.deviceParams;
+    params.append({ "-hwaccel", acceleration.hwaccel });
+
+    if (keepsFramesOnDevice(options))
+        params.append({ "-hwaccel_output_format", acceleration.outputFormat });
+
+    return params.join(" ");
+}
+
+bool MediaEncoder::keepsFramesOnDevice(const EncoderOptions& options)
+{
+    if (!options.hardwareAcceleration.has_value() || options.hardwareAcceleration->outputFormat.isEmpty())
+        return false;
+
+    // without a scaler for the device, frames have to be downloaded to be scaled in software
+    const bool isScaled = options.outputWidth.has_value() || options.outputHeight.has_value();
+    return !isScaled || !options.hardwareAcceleration->scaleFilter.isEmpty();
+}
+
+bool MediaEncoder::cutsSmartly(const EncoderOptions& options)
+{
+    // custom arguments could change the encoded ends in ways the copied middle does not follow
+    return options.smartCut && StreamCopyPlanner::matchesInputVideo(options) && options.customArguments.value_or("").trimmed().isEmpty();
+}
+
+bool MediaEncoder::supportsFastStart(const Container& container)
+{
+    // the mov family writes its index last, where players would have to seek to before playing
+    static const QStringList formats = { "mov", "mp4", "ipod", "3gp", "3g2", "psp", "f4v" };
+    return formats.contains(container.formatName);
 }
+
 QString MediaEncoder::BuildBaseParams(const EncoderOptions& options, const ComputedOptions& computed) const
 {
-    const QString videoCodecParam = options.videoCodec.has_value() ? "-c:v " + options.videoCodec->libraryName : "-vn";
-    const QString audioCodecParam = options.audioCodec.has_value() ? "-c:a " + options.audioCodec->libraryName : "-an";
-    const QString videoBitrateParam = options.sizeKbps.has_value() ? "-b:v " + QString::number(*computed.videoBitrateKbps) + "k" : "";
-    const QString audioBitrateParam = computed.audioBitrateKbps.has_value() ? "-b:a " + QString::number(*computed.audioBitrateKbps) + "k" : "";
-    const QString audioChannelsParam = options.audioChannelsCount.has_value() ? "-ac " + QString::number(*options.audioChannelsCount) : "";
+    // planned streams are mapped one by one, and a type without a codec may still have streams copied
+    const QString videoCodecParam = !options.videoCodec.has_value() ? (options.tracks.has_value() ? "" : "-vn")
+                                  : computed.copiesVideo          ? "-c:v copy"
+                                                                  : "-c:v " + options.videoCodec->libraryName;
+    const QString audioCodecParam = !options.audioCodec.has_value() ? (options.tracks.has_value() ? "" : "-an")
+                                  : computed.copiesAudio          ? "-c:a copy"
+                                                                  : "-c:a " + options.audioCodec->libraryName;
+    const optional<QualityScale> qualityScale = computed.qualityLevel.has_value() ? QualityScale::forEncoder(options.videoCodec->libraryName) : std::nullopt;
+    const QString videoBitrateParam = computed.copiesVideo                     ? ""
+                                    : qualityScale.has_value()                 ? qualityScale->params(*computed.qualityLevel)
+                                    : computed.videoBitrateKbps.has_value()    ? "-b:v " + QString::number(*computed.videoBitrateKbps) + "k"
+                                                                               : "";
+    const QString audioBitrateParam = computed.audioBitrateKbps.has_value() && !computed.copiesAudio ? "-b:a " + QString::number(*computed.audioBitrateKbps) + "k" : "";
+    const QString audioChannelsParam = options.audioChannelsCount.has_value() && !computed.copiesAudio ? "-ac " + QString::number(*options.audioChannelsCount) : "";
     const QString formatParam = QString("-f %1").arg(options.container.formatName);
+    const QString threadsParam = options.resources.threadsCount.has_value() ? "-threads " + QString::number(*options.resources.threadsCount) : "";
 
     QStringList params {
         videoCodecParam,
@@ -134,29 +1615,48 @@ QString MediaEncoder::BuildBaseParams(const EncoderOptions& options, const Compu
         videoBitrateParam,
         audioBitrateParam,
         audioChannelsParam,
+        threadsParam,
         formatParam
     };
     params.removeAll({});
 
     return params.join(" ");
 }
+
 QString MediaEncoder::BuildVideoFilterParams(const EncoderOptions& options, const ComputedOptions& computed) const
 {
+    // animated images have no bitrate to aim at: the frame rate and width of the attempt are what fit them to the target
+    if (options.videoCodec.has_value() && AnimatedImage::isAnimatedImage(*options.videoCodec))
+    {
+        const QList<AnimatedImage::Attempt> attempts = AnimatedImage::planAttempts(options, computed.targetSizeKbps);
+        return AnimatedImage::encodeParams(options, attempts.at(qMin<qsizetype>(computed.animatedImageAttempt, attempts.size() - 1)));
+    }
+
+    // frames decoded on the GPU must be scaled by the GPU filter of the same device
+    const QStringList videoFilters = BuildVideoFilters(options, keepsFramesOnDevice(options));
+
+    return videoFilters.empty() ? "" : "-filter:v " + videoFilters.join(',');
+}
+
+QStringList MediaEncoder::BuildVideoFilters(const EncoderOptions& options, const bool isOnDevice)
+{
+    const QString scaler = isOnDevice ? options.hardwareAcceleration->scaleFilter : "scale";
+
     QString aspectRatioFilter;
     QString scaleFilter;
     if (options.outputWidth.has_value() && options.outputHeight.has_value())
     {
-        scaleFilter = QString("scale=%1:%2")
-                          .arg(QString::number(*options.outputWidth), QString::number(*options.outputHeight));
+        scaleFilter = QString("%1=%2:%3")
+                          .arg(scaler, QString::number(*options.outputWidth), QString::number(*options.outputHeight));
         aspectRatioFilter = "setsar=1/1";
     }
     else if (options.outputWidth.has_value())
     {
-        scaleFilter = QString("scale=%1:-2").arg(QString::number(*options.outputWidth));
+        scaleFilter = QString("%1=%2:-2").arg(scaler, QString::number(*options.outputWidth));
     }
     else if (options.outputHeight.has_value())
     {
-        scaleFilter = QString("scale=-1:%1").arg(QString::number(*options.outputHeight));
+        scaleFilter = QString("%1=-1:%2").arg(scaler, QString::number(*options.outputHeight));
     }
 
     if (options.aspectRatio.has_value())
@@ -166,7 +1666,7 @@ QString MediaEncoder::BuildVideoFilterParams(const EncoderOptions& options, cons
     }
 
     QString speedFilter;
-    double fps = *options.fps;
+    double fps = options.fps.value_or(0);
     if (options.speed.has_value())
     {
         speedFilter = QString("setpts=%1*PTS").arg(QString::number(1.0 / *options.speed));
@@ -187,10 +1687,17 @@ QString MediaEncoder::BuildVideoFilterParams(const EncoderOptions& options, cons
     };
     videoFilters.removeAll({});
 
-    return videoFilters.empty() ? "" : "-filter:v " + videoFilters.join(',');
+    return videoFilters;
 }
 
 QString MediaEncoder::BuildAudioFilterParams(const EncoderOptions& options, const ComputedOptions& computed) const
+{
+    const QStringList audioFilters = BuildAudioFilters(options);
+
+    return audioFilters.empty() ? "" : "-filter:a " + audioFilters.join(',');
+}
+
+QStringList MediaEncoder::BuildAudioFilters(const EncoderOptions& options)
 {
     QString audioSpeedFilter;
     if (options.speed.has_value())
@@ -201,45 +1708,32 @@ QString MediaEncoder::BuildAudioFilterParams(const EncoderOptions& options, cons
     QStringList audioFilters { audioSpeedFilter };
     audioFilters.removeAll({});
 
-    return audioFilters.empty() ? "" : "-filter:a " + audioFilters.join(',');
+    return audioFilters;
 }
 
-QString MediaEncoder::getAvailableFormats() const
+bool MediaEncoder::supportsTwoPass(const Codec& videoCodec)
 {
-    ffmpeg->startCommand("ffmpeg -encoders");
-    ffmpeg->waitForFinished();
-    return ffmpeg->readAllStandardOutput();
+    // encoders that honor -pass/-passlogfile; hardware encoders do their multipass internally
+    static const QStringList codecs = { "libx264", "libx264rgb", "libvpx", "libvpx-vp9", "libaom-av1", "libxvid", "libtheora", "mpeg4" };
+    return codecs.contains(videoCodec.libraryName);
 }
 
 bool MediaEncoder::computeAudioBitrate(const EncoderOptions& options, ComputedOptions& computed) const
 {
-    double audioBitrateKbps = qMax(options.minAudioBitrateKbps, options.audioQualityPercent.value_or(1) * options.maxAudioBitrateKbps);
-    // TODO: Using the strategy pattern, specialize certain codecs to use different bitrate formulas
+    const BitrateStrategy strategy = BitrateStrategy::forEncoder(options.audioCodec.has_value() ? options.audioCodec->libraryName : "");
+    const double bitrateKbps = strategy.audioBitrateKbps(options.audioQualityPercent.value_or(1), options.audioChannelsCount.value_or(2));
 
-    computed.audioBitrateKbps = audioBitrateKbps;
+    computed.audioBitrateKbps = qBound(options.minAudioBitrateKbps, bitrateKbps, options.maxAudioBitrateKbps);
     return true;
 }
 
 double MediaEncoder::computePixelRatio(const EncoderOptions& options, const Metadata& metadata)
 {
     double pixelRatio = 1;
-    int outputWidth;
-    int outputHeight;
-
-    long inputPixelCount = metadata.width * metadata.height;
-
-    if (options.outputWidth.has_value())
-    {
-        outputHeight = *options.outputHeight;
-        outputWidth = outputHeight * metadata.aspectRatioX / metadata.aspectRatioY;
-    }
-    else
-    {
-        outputWidth = *options.outputWidth;
-        outputHeight = outputWidth * metadata.aspectRatioX / metadata.aspectRatioY;
-    }
 
-    double outputPixelCount = outputWidth * outputHeight;
+    const double inputPixelCount = metadata.width * metadata.height;
+    const QSizeF outputSize = BitrateStrategy::outputSize(options);
+    const double outputPixelCount = outputSize.width() * outputSize.height();
 
     // TODO: Add option to enable bitrate compensation even when upscaling (will result in bigger files)
     if (outputPixelCount > 0 && outputPixelCount < inputPixelCount)
@@ -248,77 +1742,70 @@ double MediaEncoder::computePixelRatio(const EncoderOptions& options, const Meta
     return pixelRatio;
 }
 
-std::variant<QString, Message> MediaEncoder::extensionForContainer(const Container& container) const
+void MediaEncoder::ComputeVideoBitrate(const EncoderOptions& options, ComputedOptions& computed, const Metadata& metadata, const double sizeKbps)
 {
-    QProcess process;
-    const QString command = QString("ffmpeg -hide_banner -h muxer=%2").arg(container.formatName);
-
-    process.startCommand(command);
+    // every kept stream takes its share of the size target, not only the first audio one
+    const double audioBitrateKbps = options.tracks.has_value() ? options.tracks->bitrateKbpsBesidesVideo(computed.audioBitrateKbps.value_or(0))
+                                                               : computed.audioBitrateKbps.value_or(0);
+    const qsizetype videoStreamsCount = options.tracks.has_value() ? qMax(qsizetype(1), options.tracks->count("video", TrackPlan::Action::Encode)) : 1;
 
-    if (const bool result = process.waitForFinished(10000); !result)
-    {
-        return Message(
-            Severity::Critical,
-            tr("Failed to query file extension for container"),
-            tr("FFmpeg did not respond in time to query the file extension for container %1.")
-                .arg(container.formatName),
-            process.readAllStandardError()
-        );
-    }
+    computed.targetSizeKbps = sizeKbps;
+    computed.overshootCorrectionPercent = sizeCalibration->overshootCorrectionFor(options);
 
-    const QString output = process.readAllStandardOutput();
-    static QRegularExpression regex(R"(Common extensions: (.+(?=\.)))");
-    const QRegularExpressionMatch match = regex.match(output);
+    double pixelRatio = computePixelRatio(options, metadata);
+    double bitrateKbps = sizeKbps / metadata.durationSeconds * (1.0 - computed.overshootCorrectionPercent);
 
-    if (!match.hasMatch())
-    {
-        return Message(
-            Severity::Critical,
-            tr("Failed to query file extension for container"),
-            tr("FFmpeg did not return a file extension for container %1.")
-                .arg(container.formatName),
-            output
-        );
-    }
+    const BitrateStrategy strategy = BitrateStrategy::forEncoder(options.videoCodec.has_value() ? options.videoCodec->libraryName : "");
+    const double efficiency = strategy.videoEfficiency.value_or(1);
+    double videoBitrateKbps = qMax(options.minVideoBitrateKbps * efficiency, pixelRatio * (bitrateKbps - audioBitrateKbps) / videoStreamsCount);
 
-    QStringList extensions = match.captured(1).split(",");
+    // past transparency, the rest of the size target would only be padding
+    const optional<double> transparentBitrateKbps = strategy.transparentVideoBitrateKbps(options);
+    if (transparentBitrateKbps.has_value())
+        videoBitrateKbps = qMin(videoBitrateKbps, qMax(options.minVideoBitrateKbps * efficiency, *transparentBitrateKbps));
 
-    if (extensions.isEmpty())
-    {
-        return Message(
-            Severity::Critical,
-            tr("Failed to query file extension for container"),
-            tr("FFmpeg did not return a file extension for container %1.")
-                .arg(container.formatName),
-            output
-        );
-    }
+    // a capped encode lands under the target on purpose, which the size calibration must not learn as a drift
+    computed.videoBitrateKbps = videoBitrateKbps;
+    computed.requestedSizeKbps = (videoBitrateKbps * videoStreamsCount + audioBitrateKbps) * metadata.durationSeconds;
+}
 
-    return extensions.first().trimmed();
+void MediaEncoder::MoveToThread(QThread* thread)
+{
+    // the cache parents the threads copying results in, which have to live with it on the thread storing them
+    moveToThread(thread);
+    results->moveToThread(thread);
 }
 
-void MediaEncoder::ComputeVideoBitrate(const EncoderOptions& options, ComputedOptions& computed, const Metadata& metadata)
+void MediaEncoder::ReportProgress(const int jobId, const EncodingProgress& progress)
 {
-    double audioBitrateKbps = computed.audioBitrateKbps.value_or(0);
+    pendingProgress.insert(jobId, progress);
 
-    double pixelRatio = computePixelRatio(options, metadata);
-    double bitrateKbps = *options.sizeKbps / metadata.durationSeconds * (1.0 - options.overshootCorrectionPercent);
+    if (!progressTimer->isActive())
+        progressTimer->start();
+}
+
+void MediaEncoder::FlushProgress()
+{
+    // taken first, as a receiver on this thread may queue another job, or end one
+    const QHash<int, EncodingProgress> progresses = std::exchange(pendingProgress, {});
 
-    computed.videoBitrateKbps = qMax(options.minVideoBitrateKbps, pixelRatio * (bitrateKbps - audioBitrateKbps));
+    for (auto it = progresses.constBegin(); it != progresses.constEnd(); ++it)
+        emit jobProgressUpdate(it.key(), it.value());
 }
 
-QString MediaEncoder::parseOutput()
+QString MediaEncoder::parseOutput(const QString& output)
 {
-    QStringList split = output.split("Press [q] to stop, [?] for help");
-    if (split.length() == 1)
-        split = output.split("[0][0][0][0]");
+    // compiled once, as every failed job is summarized with it
+    static const QRegularExpression noise(R"((\[.*\]|(?:Conversion failed!)|(?:v\d\.\d.*)|(?: (?:\s)+)|(?:- (?:\s)+(?1))))");
+    static const QLatin1String encodingStarted("Press [q] to stop, [?] for help");
+    static const QLatin1String streamsMapped("[0][0][0][0]");
+
+    // only what follows the last marker is kept, found without splitting the whole log
+    qsizetype start = 0;
+    if (const qsizetype at = output.lastIndexOf(encodingStarted); at >= 0)
+        start = at + encodingStarted.size();
+    else if (const qsizetype at = output.lastIndexOf(streamsMapped); at >= 0)
+        start = at + streamsMapped.size();
 
-    return split.last()
-        .replace(
-            QRegularExpression(
-                R"((\[.*\]|(?:Conversion failed!)|(?:v\d\.\d.*)|(?: (?:\s)+)|(?:- (?:\s)+(?1))))"
-            ),
-            ""
-        )
-        .trimmed();
+    return output.sliced(start).replace(noise, "").trimmed();
 }
@@ -1,72 +1,294 @@
 #ifndef MEDIAENCODER_H
 #define MEDIAENCODER_H
 
+#include "animated_image.hpp"
+#include "chunked_encode.hpp"
+#include "complexity_analyzer.hpp"
 #include "core/formats/codec.hpp"
 #include "core/formats/container.hpp"
 #include "core/formats/metadata.hpp"
+#include "encoded_output.hpp"
 #include "encoder_options.hpp"
+#include "encoder_strategy.hpp"
+#include "encoding_progress.hpp"
+#include "job_state.hpp"
+#include "preview_encode.hpp"
+#include "quality_level_cache.hpp"
+#include "quality_search.hpp"
+#include "resource_usage.hpp"
+#include "result_cache.hpp"
+#include "resumable_encode.hpp"
+#include "size_calibration.hpp"
+#include "worker_capabilities.hpp"
 
 #include <QDir>
-#include <QEventLoop>
+#include <QHash>
 #include <QList>
 #include <QObject>
 #include <QPoint>
 #include <QProcess>
+#include <atomic>
+#include <deque>
 
+class QThread;
+class QTimer;
 struct Message;
+class EncodeJob;
 using std::optional;
 
+//!
+//! \brief Schedules encoding jobs and runs a bounded number of them in parallel.
+//! \details Nothing blocks: every step runs in its own process, and is followed up on once it reports back.
+//!
 class MediaEncoder : public QObject
 {
     Q_OBJECT
 
 public:
-    explicit MediaEncoder();
-    ~MediaEncoder() override;
+    MediaEncoder(std::shared_ptr<SizeCalibration> sizeCalibration, std::shared_ptr<QualityLevelCache> qualityLevels,
+                 std::shared_ptr<ResultCache> results);
 
     struct ComputedOptions
     {
         optional<double> videoBitrateKbps;
         optional<double> audioBitrateKbps;
+        double overshootCorrectionPercent = 0;
+        //! The size the video bitrate was computed for, see ComplexityAnalyzer.
+        optional<double> targetSizeKbps;
+        //! The size the encoder was asked for once the video bitrate was scaled with the pixels, floored and capped at
+        //! transparency, which is what the size calibration compares the output against.
+        optional<double> requestedSizeKbps;
+        //! The constant quality level used in place of a video bitrate, for quality-targeted jobs.
+        optional<int> qualityLevel;
+        //! Streams copied as they are, see StreamCopyPlanner.
+        bool copiesVideo = false;
+        bool copiesAudio = false;
+        //! The attempt at the size target an animated image is encoded at; see AnimatedImage::planAttempts().
+        int animatedImageAttempt = 0;
     };
 
-    void Encode(const EncoderOptions& options);
-    QString getAvailableFormats() const;
+    //! Reserves count consecutive ids, from any thread, for the jobs of a later call; returns the first one.
+    int ReserveJobIds(const int count) { return nextJobId.fetch_add(count); }
+    //! Queues a new job and returns its id, which is jobId when reserved. The job starts as soon as a slot is free.
+    int Encode(const EncoderOptions& options, optional<int> jobId = {});
+    //! Queues jobs that pool their size targets: the ones analyzing complexity share the sum of theirs,
+    //! so that simple inputs leave bits to demanding ones. They start once all of them are analyzed.
+    //! The ids follow firstJobId when reserved.
+    QList<int> EncodeBatch(const std::vector<EncoderOptions>& batch, optional<int> firstJobId = {});
+    //! Queues variants of one input that share a single decode: one ffmpeg process splits the decoded streams
+    //! and encodes every output from them. Returns one job id per variant, in order; the jobs end together.
+    //! Variants needing passes of their own - two-pass, complexity analysis, quality search - or of another
+    //! input are queued as separate jobs.
+    QList<int> EncodeVariants(const std::vector<EncoderOptions>& variants);
+    //! Encodes a few seconds of the input with the options, ahead of queued jobs, and returns the preview id,
+    //! which is reservedId when reserved.
+    //! The result projects the size and duration of the full encode. With a target quality, the samples are encoded
+    //! at the level found for the input, and the preview fails while none was searched yet.
+    int Preview(const EncoderOptions& options, optional<int> reservedId = {});
+
+    //! Stops the job wherever it is, along with its parts; jobCancelled() follows once its processes exited.
+    //! Returns false when there is no such job, it is already cancelled, or its output is being moved into place.
+    bool Cancel(int jobId);
+    //! Suspends the job and its parts, which keep their slots so that the CPU is not handed to the next job.
+    //! A paused job that did not start yet keeps its place in the queue.
+    bool Pause(int jobId);
+    bool Resume(int jobId);
+    [[nodiscard]] optional<JobState> jobState(int jobId) const;
+    [[nodiscard]] optional<EncoderOptions> jobOptions(int jobId) const;
+
+    //! Sets the amount of threads each job is expected to use; the job limit becomes cores / threads.
+    //! Jobs whose options set their own thread count take that many cores instead.
+    void setThreadsPerJob(int threadsCount);
+    //! Sets the job limit; each job then gets cores / count of the cores.
+    void setMaxConcurrentJobs(int count);
+    [[nodiscard]] int maxConcurrentJobs() const { return maxJobs; }
+    //! Lets segments of chunked jobs, and jobs run by a single process, run on other hosts, through a command
+    //! template such as "ssh %1". Hosts must see the input and output folders at the same paths, unless the
+    //! command streams them; see FarmClient.
+    void setRemoteWorkers(const QStringList& hosts, const QString& commandTemplate);
+    //! What the worker advertised; jobs go to the workers having their encoders, and hardware encodes to the
+    //! workers with the hardware. Workers that advertised nothing take one job at a time, of any kind.
+    void setWorkerCapabilities(const QString& host, const WorkerCapabilities& capabilities);
+    //! Runs jobs with -benchmark, so that jobResourceUsage() reports what each one cost.
+    void setMeasuresResourceUsage(bool enabled) { measuresResourceUsage = enabled; }
+    //! Encodes the jobs an in-process engine supports without spawning ffmpeg, when this build has one;
+    //! see DefaultEncoderStrategy. Measured, remote, chunked and resumable jobs keep running through ffmpeg.
+    void setInProcessEncoding(bool enabled) { isInProcessEncoding = enabled; }
+    //! Writes outputs to this folder, meant to be on fast local storage, and moves each one to its destination
+    //! once done, while the next job already runs. Empty writes them at their destination.
+    void setStagingDirectory(const QString& path) { stagingDirectory = path; }
+    //! Answers requests identical to a past one with its output, when the ResultCache has a quota; on by default.
+    //! Measuring encoders needs them to run every time.
+    void setReusesResults(bool enabled) { reusesResults = enabled; }
+    //! Records how far each output drifted from its size in the SizeCalibration; on by default. Comparing encodes
+    //! needs every one of them to be asked for the same bitrate.
+    void setLearnsSizes(bool enabled) { learnsSizes = enabled; }
+    [[nodiscard]] bool isIdle() const
+    {
+        return pendingJobs.empty() && runningJobs.isEmpty() && remoteJobs.isEmpty() && coordinatingJobs.isEmpty()
+            && analyzingJobs.isEmpty() && publishingJobs.isEmpty();
+    }
+
+    //! Moves the encoder to the thread, along with the result cache it shares. Its methods must then be called
+    //! from that thread, which EncoderThread takes care of.
+    void MoveToThread(QThread* thread);
+
+    //! The reason a job failed, from the log ffmpeg printed: what follows its last banner, without the noise.
+    static QString parseOutput(const QString& output);
 
 signals:
-    void encodingStarted(double videoBitrateKbps, double audioBitrateKbps);
-    void encodingSucceeded(const EncoderOptions& options, const ComputedOptions& computed, QFile& output);
-    void encodingProgressUpdate(double progressPercent);
-    void encodingFailed(QString error, QString errorDetails = "");
+    void jobQueued(int jobId, const EncoderOptions& options);
+    void jobStarted(int jobId, const MediaEncoder::ComputedOptions& computed);
+    void jobSucceeded(int jobId, const EncoderOptions& options, const ComputedOptions& computed, const EncodedOutput& output);
+    //! Coalesced: the latest progress of every job is emitted together, at most once per progressIntervalMs.
+    void jobProgressUpdate(int jobId, const EncodingProgress& progress);
+    //! Emitted right before jobSucceeded(), when resource usage is measured.
+    void jobResourceUsage(int jobId, const ResourceUsage& usage);
+    void jobFailed(int jobId, QString error, QString errorDetails = "");
+    void jobCancelled(int jobId);
+    void jobStateChanged(int jobId, JobState state);
+    void queueFinished();
+    void previewCompleted(int previewId, const PreviewEncode::Result& result);
+    void previewFailed(int previewId, QString error, QString errorDetails = "");
 
 private:
+    //! Checks the parameters built for recorded inputs, see tests/core_paths_test.cpp.
+    friend class CorePathsTest;
+
     const bool IS_WINDOWS = QSysInfo::kernelType() == "winnt";
+    static constexpr int defaultThreadsPerJob = 4;
+    static constexpr auto progressParams = "-progress pipe:1 -nostats";
+    //! About 30 updates a second, however many jobs run, so that receivers on another thread are not flooded.
+    static constexpr int progressIntervalMs = 33;
+    //! Peak bitrate of a ladder rendition, relative to its average.
+    static constexpr double maxrateFactor = 1.07;
 
-    void StartCompression(const EncoderOptions& options, const ComputedOptions& computedOptions, const Metadata& metadata);
-    void UpdateProgress(double mediaDuration);
-    void EndCompression(
-        const EncoderOptions& options, const ComputedOptions& computed, QString outputPath, QString command, int exitCode
-    );
+    enum class StreamSelection
+    {
+        All,
+        VideoOnly,
+        AudioOnly
+    };
 
+    //! Restricts a command to part of the input; an empty duration runs to the end.
+    struct InputRange
+    {
+        optional<double> startSeconds;
+        optional<double> durationSeconds;
+    };
+
+    EncodeJob* CreateJob(const EncoderOptions& options, optional<int> jobId = {});
+    void StartAnalyses();
+    void AllocateSizeBudgets(const QList<EncodeJob*>& batch, const QHash<EncodeJob*, double>& complexities);
+    void ScheduleJobs();
+    //! The free cores the job would be pinned to, or none when too few of the ones it may use are free.
+    [[nodiscard]] QList<int> coresFor(const EncodeJob* job) const;
+    void ReleaseCores(EncodeJob* job);
+    //! The worker with a free slot best suited to the job, or none.
+    [[nodiscard]] QString remoteWorkerFor(const EncodeJob* job) const;
+    //! Whether the whole job can run on a worker: jobs made of parts, or passes sharing files, stay on this host.
+    [[nodiscard]] static bool runsRemotely(const EncoderOptions& options);
+    void StartCompression(EncodeJob* job);
+    bool PrepareCompression(EncodeJob* job);
+    bool PrepareSharedDecode(EncodeJob* carrier);
+    void EndSharedDecode(EncodeJob* carrier, JobState outcome, const QString& error = {}, const QString& errorDetails = {});
+    //! The job running the process of a shared decode, which is the job itself for the others.
+    [[nodiscard]] EncodeJob* carrierOf(EncodeJob* job) const;
+    //! Links or copies the cached output of an identical encode in place of running it; false when there is none.
+    bool ReuseResult(EncodeJob* job);
+    //! What the result of the job depends on, as given to ResultCache::keyFor().
+    [[nodiscard]] QString resultParametersOf(const EncodeJob* job, const ComputedOptions& computed) const;
+    void StartChunkedCompression(EncodeJob* job);
+    void StartResumableCompression(EncodeJob* job);
+    //! Identifies what the job encodes, so that segments of another encode are never resumed from.
+    [[nodiscard]] QString resumeFingerprintOf(const EncodeJob* job, const ComputedOptions& computed) const;
+    void StartQualitySearch(EncodeJob* job);
+    void EnqueueQualityProbes(EncodeJob* job, QualitySearch* search);
+    void EnqueueSegments(EncodeJob* job, ChunkedEncode* chunk, const QList<ChunkedEncode::Segment>& segments);
+    void StitchSegments(EncodeJob* job, const QStringList& segmentPaths, const QString& audioPath);
+    void FailChunkedCompression(EncodeJob* job, ChunkedEncode* chunk, const QString& error, const QString& errorDetails);
+    void EndCompression(EncodeJob* job);
+    void DiscardJob(EncodeJob* job);
+    void DiscardParts(EncodeJob* job);
+    [[nodiscard]] static QList<EncodeJob*> partsOf(const EncodeJob* job);
+
+    [[nodiscard]] ComputedOptions ComputeOptions(const EncodeJob* job);
+    [[nodiscard]] std::variant<QString, Message> ResolveOutputPath(const EncoderOptions& options) const;
+    //! Where the job writes its output: the staging folder, from which the job moves it to outputPath, or outputPath itself.
+    [[nodiscard]] QString StageOutput(EncodeJob* job, const QString& outputPath) const;
+    [[nodiscard]] QStringList BuildCommands(EncodeJob* job, const ComputedOptions& computed, const QString& outputPath,
+                                            const InputRange& range = {}, StreamSelection streams = StreamSelection::All,
+                                            const QString& formatName = {}, const QString& muxerParams = {}) const;
+
+    [[nodiscard]] QString BuildSharedDecodeCommand(const QList<EncodeJob*>& outputs, const QList<ComputedOptions>& computed,
+                                                   const QStringList& outputPaths) const;
+    //! Decodes once, scales each rendition of the ladder from a split of the frames, and muxes them all as it goes.
+    [[nodiscard]] QString BuildLadderCommand(const EncoderOptions& options, const ComputedOptions& computed, const QString& playlistPath) const;
+
+    [[nodiscard]] EncoderStrategy::Request BuildStrategyRequest(const EncoderOptions& options, const ComputedOptions& computed,
+                                                                const QString& outputPath) const;
+    //! Seeks to the range within the trimmed input, and stops at its end or at the trim end.
+    [[nodiscard]] static QString BuildRangeParams(const EncoderOptions& options, const InputRange& range);
+    [[nodiscard]] QString BuildGlobalParams(const EncoderOptions& options) const;
+    [[nodiscard]] QString BuildInputParams(const EncoderOptions& options) const;
     [[nodiscard]] QString BuildBaseParams(const EncoderOptions& options, const ComputedOptions& computed) const;
     [[nodiscard]] QString BuildVideoFilterParams(const EncoderOptions& options, [[maybe_unused]] const ComputedOptions& computed) const;
     [[nodiscard]] QString BuildAudioFilterParams(const EncoderOptions& options, const ComputedOptions& computed) const;
+    //! \param isOnDevice Whether decoded frames are on the GPU, to be scaled by its own filter.
+    [[nodiscard]] static QStringList BuildVideoFilters(const EncoderOptions& options, bool isOnDevice);
+    [[nodiscard]] static QStringList BuildAudioFilters(const EncoderOptions& options);
+
+    //! Keeps the latest progress of the job until the next flush; a job that ended drops its own.
+    void ReportProgress(int jobId, const EncodingProgress& progress);
+    void FlushProgress();
 
-    void ComputeVideoBitrate(const EncoderOptions& options, ComputedOptions& computed, const Metadata& metadata);
+    void ComputeVideoBitrate(const EncoderOptions& options, ComputedOptions& computed, const Metadata& metadata, double sizeKbps);
     bool computeAudioBitrate(const EncoderOptions& options, ComputedOptions& computed) const;
+    static bool supportsTwoPass(const Codec& videoCodec);
     double computePixelRatio(const EncoderOptions& options, const Metadata& metadata);
+    static bool keepsFramesOnDevice(const EncoderOptions& options);
+    //! Whether the ends re-encoded for a smart cut can be joined to the video copied between them.
+    static bool cutsSmartly(const EncoderOptions& options);
+    //! Whether the muxer can move the index to the front, which players then have before any frame.
+    static bool supportsFastStart(const Container& container);
 
-    std::variant<QString, Message> extensionForContainer(const Container& container) const;
-
-    QString output = "";
-    QString parseOutput();
-
-    QEventLoop eventLoop;
-    QProcess* ffprobe = new QProcess();
-    QProcess* ffmpeg = new QProcess(&eventLoop);
+    //! Jobs queued through Encode() and EncodeBatch(), until they end; parts are not in it.
+    QHash<int, EncodeJob*> jobs;
+    std::deque<EncodeJob*> pendingJobs;
+    QList<EncodeJob*> runningJobs;
+    //! Jobs running on a remote worker, with the host they run on; they do not take a local slot.
+    QHash<EncodeJob*, QString> remoteJobs;
+    //! Chunked jobs waiting on their parts, or stitching them; they do not take a slot either.
+    QList<EncodeJob*> coordinatingJobs;
+    //! Jobs running a shared decode, with the jobs of the other outputs it writes; those wait as coordinating jobs.
+    QHash<EncodeJob*, QList<EncodeJob*>> sharedDecodes;
+    //! Jobs done encoding whose output is being moved from the staging folder; they no longer take a slot.
+    QList<EncodeJob*> publishingJobs;
+    //! Jobs waiting on the complexity analysis of their batch.
+    QList<EncodeJob*> analyzingJobs;
+    std::deque<ComplexityAnalyzer*> pendingAnalyses;
+    int runningAnalyses = 0;
+    QStringList remoteWorkers;
+    QString remoteWorkerCommand;
+    QHash<QString, WorkerCapabilities> workerCapabilities;
+    //! Shared by jobs, their parts and previews; reserved from other threads, see ReserveJobIds().
+    std::atomic<int> nextJobId = 0;
+    int maxJobs = 1;
+    int threadsPerJob = defaultThreadsPerJob;
+    //! Cores no local job is pinned to; each running job holds its own, so that no two share one.
+    QList<int> freeCores;
+    QHash<EncodeJob*, QList<int>> reservedCores;
+    bool measuresResourceUsage = false;
+    bool isInProcessEncoding = false;
+    QString stagingDirectory;
+    bool reusesResults = true;
+    bool learnsSizes = true;
+    QTimer* progressTimer;
+    QHash<int, EncodingProgress> pendingProgress;
 
-    QMetaObject::Connection* const processUpdateConnection = new QMetaObject::Connection();
-    QMetaObject::Connection* const processFinishedConnection = new QMetaObject::Connection();
+    std::shared_ptr<SizeCalibration> sizeCalibration;
+    std::shared_ptr<QualityLevelCache> qualityLevels;
+    std::shared_ptr<ResultCache> results;
 };
 
 #endif // MEDIAENCODER_H
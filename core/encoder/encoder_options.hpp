@@ -6,7 +6,11 @@
 
 #include "core/formats/codec.hpp"
 #include "core/formats/container.hpp"
+#include "core/formats/hardware_acceleration.hpp"
 #include "core/formats/metadata.hpp"
+#include "resource_limits.hpp"
+#include "streaming_ladder.hpp"
+#include "track_plan.hpp"
 
 using std::optional;
 
@@ -17,8 +21,15 @@ struct EncoderOptions
     const QString outputPath;
     const optional<const Codec> videoCodec;
     const optional<const Codec> audioCodec;
+    const optional<const HardwareAcceleration> hardwareAcceleration;
     const Container container;
+    //! Writes renditions for adaptive streaming in place of a single file; the container then only picks HLS segments.
+    const optional<const StreamingLadder> ladder;
+    //! Which streams of the input are encoded, copied or dropped; ffmpeg picks one of each type when there is no plan.
+    const optional<const TrackPlan> tracks;
     const optional<const double> sizeKbps;
+    //! The VMAF score to reach with the smallest file, in place of a size target; see QualitySearch.
+    const optional<const double> targetQuality;
     const optional<const double> audioQualityPercent;
     const optional<const int> audioChannelsCount;
     const optional<const int> outputWidth;
@@ -26,10 +37,24 @@ struct EncoderOptions
     const optional<const QPoint> aspectRatio;
     const optional<const int> fps;
     const optional<const double> speed;
+    //! Where the output starts and ends in the input, in seconds. The metadata already holds the duration left
+    //! between them, and ranges of the input are taken within it.
+    const optional<const double> trimStartSeconds;
+    const optional<const double> trimEndSeconds;
     const double minVideoBitrateKbps = 64;
     const double minAudioBitrateKbps = 16;
     const double maxAudioBitrateKbps = 256;
     const double overshootCorrectionPercent = 0.02;
+    const bool twoPass = false;
+    //! Encodes the video as segments cut at keyframes, in parallel, and stitches them together.
+    const bool chunked = false;
+    //! Checkpoints the encode as segments next to the output, so that an interrupted one resumes where it stopped.
+    const bool resumable = false;
+    //! Measures how demanding the video is before encoding, and spends no more of the size target than it needs.
+    const bool analyzeComplexity = false;
+    //! Re-encodes only the GOPs around the trim points, and copies the video between them; see ChunkedEncode.
+    const bool smartCut = false;
+    const ResourceLimits resources = {};
     const optional<const QString> customArguments;
 };
 
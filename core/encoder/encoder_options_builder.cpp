@@ -1,6 +1,11 @@
 #include "encoder_options_builder.hpp"
 
+#include "animated_image.hpp"
+#include "quality_scale.hpp"
+
 #include <QFile>
+#include <QThread>
+#include <algorithm>
 
 EncoderOptionsBuilder::self& EncoderOptionsBuilder::useMetadata(const Metadata& metadata)
 {
@@ -50,12 +55,51 @@ EncoderOptionsBuilder::self& EncoderOptionsBuilder::withAudioCodec(const Codec&
     return *this;
 }
 
+EncoderOptionsBuilder::self& EncoderOptionsBuilder::withHardwareAcceleration(const HardwareAcceleration& acceleration)
+{
+    this->hardwareAcceleration = acceleration;
+    return *this;
+}
+
 EncoderOptionsBuilder::self& EncoderOptionsBuilder::withContainer(const Container& container)
 {
     this->container = container;
     return *this;
 }
 
+EncoderOptionsBuilder::self& EncoderOptionsBuilder::withLadder(const StreamingLadder& ladder)
+{
+    if (ladder.renditions.isEmpty())
+    {
+        errors.append(QObject::tr("A ladder needs at least one rendition."));
+        return *this;
+    }
+
+    if (ladder.segmentSeconds <= 0)
+    {
+        errors.append(QObject::tr("Ladder segments must last more than 0 seconds."));
+        return *this;
+    }
+
+    this->ladder = ladder;
+    return *this;
+}
+
+EncoderOptionsBuilder::self& EncoderOptionsBuilder::withTrackActions(const QHash<int, TrackPlan::Action>& actions)
+{
+    for (const int index : actions.keys())
+    {
+        if (index < 0)
+        {
+            errors.append(QObject::tr("Stream indexes must not be lower than 0."));
+            return *this;
+        }
+    }
+
+    this->trackActions = actions;
+    return *this;
+}
+
 EncoderOptionsBuilder::self& EncoderOptionsBuilder::withTargetOutputSize(double sizeKbps)
 {
     if (sizeKbps == 0)
@@ -73,6 +117,18 @@ EncoderOptionsBuilder::self& EncoderOptionsBuilder::withTargetOutputSize(double
     return *this;
 }
 
+EncoderOptionsBuilder::self& EncoderOptionsBuilder::withTargetQuality(double vmafScore)
+{
+    if (vmafScore <= 0 || vmafScore > 100)
+    {
+        errors.append(QObject::tr("Target quality must be a VMAF score between 0 and 100."));
+        return *this;
+    }
+
+    this->targetQuality = vmafScore;
+    return *this;
+}
+
 EncoderOptionsBuilder::self& EncoderOptionsBuilder::withAudioQuality(double audioQualityPercent)
 {
     if (audioQualityPercent < 0 || audioQualityPercent > 100)
@@ -180,6 +236,26 @@ EncoderOptionsBuilder::self& EncoderOptionsBuilder::atSpeed(double speed)
     return *this;
 }
 
+EncoderOptionsBuilder::self& EncoderOptionsBuilder::withTrim(optional<double> startSeconds, optional<double> endSeconds)
+{
+    if (startSeconds.value_or(0) < 0 || endSeconds.value_or(1) <= 0)
+    {
+        errors.append(QObject::tr("Trim points must not be before the start of the input."));
+        return *this;
+    }
+
+    if (startSeconds.has_value() && endSeconds.has_value() && *endSeconds <= *startSeconds)
+    {
+        errors.append(QObject::tr("The trim end must be after the trim start."));
+        return *this;
+    }
+
+    // a start at 0 keeps the whole beginning, as none would
+    this->trimStartSeconds = startSeconds.value_or(0) > 0 ? startSeconds : std::nullopt;
+    this->trimEndSeconds = endSeconds;
+    return *this;
+}
+
 EncoderOptionsBuilder::self& EncoderOptionsBuilder::withMinVideoBitrate(double bitrateKbps)
 {
     if (bitrateKbps <= 0)
@@ -222,6 +298,69 @@ EncoderOptionsBuilder::self& EncoderOptionsBuilder::withOvershootCorrection(doub
     return *this;
 }
 
+EncoderOptionsBuilder::self& EncoderOptionsBuilder::withTwoPass(bool enabled)
+{
+    this->twoPass = enabled;
+    return *this;
+}
+
+EncoderOptionsBuilder::self& EncoderOptionsBuilder::withChunkedEncoding(bool enabled)
+{
+    this->chunked = enabled;
+    return *this;
+}
+
+EncoderOptionsBuilder::self& EncoderOptionsBuilder::withResumableEncoding(bool enabled)
+{
+    this->resumable = enabled;
+    return *this;
+}
+
+EncoderOptionsBuilder::self& EncoderOptionsBuilder::withComplexityAnalysis(bool enabled)
+{
+    this->analyzeComplexity = enabled;
+    return *this;
+}
+
+EncoderOptionsBuilder::self& EncoderOptionsBuilder::withSmartCut(bool enabled)
+{
+    this->smartCut = enabled;
+    return *this;
+}
+
+EncoderOptionsBuilder::self& EncoderOptionsBuilder::withResourceLimits(const ResourceLimits& limits)
+{
+    const int coresCount = QThread::idealThreadCount();
+
+    for (const int core : limits.allowedCores)
+    {
+        if (core < 0 || core >= coresCount)
+        {
+            errors.append(QObject::tr("Core %1 does not exist; cores go from 0 to %2.").arg(QString::number(core), QString::number(coresCount - 1)));
+            return *this;
+        }
+    }
+
+    if (limits.threadsCount.value_or(1) <= 0 || limits.filterThreadsCount.value_or(1) <= 0)
+    {
+        errors.append(QObject::tr("Thread counts must be greater than 0."));
+        return *this;
+    }
+
+    if (limits.memoryLimitMb.value_or(1) <= 0)
+    {
+        errors.append(QObject::tr("Memory limit must be greater than 0."));
+        return *this;
+    }
+
+    this->resources = limits;
+
+    // the GUI and the CLI both pass through here, so jobs only ever see each existing core once
+    std::sort(resources.allowedCores.begin(), resources.allowedCores.end());
+    resources.allowedCores.erase(std::unique(resources.allowedCores.begin(), resources.allowedCores.end()), resources.allowedCores.end());
+    return *this;
+}
+
 EncoderOptionsBuilder::self& EncoderOptionsBuilder::withCustomArguments(const QString& customArguments)
 {
     this->customArguments = customArguments;
@@ -245,21 +384,125 @@ std::variant<EncoderOptions, QList<QString>> EncoderOptionsBuilder::build()
     if (!container.has_value())
         errors.append(QObject::tr("No container was specified."));
 
+    if (targetQuality.has_value() && (!videoCodec.has_value() || !QualityScale::forEncoder(videoCodec->libraryName).has_value()))
+        errors.append(QObject::tr("A target quality needs a video codec with a constant quality mode, such as libx264 or libsvtav1."));
+
+    // frames of a sped up output match no frame of the input to be scored against
+    if (targetQuality.has_value() && speed.has_value())
+        errors.append(QObject::tr("A target quality cannot be combined with a speed change."));
+
+    // every rendition is encoded at its own bitrate, from frames scaled for it
+    if (ladder.has_value() && (!videoCodec.has_value() || videoCodec->libraryName == "copy"))
+        errors.append(QObject::tr("A ladder needs a video codec to encode its renditions with."));
+
+    if (ladder.has_value() && targetQuality.has_value())
+        errors.append(QObject::tr("A ladder cannot be combined with a target quality; its renditions set their own bitrates."));
+
+    const bool isAnimatedImage = videoCodec.has_value() && AnimatedImage::isAnimatedImage(*videoCodec);
+
+    // the filter graph of an animated image makes the frames of a single video stream
+    if (isAnimatedImage && (ladder.has_value() || !trackActions.isEmpty()))
+        errors.append(QObject::tr("An animated image cannot be a ladder, nor have its streams chosen."));
+
+    if (inputMetadata.has_value() && trimStartSeconds.value_or(0) >= inputMetadata->durationSeconds)
+        errors.append(QObject::tr("The trim start must be before the end of the input."));
+
     if (minAudioBitrateKbps > maxAudioBitrateKbps)
         errors.append(QObject::tr("Minimum audio bitrate must be less than or equal to maximum audio bitrate."));
 
+    // streams are planned against the metadata, which may be given after the actions
+    optional<TrackPlan> tracks;
+    if (!trackActions.isEmpty() && inputMetadata.has_value())
+    {
+        tracks = TrackPlan::forStreams(inputMetadata->streams, trackActions);
+
+        for (const int index : trackActions.keys())
+        {
+            if (std::none_of(tracks->tracks.cbegin(), tracks->tracks.cend(), [index](const TrackPlan::Track& track)
+                             { return track.stream.index == index; }))
+                errors.append(QObject::tr("Stream %1 is not in the input.").arg(index));
+        }
+
+        for (const TrackPlan::Track& track : std::as_const(tracks->tracks))
+        {
+            if (track.action != TrackPlan::Action::Encode)
+                continue;
+
+            if (track.stream.type == "video" && !videoCodec.has_value())
+                errors.append(QObject::tr("Stream %1 is video to encode, but no video codec was specified.").arg(track.stream.index));
+            else if (track.stream.type == "audio" && !audioCodec.has_value())
+                errors.append(QObject::tr("Stream %1 is audio to encode, but no audio codec was specified.").arg(track.stream.index));
+            else if (track.stream.type != "video" && track.stream.type != "audio" && track.stream.type != "subtitle")
+                errors.append(QObject::tr("Stream %1 holds %2, which can only be copied or dropped.").arg(QString::number(track.stream.index), track.stream.type));
+        }
+
+        const qsizetype copiedVideoCount = tracks->count("video", TrackPlan::Action::Copy);
+        const qsizetype copiedCount = std::count_if(tracks->tracks.cbegin(), tracks->tracks.cend(), [](const TrackPlan::Track& track)
+                                                    { return track.action == TrackPlan::Action::Copy; });
+
+        // copied streams keep the timing of the input, which the encoded ones would no longer match
+        if (copiedCount > 0 && speed.has_value())
+            errors.append(QObject::tr("Streams cannot be copied along with a speed change."));
+
+        // the video filters apply to every video stream, and ffmpeg cannot filter a copied one
+        if (copiedVideoCount > 0 && (outputWidth.has_value() || outputHeight.has_value() || aspectRatio.has_value() || fps.has_value()))
+            errors.append(QObject::tr("A video stream cannot be copied while the video is resized or its frame rate changed."));
+
+        if (ladder.has_value())
+            errors.append(QObject::tr("A ladder maps its own streams, which cannot be chosen for it."));
+
+        if (std::all_of(tracks->tracks.cbegin(), tracks->tracks.cend(), [](const TrackPlan::Track& track)
+                        { return track.action == TrackPlan::Action::Drop; }))
+            errors.append(QObject::tr("Every stream of the input is dropped."));
+
+        if (targetQuality.has_value() && tracks->count("video", TrackPlan::Action::Encode) == 0)
+            errors.append(QObject::tr("A target quality needs a video stream to encode."));
+    }
+
     if (!errors.isEmpty())
         return errors;
 
+    // the rest of the encoder only sees the part of the input that is kept
+    const optional<double> trimEnd = trimEndSeconds.has_value() && *trimEndSeconds < inputMetadata->durationSeconds ? trimEndSeconds : std::nullopt;
+    const bool isTrimmed = trimStartSeconds.has_value() || trimEnd.has_value();
+    Metadata keptMetadata = *inputMetadata;
+    if (isTrimmed)
+    {
+        keptMetadata.durationSeconds = trimEnd.value_or(inputMetadata->durationSeconds) - trimStartSeconds.value_or(0);
+        keptMetadata.sizeKbps = inputMetadata->sizeKbps * keptMetadata.durationSeconds / inputMetadata->durationSeconds;
+    }
+
+    // a copied middle only joins re-encoded ends made alike, at no bitrate of their own
+    const bool isSmartCut = smartCut && isTrimmed && videoCodec.has_value() && videoCodec->libraryName != "copy" && !sizeKbps.has_value()
+                         && !targetQuality.has_value() && !ladder.has_value() && !isAnimatedImage
+                         // planned streams are mapped by a single process, as parts holding a type each would lose the others
+                         && !tracks.has_value();
+    const bool encodesVideo = videoCodec.has_value() && (!tracks.has_value() || tracks->count("video", TrackPlan::Action::Encode) > 0);
+
+    // a ladder runs as one process writing all of its renditions, with bitrates of their own
+    const bool isTwoPass = twoPass && encodesVideo && sizeKbps.has_value() && !targetQuality.has_value() && !ladder.has_value();
+    // a second pass needs the statistics of the whole first one, and copied video cannot be cut on a schedule
+    const bool isResumable = resumable && !isTwoPass && !(videoCodec.has_value() && videoCodec->libraryName == "copy") && !ladder.has_value()
+                          // a smart cut is stitched from parts, like a chunked encode
+                          && !isSmartCut && !tracks.has_value()
+                          // segments of an animated image would each have a palette of their own, and be encoded again whole when too large
+                          && !isAnimatedImage;
+
     // TODO: Should we use std::move? I have to read on move semantics lol
     return EncoderOptions {
-        .inputMetadata = *inputMetadata,
+        .inputMetadata = keptMetadata,
         .inputPath = *inputPath,
         .outputPath = *outputPath,
         .videoCodec = videoCodec,
-        .audioCodec = audioCodec,
+        // neither GIF nor WebP holds audio
+        .audioCodec = isAnimatedImage ? std::nullopt : audioCodec,
+        .hardwareAcceleration = videoCodec.has_value() ? hardwareAcceleration : std::nullopt,
         .container = *container,
-        .sizeKbps = sizeKbps,
+        .ladder = ladder,
+        .tracks = tracks,
+        // the quality target decides the size, and the renditions of a ladder their own
+        .sizeKbps = targetQuality.has_value() || ladder.has_value() ? std::nullopt : sizeKbps,
+        .targetQuality = targetQuality,
         .audioQualityPercent = audioQualityPercent,
         .audioChannelsCount = audioChannelsCount,
         .outputWidth = outputWidth,
@@ -267,10 +510,24 @@ std::variant<EncoderOptions, QList<QString>> EncoderOptionsBuilder::build()
         .aspectRatio = aspectRatio,
         .fps = fps,
         .speed = speed,
+        .trimStartSeconds = trimStartSeconds,
+        .trimEndSeconds = trimEnd,
         .minVideoBitrateKbps = minVideoBitrateKbps,
         .minAudioBitrateKbps = minAudioBitrateKbps,
         .maxAudioBitrateKbps = maxAudioBitrateKbps,
         .overshootCorrectionPercent = overshootCorrectionPercent,
+        // a second pass only helps when there is a video bitrate to hit
+        .twoPass = isTwoPass,
+        // copied streams cannot be cut at arbitrary keyframes and stitched back without re-encoding,
+        // and parts running in parallel would have no single point to resume from
+        .chunked = chunked && encodesVideo && videoCodec->libraryName != "copy" && !isResumable && !ladder.has_value() && !isSmartCut && !tracks.has_value()
+                && !isAnimatedImage,
+        .resumable = isResumable,
+        // the analysis only decides how much of the size target the video gets
+        .analyzeComplexity = analyzeComplexity && encodesVideo && videoCodec->libraryName != "copy" && sizeKbps.has_value() && !targetQuality.has_value()
+                           && !ladder.has_value(),
+        .smartCut = isSmartCut,
+        .resources = resources,
         .customArguments = customArguments
     };
 }
@@ -3,6 +3,7 @@
 
 #include "core/formats/codec.hpp"
 #include "core/formats/container.hpp"
+#include "core/formats/hardware_acceleration.hpp"
 #include "core/formats/metadata.hpp"
 #include "encoder_options.hpp"
 
@@ -18,8 +19,15 @@ public:
     self& outputTo(const QString& outputPath);
     self& withVideoCodec(const Codec& codec);
     self& withAudioCodec(const Codec& codec);
+    self& withHardwareAcceleration(const HardwareAcceleration& acceleration);
     self& withContainer(const Container& container);
+    //! Encodes every rendition of the ladder from one decode, in place of the size target and output size.
+    self& withLadder(const StreamingLadder& ladder);
+    //! Encodes, copies or drops streams of the input by index; see TrackPlan::forStreams for the ones left out.
+    self& withTrackActions(const QHash<int, TrackPlan::Action>& actions);
     self& withTargetOutputSize(double sizeKbps);
+    //! Takes precedence over the target output size.
+    self& withTargetQuality(double vmafScore);
     self& withAudioQuality(double audioQualityPercent);
     self& withAudioChannelsCount(int audioChannelsCount);
     self& withOutputWidth(int outputWidth);
@@ -27,10 +35,19 @@ public:
     self& withAspectRatio(const QPoint& aspectRatio);
     self& atFps(int fps);
     self& atSpeed(double speed);
+    //! Keeps the part of the input between the two points, in seconds; either may be left out.
+    self& withTrim(optional<double> startSeconds, optional<double> endSeconds);
     self& withMinVideoBitrate(double bitrateKbps);
     self& withMinAudioBitrate(double bitrateKbps);
     self& withMaxAudioBitrate(double bitrateKbps);
     self& withOvershootCorrection(double overshootCorrectionPercent);
+    self& withTwoPass(bool enabled);
+    self& withChunkedEncoding(bool enabled);
+    self& withResumableEncoding(bool enabled);
+    self& withComplexityAnalysis(bool enabled);
+    //! Only applies to a trim, with a video codec writing the codec of the input and no size or quality target.
+    self& withSmartCut(bool enabled);
+    self& withResourceLimits(const ResourceLimits& limits);
     self& withCustomArguments(const QString& customArguments);
 
     std::variant<EncoderOptions, QList<QString>> build();
@@ -41,8 +58,12 @@ private:
     optional<QString> outputPath;
     optional<Codec> videoCodec;
     optional<Codec> audioCodec;
+    optional<HardwareAcceleration> hardwareAcceleration;
     optional<Container> container;
+    optional<StreamingLadder> ladder;
+    QHash<int, TrackPlan::Action> trackActions;
     optional<double> sizeKbps;
+    optional<double> targetQuality;
     optional<double> audioQualityPercent;
     optional<int> audioChannelsCount;
     optional<int> outputWidth;
@@ -50,10 +71,18 @@ private:
     optional<QPoint> aspectRatio;
     optional<int> fps;
     optional<double> speed;
+    optional<double> trimStartSeconds;
+    optional<double> trimEndSeconds;
     double minVideoBitrateKbps = 64;
     double minAudioBitrateKbps = 16;
     double maxAudioBitrateKbps = 256;
     double overshootCorrectionPercent = 0.02;
+    bool twoPass = false;
+    bool chunked = false;
+    bool resumable = false;
+    bool analyzeComplexity = false;
+    bool smartCut = false;
+    ResourceLimits resources;
     optional<QString> customArguments;
 
     QList<QString> errors;
@@ -0,0 +1,60 @@
+#ifndef ENCODER_STRATEGY_H
+#define ENCODER_STRATEGY_H
+
+#include "encoding_progress.hpp"
+
+#include <QObject>
+#include <QString>
+#include <optional>
+
+using std::optional;
+
+//!
+//! \brief An engine encoding a job within the application, in place of the ffmpeg processes EncodeJob runs by default.
+//! \details Jobs whose options an engine does not support - see DefaultEncoderStrategy - keep running through ffmpeg.
+//! Engines report typed progress, and end with exactly one of succeeded(), failed() or stopped().
+//!
+class EncoderStrategy : public QObject
+{
+    Q_OBJECT
+
+public:
+    //! A single pass from one input to one output, with the filters and bitrates MediaEncoder settled on.
+    struct Request
+    {
+        QString inputPath;
+        QString outputPath;
+        QString formatName;
+        //! Library names of the encoders; a stream without one is left out of the output.
+        optional<QString> videoEncoder;
+        optional<QString> audioEncoder;
+        optional<double> videoBitrateKbps;
+        optional<double> audioBitrateKbps;
+        //! Encoder options in the form of ffmpeg parameters, such as "-crf 30", for quality-targeted jobs.
+        QString videoQualityParams;
+        //! Filter chains in the syntax of -filter:v and -filter:a; empty to pass frames through.
+        QString videoFilters;
+        QString audioFilters;
+        optional<int> audioChannelsCount;
+        optional<int> threadsCount;
+        double durationSeconds = 0;
+        //! Moves the index of mov-family outputs to the front, as -movflags +faststart does.
+        bool fastStart = false;
+    };
+
+    using QObject::QObject;
+
+    virtual void Start(const Request& request) = 0;
+    //! Ends the encode early; stopped() follows once it did, leaving a partial output behind.
+    virtual void Stop() = 0;
+    virtual void setPaused(bool paused) = 0;
+    [[nodiscard]] virtual bool isRunning() const = 0;
+
+signals:
+    void progressUpdate(const EncodingProgress& progress);
+    void succeeded();
+    void failed(QString error, QString errorDetails = "");
+    void stopped();
+};
+
+#endif
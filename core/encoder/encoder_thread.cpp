@@ -0,0 +1,113 @@
+#include "encoder_thread.hpp"
+
+#include <QCoreApplication>
+
+EncoderThread::EncoderThread(MediaEncoder& encoder)
+    : mediaEncoder(encoder)
+{
+    // queued signals copy their arguments through the meta-type system
+    qRegisterMetaType<EncoderOptions>();
+    qRegisterMetaType<MediaEncoder::ComputedOptions>();
+    qRegisterMetaType<EncodedOutput>();
+    qRegisterMetaType<EncodingProgress>();
+    qRegisterMetaType<ResourceUsage>();
+    qRegisterMetaType<JobState>();
+    qRegisterMetaType<PreviewEncode::Result>();
+
+    // the encoder only turns idle as its queue finishes
+    connect(&mediaEncoder, &MediaEncoder::queueFinished, this, &EncoderThread::RefreshIdle, Qt::DirectConnection);
+
+    thread.setObjectName("MediaEncoder");
+    mediaEncoder.MoveToThread(&thread);
+    thread.start();
+
+    connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, &EncoderThread::Stop);
+}
+
+EncoderThread::~EncoderThread()
+{
+    Stop();
+}
+
+void EncoderThread::Stop()
+{
+    if (!thread.isRunning())
+        return;
+
+    // the encoder outlives this, and is destroyed on the thread that created it
+    QThread* const owner = QThread::currentThread();
+    QMetaObject::invokeMethod(&mediaEncoder, [this, owner]
+                              { mediaEncoder.MoveToThread(owner); }, Qt::BlockingQueuedConnection);
+
+    thread.quit();
+    thread.wait();
+}
+
+int EncoderThread::Encode(const EncoderOptions& options)
+{
+    const int jobId = mediaEncoder.ReserveJobIds(1);
+    Forward([this, options, jobId]
+            { mediaEncoder.Encode(options, jobId); });
+    return jobId;
+}
+
+QList<int> EncoderThread::EncodeBatch(const std::vector<EncoderOptions>& batch)
+{
+    const int firstJobId = mediaEncoder.ReserveJobIds(static_cast<int>(batch.size()));
+    Forward([this, batch, firstJobId]
+            { mediaEncoder.EncodeBatch(batch, firstJobId); });
+
+    QList<int> jobIds;
+    for (int i = 0; i < static_cast<int>(batch.size()); i++)
+        jobIds.append(firstJobId + i);
+
+    return jobIds;
+}
+
+int EncoderThread::Preview(const EncoderOptions& options)
+{
+    const int previewId = mediaEncoder.ReserveJobIds(1);
+    Forward([this, options, previewId]
+            { mediaEncoder.Preview(options, previewId); });
+    return previewId;
+}
+
+void EncoderThread::Cancel(const int jobId)
+{
+    QMetaObject::invokeMethod(&mediaEncoder, [this, jobId]
+                              { mediaEncoder.Cancel(jobId); }, Qt::QueuedConnection);
+}
+
+void EncoderThread::Pause(const int jobId)
+{
+    QMetaObject::invokeMethod(&mediaEncoder, [this, jobId]
+                              { mediaEncoder.Pause(jobId); }, Qt::QueuedConnection);
+}
+
+void EncoderThread::Resume(const int jobId)
+{
+    QMetaObject::invokeMethod(&mediaEncoder, [this, jobId]
+                              { mediaEncoder.Resume(jobId); }, Qt::QueuedConnection);
+}
+
+bool EncoderThread::isIdle() const
+{
+    return forwardedCalls == 0 && isEncoderIdle;
+}
+
+void EncoderThread::Configure(const std::function<void(MediaEncoder&)>& change)
+{
+    QMetaObject::invokeMethod(&mediaEncoder, [this, change]
+                              { change(mediaEncoder); }, Qt::QueuedConnection);
+}
+
+void EncoderThread::Forward(const std::function<void()>& call)
+{
+    forwardedCalls++;
+    QMetaObject::invokeMethod(&mediaEncoder, [this, call]
+                              {
+        call();
+        // refreshed first, so that the flag is never read stale once no call is left
+        RefreshIdle();
+        forwardedCalls--; }, Qt::QueuedConnection);
+}
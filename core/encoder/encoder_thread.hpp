@@ -0,0 +1,57 @@
+#ifndef ENCODER_THREAD_H
+#define ENCODER_THREAD_H
+
+#include "encoder.hpp"
+
+#include <QObject>
+#include <QThread>
+#include <atomic>
+#include <functional>
+
+//!
+//! \brief Runs a MediaEncoder on a thread of its own, so that reading and parsing the output of its processes
+//! never holds up the window.
+//! \details Calls are forwarded to the encoder's thread in the order they are made, and none waits on it: job ids
+//! are reserved on the calling thread, and whether the encoder is idle is read from a flag it keeps up to date.
+//! Signals of the encoder reach receivers living on other threads through queued connections, with progress
+//! coalesced by the encoder itself.
+//!
+class EncoderThread : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit EncoderThread(MediaEncoder& encoder);
+    //! See Stop().
+    ~EncoderThread() override;
+
+    //! The encoder, to connect to its signals; its methods are only called through this.
+    [[nodiscard]] MediaEncoder& encoder() const { return mediaEncoder; }
+
+    int Encode(const EncoderOptions& options);
+    QList<int> EncodeBatch(const std::vector<EncoderOptions>& batch);
+    int Preview(const EncoderOptions& options);
+    void Cancel(int jobId);
+    void Pause(int jobId);
+    void Resume(int jobId);
+    [[nodiscard]] bool isIdle() const;
+    //! Changes settings of the encoder, such as setThreadsPerJob(), on its thread.
+    void Configure(const std::function<void(MediaEncoder&)>& change);
+    //! Hands the encoder back to the thread calling this, and ends its own; done as the application quits,
+    //! while events are still delivered. Calls are made on the encoder directly afterwards.
+    void Stop();
+
+private:
+    //! Runs the call on the encoder's thread, then tells whether the encoder is idle.
+    void Forward(const std::function<void()>& call);
+    //! Only on the encoder's thread.
+    void RefreshIdle() { isEncoderIdle = mediaEncoder.isIdle(); }
+
+    MediaEncoder& mediaEncoder;
+    QThread thread;
+    //! Calls queuing work that the encoder has not run yet, which keep it from being idle.
+    std::atomic<int> forwardedCalls = 0;
+    std::atomic<bool> isEncoderIdle = true;
+};
+
+#endif
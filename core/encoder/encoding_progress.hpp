@@ -0,0 +1,23 @@
+#ifndef ENCODING_PROGRESS_H
+#define ENCODING_PROGRESS_H
+
+#include <QtGlobal>
+#include <optional>
+
+using std::optional;
+
+//!
+//! \brief A snapshot of a job's progress, as reported by ffmpeg's -progress output.
+//!
+struct EncodingProgress
+{
+    double percent = 0;
+    double encodedSeconds = 0;
+    double fps = 0;
+    double speed = 0; // multiple of realtime
+    qint64 totalSizeBytes = 0;
+    double bitrateKbps = 0;
+    optional<double> etaSeconds = {};
+};
+
+#endif
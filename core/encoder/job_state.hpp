@@ -0,0 +1,20 @@
+#ifndef JOB_STATE_H
+#define JOB_STATE_H
+
+//!
+//! \brief Where a job stands, from being queued to being done with.
+//! \details Probing covers the work before encoding: analyzing complexity, finding keyframes to split at
+//! or searching a quality level. Paused and Cancelled override the step the job was at.
+//!
+enum class JobState
+{
+    Queued,
+    Probing,
+    Encoding,
+    Paused,
+    Cancelled,
+    Done,
+    Failed
+};
+
+#endif
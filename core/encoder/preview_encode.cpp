@@ -0,0 +1,95 @@
+#include "preview_encode.hpp"
+#include "encode_job.hpp"
+
+PreviewEncode::PreviewEncode(const EncoderOptions& options, QObject* parent)
+    : QObject(parent)
+    , options(options)
+{
+    timer.start();
+}
+
+QList<PreviewEncode::Sample> PreviewEncode::planSamples(const double durationSeconds, const int samplesCount, const double sampleSeconds)
+{
+    if (durationSeconds <= 0)
+        return { { 0, sampleSeconds } };
+
+    // short inputs get fewer samples, so that they do not overlap
+    const double length = qMin(sampleSeconds, durationSeconds);
+    const int count = qBound(1, static_cast<int>(durationSeconds / (2 * length)), samplesCount);
+
+    QList<Sample> samples;
+    for (int i = 0; i < count; i++)
+    {
+        const double center = durationSeconds * (i + 1) / (count + 1);
+        samples.append({ qBound(0.0, center - length / 2, durationSeconds - length), length });
+    }
+
+    return samples;
+}
+
+void PreviewEncode::AddSample(EncodeJob* part, const Sample& sample)
+{
+    const qsizetype index = partsState.size();
+    partsState.append({ .job = part, .sample = sample });
+    remainingParts++;
+
+    connect(part, &EncodeJob::succeeded, this, [this, index](const EncodedOutput& output)
+            { RecordSample(index, output.sizeBytes); });
+    connect(part, &EncodeJob::failed, this, &PreviewEncode::failed);
+}
+
+QList<EncodeJob*> PreviewEncode::parts() const
+{
+    QList<EncodeJob*> jobs;
+
+    for (const Part& part : partsState)
+    {
+        if (part.job)
+            jobs.append(part.job.data());
+    }
+
+    return jobs;
+}
+
+void PreviewEncode::RecordSample(const qsizetype index, const qint64 sizeBytes)
+{
+    Part& part = partsState[index];
+    part.sizeBytes = sizeBytes;
+    part.wallSeconds = part.job->elapsedSeconds();
+    part.fps = part.job->progress().fps;
+
+    if (--remainingParts == 0)
+        emit completed(result());
+}
+
+PreviewEncode::Result PreviewEncode::result() const
+{
+    const double speedFactor = options.speed.value_or(1);
+    const double inputSeconds = options.inputMetadata.durationSeconds;
+
+    double sampledSeconds = 0;
+    double sizeKbps = 0;
+    double wallSeconds = 0;
+    double fps = 0;
+
+    for (const Part& part : partsState)
+    {
+        sampledSeconds += part.sample.durationSeconds;
+        sizeKbps += part.sizeBytes / 125.0;
+        wallSeconds += part.wallSeconds;
+        fps += part.fps;
+    }
+
+    Result result { .samplesCount = static_cast<int>(partsState.size()) };
+    if (sampledSeconds <= 0 || partsState.isEmpty())
+        return result;
+
+    // sizes scale with the output duration, which speed changes shorten or lengthen
+    result.projectedSizeKbps = sizeKbps / (sampledSeconds / speedFactor) * (inputSeconds / speedFactor);
+    result.speed = wallSeconds > 0 ? sampledSeconds / wallSeconds : 0;
+    result.projectedWallSeconds = result.speed > 0 ? inputSeconds / result.speed : 0;
+    result.fps = fps / partsState.size();
+    result.wallSeconds = timer.elapsed() / 1000.0;
+
+    return result;
+}
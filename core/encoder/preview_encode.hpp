@@ -0,0 +1,80 @@
+#ifndef PREVIEW_ENCODE_H
+#define PREVIEW_ENCODE_H
+
+#include "encoder_options.hpp"
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QTemporaryDir>
+
+class EncodeJob;
+
+//!
+//! \brief Encodes a few short samples of an input with the options of a full encode, to project its size and duration.
+//! \details The samples are created and scheduled by MediaEncoder with the same commands as the full encode,
+//! restricted to their range; this only collects how they went. Sample outputs are removed along with the preview.
+//!
+class PreviewEncode : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Sample
+    {
+        double startSeconds;
+        double durationSeconds;
+    };
+
+    struct Result
+    {
+        double projectedSizeKbps = 0;
+        //! How long the full encode would take at the speed the samples were encoded at.
+        double projectedWallSeconds = 0;
+        double fps = 0;
+        double speed = 0; // multiple of realtime, over all passes
+        //! How long the preview itself took, waiting for free slots included.
+        double wallSeconds = 0;
+        int samplesCount = 0;
+    };
+
+    PreviewEncode(const EncoderOptions& options, QObject* parent = nullptr);
+
+    //! Spreads samples evenly across the input, away from its ends where intros and credits would skew the projection.
+    static QList<Sample> planSamples(double durationSeconds, int samplesCount = defaultSamplesCount, double sampleSeconds = defaultSampleSeconds);
+
+    [[nodiscard]] QString scratchPath() const { return scratchDir.path(); }
+    void AddSample(EncodeJob* part, const Sample& sample);
+    //! The samples that were not deleted yet.
+    [[nodiscard]] QList<EncodeJob*> parts() const;
+
+    static constexpr int defaultSamplesCount = 3;
+    static constexpr double defaultSampleSeconds = 5;
+
+signals:
+    void completed(const PreviewEncode::Result& result);
+    void failed(QString error, QString errorDetails = "");
+
+private:
+    void RecordSample(qsizetype index, qint64 sizeBytes);
+    [[nodiscard]] Result result() const;
+
+    const EncoderOptions options;
+    QTemporaryDir scratchDir;
+    QElapsedTimer timer;
+
+    struct Part
+    {
+        QPointer<EncodeJob> job;
+        Sample sample;
+        qint64 sizeBytes = 0;
+        double wallSeconds = 0;
+        double fps = 0;
+    };
+
+    QList<Part> partsState;
+    int remainingParts = 0;
+};
+
+#endif
@@ -0,0 +1,110 @@
+#include "quality_level_cache.hpp"
+#include "core/formats/ffmpeg_format_support_loader.hpp"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <algorithm>
+
+optional<int> QualityLevelCache::levelFor(const EncoderOptions& options)
+{
+    Load();
+
+    const QString cacheKey = key(options);
+    if (!entries.contains(cacheKey))
+        return {};
+
+    QJsonObject entry = entries.value(cacheKey).toObject();
+
+    // persisted along with the next level found, which is enough to keep recently used ones
+    entry.insert("usedAt", QDateTime::currentMSecsSinceEpoch());
+    entries.insert(cacheKey, entry);
+
+    return entry.value("level").toInt();
+}
+
+void QualityLevelCache::Record(const EncoderOptions& options, const int level)
+{
+    Load();
+    entries.insert(key(options), QJsonObject {
+                                     { "level", level },
+                                     { "usedAt", QDateTime::currentMSecsSinceEpoch() },
+                                 });
+
+    // a level ends a whole search, so there is no burst of them to wait for
+    Save();
+}
+
+void QualityLevelCache::Load()
+{
+    if (isLoaded)
+        return;
+
+    isLoaded = true;
+
+    QFile file(QDir(FFmpegFormatSupportLoader::cacheDirectory()).filePath("quality_levels.json"));
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    const QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+    if (root.value("version").toInt() == cacheFormatVersion)
+        entries = root.value("entries").toObject();
+}
+
+void QualityLevelCache::Save()
+{
+    if (entries.size() > maxEntries)
+    {
+        QList<std::pair<qint64, QString>> usages;
+        for (auto it = entries.constBegin(); it != entries.constEnd(); ++it)
+            usages.append({ it.value().toObject().value("usedAt").toInteger(), it.key() });
+
+        std::sort(usages.begin(), usages.end());
+
+        for (qsizetype i = 0; i < usages.size() - maxEntries; i++)
+            entries.remove(usages.at(i).second);
+    }
+
+    QDir().mkpath(FFmpegFormatSupportLoader::cacheDirectory());
+
+    QSaveFile file(QDir(FFmpegFormatSupportLoader::cacheDirectory()).filePath("quality_levels.json"));
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    file.write(QJsonDocument(QJsonObject { { "version", cacheFormatVersion }, { "entries", entries } }).toJson(QJsonDocument::Compact));
+    file.commit();
+}
+
+QString QualityLevelCache::key(const EncoderOptions& options)
+{
+    const QFileInfo input(options.inputPath);
+    const auto optionalNumber = [](const auto& value)
+    {
+        return value.has_value() ? QString::number(*value) : QString();
+    };
+
+    QStringList identity {
+        input.absoluteFilePath(),
+        QString::number(input.size()),
+        QString::number(input.lastModified().toMSecsSinceEpoch()),
+        options.videoCodec.has_value() ? options.videoCodec->libraryName : "",
+        optionalNumber(options.targetQuality),
+        optionalNumber(options.outputWidth),
+        optionalNumber(options.outputHeight),
+        optionalNumber(options.fps),
+        optionalNumber(options.speed),
+        options.customArguments.value_or(""),
+    };
+
+    // only appended when trimmed, so that the levels of untrimmed inputs keep the keys they were found under
+    if (options.trimStartSeconds.has_value() || options.trimEndSeconds.has_value())
+        identity << optionalNumber(options.trimStartSeconds) << optionalNumber(options.trimEndSeconds);
+
+    // a hash keeps paths, and the inputs they name, out of the cache file
+    const QByteArray hash = QCryptographicHash::hash(identity.join('|').toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QString::fromLatin1(hash);
+}
@@ -0,0 +1,32 @@
+#ifndef QUALITY_LEVEL_CACHE_H
+#define QUALITY_LEVEL_CACHE_H
+
+#include "encoder_options.hpp"
+
+#include <QJsonObject>
+
+//!
+//! \brief Remembers the quality level a search found for an input, so that encoding it again skips the search.
+//! \details Levels are kept in a file of the cache folder, keyed by the input file and by every option that changes
+//! what the encoder sees or aims for; past maxEntries, the least recently used are dropped.
+//!
+class QualityLevelCache
+{
+public:
+    [[nodiscard]] optional<int> levelFor(const EncoderOptions& options);
+    void Record(const EncoderOptions& options, int level);
+
+    static constexpr int maxEntries = 2048;
+
+private:
+    [[nodiscard]] static QString key(const EncoderOptions& options);
+    void Load();
+    void Save();
+
+    QJsonObject entries;
+    bool isLoaded = false;
+
+    static constexpr int cacheFormatVersion = 1;
+};
+
+#endif
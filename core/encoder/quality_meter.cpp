@@ -0,0 +1,82 @@
+#include "quality_meter.hpp"
+
+#include <QRegularExpression>
+#include <QThread>
+
+QualityMeter::QualityMeter(QObject* parent)
+    : QObject(parent)
+    , ffmpeg(new QProcess(this))
+{
+    // scores are printed at the info level, on stderr
+    ffmpeg->setProcessChannelMode(QProcess::MergedChannels);
+
+    connect(ffmpeg, &QProcess::finished, this, &QualityMeter::EndMeasure);
+    connect(ffmpeg, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error)
+            {
+        if (error == QProcess::FailedToStart)
+            emit measured({}); });
+}
+
+void QualityMeter::MeasureAsync(const Metric metric, const QString& distortedPath, const Reference& reference)
+{
+    currentMetric = metric;
+
+    QStringList referenceRange;
+    if (reference.startSeconds.has_value())
+        referenceRange << "-ss" << QString::number(*reference.startSeconds, 'f', 6);
+    if (reference.durationSeconds.has_value())
+        referenceRange << "-t" << QString::number(*reference.durationSeconds, 'f', 6);
+
+    const QString comparison = metric == Metric::Vmaf
+        ? QString("libvmaf=n_threads=%1").arg(QThread::idealThreadCount())
+        : QString("ssim");
+
+    // the distorted input comes first, as both filters expect
+    const QString referenceFps = reference.fps.has_value() ? QString("fps=%1,").arg(*reference.fps) : QString();
+    const QString graph = QString("[0:v]scale=%1:%2:flags=bicubic,setsar=1[distorted];[1:v]%3setsar=1[reference];[distorted][reference]%4")
+                              .arg(QString::number(reference.width), QString::number(reference.height), referenceFps, comparison);
+
+    ffmpeg->start("ffmpeg", QStringList { "-hide_banner", "-nostats", "-i", distortedPath }
+                                << referenceRange << QStringList { "-i", reference.path, "-lavfi", graph, "-f", "null", "-" });
+}
+
+void QualityMeter::EndMeasure(const int exitCode, const QProcess::ExitStatus exitStatus)
+{
+    if (exitStatus == QProcess::CrashExit || exitCode != 0)
+    {
+        emit measured({});
+        return;
+    }
+
+    emit measured(parseScore(currentMetric, QString::fromUtf8(ffmpeg->readAll())));
+}
+
+optional<QualityMeter::Metric> QualityMeter::metricFromName(const QString& name)
+{
+    if (name.compare("vmaf", Qt::CaseInsensitive) == 0)
+        return Metric::Vmaf;
+    if (name.compare("ssim", Qt::CaseInsensitive) == 0)
+        return Metric::Ssim;
+
+    return {};
+}
+
+QString QualityMeter::metricName(const Metric metric)
+{
+    return metric == Metric::Vmaf ? "vmaf" : "ssim";
+}
+
+optional<double> QualityMeter::parseScore(const Metric metric, const QString& log)
+{
+    // "VMAF score: 95.123456" and "SSIM Y:0.99 (20.1) U:0.99 (21.3) V:0.99 (21.0) All:0.991234 (20.5)"
+    static const QRegularExpression vmafScore(R"(VMAF score[:=]\s*([0-9.]+))");
+    static const QRegularExpression ssimScore(R"(SSIM .*All:([0-9.]+))");
+
+    const QRegularExpressionMatch match = (metric == Metric::Vmaf ? vmafScore : ssimScore).match(log);
+    if (!match.hasMatch())
+        return {};
+
+    bool ok = false;
+    const double score = match.captured(1).toDouble(&ok);
+    return ok ? optional(score) : std::nullopt;
+}
@@ -0,0 +1,59 @@
+#ifndef QUALITY_METER_H
+#define QUALITY_METER_H
+
+#include <QObject>
+#include <QProcess>
+#include <QString>
+#include <optional>
+
+using std::optional;
+
+//!
+//! \brief Scores an encode against its source with ffmpeg's libvmaf or ssim filters.
+//! \details The encode is scaled to the size of the source first, so that resized outputs can be compared.
+//! Outputs with a different speed than the source would be compared frame by frame all the same,
+//! and should not be measured.
+//!
+class QualityMeter : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Metric
+    {
+        Vmaf, // 0 to 100
+        Ssim  // 0 to 1
+    };
+
+    //! The part of the source that was encoded; the whole source when empty.
+    struct Reference
+    {
+        QString path;
+        int width;
+        int height;
+        optional<double> startSeconds = {};
+        optional<double> durationSeconds = {};
+        //! The frame rate the encode was converted to, which the source is converted to as well.
+        optional<double> fps = {};
+    };
+
+    explicit QualityMeter(QObject* parent = nullptr);
+
+    void MeasureAsync(Metric metric, const QString& distortedPath, const Reference& reference);
+
+    [[nodiscard]] static optional<Metric> metricFromName(const QString& name);
+    [[nodiscard]] static QString metricName(Metric metric);
+    [[nodiscard]] static optional<double> parseScore(Metric metric, const QString& log);
+
+signals:
+    //! Empty when the measure failed, for instance because ffmpeg was built without libvmaf.
+    void measured(optional<double> score);
+
+private:
+    void EndMeasure(int exitCode, QProcess::ExitStatus exitStatus);
+
+    QProcess* ffmpeg;
+    Metric currentMetric = Metric::Vmaf;
+};
+
+#endif
@@ -0,0 +1,32 @@
+#include "quality_scale.hpp"
+
+#include <QHash>
+
+optional<QualityScale> QualityScale::forEncoder(const QString& libraryName)
+{
+    static const QHash<QString, QualityScale> scales = {
+        { "libx264", { "-crf %1", 12, 40 } },
+        { "libx264rgb", { "-crf %1", 12, 40 } },
+        { "libx265", { "-crf %1", 12, 40 } },
+        // without -b:v 0, libvpx and libaom treat the level as a cap on a default bitrate
+        { "libvpx", { "-crf %1 -b:v 0", 10, 55 } },
+        { "libvpx-vp9", { "-crf %1 -b:v 0", 15, 55 } },
+        { "libaom-av1", { "-crf %1 -b:v 0", 15, 58 } },
+        { "libsvtav1", { "-crf %1", 15, 58 } },
+    };
+
+    if (scales.contains(libraryName))
+        return scales.value(libraryName);
+
+    // hardware encoders share a rate control per vendor, whatever their codec
+    if (libraryName.endsWith("_nvenc"))
+        return QualityScale { "-rc vbr -cq %1 -b:v 0", 15, 45 };
+    if (libraryName.endsWith("_qsv"))
+        return QualityScale { "-global_quality %1", 15, 45 };
+    if (libraryName.endsWith("_vaapi"))
+        return QualityScale { "-rc_mode CQP -qp %1", 15, 45 };
+    if (libraryName.endsWith("_amf"))
+        return QualityScale { "-rc cqp -qp_i %1 -qp_p %1", 15, 45 };
+
+    return {};
+}
@@ -0,0 +1,26 @@
+#ifndef QUALITY_SCALE_H
+#define QUALITY_SCALE_H
+
+#include <QString>
+#include <optional>
+
+using std::optional;
+
+//!
+//! \brief The constant quality setting of a video encoder, such as -crf for libx264 or -cq for the NVENC encoders.
+//! \details Levels go from the best quality to the worst; the range is the one worth searching, not the encoder's whole.
+//!
+struct QualityScale
+{
+    //! Parameters setting the level, which replaces %1; some encoders also need their bitrate limit lifted.
+    QString parameters;
+    int bestLevel;
+    int worstLevel;
+
+    [[nodiscard]] QString params(const int level) const { return parameters.arg(level); }
+
+    //! Empty for encoders that only support a target bitrate.
+    [[nodiscard]] static optional<QualityScale> forEncoder(const QString& libraryName);
+};
+
+#endif
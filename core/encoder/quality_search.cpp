@@ -0,0 +1,131 @@
+#include "quality_search.hpp"
+#include "encode_job.hpp"
+
+QualitySearch::QualitySearch(const EncoderOptions& options, const QualityScale& scale, const int levelsPerRound, QObject* parent)
+    : QObject(parent)
+    , options(options)
+    , scale(scale)
+    , levelsPerRound(qMax(1, levelsPerRound))
+    , searchSamples(PreviewEncode::planSamples(options.inputMetadata.durationSeconds, samplesCount, sampleSeconds))
+    , fromLevel(scale.bestLevel)
+    , toLevel(scale.worstLevel)
+{
+}
+
+QList<int> QualitySearch::nextLevels() const
+{
+    if (fromLevel > toLevel)
+        return {};
+
+    return spreadLevels(fromLevel, toLevel, levelsPerRound);
+}
+
+QList<int> QualitySearch::spreadLevels(const int fromLevel, const int toLevel, const int count)
+{
+    const int levelsCount = toLevel - fromLevel + 1;
+    QList<int> levels;
+
+    // few enough levels are left to try all of them at once
+    if (levelsCount <= count)
+    {
+        for (int level = fromLevel; level <= toLevel; level++)
+            levels.append(level);
+
+        return levels;
+    }
+
+    for (int i = 1; i <= count; i++)
+    {
+        const int level = fromLevel + qRound(static_cast<double>(levelsCount - 1) * i / (count + 1));
+        if (levels.isEmpty() || levels.last() != level)
+            levels.append(level);
+    }
+
+    return levels;
+}
+
+void QualitySearch::AddProbe(const int level, EncodeJob* part, const PreviewEncode::Sample& sample)
+{
+    probes.append(part);
+    remainingProbes++;
+
+    connect(part, &EncodeJob::succeeded, this, [this, level, sample](const EncodedOutput& output)
+            { MeasureProbe(level, output.path, sample); });
+    connect(part, &EncodeJob::failed, this, &QualitySearch::failed);
+}
+
+QList<EncodeJob*> QualitySearch::parts() const
+{
+    QList<EncodeJob*> jobs;
+
+    for (const QPointer<EncodeJob>& probe : probes)
+    {
+        if (probe)
+            jobs.append(probe.data());
+    }
+
+    return jobs;
+}
+
+void QualitySearch::MeasureProbe(const int level, const QString& samplePath, const PreviewEncode::Sample& sample)
+{
+    auto* meter = new QualityMeter(this);
+    connect(meter, &QualityMeter::measured, this, [this, meter, level](optional<double> score)
+            {
+        meter->deleteLater();
+        RecordScore(level, score); });
+
+    // samples are taken within the trimmed input, which the reference is not
+    const Metadata& metadata = options.inputMetadata;
+    meter->MeasureAsync(QualityMeter::Metric::Vmaf, samplePath,
+                        { .path = options.inputPath, .width = static_cast<int>(metadata.width), .height = static_cast<int>(metadata.height),
+                          .startSeconds = sample.startSeconds + options.trimStartSeconds.value_or(0), .durationSeconds = sample.durationSeconds,
+                          .fps = options.fps.has_value() ? optional<double>(*options.fps) : std::nullopt });
+}
+
+void QualitySearch::RecordScore(const int level, const optional<double> score)
+{
+    if (!score.has_value())
+    {
+        remainingProbes = -1;
+        emit failed(tr("Could not measure the quality of the samples."), tr("Quality targets need an ffmpeg build with libvmaf."));
+        return;
+    }
+
+    scores[level].append(*score);
+
+    if (--remainingProbes == 0)
+        CompleteRound();
+}
+
+void QualitySearch::CompleteRound()
+{
+    // levels go from the best quality to the worst, so scores drop as levels rise
+    optional<int> worstPassing;
+    optional<int> bestFailing;
+
+    for (auto it = scores.cbegin(); it != scores.cend(); ++it)
+    {
+        double total = 0;
+        for (const double score : it.value())
+            total += score;
+
+        if (total / it.value().size() >= *options.targetQuality)
+            worstPassing = qMax(worstPassing.value_or(it.key()), it.key());
+        else
+            bestFailing = qMin(bestFailing.value_or(it.key()), it.key());
+    }
+
+    if (worstPassing.has_value())
+    {
+        passingLevel = qMax(passingLevel.value_or(*worstPassing), *worstPassing);
+        fromLevel = *passingLevel + 1;
+    }
+    if (bestFailing.has_value())
+        toLevel = qMin(toLevel, *bestFailing - 1);
+
+    // the range now excludes every level of this round
+    scores.clear();
+    probes.clear();
+    emit roundCompleted();
+}
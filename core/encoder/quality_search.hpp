@@ -0,0 +1,72 @@
+#ifndef QUALITY_SEARCH_H
+#define QUALITY_SEARCH_H
+
+#include "encoder_options.hpp"
+#include "preview_encode.hpp"
+#include "quality_meter.hpp"
+#include "quality_scale.hpp"
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QTemporaryDir>
+
+class EncodeJob;
+
+//!
+//! \brief Searches the worst quality level whose samples still reach a VMAF score, for quality-targeted encodes.
+//! \details Each round tries several levels spread over the range left, so that their samples can be encoded in parallel;
+//! the range then narrows around the levels that reached the score. The sample encodes are created and scheduled
+//! by MediaEncoder; this scores them against the input and plans the next round.
+//!
+class QualitySearch : public QObject
+{
+    Q_OBJECT
+
+public:
+    QualitySearch(const EncoderOptions& options, const QualityScale& scale, int levelsPerRound, QObject* parent = nullptr);
+
+    //! The levels to try next; empty once the search is over.
+    [[nodiscard]] QList<int> nextLevels() const;
+    //! The worst level that reached the score, or the best one of the scale if none did.
+    [[nodiscard]] int result() const { return passingLevel.value_or(scale.bestLevel); }
+    [[nodiscard]] const QList<PreviewEncode::Sample>& samples() const { return searchSamples; }
+
+    [[nodiscard]] QString scratchPath() const { return scratchDir.path(); }
+    //! Follows the encode of a sample at a level, and scores it once done.
+    void AddProbe(int level, EncodeJob* part, const PreviewEncode::Sample& sample);
+    //! The sample encodes that were not deleted yet.
+    [[nodiscard]] QList<EncodeJob*> parts() const;
+
+    static QList<int> spreadLevels(int fromLevel, int toLevel, int count);
+
+    static constexpr int samplesCount = 3;
+    static constexpr double sampleSeconds = 4;
+
+signals:
+    void roundCompleted();
+    void failed(QString error, QString errorDetails = "");
+
+private:
+    void MeasureProbe(int level, const QString& samplePath, const PreviewEncode::Sample& sample);
+    void RecordScore(int level, optional<double> score);
+    void CompleteRound();
+
+    const EncoderOptions options;
+    const QualityScale scale;
+    const int levelsPerRound;
+    QList<PreviewEncode::Sample> searchSamples;
+    QTemporaryDir scratchDir;
+
+    //! Levels left to search, both included.
+    int fromLevel;
+    int toLevel;
+    optional<int> passingLevel;
+
+    QList<QPointer<EncodeJob>> probes;
+    QHash<int, QList<double>> scores;
+    int remainingProbes = 0;
+};
+
+#endif
@@ -0,0 +1,52 @@
+#include "resource_limits.hpp"
+
+ResourceLimits ResourceLimits::fromSettings(const Settings& settings)
+{
+    ResourceLimits limits;
+    limits.priority = priorityFromName(settings.get("Main/sEncoderPriority").toString()).value_or(Priority::Normal);
+
+    for (const QString& core : settings.get("Main/sEncoderCores").toStringList())
+    {
+        bool ok = false;
+        const int index = core.trimmed().toInt(&ok);
+        if (ok)
+            limits.allowedCores.append(index);
+    }
+
+    // zero leaves the choice to ffmpeg, or sets no limit
+    if (const int threads = settings.get("Main/iEncoderThreads").toInt(); threads > 0)
+        limits.threadsCount = threads;
+    if (const int threads = settings.get("Main/iFilterThreads").toInt(); threads > 0)
+        limits.filterThreadsCount = threads;
+    if (const qint64 megabytes = settings.get("Main/iEncoderMemoryLimitMb").toLongLong(); megabytes > 0)
+        limits.memoryLimitMb = megabytes;
+
+    return limits;
+}
+
+optional<ResourceLimits::Priority> ResourceLimits::priorityFromName(const QString& name)
+{
+    const QString lowered = name.trimmed().toLower();
+
+    if (lowered == "normal")
+        return Priority::Normal;
+    if (lowered == "low")
+        return Priority::Low;
+    if (lowered == "idle")
+        return Priority::Idle;
+
+    return {};
+}
+
+int ResourceLimits::niceness(const Priority priority)
+{
+    switch (priority)
+    {
+    case Priority::Low:
+        return 10;
+    case Priority::Idle:
+        return 19;
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef RESOURCE_LIMITS_H
+#define RESOURCE_LIMITS_H
+
+#include "core/settings/settings.hpp"
+
+#include <QList>
+#include <QString>
+#include <optional>
+
+using std::optional;
+
+//!
+//! \brief How much of the machine the ffmpeg processes of a job may take.
+//! \details The scheduler gives each job as many cores as it has threads, among the allowed ones, and packs jobs
+//! so that no core is shared. Priority, cores and memory only apply to local processes; threads apply everywhere.
+//!
+struct ResourceLimits
+{
+    enum class Priority
+    {
+        Normal,
+        Low,
+        Idle
+    };
+
+    Priority priority = Priority::Normal;
+    //! Cores the job may run on; any when empty.
+    QList<int> allowedCores;
+    //! Passed as -threads; when empty, ffmpeg sizes its threads to the cores it was given.
+    optional<int> threadsCount;
+    //! Passed as -filter_threads.
+    optional<int> filterThreadsCount;
+    //! Enforced through a job object on Windows and an address space limit elsewhere, which fails allocations past it.
+    optional<qint64> memoryLimitMb;
+
+    //! From the sEncoderPriority, sEncoderCores, iEncoderThreads, iFilterThreads and iEncoderMemoryLimitMb keys of Main.
+    [[nodiscard]] static ResourceLimits fromSettings(const Settings& settings);
+    [[nodiscard]] static optional<Priority> priorityFromName(const QString& name);
+    //! The nice value of the priority, from 0 to 19.
+    [[nodiscard]] static int niceness(Priority priority);
+};
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef RESOURCE_USAGE_H
+#define RESOURCE_USAGE_H
+
+#include <QtGlobal>
+
+//!
+//! \brief What the ffmpeg processes of a job cost, as reported by ffmpeg's -benchmark output.
+//! \details Times add up over the passes of a job; the peak memory is the highest of them.
+//!
+struct ResourceUsage
+{
+    double userSeconds = 0;
+    double systemSeconds = 0;
+    qint64 peakRssKb = 0;
+
+    [[nodiscard]] double cpuSeconds() const { return userSeconds + systemSeconds; }
+};
+
+#endif
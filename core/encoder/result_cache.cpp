@@ -0,0 +1,229 @@
+#include "result_cache.hpp"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+#include <algorithm>
+#include <filesystem>
+
+ResultCache::ResultCache(std::shared_ptr<Settings> settings)
+    : settings(std::move(settings))
+{
+    const QString configuredDirectory = this->settings->get("Main/sResultCacheDirectory").toString();
+    directory = !configuredDirectory.isEmpty()
+                  ? configuredDirectory
+                  : QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("results");
+    quotaBytes = this->settings->get("Main/iResultCacheMb").toLongLong() * 1024 * 1024;
+}
+
+ResultCache::~ResultCache()
+{
+    for (QThread* thread : findChildren<QThread*>(Qt::FindDirectChildrenOnly))
+        thread->wait();
+}
+
+optional<QString> ResultCache::lookup(const QString& key)
+{
+    Load();
+    if (!isEnabled() || key.isEmpty() || !entries.contains(key))
+        return {};
+
+    Entry& entry = entries[key];
+    const QFileInfo result(QDir(directory).filePath(entry.fileName));
+
+    // deleted from the folder, or changed through a link made outside of it
+    if (!result.exists() || result.size() != entry.sizeBytes)
+    {
+        Remove(key);
+        Save();
+        return {};
+    }
+
+    entry.lastUsed = QDateTime::currentDateTimeUtc();
+    Save();
+    return result.filePath();
+}
+
+void ResultCache::Store(const QString& key, const QString& outputPath)
+{
+    Load();
+    if (!isEnabled() || key.isEmpty() || entries.contains(key) || pendingKeys.contains(key))
+        return;
+
+    // a result larger than the whole quota would only evict every other one before being evicted itself
+    const QFileInfo output(outputPath);
+    if (!output.isFile() || output.size() > quotaBytes)
+        return;
+
+    QDir().mkpath(directory);
+
+    const Entry entry { output.suffix().isEmpty() ? key : key + "." + output.suffix(), output.size(), QDateTime::currentDateTimeUtc() };
+    auto error = std::make_shared<QString>();
+    QThread* writer = QThread::create([from = output.filePath(), to = QDir(directory).filePath(entry.fileName), error]
+                                      { *error = linkOrCopy(from, to); });
+    writer->setParent(this);
+    pendingKeys.insert(key);
+
+    connect(writer, &QThread::finished, this, [this, writer, error, key, entry]
+            {
+        writer->deleteLater();
+        pendingKeys.remove(key);
+
+        // a result that could not be kept is only encoded again next time
+        if (!error->isEmpty())
+            return;
+
+        entries.insert(key, entry);
+        Evict();
+        Save(); });
+
+    writer->start();
+}
+
+QString ResultCache::keyFor(const QString& inputPath, const QString& parameters)
+{
+    QFile input(inputPath);
+    if (!input.open(QIODevice::ReadOnly))
+        return {};
+
+    const QFileInfo info(input);
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(QString("%1|%2|%3|").arg(QString::number(info.size()), QString::number(info.lastModified().toMSecsSinceEpoch()), parameters.simplified()).toUtf8());
+
+    // the size and time already tell most edits apart; samples catch files rewritten in place with both kept
+    for (const qint64 offset : { qint64(0), (info.size() - sampleBytes) / 2, info.size() - sampleBytes })
+    {
+        if (!input.seek(qMax(qint64(0), offset)))
+            return {};
+
+        hash.addData(input.read(sampleBytes));
+    }
+
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+QString ResultCache::linkOrCopy(const QString& from, const QString& to)
+{
+    namespace fs = std::filesystem;
+    const fs::path source(from.toStdU16String());
+    const fs::path target(to.toStdU16String());
+    const fs::path partial = target.parent_path() / (target.filename().u16string() + u".sme-part");
+    std::error_code error;
+
+    fs::remove(partial, error);
+    fs::create_hard_link(source, partial, error);
+    if (error)
+        fs::copy_file(source, partial, fs::copy_options::overwrite_existing, error);
+
+    // renamed over the target, so that a file there is replaced rather than written through
+    if (!error)
+        fs::rename(partial, target, error);
+
+    if (error)
+    {
+        std::error_code ignored;
+        fs::remove(partial, ignored);
+        return QString::fromStdString(error.message()) + "\n\n" + from + " -> " + to;
+    }
+
+    return {};
+}
+
+void ResultCache::Detach(const QString& path)
+{
+    namespace fs = std::filesystem;
+    const fs::path target(path.toStdU16String());
+    std::error_code error;
+
+    const std::uintmax_t linksCount = fs::hard_link_count(target, error);
+    if (!error && linksCount > 1)
+        fs::remove(target, error);
+}
+
+void ResultCache::Load()
+{
+    if (isLoaded)
+        return;
+
+    isLoaded = true;
+
+    QFile index(indexPath());
+    if (!index.open(QIODevice::ReadOnly))
+        return;
+
+    const QJsonObject root = QJsonDocument::fromJson(index.readAll()).object();
+    if (root.value("version").toInt() != indexFormatVersion)
+        return;
+
+    const QJsonObject results = root.value("results").toObject();
+    for (auto it = results.constBegin(); it != results.constEnd(); ++it)
+    {
+        const QJsonObject result = it.value().toObject();
+        entries.insert(it.key(), {
+                                     result.value("file").toString(),
+                                     result.value("sizeBytes").toInteger(),
+                                     QDateTime::fromString(result.value("lastUsed").toString(), Qt::ISODateWithMs),
+                                 });
+    }
+
+    // the quota may have been lowered since
+    if (isEnabled())
+        Evict();
+}
+
+void ResultCache::Save() const
+{
+    QJsonObject results;
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it)
+    {
+        results.insert(it.key(), QJsonObject {
+                                     { "file", it->fileName },
+                                     { "sizeBytes", it->sizeBytes },
+                                     { "lastUsed", it->lastUsed.toString(Qt::ISODateWithMs) },
+                                 });
+    }
+
+    QDir().mkpath(directory);
+
+    // written aside and renamed, so that a crash while saving leaves the previous index
+    QSaveFile index(indexPath());
+    if (!index.open(QIODevice::WriteOnly))
+        return;
+
+    index.write(QJsonDocument(QJsonObject { { "version", indexFormatVersion }, { "results", results } }).toJson(QJsonDocument::Compact));
+    index.commit();
+}
+
+void ResultCache::Evict()
+{
+    qint64 totalBytes = 0;
+    for (const Entry& entry : std::as_const(entries))
+        totalBytes += entry.sizeBytes;
+
+    while (totalBytes > quotaBytes && !entries.isEmpty())
+    {
+        const auto oldest = std::min_element(entries.cbegin(), entries.cend(), [](const Entry& a, const Entry& b)
+                                             { return a.lastUsed < b.lastUsed; });
+
+        const QString key = oldest.key();
+        totalBytes -= oldest->sizeBytes;
+        Remove(key);
+    }
+}
+
+void ResultCache::Remove(const QString& key)
+{
+    // only the link of the folder goes; an output sharing the data keeps it
+    QFile::remove(QDir(directory).filePath(entries.take(key).fileName));
+}
+
+QString ResultCache::indexPath() const
+{
+    return QDir(directory).filePath("index.json");
+}
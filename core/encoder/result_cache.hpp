@@ -0,0 +1,75 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include "core/settings/settings.hpp"
+
+#include <QDateTime>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <di.hpp>
+#include <memory>
+#include <optional>
+
+using std::optional;
+
+//!
+//! \brief Keeps the outputs of past encodes, so that an identical request is answered with the previous output.
+//! \details Results are keyed by a partial hash of the input, its size and modification time, and the parameters
+//! the encoder was given, and live in a folder of their own up to the size set with iResultCacheMb, after which the
+//! least recently used ones go first. Each is a hard link to the output when both are on one file system, and a
+//! copy otherwise. Outputs are never written through such a link: see Detach().
+//!
+class ResultCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    BOOST_DI_INJECT(ResultCache, (named = di_settings) std::shared_ptr<Settings> settings);
+    //! Waits for results being copied in, as one cut short would be kept half written.
+    ~ResultCache() override;
+
+    [[nodiscard]] bool isEnabled() const { return quotaBytes > 0; }
+
+    //! The cached result of an identical encode, which counts as using it; empty when there is none.
+    [[nodiscard]] optional<QString> lookup(const QString& key);
+    //! Keeps the output on a worker thread, then evicts results past the quota.
+    void Store(const QString& key, const QString& outputPath);
+
+    //! Identifies an encode of the input with these parameters, whitespace aside.
+    //! Only the start, middle and end of the input are read, along with its size and modification time.
+    [[nodiscard]] static QString keyFor(const QString& inputPath, const QString& parameters);
+    //! Hard links the file when both paths are on one file system, and copies it otherwise, replacing what is there.
+    //! Returns the error, if any.
+    [[nodiscard]] static QString linkOrCopy(const QString& from, const QString& to);
+    //! Unlinks the file when it shares its data with a cached result, so that writing to the path leaves the result intact.
+    static void Detach(const QString& path);
+
+private:
+    struct Entry
+    {
+        QString fileName;
+        qint64 sizeBytes = 0;
+        QDateTime lastUsed;
+    };
+
+    void Load();
+    void Save() const;
+    void Evict();
+    void Remove(const QString& key);
+    [[nodiscard]] QString indexPath() const;
+
+    std::shared_ptr<Settings> settings;
+    QString directory;
+    qint64 quotaBytes = 0;
+    bool isLoaded = false;
+    QHash<QString, Entry> entries;
+    //! Keys of the results being copied in, which no other encode stores again meanwhile.
+    QSet<QString> pendingKeys;
+
+    static constexpr int indexFormatVersion = 1;
+    //! Bytes read at each of the three places the input is sampled.
+    static constexpr qint64 sampleBytes = 64 * 1024;
+};
+
+#endif
@@ -0,0 +1,231 @@
+#include "resumable_encode.hpp"
+#include "encode_job.hpp"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <algorithm>
+
+ResumableEncode::ResumableEncode(const QString& outputPath, const QString& fingerprint, QObject* parent)
+    : QObject(parent)
+    , path(directoryFor(outputPath))
+    , fingerprint(fingerprint)
+{
+}
+
+ResumableEncode::~ResumableEncode()
+{
+    if (isDiscarded)
+        QDir(path).removeRecursively();
+}
+
+void ResumableEncode::Load()
+{
+    QDir dir(path);
+    QFile manifest(manifestPath());
+
+    if (manifest.open(QIODevice::ReadOnly))
+    {
+        const QJsonObject root = QJsonDocument::fromJson(manifest.readAll()).object();
+        manifest.close();
+
+        if (root.value("version").toInt() == manifestFormatVersion && root.value("fingerprint").toString() == fingerprint)
+        {
+            for (const QJsonValue& value : root.value("segments").toArray())
+            {
+                const QJsonObject segment = value.toObject();
+                segmentsDone.append({ segment.value("file").toString(), segment.value("startSeconds").toDouble(), segment.value("endSeconds").toDouble() });
+            }
+
+            if (root.contains("videoBitrateKbps"))
+                bitrateKbps = root.value("videoBitrateKbps").toDouble();
+
+            runOffsetSeconds = root.value("runOffsetSeconds").toDouble();
+            complete = root.value("complete").toBool();
+        }
+        else
+        {
+            // segments of other options or of another input would not match the rest of the output
+            dir.removeRecursively();
+        }
+    }
+
+    dir.mkpath(".");
+
+    // the run may have been interrupted right after closing segments it never got to checkpoint
+    if (!complete && Harvest())
+        Save();
+
+    for (const QString& fileName : dir.entryList({ "segment_*" }, QDir::Files))
+    {
+        const bool isDone = std::any_of(segmentsDone.cbegin(), segmentsDone.cend(), [&fileName](const Segment& segment)
+                                        { return segment.fileName == fileName; });
+        if (!isDone)
+            dir.remove(fileName);
+    }
+}
+
+bool ResumableEncode::BeginRun()
+{
+    runOffsetSeconds = resumeSeconds();
+    harvestedListSize = -1;
+    complete = false;
+
+    // its segments were all recorded, and ffmpeg would append to it otherwise
+    QFile::remove(listPath());
+    return Save();
+}
+
+void ResumableEncode::Checkpoint()
+{
+    // a missed checkpoint only costs encoding its segments again
+    if (Harvest())
+        Save();
+}
+
+void ResumableEncode::Complete()
+{
+    Harvest();
+    complete = true;
+    Save();
+}
+
+QList<EncodeJob*> ResumableEncode::parts() const
+{
+    return runPart.isNull() ? QList<EncodeJob*>() : QList<EncodeJob*> { runPart.data() };
+}
+
+QStringList ResumableEncode::segmentPaths() const
+{
+    const QDir dir(path);
+    QStringList paths;
+
+    for (const Segment& segment : segmentsDone)
+        paths.append(dir.filePath(segment.fileName));
+
+    return paths;
+}
+
+QString ResumableEncode::segmentPattern() const
+{
+    return QDir(path).filePath("segment_%05d.mkv");
+}
+
+QString ResumableEncode::listPath() const
+{
+    return QDir(path).filePath("segments.csv");
+}
+
+QString ResumableEncode::muxerParams(const int startNumber, const bool forcesKeyframes) const
+{
+    QStringList params {
+        QString("-segment_time %1 -segment_format matroska -segment_start_number %2").arg(segmentSeconds).arg(startNumber),
+        // each segment starts at zero, as the concat demuxer expects
+        "-reset_timestamps 1",
+        QString(R"(-segment_list "%1" -segment_list_type csv)").arg(listPath()),
+    };
+
+    // segments can only be cut at keyframes, which the encoder may otherwise place far apart
+    if (forcesKeyframes)
+        params.append(QString(R"(-force_key_frames "expr:gte(t,n_forced*%1)")").arg(segmentSeconds));
+
+    return params.join(" ");
+}
+
+QString ResumableEncode::directoryFor(const QString& outputPath)
+{
+    const QFileInfo output(outputPath);
+    return output.dir().filePath(QString(".%1.sme-resume").arg(output.fileName()));
+}
+
+QList<ResumableEncode::Segment> ResumableEncode::parseSegmentList(const QByteArray& list, const double offsetSeconds)
+{
+    QList<Segment> segments;
+
+    for (const QByteArray& line : list.split('\n'))
+    {
+        const QList<QByteArray> fields = line.trimmed().split(',');
+        if (fields.size() < 3)
+            continue;
+
+        bool isStartValid = false;
+        bool isEndValid = false;
+        const double startSeconds = fields.at(fields.size() - 2).toDouble(&isStartValid);
+        const double endSeconds = fields.last().toDouble(&isEndValid);
+
+        // a file name with commas is quoted, and only the times are needed unquoted
+        QString fileName = QString::fromUtf8(fields.first(fields.size() - 2).join(','));
+        if (fileName.startsWith('"') && fileName.endsWith('"'))
+            fileName = fileName.sliced(1, fileName.size() - 2).replace(R"("")", R"(")");
+
+        if (isStartValid && isEndValid && !fileName.isEmpty())
+            segments.append({ fileName, offsetSeconds + startSeconds, offsetSeconds + endSeconds });
+    }
+
+    return segments;
+}
+
+bool ResumableEncode::Harvest()
+{
+    const QFileInfo listInfo(listPath());
+    if (!listInfo.exists() || listInfo.size() == harvestedListSize)
+        return false;
+
+    QFile list(listPath());
+    if (!list.open(QIODevice::ReadOnly))
+        return false;
+
+    harvestedListSize = listInfo.size();
+    const QDir dir(path);
+    bool hasNewSegments = false;
+
+    for (const Segment& segment : parseSegmentList(list.readAll(), runOffsetSeconds))
+    {
+        const bool isKnown = std::any_of(segmentsDone.cbegin(), segmentsDone.cend(), [&segment](const Segment& done)
+                                         { return done.fileName == segment.fileName; });
+
+        if (!isKnown && dir.exists(segment.fileName))
+        {
+            segmentsDone.append(segment);
+            hasNewSegments = true;
+        }
+    }
+
+    return hasNewSegments;
+}
+
+bool ResumableEncode::Save() const
+{
+    QJsonArray segments;
+    for (const Segment& segment : segmentsDone)
+        segments.append(QJsonObject { { "file", segment.fileName }, { "startSeconds", segment.startSeconds }, { "endSeconds", segment.endSeconds } });
+
+    // written aside and renamed, so that a crash while saving leaves the previous manifest
+    QSaveFile manifest(manifestPath());
+    if (!manifest.open(QIODevice::WriteOnly))
+        return false;
+
+    QJsonObject root {
+        { "version", manifestFormatVersion },
+        { "fingerprint", fingerprint },
+        { "runOffsetSeconds", runOffsetSeconds },
+        { "complete", complete },
+        { "segments", segments },
+    };
+
+    if (bitrateKbps.has_value())
+        root.insert("videoBitrateKbps", *bitrateKbps);
+
+    manifest.write(QJsonDocument(root).toJson());
+
+    return manifest.commit();
+}
+
+QString ResumableEncode::manifestPath() const
+{
+    return QDir(path).filePath("manifest.json");
+}
@@ -0,0 +1,95 @@
+#ifndef RESUMABLE_ENCODE_H
+#define RESUMABLE_ENCODE_H
+
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QStringList>
+#include <optional>
+
+class EncodeJob;
+
+//!
+//! \brief Checkpoints an encode as segments under a folder next to its output, so that an interrupted one resumes.
+//! \details ffmpeg writes the segments and lists each one it closed; the manifest records them for the run, along
+//! with a fingerprint of the options and input, so that a restart with other options starts over instead, and the
+//! video bitrate of the first run, which the later ones encode at. Segments
+//! that no manifest vouches for were cut short, and are encoded again. Once all of them are done, MediaEncoder
+//! concatenates them, and the folder is removed when the job succeeds or is cancelled.
+//!
+class ResumableEncode : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Segment
+    {
+        QString fileName;
+        //! Times are on the output timeline, which differs from the input one at other speeds.
+        double startSeconds;
+        double endSeconds;
+    };
+
+    ResumableEncode(const QString& outputPath, const QString& fingerprint, QObject* parent = nullptr);
+    //! Removes the folder when the encode was discarded; it is kept otherwise, for a restart to resume.
+    ~ResumableEncode() override;
+
+    //! Reads what an earlier run of the same encode left behind, and wipes it if it was not the same encode.
+    void Load();
+    //! Records where the next run starts; false when the manifest cannot be written.
+    bool BeginRun();
+    //! Records the segments the running ffmpeg closed since the last checkpoint.
+    void Checkpoint();
+    //! Records that the last segment was written, so that a restart only has the segments left to concatenate.
+    void Complete();
+    //! Marks the folder to be removed along with this.
+    void Discard() { isDiscarded = true; }
+
+    //! Follows the ffmpeg process writing the segments of the current run.
+    void setPart(EncodeJob* part) { runPart = part; }
+    //! The part that was not deleted yet, if any.
+    [[nodiscard]] QList<EncodeJob*> parts() const;
+
+    [[nodiscard]] bool isComplete() const { return complete; }
+    //! The video bitrate the segments were encoded at, recorded by the next BeginRun().
+    [[nodiscard]] std::optional<double> videoBitrateKbps() const { return bitrateKbps; }
+    void setVideoBitrateKbps(const std::optional<double>& kbps) { bitrateKbps = kbps; }
+    //! Where the next run starts, on the output timeline.
+    [[nodiscard]] double resumeSeconds() const { return segmentsDone.isEmpty() ? 0 : segmentsDone.last().endSeconds; }
+    [[nodiscard]] QStringList segmentPaths() const;
+    //! The pattern ffmpeg names segments after, and the list it writes them to.
+    [[nodiscard]] QString segmentPattern() const;
+    [[nodiscard]] QString listPath() const;
+    //! Params of the segment muxer, for a run numbering its segments from startNumber.
+    [[nodiscard]] QString muxerParams(int startNumber, bool forcesKeyframes) const;
+    [[nodiscard]] int nextSegmentNumber() const { return static_cast<int>(segmentsDone.size()); }
+
+    //! The folder of the encode writing to outputPath.
+    static QString directoryFor(const QString& outputPath);
+    //! Reads a list of segment_list_type csv, which has a line such as "segment_00003.mkv,90.000000,120.000000" per segment.
+    static QList<Segment> parseSegmentList(const QByteArray& list, double offsetSeconds);
+
+    //! How much encoding an interruption may cost at most, in output seconds.
+    static constexpr double segmentSeconds = 30;
+
+private:
+    //! Adds the segments of the list of the current run that are not recorded yet; true when there were any.
+    bool Harvest();
+    bool Save() const;
+    [[nodiscard]] QString manifestPath() const;
+
+    const QString path;
+    const QString fingerprint;
+    QList<Segment> segmentsDone;
+    std::optional<double> bitrateKbps;
+    double runOffsetSeconds = 0;
+    qint64 harvestedListSize = -1;
+    bool complete = false;
+    bool isDiscarded = false;
+    QPointer<EncodeJob> runPart;
+
+    static constexpr int manifestFormatVersion = 1;
+};
+
+#endif
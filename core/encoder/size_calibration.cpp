@@ -0,0 +1,70 @@
+#include "size_calibration.hpp"
+
+SizeCalibration::SizeCalibration(std::shared_ptr<Settings> settings)
+    : settings(std::move(settings))
+{
+}
+
+double SizeCalibration::overshootCorrectionFor(const EncoderOptions& options) const
+{
+    const QVariant ratio = settings->get(bucketKey(options) + "/ratio");
+
+    if (!ratio.isValid() || ratio.toDouble() <= 0)
+        return options.overshootCorrectionPercent;
+
+    // keep the default safety margin on top of what the encoder usually overshoots by
+    const double correction = 1.0 - (1.0 - options.overshootCorrectionPercent) / ratio.toDouble();
+    return qBound(minCorrectionPercent, correction, maxCorrectionPercent);
+}
+
+void SizeCalibration::Record(const EncoderOptions& options, double requestedSizeKbps, double achievedSizeKbps)
+{
+    if (!options.videoCodec.has_value() || requestedSizeKbps <= 0)
+        return;
+
+    // ratio of the achieved size to the size the encoder was actually asked for
+    const double sample = achievedSizeKbps / requestedSizeKbps;
+
+    // outliers are more likely a broken encode than a drift worth learning
+    if (sample < 0.2 || sample > 5)
+        return;
+
+    const QString key = bucketKey(options);
+    const QVariant previous = settings->get(key + "/ratio");
+    const int samplesCount = settings->get(key + "/samples").toInt();
+
+    const double ratio = previous.isValid() ? smoothingFactor * sample + (1 - smoothingFactor) * previous.toDouble()
+                                            : sample;
+
+    settings->Set(key + "/ratio", ratio);
+    settings->Set(key + "/samples", samplesCount + 1);
+}
+
+QString SizeCalibration::bucketKey(const EncoderOptions& options) const
+{
+    return QString("SizeCalibration/%1_%2_%3p%4")
+        .arg(options.videoCodec.has_value() ? options.videoCodec->libraryName : "none",
+             options.container.formatName,
+             QString::number(resolutionBucket(options)),
+             options.twoPass ? "_2pass" : "");
+}
+
+int SizeCalibration::resolutionBucket(const EncoderOptions& options)
+{
+    const Metadata& metadata = options.inputMetadata;
+    double height = metadata.height;
+
+    if (options.outputHeight.has_value())
+        height = *options.outputHeight;
+    else if (options.outputWidth.has_value() && metadata.width > 0)
+        height = *options.outputWidth * metadata.height / metadata.width;
+
+    static constexpr int buckets[] = { 240, 360, 480, 720, 1080, 1440, 2160 };
+    for (const int bucket : buckets)
+    {
+        if (height <= bucket)
+            return bucket;
+    }
+
+    return 4320;
+}
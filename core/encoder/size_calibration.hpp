@@ -0,0 +1,36 @@
+#ifndef SIZE_CALIBRATION_H
+#define SIZE_CALIBRATION_H
+
+#include "core/settings/settings.hpp"
+#include "encoder_options.hpp"
+
+#include <di.hpp>
+#include <memory>
+
+//!
+//! \brief Learns how far encoders drift from the requested output size, and corrects the target bitrate accordingly.
+//! \details Ratios are kept per video codec, container and resolution bucket in the SizeCalibration section of the settings.
+//!
+class SizeCalibration
+{
+public:
+    BOOST_DI_INJECT(SizeCalibration, (named = di_settings) std::shared_ptr<Settings> settings);
+
+    //! The overshoot correction to apply to the target bitrate, or the options' own when nothing was learned yet.
+    [[nodiscard]] double overshootCorrectionFor(const EncoderOptions& options) const;
+    //! \param requestedSizeKbps The size the encoder was asked for, see MediaEncoder::ComputedOptions; a bitrate scaled
+    //! down with the pixels is not an undershoot to correct.
+    void Record(const EncoderOptions& options, double requestedSizeKbps, double achievedSizeKbps);
+
+private:
+    [[nodiscard]] QString bucketKey(const EncoderOptions& options) const;
+    [[nodiscard]] static int resolutionBucket(const EncoderOptions& options);
+
+    std::shared_ptr<Settings> settings;
+
+    static constexpr double smoothingFactor = 0.3;
+    static constexpr double minCorrectionPercent = -0.25;
+    static constexpr double maxCorrectionPercent = 0.5;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef DEFAULT_ENCODER_STRATEGY_H
+#define DEFAULT_ENCODER_STRATEGY_H
+
+#include "core/encoder/encoder.hpp"
+#include "core/encoder/encoder_options.hpp"
+#include "core/encoder/encoder_strategy.hpp"
+
+#ifdef SME_WITH_LIBAV
+#include "libav_encoder_strategy.hpp"
+#endif
+
+//!
+//! \brief Picks the engine a job runs on: the in-process one when this build has it and it supports the job.
+//! \details Builds without SME_WITH_LIBAV have none, so that every job runs through ffmpeg processes.
+//!
+class DefaultEncoderStrategy
+{
+public:
+    //! An engine owned by parent, or nullptr when the job is to run through ffmpeg.
+    [[nodiscard]] static EncoderStrategy* createFor([[maybe_unused]] const EncoderOptions& options,
+                                                    [[maybe_unused]] const MediaEncoder::ComputedOptions& computed,
+                                                    [[maybe_unused]] QObject* parent)
+    {
+#ifdef SME_WITH_LIBAV
+        if (LibavEncoderStrategy::supports(options, computed))
+            return new LibavEncoderStrategy(parent);
+#endif
+
+        return nullptr;
+    }
+};
+
+#endif
@@ -0,0 +1,625 @@
+#include "libav_encoder_strategy.hpp"
+
+#include "core/encoder/animated_image.hpp"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QList>
+#include <algorithm>
+#include <functional>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+}
+
+namespace
+{
+QString errorText(const int code)
+{
+    char text[AV_ERROR_MAX_STRING_SIZE] = {};
+    av_strerror(code, text, sizeof(text));
+    return QString::fromUtf8(text);
+}
+
+//! The formats an encoder takes, in its order of preference; empty when it takes any.
+template <typename T>
+QList<T> listUntil(const T* values, const T end)
+{
+    QList<T> list;
+    for (const T* value = values; value != nullptr && *value != end; value++)
+        list.append(*value);
+
+    return list;
+}
+
+// the lists of AVCodec are deprecated from libavcodec 61.13 on, in favor of avcodec_get_supported_config()
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(61, 13, 100)
+template <typename T>
+QList<T> supportedConfigs(const AVCodec* codec, const AVCodecConfig config, const T end)
+{
+    const void* values = nullptr;
+    avcodec_get_supported_config(nullptr, codec, config, 0, &values, nullptr);
+    return listUntil(static_cast<const T*>(values), end);
+}
+
+QList<AVPixelFormat> pixelFormatsOf(const AVCodec* codec) { return supportedConfigs(codec, AV_CODEC_CONFIG_PIX_FORMAT, AV_PIX_FMT_NONE); }
+QList<AVSampleFormat> sampleFormatsOf(const AVCodec* codec) { return supportedConfigs(codec, AV_CODEC_CONFIG_SAMPLE_FORMAT, AV_SAMPLE_FMT_NONE); }
+QList<int> sampleRatesOf(const AVCodec* codec) { return supportedConfigs(codec, AV_CODEC_CONFIG_SAMPLE_RATE, 0); }
+#else
+QList<AVPixelFormat> pixelFormatsOf(const AVCodec* codec) { return listUntil(codec->pix_fmts, AV_PIX_FMT_NONE); }
+QList<AVSampleFormat> sampleFormatsOf(const AVCodec* codec) { return listUntil(codec->sample_fmts, AV_SAMPLE_FMT_NONE); }
+QList<int> sampleRatesOf(const AVCodec* codec) { return listUntil(codec->supported_samplerates, 0); }
+#endif
+
+struct StreamContext
+{
+    AVStream* input = nullptr;
+    AVStream* output = nullptr;
+    AVCodecContext* decoder = nullptr;
+    AVCodecContext* encoder = nullptr;
+    AVFilterGraph* graph = nullptr;
+    AVFilterContext* source = nullptr;
+    AVFilterContext* sink = nullptr;
+    double encodedSeconds = 0;
+    qint64 encodedFrames = 0;
+
+    ~StreamContext()
+    {
+        avcodec_free_context(&decoder);
+        avcodec_free_context(&encoder);
+        avfilter_graph_free(&graph);
+    }
+};
+
+//!
+//! \brief One run from the input to the output, which releases everything it opened when destroyed.
+//! \details Functions return the libav error code of the step that failed, which is kept in failedStep.
+//!
+class Transcode
+{
+public:
+    explicit Transcode(const EncoderStrategy::Request& request)
+        : request(request)
+        , packet(av_packet_alloc())
+        , frame(av_frame_alloc())
+        , filtered(av_frame_alloc())
+        , encoded(av_packet_alloc())
+    {
+    }
+
+    ~Transcode()
+    {
+        video.reset();
+        audio.reset();
+
+        if (output != nullptr && !(output->oformat->flags & AVFMT_NOFILE))
+            avio_closep(&output->pb);
+
+        avformat_free_context(output);
+        avformat_close_input(&input);
+        av_packet_free(&packet);
+        av_packet_free(&encoded);
+        av_frame_free(&frame);
+        av_frame_free(&filtered);
+    }
+
+    int Open()
+    {
+        int ret;
+        if ((ret = avformat_open_input(&input, request.inputPath.toUtf8().constData(), nullptr, nullptr)) < 0)
+            return Fail("opening the input", ret);
+        if ((ret = avformat_find_stream_info(input, nullptr)) < 0)
+            return Fail("reading the input streams", ret);
+
+        avformat_alloc_output_context2(&output, nullptr, request.formatName.toUtf8().constData(), request.outputPath.toUtf8().constData());
+        if (output == nullptr)
+            return Fail("creating the output", AVERROR_MUXER_NOT_FOUND);
+
+        // like ffmpeg, a stream missing from the input is only left out
+        if (request.videoEncoder.has_value() && (ret = OpenStream(video, AVMEDIA_TYPE_VIDEO, *request.videoEncoder)) < 0)
+            return ret;
+        if (request.audioEncoder.has_value() && (ret = OpenStream(audio, AVMEDIA_TYPE_AUDIO, *request.audioEncoder)) < 0)
+            return ret;
+        if (video == nullptr && audio == nullptr)
+            return Fail("finding a stream to encode", AVERROR_STREAM_NOT_FOUND);
+
+        if (!(output->oformat->flags & AVFMT_NOFILE) && (ret = avio_open(&output->pb, request.outputPath.toUtf8().constData(), AVIO_FLAG_WRITE)) < 0)
+            return Fail("opening the output", ret);
+
+        AVDictionary* muxerOptions = nullptr;
+        if (request.fastStart)
+            av_dict_set(&muxerOptions, "movflags", "+faststart", 0);
+
+        ret = avformat_write_header(output, &muxerOptions);
+        av_dict_free(&muxerOptions);
+        if (ret < 0)
+            return Fail("writing the output header", ret);
+
+        return 0;
+    }
+
+    //! \param shouldContinue Called between packets; blocks while paused and returns false to stop.
+    int Run(const std::function<bool()>& shouldContinue, const std::function<void(const EncodingProgress&)>& report, const int reportIntervalMs)
+    {
+        QElapsedTimer elapsed;
+        QElapsedTimer sinceReport;
+        elapsed.start();
+        sinceReport.start();
+
+        int ret;
+        while ((ret = av_read_frame(input, packet)) >= 0)
+        {
+            StreamContext* stream = streamFor(packet->stream_index);
+            ret = stream != nullptr ? Decode(*stream, packet) : 0;
+            av_packet_unref(packet);
+
+            if (ret < 0)
+                return ret;
+            if (!shouldContinue())
+                return AVERROR_EXIT;
+
+            if (sinceReport.hasExpired(reportIntervalMs))
+            {
+                report(progress(elapsed.elapsed() / 1000.0));
+                sinceReport.restart();
+            }
+        }
+
+        if (ret != AVERROR_EOF)
+            return Fail("reading the input", ret);
+
+        // what the decoders, filters and encoders still hold is drained in that order
+        for (StreamContext* stream : { video.get(), audio.get() })
+        {
+            if (stream == nullptr)
+                continue;
+            if ((ret = Decode(*stream, nullptr)) < 0)
+                return ret;
+            if ((ret = av_buffersrc_add_frame_flags(stream->source, nullptr, 0)) < 0)
+                return Fail("flushing the filters", ret);
+            if ((ret = Filter(*stream)) < 0)
+                return ret;
+            if ((ret = Encode(*stream, nullptr)) < 0)
+                return ret;
+        }
+
+        if ((ret = av_write_trailer(output)) < 0)
+            return Fail("finishing the output", ret);
+
+        report(progress(elapsed.elapsed() / 1000.0));
+        return 0;
+    }
+
+    QString failedStep;
+
+private:
+    int Fail(const QString& step, const int code)
+    {
+        failedStep = step;
+        return code;
+    }
+
+    [[nodiscard]] StreamContext* streamFor(const int index) const
+    {
+        if (video != nullptr && video->input->index == index)
+            return video.get();
+        if (audio != nullptr && audio->input->index == index)
+            return audio.get();
+
+        return nullptr;
+    }
+
+    int OpenStream(std::unique_ptr<StreamContext>& context, const AVMediaType type, const QString& encoderName)
+    {
+        const int index = av_find_best_stream(input, type, -1, -1, nullptr, 0);
+        if (index < 0)
+            return 0;
+
+        context = std::make_unique<StreamContext>();
+        StreamContext& stream = *context;
+        stream.input = input->streams[index];
+
+        const AVCodec* decoderCodec = avcodec_find_decoder(stream.input->codecpar->codec_id);
+        if (decoderCodec == nullptr)
+            return Fail("finding a decoder", AVERROR_DECODER_NOT_FOUND);
+
+        int ret;
+        stream.decoder = avcodec_alloc_context3(decoderCodec);
+        if ((ret = avcodec_parameters_to_context(stream.decoder, stream.input->codecpar)) < 0)
+            return Fail("setting up the decoder", ret);
+
+        stream.decoder->pkt_timebase = stream.input->time_base;
+        stream.decoder->thread_count = request.threadsCount.value_or(0);
+        if (type == AVMEDIA_TYPE_VIDEO)
+            stream.decoder->framerate = av_guess_frame_rate(input, stream.input, nullptr);
+
+        if ((ret = avcodec_open2(stream.decoder, decoderCodec, nullptr)) < 0)
+            return Fail("opening the decoder", ret);
+
+        const AVCodec* encoderCodec = avcodec_find_encoder_by_name(encoderName.toUtf8().constData());
+        if (encoderCodec == nullptr)
+            return Fail("finding encoder " + encoderName, AVERROR_ENCODER_NOT_FOUND);
+
+        // the filters end with a conversion to what the encoder takes, which is then known from their output
+        if ((ret = BuildFilters(stream, type, encoderCodec)) < 0)
+            return ret;
+
+        AVCodecContext* encoder = stream.encoder = avcodec_alloc_context3(encoderCodec);
+        AVDictionary* encoderOptions = nullptr;
+
+        if (type == AVMEDIA_TYPE_VIDEO)
+        {
+            const AVRational frameRate = av_buffersink_get_frame_rate(stream.sink);
+
+            encoder->width = av_buffersink_get_w(stream.sink);
+            encoder->height = av_buffersink_get_h(stream.sink);
+            encoder->sample_aspect_ratio = av_buffersink_get_sample_aspect_ratio(stream.sink);
+            encoder->pix_fmt = static_cast<AVPixelFormat>(av_buffersink_get_format(stream.sink));
+            encoder->framerate = frameRate;
+            encoder->time_base = frameRate.num > 0 ? av_inv_q(frameRate) : av_buffersink_get_time_base(stream.sink);
+
+            if (request.videoBitrateKbps.has_value())
+                encoder->bit_rate = static_cast<int64_t>(*request.videoBitrateKbps * 1000);
+
+            // parameters such as "-crf 30 -b:v 0" map onto the encoder's own options
+            const QStringList params = request.videoQualityParams.split(' ', Qt::SkipEmptyParts);
+            for (qsizetype i = 0; i + 1 < params.size(); i += 2)
+            {
+                const QString key = params.at(i).sliced(1).section(':', 0, 0);
+                av_dict_set(&encoderOptions, key.toUtf8().constData(), params.at(i + 1).toUtf8().constData(), 0);
+            }
+        }
+        else
+        {
+            encoder->sample_rate = av_buffersink_get_sample_rate(stream.sink);
+            encoder->sample_fmt = static_cast<AVSampleFormat>(av_buffersink_get_format(stream.sink));
+            encoder->time_base = { 1, encoder->sample_rate };
+            if ((ret = av_buffersink_get_ch_layout(stream.sink, &encoder->ch_layout)) < 0)
+                return Fail("setting up the audio encoder", ret);
+
+            if (request.audioBitrateKbps.has_value())
+                encoder->bit_rate = static_cast<int64_t>(*request.audioBitrateKbps * 1000);
+        }
+
+        encoder->thread_count = request.threadsCount.value_or(0);
+        if (output->oformat->flags & AVFMT_GLOBALHEADER)
+            encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+        ret = avcodec_open2(encoder, encoderCodec, &encoderOptions);
+        av_dict_free(&encoderOptions);
+        if (ret < 0)
+            return Fail("opening encoder " + encoderName, ret);
+
+        // most audio encoders take frames of a fixed size, which the filters cut the samples into
+        if (type == AVMEDIA_TYPE_AUDIO && !(encoderCodec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE) && encoder->frame_size > 0)
+            av_buffersink_set_frame_size(stream.sink, encoder->frame_size);
+
+        stream.output = avformat_new_stream(output, nullptr);
+        if (stream.output == nullptr)
+            return Fail("adding an output stream", AVERROR(ENOMEM));
+        if ((ret = avcodec_parameters_from_context(stream.output->codecpar, encoder)) < 0)
+            return Fail("adding an output stream", ret);
+
+        stream.output->time_base = encoder->time_base;
+        return 0;
+    }
+
+    int BuildFilters(StreamContext& stream, const AVMediaType type, const AVCodec* encoderCodec)
+    {
+        const bool isVideo = type == AVMEDIA_TYPE_VIDEO;
+        const AVCodecContext* decoder = stream.decoder;
+        const AVRational timeBase = stream.input->time_base;
+        QString sourceArgs;
+        QString conversion;
+
+        if (isVideo)
+        {
+            const AVRational aspect = decoder->sample_aspect_ratio.num > 0 ? decoder->sample_aspect_ratio : AVRational { 1, 1 };
+            const QList<AVPixelFormat> formats = pixelFormatsOf(encoderCodec);
+            const AVPixelFormat format = formats.isEmpty() || formats.contains(decoder->pix_fmt) ? decoder->pix_fmt : formats.first();
+
+            sourceArgs = QString("video_size=%1x%2:pix_fmt=%3:time_base=%4/%5:pixel_aspect=%6/%7")
+                             .arg(QString::number(decoder->width), QString::number(decoder->height), QString::number(decoder->pix_fmt),
+                                  QString::number(timeBase.num), QString::number(timeBase.den), QString::number(aspect.num), QString::number(aspect.den));
+            conversion = QString("format=pix_fmts=%1").arg(av_get_pix_fmt_name(format));
+        }
+        else
+        {
+            AVChannelLayout layout {};
+            if (decoder->ch_layout.order == AV_CHANNEL_ORDER_UNSPEC)
+                av_channel_layout_default(&layout, decoder->ch_layout.nb_channels);
+            else
+                av_channel_layout_copy(&layout, &decoder->ch_layout);
+
+            char layoutName[64] = {};
+            av_channel_layout_describe(&layout, layoutName, sizeof(layoutName));
+            av_channel_layout_uninit(&layout);
+
+            const QList<AVSampleFormat> formats = sampleFormatsOf(encoderCodec);
+            const AVSampleFormat format = formats.isEmpty() || formats.contains(decoder->sample_fmt) ? decoder->sample_fmt : formats.first();
+
+            // encoders limited to some rates, such as libopus, get the closest one
+            int sampleRate = decoder->sample_rate;
+            const QList<int> rates = sampleRatesOf(encoderCodec);
+            if (!rates.isEmpty() && !rates.contains(sampleRate))
+            {
+                sampleRate = *std::min_element(rates.cbegin(), rates.cend(), [&](const int a, const int b)
+                                               { return qAbs(a - decoder->sample_rate) < qAbs(b - decoder->sample_rate); });
+            }
+
+            sourceArgs = QString("time_base=%1/%2:sample_rate=%3:sample_fmt=%4:channel_layout=%5")
+                             .arg(QString::number(timeBase.num), QString::number(timeBase.den), QString::number(decoder->sample_rate),
+                                  av_get_sample_fmt_name(decoder->sample_fmt), layoutName);
+            conversion = QString("aformat=sample_fmts=%1:sample_rates=%2").arg(av_get_sample_fmt_name(format), QString::number(sampleRate));
+
+            if (request.audioChannelsCount.has_value())
+            {
+                AVChannelLayout outputLayout {};
+                char outputLayoutName[64] = {};
+                av_channel_layout_default(&outputLayout, *request.audioChannelsCount);
+                av_channel_layout_describe(&outputLayout, outputLayoutName, sizeof(outputLayoutName));
+                av_channel_layout_uninit(&outputLayout);
+
+                conversion += QString(":channel_layouts=%1").arg(outputLayoutName);
+            }
+        }
+
+        int ret;
+        stream.graph = avfilter_graph_alloc();
+        if (stream.graph == nullptr)
+            return Fail("setting up the filters", AVERROR(ENOMEM));
+
+        if ((ret = avfilter_graph_create_filter(&stream.source, avfilter_get_by_name(isVideo ? "buffer" : "abuffer"), "in",
+                                                sourceArgs.toUtf8().constData(), nullptr, stream.graph)) < 0)
+            return Fail("setting up the filters", ret);
+        if ((ret = avfilter_graph_create_filter(&stream.sink, avfilter_get_by_name(isVideo ? "buffersink" : "abuffersink"), "out",
+                                                nullptr, nullptr, stream.graph)) < 0)
+            return Fail("setting up the filters", ret);
+
+        const QString& chain = isVideo ? request.videoFilters : request.audioFilters;
+        const QString filters = chain.isEmpty() ? conversion : chain + "," + conversion;
+
+        // the chain is parsed as it would be by -filter:v or -filter:a, between the source and the sink
+        AVFilterInOut* chainInput = avfilter_inout_alloc();
+        AVFilterInOut* chainOutput = avfilter_inout_alloc();
+        chainInput->name = av_strdup("in");
+        chainInput->filter_ctx = stream.source;
+        chainOutput->name = av_strdup("out");
+        chainOutput->filter_ctx = stream.sink;
+
+        ret = avfilter_graph_parse_ptr(stream.graph, filters.toUtf8().constData(), &chainOutput, &chainInput, nullptr);
+        avfilter_inout_free(&chainInput);
+        avfilter_inout_free(&chainOutput);
+
+        if (ret < 0)
+            return Fail("parsing filters " + filters, ret);
+        if ((ret = avfilter_graph_config(stream.graph, nullptr)) < 0)
+            return Fail("configuring filters " + filters, ret);
+
+        return 0;
+    }
+
+    int Decode(StreamContext& stream, const AVPacket* input)
+    {
+        int ret = avcodec_send_packet(stream.decoder, input);
+        if (ret < 0 && ret != AVERROR_EOF)
+            return Fail("decoding", ret);
+
+        while ((ret = avcodec_receive_frame(stream.decoder, frame)) >= 0)
+        {
+            frame->pts = frame->best_effort_timestamp;
+
+            // the source takes the frame's buffers over, so the frame is handed on without a copy
+            ret = av_buffersrc_add_frame_flags(stream.source, frame, 0);
+            av_frame_unref(frame);
+
+            if (ret < 0)
+                return Fail("filtering", ret);
+            if ((ret = Filter(stream)) < 0)
+                return ret;
+        }
+
+        return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : Fail("decoding", ret);
+    }
+
+    int Filter(StreamContext& stream)
+    {
+        int ret;
+        while ((ret = av_buffersink_get_frame(stream.sink, filtered)) >= 0)
+        {
+            if (filtered->pts != AV_NOPTS_VALUE)
+                filtered->pts = av_rescale_q(filtered->pts, av_buffersink_get_time_base(stream.sink), stream.encoder->time_base);
+            filtered->pict_type = AV_PICTURE_TYPE_NONE;
+
+            ret = Encode(stream, filtered);
+            av_frame_unref(filtered);
+
+            if (ret < 0)
+                return ret;
+        }
+
+        return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : Fail("filtering", ret);
+    }
+
+    int Encode(StreamContext& stream, const AVFrame* input)
+    {
+        int ret = avcodec_send_frame(stream.encoder, input);
+        if (ret < 0 && ret != AVERROR_EOF)
+            return Fail("encoding", ret);
+
+        while ((ret = avcodec_receive_packet(stream.encoder, encoded)) >= 0)
+        {
+            encoded->stream_index = stream.output->index;
+            av_packet_rescale_ts(encoded, stream.encoder->time_base, stream.output->time_base);
+
+            if (encoded->pts != AV_NOPTS_VALUE)
+                stream.encodedSeconds = qMax(stream.encodedSeconds, (encoded->pts + encoded->duration) * av_q2d(stream.output->time_base));
+            stream.encodedFrames++;
+
+            // the muxer takes the packet over
+            if ((ret = av_interleaved_write_frame(output, encoded)) < 0)
+                return Fail("writing the output", ret);
+        }
+
+        return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : Fail("encoding", ret);
+    }
+
+    [[nodiscard]] EncodingProgress progress(const double elapsedSeconds) const
+    {
+        EncodingProgress progress;
+        progress.encodedSeconds = qMax(video != nullptr ? video->encodedSeconds : 0, audio != nullptr ? audio->encodedSeconds : 0);
+        progress.totalSizeBytes = output->pb != nullptr ? avio_tell(output->pb) : 0;
+
+        if (elapsedSeconds > 0)
+        {
+            progress.fps = video != nullptr ? video->encodedFrames / elapsedSeconds : 0;
+            progress.speed = progress.encodedSeconds / elapsedSeconds;
+        }
+        if (progress.encodedSeconds > 0)
+            progress.bitrateKbps = progress.totalSizeBytes * 8 / 1000.0 / progress.encodedSeconds;
+
+        return progress;
+    }
+
+    const EncoderStrategy::Request& request;
+    AVFormatContext* input = nullptr;
+    AVFormatContext* output = nullptr;
+    std::unique_ptr<StreamContext> video;
+    std::unique_ptr<StreamContext> audio;
+    AVPacket* packet;
+    AVFrame* frame;
+    AVFrame* filtered;
+    AVPacket* encoded;
+};
+}
+
+LibavEncoderStrategy::LibavEncoderStrategy(QObject* parent)
+    : EncoderStrategy(parent)
+{
+}
+
+LibavEncoderStrategy::~LibavEncoderStrategy()
+{
+    Stop();
+
+    if (worker != nullptr)
+        worker->wait();
+}
+
+bool LibavEncoderStrategy::supports(const EncoderOptions& options, const MediaEncoder::ComputedOptions& computed)
+{
+    // the second pass reads the statistics file of the first, which only ffmpeg writes
+    if (options.twoPass)
+        return false;
+    // a trimmed input would need seeking, which it does not do
+    if (options.trimStartSeconds.has_value() || options.trimEndSeconds.has_value())
+        return false;
+    // planned tracks would need more than a stream of each type
+    if (options.tracks.has_value())
+        return false;
+    // an animated image is filtered through a palette, and encoded again when too large
+    if (options.videoCodec.has_value() && AnimatedImage::isAnimatedImage(*options.videoCodec))
+        return false;
+    // frames are decoded and converted in software, and arguments are only understood by ffmpeg
+    if (options.hardwareAcceleration.has_value() || !options.customArguments.value_or("").trimmed().isEmpty())
+        return false;
+    // packets are always decoded and encoded again
+    if (computed.copiesVideo || computed.copiesAudio)
+        return false;
+    // priority and memory limits apply to a process of its own, which an in-process encode does not have
+    if (options.resources.priority != ResourceLimits::Priority::Normal || options.resources.memoryLimitMb.has_value())
+        return false;
+
+    if (!options.videoCodec.has_value() && !options.audioCodec.has_value())
+        return false;
+    if (options.videoCodec.has_value() && avcodec_find_encoder_by_name(options.videoCodec->libraryName.toUtf8().constData()) == nullptr)
+        return false;
+    if (options.audioCodec.has_value() && avcodec_find_encoder_by_name(options.audioCodec->libraryName.toUtf8().constData()) == nullptr)
+        return false;
+
+    return av_guess_format(options.container.formatName.toUtf8().constData(), nullptr, nullptr) != nullptr;
+}
+
+void LibavEncoderStrategy::Start(const Request& request)
+{
+    isStopped = false;
+    error.clear();
+    errorDetails.clear();
+
+    worker = QThread::create([this, request]
+                             { Encode(request); });
+    worker->setParent(this);
+
+    connect(worker, &QThread::finished, this, [this]
+            {
+        worker->deleteLater();
+        worker = nullptr;
+
+        if (isStopped)
+            emit stopped();
+        else if (!error.isEmpty())
+            emit failed(error, errorDetails);
+        else
+            emit succeeded(); });
+
+    worker->start();
+}
+
+void LibavEncoderStrategy::Stop()
+{
+    QMutexLocker lock(&pauseMutex);
+    isStopped = true;
+    resumed.wakeAll();
+}
+
+void LibavEncoderStrategy::setPaused(const bool paused)
+{
+    QMutexLocker lock(&pauseMutex);
+    isPaused = paused;
+    resumed.wakeAll();
+}
+
+bool LibavEncoderStrategy::WaitUnlessStopped()
+{
+    QMutexLocker lock(&pauseMutex);
+    while (isPaused && !isStopped)
+        resumed.wait(&pauseMutex);
+
+    return !isStopped;
+}
+
+void LibavEncoderStrategy::Encode(const Request& request)
+{
+    // reported from the worker, to be emitted by the thread the strategy lives in
+    const auto report = [this](const EncodingProgress& progress)
+    {
+        QMetaObject::invokeMethod(this, [this, progress]
+                                  { emit progressUpdate(progress); }, Qt::QueuedConnection);
+    };
+
+    int ret;
+    {
+        Transcode transcode(request);
+        if ((ret = transcode.Open()) >= 0)
+            ret = transcode.Run([this]
+                                { return WaitUnlessStopped(); }, report, progressIntervalMs);
+
+        if (ret < 0 && ret != AVERROR_EXIT)
+        {
+            error = tr("Encoding failed while %1.").arg(transcode.failedStep);
+            errorDetails = QString("%1\n\n%2 -> %3").arg(errorText(ret), request.inputPath, request.outputPath);
+        }
+    }
+
+    // an output cut short is of no use, as with ffmpeg
+    if (ret < 0 && ret != AVERROR_EXIT)
+        QFile::remove(request.outputPath);
+}
@@ -0,0 +1,51 @@
+#ifndef LIBAV_ENCODER_STRATEGY_H
+#define LIBAV_ENCODER_STRATEGY_H
+
+#include "core/encoder/encoder.hpp"
+#include "core/encoder/encoder_strategy.hpp"
+
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <atomic>
+
+//!
+//! \brief Decodes, filters and encodes through libavformat, libavcodec and libavfilter, on a worker thread.
+//! \details Decoded frames are handed to the filters and encoders by reference, never copied, and no process
+//! is spawned per job. It covers single-pass software encodes of the first video and audio streams; anything else,
+//! such as stream copies, hardware decoding or custom arguments, is left to ffmpeg.
+//!
+class LibavEncoderStrategy : public EncoderStrategy
+{
+    Q_OBJECT
+
+public:
+    explicit LibavEncoderStrategy(QObject* parent = nullptr);
+    ~LibavEncoderStrategy() override;
+
+    [[nodiscard]] static bool supports(const EncoderOptions& options, const MediaEncoder::ComputedOptions& computed);
+
+    void Start(const Request& request) override;
+    void Stop() override;
+    void setPaused(bool paused) override;
+    [[nodiscard]] bool isRunning() const override { return worker != nullptr; }
+
+private:
+    //! Runs on the worker thread; the outcome is reported once it ended.
+    void Encode(const Request& request);
+    //! Blocks while paused; false once stopped.
+    bool WaitUnlessStopped();
+
+    QThread* worker = nullptr;
+    std::atomic_bool isStopped = false;
+    bool isPaused = false;
+    QMutex pauseMutex;
+    QWaitCondition resumed;
+
+    QString error;
+    QString errorDetails;
+
+    static constexpr int progressIntervalMs = 500;
+};
+
+#endif
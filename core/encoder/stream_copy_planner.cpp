@@ -0,0 +1,104 @@
+#include "stream_copy_planner.hpp"
+
+#include <QHash>
+
+StreamCopyPlanner::Plan StreamCopyPlanner::plan(const EncoderOptions& options, const optional<double> audioBitrateKbps)
+{
+    // custom arguments can hold filters or encoder settings, which copying would silently drop
+    const bool hasCustomArguments = !options.customArguments.value_or("").trimmed().isEmpty();
+
+    return {
+        .copiesVideo = options.videoCodec.has_value()
+            && (options.videoCodec->libraryName == "copy" || (!hasCustomArguments && canCopyVideo(options))),
+        .copiesAudio = options.audioCodec.has_value()
+            && (options.audioCodec->libraryName == "copy" || (!hasCustomArguments && canCopyAudio(options, audioBitrateKbps))),
+    };
+}
+
+bool StreamCopyPlanner::canCopyVideo(const EncoderOptions& options)
+{
+    if (!matchesInputVideo(options))
+        return false;
+
+    // a copy starts at the keyframe before the trim start, rather than at it; see EncoderOptions::smartCut
+    if (options.trimStartSeconds.has_value() || options.trimEndSeconds.has_value())
+        return false;
+
+    // the input is the best the quality search could find, but rarely the smallest file reaching it
+    if (options.targetQuality.has_value())
+        return false;
+
+    // the copied stream keeps its size, so the whole input has to fit the target already
+    return !options.sizeKbps.has_value() || options.inputMetadata.sizeKbps * 8 <= *options.sizeKbps;
+}
+
+bool StreamCopyPlanner::canCopyAudio(const EncoderOptions& options, const optional<double> audioBitrateKbps)
+{
+    const Metadata& metadata = options.inputMetadata;
+
+    if (metadata.audioCodec.isEmpty() || codecNameFor(options.audioCodec->libraryName) != metadata.audioCodec)
+        return false;
+
+    if (options.speed.has_value() || options.audioChannelsCount.has_value())
+        return false;
+
+    return metadata.audioBitrateKbps > 0
+        && metadata.audioBitrateKbps <= audioBitrateKbps.value_or(0) * audioBitrateTolerance;
+}
+
+bool StreamCopyPlanner::matchesInputVideo(const EncoderOptions& options)
+{
+    const Metadata& metadata = options.inputMetadata;
+
+    if (!options.videoCodec.has_value() || metadata.videoCodec.isEmpty() || codecNameFor(options.videoCodec->libraryName) != metadata.videoCodec)
+        return false;
+
+    const bool isResized = (options.outputWidth.has_value() && *options.outputWidth != metadata.width)
+                        || (options.outputHeight.has_value() && *options.outputHeight != metadata.height);
+    const bool isRetimed = options.speed.has_value()
+                        || (options.fps.has_value() && qAbs(*options.fps - metadata.frameRate) > 0.01);
+
+    // every rendition of a ladder is scaled and keyframed on its own schedule
+    return !isResized && !isRetimed && !options.aspectRatio.has_value() && !options.ladder.has_value();
+}
+
+QString StreamCopyPlanner::codecNameFor(const QString& encoderName)
+{
+    static const QHash<QString, QString> codecNames = {
+        { "libx264", "h264" },
+        { "libx264rgb", "h264" },
+        { "libopenh264", "h264" },
+        { "libx265", "hevc" },
+        { "libaom-av1", "av1" },
+        { "libsvtav1", "av1" },
+        { "librav1e", "av1" },
+        { "libvpx", "vp8" },
+        { "libvpx-vp9", "vp9" },
+        { "libxvid", "mpeg4" },
+        { "libtheora", "theora" },
+        { "libwebp", "webp" },
+        { "libwebp_anim", "webp" },
+        { "prores_ks", "prores" },
+        { "prores_aw", "prores" },
+        { "libmp3lame", "mp3" },
+        { "libshine", "mp3" },
+        { "libopus", "opus" },
+        { "libvorbis", "vorbis" },
+        { "libfdk_aac", "aac" },
+    };
+
+    if (codecNames.contains(encoderName))
+        return codecNames.value(encoderName);
+
+    // hardware and platform encoders are named after their codec, e.g. hevc_nvenc or aac_mf
+    static const QHash<QString, QString> families = { { "h264", "h264" }, { "hevc", "hevc" }, { "av1", "av1" }, { "vp8", "vp8" },
+                                                      { "vp9", "vp9" }, { "mpeg2", "mpeg2video" }, { "mjpeg", "mjpeg" },
+                                                      { "aac", "aac" }, { "mp3", "mp3" }, { "opus", "opus" } };
+    const QString prefix = encoderName.section('_', 0, 0);
+
+    if (encoderName.contains('_') && families.contains(prefix))
+        return families.value(prefix);
+
+    // native encoders share the name of their codec, e.g. aac, flac or gif
+    return encoderName;
+}
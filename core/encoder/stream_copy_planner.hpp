@@ -0,0 +1,38 @@
+#ifndef STREAM_COPY_PLANNER_H
+#define STREAM_COPY_PLANNER_H
+
+#include "encoder_options.hpp"
+
+//!
+//! \brief Decides which streams can be copied as they are instead of being encoded again.
+//! \details A stream is copied when the input already uses the codec of the selected encoder and
+//! nothing requested for it needs decoding: no filter, no size it does not already meet, no custom arguments.
+//!
+class StreamCopyPlanner
+{
+public:
+    struct Plan
+    {
+        bool copiesVideo = false;
+        bool copiesAudio = false;
+    };
+
+    //! audioBitrateKbps is the bitrate the audio would be encoded at.
+    [[nodiscard]] static Plan plan(const EncoderOptions& options, optional<double> audioBitrateKbps);
+
+    //! Whether the video encoder writes the codec of the input at its size and frame rate, from unfiltered frames,
+    //! so that its output can be joined to the copied input. Says nothing of the bitrate.
+    [[nodiscard]] static bool matchesInputVideo(const EncoderOptions& options);
+
+    //! The name ffprobe reports for streams written by an encoder, e.g. h264 for libx264 or h264_nvenc.
+    [[nodiscard]] static QString codecNameFor(const QString& encoderName);
+
+private:
+    [[nodiscard]] static bool canCopyVideo(const EncoderOptions& options);
+    [[nodiscard]] static bool canCopyAudio(const EncoderOptions& options, optional<double> audioBitrateKbps);
+
+    //! Encoding at a bit more than the input bitrate would not be noticeably better, so it is copied too.
+    static constexpr double audioBitrateTolerance = 1.05;
+};
+
+#endif
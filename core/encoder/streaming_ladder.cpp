@@ -0,0 +1,119 @@
+#include "streaming_ladder.hpp"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QRegularExpression>
+
+QString StreamingLadder::playlistPath(const QString& directory) const
+{
+    return QDir(directory).filePath(format == Format::Hls ? "master.m3u8" : "manifest.mpd");
+}
+
+QStringList StreamingLadder::renditionNames() const
+{
+    QStringList names;
+
+    for (qsizetype i = 0; i < renditions.size(); i++)
+    {
+        const Rendition& rendition = renditions.at(i);
+        QString name = rendition.height > 0 ? QString("%1p").arg(rendition.height) : QString("%1w").arg(rendition.width);
+
+        // rungs of one size at several bitrates still need folders of their own
+        if (names.contains(name))
+            name += QString("_%1").arg(i);
+
+        names.append(name);
+    }
+
+    return names;
+}
+
+QString StreamingLadder::keyframeParams() const
+{
+    return QString(R"(-force_key_frames "expr:gte(t,n_forced*%1)")").arg(segmentSeconds);
+}
+
+QString StreamingLadder::muxerParams(const QString& directory, const bool hasAudio, const bool usesTransportStream) const
+{
+    if (format == Format::Dash)
+    {
+        return QString(R"(-f dash -seg_duration %1 -use_template 1 -use_timeline 1 -adaptation_sets "%2")")
+            .arg(QString::number(segmentSeconds), hasAudio ? "id=0,streams=v id=1,streams=a" : "id=0,streams=v");
+    }
+
+    // every rendition plays along with the single audio stream, which is a rendition of its own
+    QStringList streamMap;
+    const QStringList names = renditionNames();
+    for (qsizetype i = 0; i < names.size(); i++)
+        streamMap.append(QString("v:%1%2,name:%3").arg(QString::number(i), hasAudio ? ",agroup:audio" : "", names.at(i)));
+    if (hasAudio)
+        streamMap.append("a:0,agroup:audio,name:audio");
+
+    const QString segmentPath = QDir(directory).filePath(QString("%v/segment_%05d.") + (usesTransportStream ? "ts" : "m4s"));
+
+    return QStringList {
+        QString("-f hls -hls_time %1 -hls_playlist_type vod -hls_flags independent_segments").arg(segmentSeconds),
+        QString("-hls_segment_type %1").arg(usesTransportStream ? "mpegts" : "fmp4"),
+        QString(R"(-hls_segment_filename "%1")").arg(segmentPath),
+        QString("-master_pl_name %1").arg(QFileInfo(playlistPath(directory)).fileName()),
+        QString(R"(-var_stream_map "%1")").arg(streamMap.join(' ')),
+    }
+        .join(" ");
+}
+
+QString StreamingLadder::muxerOutputPath(const QString& directory) const
+{
+    return format == Format::Hls ? QDir(directory).filePath("%v/index.m3u8") : playlistPath(directory);
+}
+
+qint64 StreamingLadder::sizeBytes(const QString& directory)
+{
+    qint64 size = 0;
+
+    QDirIterator files(directory, QDir::Files, QDirIterator::Subdirectories);
+    while (files.hasNext())
+        size += files.nextFileInfo().size();
+
+    return size;
+}
+
+optional<StreamingLadder::Format> StreamingLadder::formatFromName(const QString& name)
+{
+    if (name.compare("hls", Qt::CaseInsensitive) == 0)
+        return Format::Hls;
+    if (name.compare("dash", Qt::CaseInsensitive) == 0)
+        return Format::Dash;
+
+    return {};
+}
+
+optional<QList<StreamingLadder::Rendition>> StreamingLadder::parseRenditions(const QString& list)
+{
+    static const QRegularExpression renditionPattern(R"(^(\d+)x(\d+)(?:@(\d+))?:(\d+(?:\.\d+)?)k?$)", QRegularExpression::CaseInsensitiveOption);
+    QList<Rendition> renditions;
+
+    for (const QString& item : list.split(',', Qt::SkipEmptyParts))
+    {
+        const QRegularExpressionMatch match = renditionPattern.match(item.trimmed());
+        if (!match.hasMatch())
+            return {};
+
+        const Rendition rendition {
+            .width = match.captured(1).toInt(),
+            .height = match.captured(2).toInt(),
+            .fps = match.hasCaptured(3) ? optional(match.captured(3).toInt()) : std::nullopt,
+            .videoBitrateKbps = match.captured(4).toDouble(),
+        };
+
+        if ((rendition.width <= 0 && rendition.height <= 0) || rendition.fps.value_or(1) <= 0 || rendition.videoBitrateKbps <= 0)
+            return {};
+
+        renditions.append(rendition);
+    }
+
+    if (renditions.isEmpty())
+        return {};
+
+    return renditions;
+}
@@ -0,0 +1,61 @@
+#ifndef STREAMING_LADDER_H
+#define STREAMING_LADDER_H
+
+#include <QList>
+#include <QString>
+#include <optional>
+
+using std::optional;
+
+//!
+//! \brief Renditions of one input for adaptive streaming, written as segmented HLS or DASH with its playlists.
+//! \details It takes the place of a container: the output is a folder holding the main playlist, and the segments
+//! of every rendition. All renditions come from a single decode, and their keyframes are forced on the same
+//! schedule, so that players can switch between them at any segment.
+//!
+struct StreamingLadder
+{
+    enum class Format
+    {
+        Hls,
+        Dash
+    };
+
+    //! A rung of the ladder; a size of 0 on either side keeps the aspect ratio of the input.
+    struct Rendition
+    {
+        int width = 0;
+        int height = 0;
+        optional<int> fps;
+        double videoBitrateKbps = 0;
+    };
+
+    Format format = Format::Hls;
+    QList<Rendition> renditions;
+    int segmentSeconds = 6;
+
+    //! Appended to the output path, as the extension of a container is; the folder is named after it.
+    [[nodiscard]] QString extension() const { return format == Format::Hls ? "hls" : "dash"; }
+    //! The playlist players open, in the output folder.
+    [[nodiscard]] QString playlistPath(const QString& directory) const;
+    //! Names of the renditions, which HLS also names their folders after; unique within the ladder.
+    [[nodiscard]] QStringList renditionNames() const;
+    //! Forces keyframes at every segment boundary, in every rendition alike.
+    [[nodiscard]] QString keyframeParams() const;
+    //! The muxer and its options, for an output with one video stream per rendition and at most one audio stream.
+    //! \param usesTransportStream Whether HLS segments are MPEG-TS rather than fragmented MP4.
+    [[nodiscard]] QString muxerParams(const QString& directory, bool hasAudio, bool usesTransportStream) const;
+    //! Where the muxer writes: the playlist of each rendition for HLS, which it writes the main one next to,
+    //! and the manifest for DASH.
+    [[nodiscard]] QString muxerOutputPath(const QString& directory) const;
+
+    //! The size of everything in the output folder.
+    [[nodiscard]] static qint64 sizeBytes(const QString& directory);
+
+    [[nodiscard]] static optional<Format> formatFromName(const QString& name);
+    //! Parses a list such as "1920x1080:5000, 1280x720@30:2800, 0x480:1200", read as size, optional frame rate
+    //! and video bitrate in kbps. Empty when any rendition is malformed.
+    [[nodiscard]] static optional<QList<Rendition>> parseRenditions(const QString& list);
+};
+
+#endif
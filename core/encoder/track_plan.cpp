@@ -0,0 +1,110 @@
+#include "track_plan.hpp"
+
+#include <QRegularExpression>
+#include <algorithm>
+
+QString TrackPlan::params(const bool withVideo, const bool withAudio) const
+{
+    QStringList maps;
+    QStringList copies;
+
+    for (const Track& track : tracks)
+    {
+        const bool isSelected = track.stream.type == "video"   ? withVideo
+                              : track.stream.type == "audio" ? withAudio
+                                                             : withVideo && withAudio;
+        if (track.action == Action::Drop || !isSelected)
+            continue;
+
+        if (track.action == Action::Copy)
+            copies.append(QString("-c:%1 copy").arg(maps.size()));
+
+        maps.append(QString("-map 0:%1").arg(track.stream.index));
+    }
+
+    return (maps + copies).join(' ');
+}
+
+qsizetype TrackPlan::count(const QString& type, const Action action) const
+{
+    return std::count_if(tracks.cbegin(), tracks.cend(), [&](const Track& track)
+                         { return track.stream.type == type && track.action == action; });
+}
+
+bool TrackPlan::encodesFirstOnly(const QString& type) const
+{
+    const auto first = std::find_if(tracks.cbegin(), tracks.cend(), [&](const Track& track)
+                                    { return track.stream.type == type; });
+
+    return first != tracks.cend() && first->action == Action::Encode && count(type, Action::Encode) == 1;
+}
+
+double TrackPlan::bitrateKbpsBesidesVideo(const double audioBitrateKbps) const
+{
+    double bitrateKbps = 0;
+
+    // encoded subtitles weigh next to nothing, while copied streams keep the bitrate of the input
+    for (const Track& track : tracks)
+    {
+        if (track.action == Action::Copy)
+            bitrateKbps += track.stream.bitrateKbps;
+        else if (track.action == Action::Encode && track.stream.type == "audio")
+            bitrateKbps += audioBitrateKbps;
+    }
+
+    return bitrateKbps;
+}
+
+TrackPlan TrackPlan::forStreams(const QList<MediaStream>& streams, const QHash<int, Action>& actions)
+{
+    TrackPlan plan;
+    bool hasVideo = false;
+    bool hasAudio = false;
+
+    for (const MediaStream& stream : streams)
+    {
+        const bool isFirstOfType = (stream.type == "video" && !hasVideo) || (stream.type == "audio" && !hasAudio);
+        hasVideo |= stream.type == "video";
+        hasAudio |= stream.type == "audio";
+
+        plan.tracks.append({ .stream = stream, .action = actions.value(stream.index, isFirstOfType ? Action::Encode : Action::Drop) });
+    }
+
+    return plan;
+}
+
+optional<TrackPlan::Action> TrackPlan::actionFromName(const QString& name)
+{
+    if (name.compare("encode", Qt::CaseInsensitive) == 0)
+        return Action::Encode;
+    if (name.compare("copy", Qt::CaseInsensitive) == 0)
+        return Action::Copy;
+    if (name.compare("drop", Qt::CaseInsensitive) == 0)
+        return Action::Drop;
+
+    return {};
+}
+
+optional<QHash<int, TrackPlan::Action>> TrackPlan::parseActions(const QString& list)
+{
+    static const QRegularExpression actionPattern(R"(^(\d+)\s*=\s*(\w+)$)");
+    QHash<int, Action> actions;
+
+    for (const QString& item : list.split(',', Qt::SkipEmptyParts))
+    {
+        const QRegularExpressionMatch match = actionPattern.match(item.trimmed());
+        if (!match.hasMatch())
+            return {};
+
+        const optional<Action> action = actionFromName(match.captured(2));
+        if (!action.has_value())
+            return {};
+
+        actions.insert(match.captured(1).toInt(), *action);
+    }
+
+    if (actions.isEmpty())
+        return {};
+
+    return actions;
+}
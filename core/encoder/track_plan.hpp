@@ -0,0 +1,55 @@
+#ifndef TRACK_PLAN_H
+#define TRACK_PLAN_H
+
+#include "core/formats/metadata.hpp"
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <optional>
+
+using std::optional;
+
+//!
+//! \brief What becomes of every stream of the input, mapped explicitly in place of ffmpeg's pick of one stream of each type.
+//! \details Each stream is encoded with the codec of its type, copied as it is, or dropped, so that extra audio
+//! languages and subtitles need not be encoded again. Kept streams are written in the order of the input.
+//!
+struct TrackPlan
+{
+    enum class Action
+    {
+        Encode,
+        Copy,
+        Drop
+    };
+
+    struct Track
+    {
+        MediaStream stream;
+        Action action = Action::Encode;
+    };
+
+    //! Every stream of the input, in order.
+    QList<Track> tracks;
+
+    //! The -map of every kept stream, and the -c of every copied one, which come after the codecs of each type and override them.
+    //! Streams of a type left out are neither mapped nor counted, as the output stream numbers only go over mapped ones;
+    //! subtitles and other streams are only mapped along with both video and audio.
+    [[nodiscard]] QString params(bool withVideo, bool withAudio) const;
+    //! Streams of the type with the action.
+    [[nodiscard]] qsizetype count(const QString& type, Action action) const;
+    //! Whether the only stream of the type encoded is the first one of the input, which the fields of Metadata describe.
+    [[nodiscard]] bool encodesFirstOnly(const QString& type) const;
+    //! The bitrate of every kept stream besides the encoded video, with encoded audio at the given bitrate.
+    [[nodiscard]] double bitrateKbpsBesidesVideo(double audioBitrateKbps) const;
+
+    //! Plans every stream of the input, with the actions given by stream index. The others are left as ffmpeg would
+    //! pick them, without its subtitle: the first video and audio streams are encoded, and the rest dropped.
+    [[nodiscard]] static TrackPlan forStreams(const QList<MediaStream>& streams, const QHash<int, Action>& actions);
+    [[nodiscard]] static optional<Action> actionFromName(const QString& name);
+    //! Parses a list such as "1=copy, 3=drop, 4=encode", read as stream index and action. Empty when any item is malformed.
+    [[nodiscard]] static optional<QHash<int, Action>> parseActions(const QString& list);
+};
+
+#endif
@@ -0,0 +1,49 @@
+#include "worker_capabilities.hpp"
+
+#include "core/formats/hardware_encoder_probe.hpp"
+
+#include <QJsonArray>
+
+bool WorkerCapabilities::supports(const EncoderOptions& options) const
+{
+    // copied streams are written by ffmpeg itself, which every worker has
+    const auto hasEncoder = [this](const optional<const Codec>& codec)
+    { return !codec.has_value() || codec->libraryName == "copy" || encoders.contains(codec->libraryName); };
+
+    return slotsCount > 0 && hasEncoder(options.videoCodec) && hasEncoder(options.audioCodec);
+}
+
+bool WorkerCapabilities::accelerates(const EncoderOptions& options) const
+{
+    return options.videoCodec.has_value() && HardwareEncoderProbe::isHardwareEncoder(options.videoCodec->libraryName)
+        && encoders.contains(options.videoCodec->libraryName);
+}
+
+QJsonObject WorkerCapabilities::toJson() const
+{
+    return {
+        { "slotsCount", slotsCount },
+        { "encoders", QJsonArray::fromStringList(encoders) },
+        { "hardwareDevices", QJsonArray::fromStringList(hardwareDevices) },
+        { "platform", platform },
+    };
+}
+
+WorkerCapabilities WorkerCapabilities::fromJson(const QJsonObject& json)
+{
+    const auto toStringList = [](const QJsonValue& value)
+    {
+        QStringList strings;
+        for (const QJsonValue& item : value.toArray())
+            strings.append(item.toString());
+
+        return strings;
+    };
+
+    return {
+        .slotsCount = json.value("slotsCount").toInt(),
+        .encoders = toStringList(json.value("encoders")),
+        .hardwareDevices = toStringList(json.value("hardwareDevices")),
+        .platform = json.value("platform").toString(),
+    };
+}
@@ -0,0 +1,32 @@
+#ifndef WORKER_CAPABILITIES_H
+#define WORKER_CAPABILITIES_H
+
+#include "encoder_options.hpp"
+
+#include <QJsonObject>
+#include <QStringList>
+
+//!
+//! \brief What a remote worker advertises it can run, which jobs are matched against before being sent to it.
+//! \details Encoders are those of the worker's ffmpeg, less the hardware ones its probe found not to initialize,
+//! so that a job for h264_nvenc only goes to a host with a working NVIDIA GPU.
+//!
+struct WorkerCapabilities
+{
+    //! Jobs the worker runs at once; 0 for a worker that could not be reached.
+    int slotsCount = 1;
+    QStringList encoders;
+    //! The hwaccel names of its PlatformInfo, e.g. cuda or vaapi.
+    QStringList hardwareDevices;
+    QString platform;
+
+    //! Whether the worker has the encoders of the job.
+    [[nodiscard]] bool supports(const EncoderOptions& options) const;
+    //! Whether the job encodes on hardware of the worker.
+    [[nodiscard]] bool accelerates(const EncoderOptions& options) const;
+
+    [[nodiscard]] QJsonObject toJson() const;
+    [[nodiscard]] static WorkerCapabilities fromJson(const QJsonObject& json);
+};
+
+#endif
@@ -9,6 +9,8 @@ struct Codec;
 struct Container {
     QString displayName;
     QString formatName;
+    //! Common file extensions, preferred first. Empty for muxers that do not write files.
+    QStringList extensions = {};
 };
 
 Q_DECLARE_METATYPE(Container)
@@ -2,13 +2,28 @@
 #include "codec.hpp"
 #include "core/notifier/notifier.hpp"
 
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
 #include <QProcess>
 #include <QRegularExpression>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QStringTokenizer>
 #include <QThread>
 
 FFmpegFormatSupportLoader::FFmpegFormatSupportLoader()
     : codecsProcess(new QProcess(this))
-    , containersProcess(new QProcess(this)) { }
+    , containersProcess(new QProcess(this))
+    , versionProcess(new QProcess(this))
+{
+    connect(codecsProcess, &QProcess::finished, this, &FFmpegFormatSupportLoader::onCodecsQueried);
+    connect(containersProcess, &QProcess::finished, this, &FFmpegFormatSupportLoader::onContainersQueried);
+    connect(versionProcess, &QProcess::finished, this, &FFmpegFormatSupportLoader::onVersionQueried);
+}
 
 void FFmpegFormatSupportLoader::QuerySupportedFormatsAsync()
 {
@@ -17,17 +32,38 @@ void FFmpegFormatSupportLoader::QuerySupportedFormatsAsync()
         return;
     }
 
-    // TODO: Make commands cross-platform
-    connect(codecsProcess, &QProcess::finished, this, &FFmpegFormatSupportLoader::onCodecsQueried);
-    codecsProcess->startCommand(R"(ffmpeg.exe -encoders -hide_banner)");
+    versionQueried = false;
+    versionProcess->startCommand(R"(ffmpeg -version)");
 
-    connect(containersProcess, &QProcess::finished, this, &FFmpegFormatSupportLoader::onContainersQueried);
-    containersProcess->startCommand(R"(ffmpeg.exe -muxers -hide_banner)");
+    if (const auto formats = LoadCache(); formats != nullptr) {
+        // package managers can keep the modification time, so the version is still checked in the background
+        cachedFormats = formats;
+        isRevalidating = true;
+        emit queryCompleted(cachedFormats);
+        return;
+    }
+
+    StartFormatsQuery();
+}
+
+void FFmpegFormatSupportLoader::StartFormatsQuery()
+{
+    codecsQueried = false;
+    containersQueried = false;
+    queryFailed = false;
+
+    codecsProcess->startCommand(R"(ffmpeg -encoders -hide_banner)");
+    containersProcess->startCommand(R"(ffmpeg -muxers -hide_banner)");
+}
+
+QString FFmpegFormatSupportLoader::cacheDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
 }
 
 void FFmpegFormatSupportLoader::onCodecsQueried()
 {
-    codecs = parseCodecs();
+    codecs = EnsureValidResult(codecsProcess) ? parseCodecs(codecsProcess->readAllStandardOutput()) : QPair<QList<Codec>, QList<Codec>> {};
     codecsQueried = true;
 
     CheckQueryComplete();
@@ -35,67 +71,148 @@ void FFmpegFormatSupportLoader::onCodecsQueried()
 
 void FFmpegFormatSupportLoader::onContainersQueried()
 {
-    containers = parseContainers();
-    containersQueried = true;
+    containers = EnsureValidResult(containersProcess) ? parseContainers(containersProcess->readAllStandardOutput()) : QList<Container> {};
+    nextExtensionQuery = 0;
+    runningExtensionQueries = 0;
 
-    CheckQueryComplete();
+    if (containers.isEmpty()) {
+        containersQueried = true;
+        CheckQueryComplete();
+        return;
+    }
+
+    const int parallelQueries = qMax(2, QThread::idealThreadCount());
+    for (int i = 0; i < parallelQueries && nextExtensionQuery < containers.size(); i++)
+        QueryNextExtension();
 }
 
-QPair<QList<Codec>, QList<Codec>> FFmpegFormatSupportLoader::parseCodecs()
+void FFmpegFormatSupportLoader::QueryNextExtension()
 {
-    if (!EnsureValidResult(codecsProcess))
-        return {};
+    const qsizetype index = nextExtensionQuery++;
+    auto* process = new QProcess(this);
+    runningExtensionQueries++;
 
-    QList<Codec> videoCodecs;
-    QList<Codec> audioCodecs;
+    connect(process, &QProcess::finished, this, [this, process, index]
+            { HandleExtensionQueried(process, index); });
+    connect(process, &QProcess::errorOccurred, this, [this, process, index](QProcess::ProcessError error)
+            {
+        // other errors are followed by finished()
+        if (error == QProcess::FailedToStart)
+            HandleExtensionQueried(process, index); });
 
-    SkipLines(10);
+    process->startCommand(QString("ffmpeg -hide_banner -h muxer=%1").arg(containers.at(index).formatName));
+}
 
-    while (codecsProcess->canReadLine()) {
-        QString line = codecsProcess->readLine().trimmed();
-        bool isAudio;
+void FFmpegFormatSupportLoader::HandleExtensionQueried(QProcess* process, const qsizetype containerIndex)
+{
+    // a muxer without extensions is kept, encoding to it reports the problem
+    containers[containerIndex].extensions = parseExtensions(process->readAllStandardOutput());
+    process->deleteLater();
+    runningExtensionQueries--;
 
-        // TODO: Audio boolean member might be unnecessary
-        if (line[0] == 'V')
-            isAudio = false;
-        else if (line[0] == 'A')
-            isAudio = true;
-        else
-            continue;
+    if (nextExtensionQuery < containers.size()) {
+        QueryNextExtension();
+        return;
+    }
 
-        static QRegularExpression delimiter("\\s");
-        QString libraryName = line.section(delimiter, 1, 2).trimmed();
-        QString displayName = line.section(delimiter, 2).trimmed();
+    if (runningExtensionQueries == 0) {
+        containersQueried = true;
+        CheckQueryComplete();
+    }
+}
 
-        Codec codec { displayName, libraryName, isAudio };
+QStringList FFmpegFormatSupportLoader::parseExtensions(const QString& muxerHelp)
+{
+    static QRegularExpression regex(R"(Common extensions: (.+(?=\.)))");
+    const QRegularExpressionMatch match = regex.match(muxerHelp);
 
-        if (isAudio)
-            audioCodecs.append(codec);
-        else
-            videoCodecs.append(codec);
+    if (!match.hasMatch())
+        return {};
+
+    QStringList extensions;
+    for (const QString& extension : match.captured(1).split(",")) {
+        if (!extension.trimmed().isEmpty())
+            extensions.append(extension.trimmed());
     }
 
-    return { videoCodecs, audioCodecs };
+    return extensions;
 }
 
-QList<Container> FFmpegFormatSupportLoader::parseContainers()
+void FFmpegFormatSupportLoader::onVersionQueried()
 {
-    if (!EnsureValidResult(containersProcess))
-        return {};
+    // a failure here only costs the cache its key, the queries themselves report errors
+    const QByteArray output = versionProcess->exitCode() == 0 ? versionProcess->readAllStandardOutput() : QByteArray();
+    versionHash = QCryptographicHash::hash(output, QCryptographicHash::Sha1).toHex();
+    versionQueried = true;
 
-    QList<Container> containers;
+    if (isRevalidating) {
+        isRevalidating = false;
 
-    while (containersProcess->canReadLine()) {
-        QString line = containersProcess->readLine().trimmed();
+        if (versionHash == cachedVersionHash)
+            return;
 
-        if (line[0] != 'E')
+        StartFormatsQuery();
+        return;
+    }
+
+    CheckQueryComplete();
+}
+
+QList<FFmpegFormatSupportLoader::ListingEntry> FFmpegFormatSupportLoader::parseListing(const QStringView output)
+{
+    QList<ListingEntry> entries;
+    bool isPastLegend = false;
+
+    for (const QStringView rawLine : qTokenize(output, u'\n')) {
+        const QStringView line = rawLine.trimmed();
+
+        // the legend of the flags reads like entries, and ends with a line of dashes
+        if (!isPastLegend) {
+            isPastLegend = line.startsWith(u"--");
             continue;
+        }
 
-        static QRegularExpression delimiter("\\s");
-        QString libraryName = line.section(delimiter, 1, 2).trimmed();
-        QString displayName = line.section(delimiter, 2).trimmed();
+        const qsizetype flagsEnd = line.indexOf(u' ');
+        if (flagsEnd < 0)
+            continue;
 
-        containers.append({ displayName, libraryName });
+        const QStringView rest = line.sliced(flagsEnd).trimmed();
+        const qsizetype nameEnd = rest.indexOf(u' ');
+        entries.append({
+            line.first(flagsEnd),
+            nameEnd < 0 ? rest : rest.first(nameEnd),
+            nameEnd < 0 ? QStringView() : rest.sliced(nameEnd).trimmed(),
+        });
+    }
+
+    return entries;
+}
+
+QPair<QList<Codec>, QList<Codec>> FFmpegFormatSupportLoader::parseCodecs(const QByteArray& output)
+{
+    const QString text = QString::fromUtf8(output);
+    QList<Codec> videoCodecs;
+    QList<Codec> audioCodecs;
+
+    for (const ListingEntry& entry : parseListing(text)) {
+        // TODO: Audio boolean member might be unnecessary
+        if (entry.flags.startsWith(u'V'))
+            videoCodecs.append({ entry.description.toString(), entry.name.toString(), false });
+        else if (entry.flags.startsWith(u'A'))
+            audioCodecs.append({ entry.description.toString(), entry.name.toString(), true });
+    }
+
+    return { videoCodecs, audioCodecs };
+}
+
+QList<Container> FFmpegFormatSupportLoader::parseContainers(const QByteArray& output)
+{
+    const QString text = QString::fromUtf8(output);
+    QList<Container> containers;
+
+    for (const ListingEntry& entry : parseListing(text)) {
+        if (entry.flags.startsWith(u'E'))
+            containers.append({ entry.description.toString(), entry.name.toString() });
     }
 
     return containers;
@@ -104,6 +221,7 @@ QList<Container> FFmpegFormatSupportLoader::parseContainers()
 bool FFmpegFormatSupportLoader::EnsureValidResult(QProcess* process)
 {
     if (process->exitStatus() == QProcess::CrashExit || process->exitCode() != 0) {
+        queryFailed = true;
         emit queryCompleted(Message(
             Severity::Critical,
             QObject::tr("Failed to query supported formats"),
@@ -117,17 +235,106 @@ bool FFmpegFormatSupportLoader::EnsureValidResult(QProcess* process)
     return true;
 }
 
-void FFmpegFormatSupportLoader::SkipLines(size_t count)
+void FFmpegFormatSupportLoader::CheckQueryComplete()
 {
-    for (size_t i = 0; i < count; i++) {
-        codecsProcess->readLine();
-    }
+    if (!codecsQueried || !containersQueried || !versionQueried || queryFailed)
+        return;
+
+    cachedFormats = QSharedPointer<FormatSupport>::create(codecs.first, codecs.second, containers);
+    SaveCache();
+    emit queryCompleted(cachedFormats);
 }
 
-void FFmpegFormatSupportLoader::CheckQueryComplete()
+QJsonObject FFmpegFormatSupportLoader::binaryIdentity()
 {
-    if (codecsQueried && containersQueried) {
-        cachedFormats = QSharedPointer<FormatSupport>::create(codecs.first, codecs.second, containers);
-        emit queryCompleted(cachedFormats);
-    }
+    // on Windows, the bundled binary next to the application is found before the one in PATH
+    QString path = QStandardPaths::findExecutable("ffmpeg", { QDir::currentPath() });
+    if (path.isEmpty())
+        path = QStandardPaths::findExecutable("ffmpeg");
+
+    const QFileInfo binary(path);
+
+    return {
+        { "path", binary.absoluteFilePath() },
+        { "modifiedAt", binary.lastModified().toMSecsSinceEpoch() },
+    };
+}
+
+QJsonObject FFmpegFormatSupportLoader::binaryKey() const
+{
+    QJsonObject key = binaryIdentity();
+    key["formatVersion"] = cacheFormatVersion;
+    return key;
+}
+
+static QJsonArray codecsToJson(const QList<Codec>& codecs)
+{
+    QJsonArray array;
+    for (const Codec& codec : codecs)
+        array.append(QJsonObject { { "displayName", codec.displayName }, { "libraryName", codec.libraryName } });
+
+    return array;
+}
+
+static QList<Codec> codecsFromJson(const QJsonArray& array, const bool isAudio)
+{
+    QList<Codec> codecs;
+    for (const QJsonValue& value : array)
+        codecs.append({ value["displayName"].toString(), value["libraryName"].toString(), isAudio });
+
+    return codecs;
+}
+
+QSharedPointer<FormatSupport> FFmpegFormatSupportLoader::LoadCache()
+{
+    QFile file(QDir(cacheDirectory()).filePath("format_support.json"));
+    if (!file.open(QIODevice::ReadOnly))
+        return nullptr;
+
+    const QJsonObject cache = QJsonDocument::fromJson(file.readAll()).object();
+    const QJsonObject key = binaryKey();
+
+    if (cache["key"].toObject() != key || key["path"].toString().isEmpty())
+        return nullptr;
+
+    QList<Container> cachedContainers;
+    for (const QJsonValue& value : cache["containers"].toArray())
+        cachedContainers.append({ value["displayName"].toString(), value["formatName"].toString(), value["extensions"].toVariant().toStringList() });
+
+    cachedVersionHash = cache["versionHash"].toString();
+
+    return QSharedPointer<FormatSupport>::create(
+        codecsFromJson(cache["videoCodecs"].toArray(), false),
+        codecsFromJson(cache["audioCodecs"].toArray(), true),
+        cachedContainers
+    );
+}
+
+void FFmpegFormatSupportLoader::SaveCache() const
+{
+    QJsonArray containersJson;
+    for (const Container& container : cachedFormats->containers)
+        containersJson.append(QJsonObject {
+            { "displayName", container.displayName },
+            { "formatName", container.formatName },
+            { "extensions", QJsonArray::fromStringList(container.extensions) },
+        });
+
+    const QJsonObject cache {
+        { "key", binaryKey() },
+        { "versionHash", versionHash },
+        { "videoCodecs", codecsToJson(cachedFormats->videoCodecs) },
+        { "audioCodecs", codecsToJson(cachedFormats->audioCodecs) },
+        { "containers", containersJson },
+    };
+
+    QDir().mkpath(cacheDirectory());
+
+    // written aside and renamed, so that an interrupted launch never leaves a truncated cache
+    QSaveFile file(QDir(cacheDirectory()).filePath("format_support.json"));
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    file.write(QJsonDocument(cache).toJson(QJsonDocument::Compact));
+    file.commit();
 }
@@ -5,10 +5,18 @@
 #include "format_support_loader.hpp"
 
 #include <QEventLoop>
+#include <QJsonObject>
 #include <QList>
 #include <QProcess>
 #include <QSharedPointer>
 
+//!
+//! \brief Asks ffmpeg for its encoders and muxers.
+//! \details Results are cached on disk, keyed by the ffmpeg binary, so that later launches do not wait on ffmpeg.
+//! Muxer extensions need one ffmpeg -h per muxer, so they are queried a few at a time along with the formats.
+//! A cached result is returned right away and then checked against the output of ffmpeg -version;
+//! it is only queried again, and reported a second time, if ffmpeg changed.
+//!
 class FFmpegFormatSupportLoader : public FormatSupportLoader
 {
     Q_OBJECT
@@ -18,26 +26,62 @@ public:
 
     void QuerySupportedFormatsAsync() override;
 
+    //! The folder where results about the local ffmpeg are cached.
+    static QString cacheDirectory();
+    //! The path and modification time of the ffmpeg binary in use, which cached results are keyed by.
+    [[nodiscard]] static QJsonObject binaryIdentity();
+
+    //! The encoders of the output of ffmpeg -encoders, as video and audio ones.
+    [[nodiscard]] static QPair<QList<Codec>, QList<Codec>> parseCodecs(const QByteArray& output);
+    //! The muxers of the output of ffmpeg -muxers, without their extensions.
+    [[nodiscard]] static QList<Container> parseContainers(const QByteArray& output);
+
 private slots:
     void onCodecsQueried();
     void onContainersQueried();
+    void onVersionQueried();
 
 private:
-    QPair<QList<Codec>, QList<Codec>> parseCodecs();
-    QList<Container> parseContainers();
+    //! A line of a listing of ffmpeg, as views into its output.
+    struct ListingEntry
+    {
+        QStringView flags;
+        QStringView name;
+        QStringView description;
+    };
+
+    void StartFormatsQuery();
+    //! The lines of a listing such as ffmpeg -encoders, after the legend of its flags.
+    [[nodiscard]] static QList<ListingEntry> parseListing(QStringView output);
+    void QueryNextExtension();
+    void HandleExtensionQueried(QProcess* process, qsizetype containerIndex);
+    static QStringList parseExtensions(const QString& muxerHelp);
     bool EnsureValidResult(QProcess* process);
-    void SkipLines(size_t count);
     void CheckQueryComplete();
 
+    [[nodiscard]] QJsonObject binaryKey() const;
+    [[nodiscard]] QSharedPointer<FormatSupport> LoadCache();
+    void SaveCache() const;
+
     QProcess* codecsProcess;
     QProcess* containersProcess;
+    QProcess* versionProcess;
     bool codecsQueried = false;
     bool containersQueried = false;
+    bool versionQueried = false;
+    bool queryFailed = false;
+    bool isRevalidating = false;
+    QString versionHash;
+    QString cachedVersionHash;
     QMetaObject::Connection connection;
     QSharedPointer<FormatSupport> cachedFormats;
 
     QPair<QList<Codec>, QList<Codec>> codecs;
     QList<Container> containers;
+    qsizetype nextExtensionQuery = 0;
+    int runningExtensionQueries = 0;
+
+    static constexpr int cacheFormatVersion = 2;
 };
 
 #endif
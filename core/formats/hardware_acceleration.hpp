@@ -0,0 +1,17 @@
+#ifndef HARDWARE_ACCELERATION_H
+#define HARDWARE_ACCELERATION_H
+
+#include <QString>
+#include <QStringList>
+
+//!
+//! \brief Describes how to keep frames on the GPU from decoding to encoding.
+//!
+struct HardwareAcceleration {
+    QString hwaccel;                 // value of -hwaccel, e.g. cuda
+    QString outputFormat;            // value of -hwaccel_output_format; empty to download decoded frames
+    QString scaleFilter;             // GPU scaler used in place of scale, e.g. scale_cuda; empty if there is none
+    QStringList deviceParams = {};   // extra input options needed to open the device
+};
+
+#endif
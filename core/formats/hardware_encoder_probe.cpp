@@ -0,0 +1,221 @@
+#include "hardware_encoder_probe.hpp"
+
+#include <QDateTime>
+
+// hardware backends by order of preference, with the decode and scale setup that keeps frames on their device
+static const QList<std::pair<QString, HardwareAcceleration>>& backends()
+{
+    static const QList<std::pair<QString, HardwareAcceleration>> backends = {
+        { "nvenc", { .hwaccel = "cuda", .outputFormat = "cuda", .scaleFilter = "scale_cuda" } },
+        { "qsv", { .hwaccel = "qsv", .outputFormat = "qsv", .scaleFilter = "scale_qsv" } },
+        { "amf", { .hwaccel = "d3d11va", .outputFormat = "", .scaleFilter = "" } },
+        { "vaapi", { .hwaccel = "vaapi", .outputFormat = "vaapi", .scaleFilter = "scale_vaapi", .deviceParams = { "-vaapi_device", "/dev/dri/renderD128" } } },
+        { "videotoolbox", { .hwaccel = "videotoolbox", .outputFormat = "videotoolbox_vld", .scaleFilter = "scale_vt" } },
+        { "mf", { .hwaccel = "d3d11va", .outputFormat = "", .scaleFilter = "" } },
+    };
+
+    return backends;
+}
+
+// software encoders to fall back on, by order of preference
+static QStringList softwareEncoders(const QString& family)
+{
+    static const QHash<QString, QStringList> encoders = {
+        { "h264", { "libx264", "libopenh264" } },
+        { "hevc", { "libx265" } },
+        { "av1", { "libsvtav1", "libaom-av1" } },
+        { "vp9", { "libvpx-vp9" } },
+        { "vp8", { "libvpx" } },
+        { "mpeg2", { "mpeg2video" } },
+        { "mjpeg", { "mjpeg" } },
+    };
+
+    return encoders.value(family);
+}
+
+HardwareEncoderProbe::HardwareEncoderProbe(std::shared_ptr<Settings> settings)
+    : settings(std::move(settings))
+    , process(new QProcess(this))
+    , timeout(new QTimer(this))
+{
+    timeout->setSingleShot(true);
+    timeout->setInterval(probeTimeoutMs);
+
+    connect(timeout, &QTimer::timeout, process, &QProcess::kill);
+    connect(process, &QProcess::finished, this, &HardwareEncoderProbe::HandleProbeResult);
+    connect(process, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error)
+            {
+        // other errors are followed by finished()
+        if (error == QProcess::FailedToStart)
+            HandleProbeResult(-1, QProcess::CrashExit); });
+}
+
+void HardwareEncoderProbe::ProbeAsync(const QSharedPointer<FormatSupport>& formats)
+{
+    this->formats = formats;
+    pendingEncoders.clear();
+
+    const QDateTime probedAt = QDateTime::fromString(settings->get("HardwareEncoders/probedAt").toString(), Qt::ISODate);
+    const int cacheDays = settings->get("Main/iHardwareProbeCacheDays").toInt();
+    const bool isCacheValid = probedAt.isValid() && probedAt.daysTo(QDateTime::currentDateTime()) < cacheDays;
+
+    for (const Codec& codec : formats->videoCodecs)
+    {
+        if (!isHardwareEncoder(codec.libraryName))
+            continue;
+
+        const QVariant cached = settings->get("HardwareEncoders/" + codec.libraryName);
+
+        if (isCacheValid && cached.isValid())
+            results.insert(codec.libraryName, cached.toBool());
+        else
+            pendingEncoders.enqueue(codec.libraryName);
+    }
+
+    if (pendingEncoders.isEmpty())
+    {
+        emit probeCompleted();
+        return;
+    }
+
+    // encoders are probed one at a time, as consumer GPUs limit the amount of concurrent sessions
+    if (currentEncoder.isEmpty())
+        ProbeNext();
+}
+
+bool HardwareEncoderProbe::isWorking(const QString& libraryName) const
+{
+    return results.value(libraryName, false);
+}
+
+HardwareEncoderProbe::ResolvedEncoder HardwareEncoderProbe::resolveEncoder(const Codec& selected) const
+{
+    const QString family = codecFamily(selected.libraryName);
+
+    if (family.isEmpty())
+        return { selected, {} };
+
+    if (isHardwareEncoder(selected.libraryName) && isWorking(selected.libraryName))
+        return { selected, accelerationFor(selected.libraryName) };
+
+    for (const auto& [backend, acceleration] : backends())
+    {
+        const QString name = family + "_" + backend;
+        if (!isWorking(name))
+            continue;
+
+        if (const optional<Codec> codec = findCodec(name))
+            return { *codec, acceleration };
+    }
+
+    // a hardware encoder known not to work would fail at runtime, so fall back on software
+    if (isHardwareEncoder(selected.libraryName) && results.contains(selected.libraryName))
+    {
+        for (const QString& name : softwareEncoders(family))
+        {
+            if (const optional<Codec> codec = findCodec(name))
+                return { *codec, {} };
+        }
+    }
+
+    return { selected, {} };
+}
+
+bool HardwareEncoderProbe::isHardwareEncoder(const QString& libraryName)
+{
+    for (const auto& [backend, acceleration] : backends())
+    {
+        if (libraryName.endsWith("_" + backend))
+            return true;
+    }
+
+    return false;
+}
+
+QString HardwareEncoderProbe::codecFamily(const QString& libraryName)
+{
+    if (isHardwareEncoder(libraryName))
+        return libraryName.section('_', 0, 0);
+
+    static const QHash<QString, QString> families = {
+        { "libx264", "h264" },
+        { "libx264rgb", "h264" },
+        { "libopenh264", "h264" },
+        { "libx265", "hevc" },
+        { "libaom-av1", "av1" },
+        { "libsvtav1", "av1" },
+        { "librav1e", "av1" },
+        { "libvpx-vp9", "vp9" },
+        { "libvpx", "vp8" },
+        { "mpeg2video", "mpeg2" },
+        { "mjpeg", "mjpeg" },
+    };
+
+    return families.value(libraryName);
+}
+
+optional<HardwareAcceleration> HardwareEncoderProbe::accelerationFor(const QString& libraryName)
+{
+    for (const auto& [backend, acceleration] : backends())
+    {
+        if (libraryName.endsWith("_" + backend))
+            return acceleration;
+    }
+
+    return {};
+}
+
+void HardwareEncoderProbe::ProbeNext()
+{
+    if (pendingEncoders.isEmpty())
+    {
+        currentEncoder.clear();
+        settings->Set("HardwareEncoders/probedAt", QDateTime::currentDateTime().toString(Qt::ISODate));
+        emit probeCompleted();
+        return;
+    }
+
+    currentEncoder = pendingEncoders.dequeue();
+    process->startCommand(testCommand(currentEncoder));
+    timeout->start();
+}
+
+void HardwareEncoderProbe::HandleProbeResult(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    if (currentEncoder.isEmpty())
+        return;
+
+    timeout->stop();
+
+    const bool isWorking = exitStatus == QProcess::NormalExit && exitCode == 0;
+    results.insert(currentEncoder, isWorking);
+    settings->Set("HardwareEncoders/" + currentEncoder, isWorking);
+
+    ProbeNext();
+}
+
+QString HardwareEncoderProbe::testCommand(const QString& libraryName) const
+{
+    const optional<HardwareAcceleration> acceleration = accelerationFor(libraryName);
+    const QString deviceParams = acceleration.has_value() ? acceleration->deviceParams.join(" ") : "";
+
+    // devices that only take frames in their own memory need them uploaded first
+    const QString uploadFilter = libraryName.endsWith("_vaapi") ? "-vf format=nv12,hwupload" : "";
+
+    return QString("ffmpeg -hide_banner -v error %1 -f lavfi -i color=black:size=256x256:rate=30 -frames:v 5 %2 -c:v %3 -f null -")
+        .arg(deviceParams, uploadFilter, libraryName);
+}
+
+optional<Codec> HardwareEncoderProbe::findCodec(const QString& libraryName) const
+{
+    if (formats.isNull())
+        return {};
+
+    for (const Codec& codec : formats->videoCodecs)
+    {
+        if (codec.libraryName == libraryName)
+            return codec;
+    }
+
+    return {};
+}
@@ -0,0 +1,69 @@
+#ifndef HARDWARE_ENCODER_PROBE_H
+#define HARDWARE_ENCODER_PROBE_H
+
+#include "codec.hpp"
+#include "core/settings/settings.hpp"
+#include "format_support.hpp"
+#include "hardware_acceleration.hpp"
+
+#include <QHash>
+#include <QObject>
+#include <QProcess>
+#include <QQueue>
+#include <QSharedPointer>
+#include <QTimer>
+#include <di.hpp>
+
+using std::optional;
+
+//!
+//! \brief Checks which hardware encoders actually initialize on this machine, by test-encoding a few frames with each.
+//! \details Results are cached in the HardwareEncoders section of the settings and refreshed after a few days.
+//!
+class HardwareEncoderProbe : public QObject
+{
+    Q_OBJECT
+
+public:
+    BOOST_DI_INJECT(HardwareEncoderProbe, (named = di_settings) std::shared_ptr<Settings> settings);
+
+    struct ResolvedEncoder
+    {
+        Codec codec;
+        optional<HardwareAcceleration> acceleration;
+    };
+
+    void ProbeAsync(const QSharedPointer<FormatSupport>& formats);
+
+    //! Whether the encoder is known to work. Encoders not probed yet are reported as not working.
+    [[nodiscard]] bool isWorking(const QString& libraryName) const;
+
+    //! The encoder to use for the family of the selected codec: preferably a working hardware one, else the software one.
+    [[nodiscard]] ResolvedEncoder resolveEncoder(const Codec& selected) const;
+
+    [[nodiscard]] static bool isHardwareEncoder(const QString& libraryName);
+    [[nodiscard]] static QString codecFamily(const QString& libraryName);
+    [[nodiscard]] static optional<HardwareAcceleration> accelerationFor(const QString& libraryName);
+
+signals:
+    void probeCompleted();
+
+private:
+    void ProbeNext();
+    void HandleProbeResult(int exitCode, QProcess::ExitStatus exitStatus);
+    [[nodiscard]] QString testCommand(const QString& libraryName) const;
+    [[nodiscard]] optional<Codec> findCodec(const QString& libraryName) const;
+
+    std::shared_ptr<Settings> settings;
+    QSharedPointer<FormatSupport> formats;
+
+    QProcess* process;
+    QTimer* timeout;
+    QQueue<QString> pendingEncoders;
+    QString currentEncoder;
+    QHash<QString, bool> results;
+
+    static constexpr int probeTimeoutMs = 10000;
+};
+
+#endif
@@ -0,0 +1,108 @@
+#include "media_file_scanner.hpp"
+
+#include <QDateTime>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QMimeDatabase>
+
+MediaFileScanner::~MediaFileScanner()
+{
+    Stop();
+
+    // deleting a thread that still runs would abort, and stopped scans end at their next file
+    for (QThread* thread : findChildren<QThread*>())
+        thread->wait();
+}
+
+void MediaFileScanner::ScanAsync(const QStringList& paths)
+{
+    Stop();
+
+    const int id = ++scanId;
+    const std::shared_ptr<std::atomic_bool> stopped = std::make_shared<std::atomic_bool>(false);
+    isStopped = stopped;
+
+    worker = QThread::create([this, paths, id, stopped, startTime = QDateTime::currentDateTimeUtc()]
+                             {
+        const QMimeDatabase database;
+        QStringList batch;
+        QElapsedTimer sinceReport;
+        sinceReport.start();
+
+        const auto report = [this, id, &batch, &sinceReport]
+        {
+            QMetaObject::invokeMethod(this, [this, id, found = batch]
+                                      {
+                if (id == scanId)
+                    emit mediaFound(found); }, Qt::QueuedConnection);
+
+            batch.clear();
+            sinceReport.restart();
+        };
+
+        for (const QString& path : paths)
+        {
+            if (*stopped)
+                return;
+
+            // files chosen one by one are worth reading to tell their type, unlike the ones of a whole folder
+            if (!QFileInfo(path).isDir())
+            {
+                if (isMediaType(database.mimeTypeForFile(path)))
+                    batch.append(path);
+                continue;
+            }
+
+            QDirIterator it(path, QDir::Files | QDir::Readable | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+            while (it.hasNext() && !*stopped)
+            {
+                const QString filePath = it.next();
+
+                if (isMediaType(database.mimeTypeForFile(filePath, QMimeDatabase::MatchExtension)) && it.fileInfo().lastModified() < startTime)
+                    batch.append(filePath);
+
+                if (!batch.isEmpty() && (batch.size() >= batchSize || sinceReport.hasExpired(batchIntervalMs)))
+                    report();
+            }
+        }
+
+        if (!batch.isEmpty() && !*stopped)
+            report(); });
+
+    QThread* thread = worker;
+    thread->setParent(this);
+
+    connect(thread, &QThread::finished, this, [this, thread]
+            {
+        thread->deleteLater();
+
+        if (thread != worker)
+            return;
+
+        worker = nullptr;
+        emit finished(); });
+
+    thread->start(QThread::LowPriority);
+}
+
+void MediaFileScanner::Stop()
+{
+    if (isStopped != nullptr)
+        *isStopped = true;
+
+    // the thread is left to end on its own, as waiting for it to reach the next file would block
+    worker = nullptr;
+}
+
+bool MediaFileScanner::isMediaType(const QMimeType& mimeType)
+{
+    const QString name = mimeType.name();
+    return name.startsWith("image/") || name.startsWith("video/") || name.startsWith("audio/");
+}
+
+bool MediaFileScanner::isMediaPath(const QString& path)
+{
+    const QFileInfo file(path);
+    return file.isDir() || isMediaType(QMimeDatabase().mimeTypeForFile(file, QMimeDatabase::MatchExtension));
+}
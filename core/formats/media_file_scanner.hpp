@@ -0,0 +1,50 @@
+#ifndef MEDIA_FILE_SCANNER_H
+#define MEDIA_FILE_SCANNER_H
+
+#include <QMimeType>
+#include <QObject>
+#include <QStringList>
+#include <QThread>
+#include <atomic>
+#include <memory>
+
+//!
+//! \brief Lists the media files among dropped or selected paths, descending into folders on a worker thread.
+//! \details Files are reported in batches as they are found, so that they can be probed and encoded while
+//! the rest of the tree is still being walked. Files in folders are told apart by extension alone, as reading
+//! each of them would take longer than walking the tree; the probe sorts out the rest. Files modified after the
+//! scan started are left out, since those are being written - possibly by the encodes of the files found first.
+//!
+class MediaFileScanner : public QObject
+{
+    Q_OBJECT
+
+public:
+    MediaFileScanner() = default;
+    ~MediaFileScanner() override;
+
+    //! Starts listing the paths, stopping the previous scan if any; mediaFound() only reports this one from then on.
+    void ScanAsync(const QStringList& paths);
+    void Stop();
+    [[nodiscard]] bool isScanning() const { return worker != nullptr; }
+
+    //! Whether the type is one ffmpeg can take as an input: a video, audio track or image.
+    [[nodiscard]] static bool isMediaType(const QMimeType& mimeType);
+    //! Whether the path is a folder, or a file of a media type; only checks the extension of files.
+    [[nodiscard]] static bool isMediaPath(const QString& path);
+
+signals:
+    void mediaFound(const QStringList& paths);
+    void finished();
+
+private:
+    QThread* worker = nullptr;
+    std::shared_ptr<std::atomic_bool> isStopped;
+    int scanId = 0;
+
+    //! Found files are reported once that many are pending, or that long after the last report.
+    static constexpr qsizetype batchSize = 64;
+    static constexpr int batchIntervalMs = 100;
+};
+
+#endif
@@ -2,10 +2,24 @@
 #define METADATA_HPP
 
 #include <QJsonObject>
+#include <QList>
 #include <QObject>
 #include <QPoint>
 #include <QString>
 
+//! A stream of the input, numbered as ffmpeg maps it with -map 0:<index>.
+struct MediaStream {
+    int index;
+    //! video, audio, subtitle, data or attachment.
+    QString type;
+    QString codec;
+    //! Empty when the input does not tag it.
+    QString language;
+    //! 0 when the input does not tell.
+    double bitrateKbps;
+    int channelsCount;
+};
+
 struct Metadata {
     double width;
     double height;
@@ -18,5 +32,7 @@ struct Metadata {
     QString videoCodec;
     QString audioCodec;
     QString container;
+    //! Every stream of the input, in order; the fields above describe the first video and audio ones.
+    QList<MediaStream> streams;
 };
 #endif // METADATA_HPP
@@ -1,77 +1,148 @@
 #include "metadata_loader.hpp"
 #include "core/notifier/message.hpp"
+#include "ffmpeg_format_support_loader.hpp"
 #include "metadata.hpp"
 
+#include <QDateTime>
+#include <QDir>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
-#include <QJsonValue>
-#include <QtConcurrent/QtConcurrent>
+#include <QSaveFile>
+#include <QThread>
 
-MetadataResult MetadataLoader::parse(QByteArray data)
+const QStringList MetadataLoader::ffprobeArguments {
+    "-v", "error",
+    "-show_entries", "format=size,duration:stream=index,codec_type,codec_name,width,height,display_aspect_ratio,r_frame_rate,nb_frames,bit_rate,channels:stream_tags=language,BPS",
+    "-of", "default",
+};
+
+MetadataResult MetadataLoader::parse(const QByteArray& data)
+{
+    ProbeParser parser;
+    parser.Feed(data);
+    return parser.finish();
+}
+
+void MetadataLoader::ProbeParser::Feed(const QByteArrayView chunk)
 {
-    QJsonDocument document = QJsonDocument::fromJson(data);
+    if (outputStart.size() < keptOutputBytes)
+        outputStart.append(chunk.first(qMin(chunk.size(), keptOutputBytes - outputStart.size())));
 
-    if (document.isNull())
+    qsizetype lineStart = 0;
+    for (qsizetype lineEnd = chunk.indexOf('\n'); lineEnd >= 0; lineEnd = chunk.indexOf('\n', lineStart))
     {
-        return Message(
-            Severity::Error,
-            QObject::tr(
-                "Could not retrieve media metadata. Is the file corrupted?"
-            ),
-            QObject::tr("Found metadata: %1").arg(data)
-        );
-    }
+        const QByteArrayView line = chunk.sliced(lineStart, lineEnd - lineStart);
 
-    QJsonObject root = document.object();
-    QJsonArray streams = root.value("streams").toArray();
+        // only the end of a line split across reads is copied, to be completed by the next one
+        if (partialLine.isEmpty())
+            ParseLine(line);
+        else
+        {
+            partialLine.append(line);
+            ParseLine(partialLine);
+            partialLine.clear();
+        }
 
-    // we only support 1 stream of each type at the moment
-    format = root.value("format").toObject();
-    bool isAudio = false;
+        lineStart = lineEnd + 1;
+    }
 
-    for (QJsonValueRef streamRef : streams)
+    partialLine.append(chunk.sliced(lineStart));
+}
+
+MetadataResult MetadataLoader::ProbeParser::finish()
+{
+    if (!partialLine.isEmpty())
     {
-        QJsonObject stream = streamRef.toObject();
-        QJsonValue type = stream.value("codec_type");
+        ParseLine(partialLine);
+        partialLine.clear();
+    }
+
+    return fromProbed({ .format = format, .video = video, .audio = audio, .streams = streams }, outputStart);
+}
 
-        if (type == "video" && video.isEmpty())
+void MetadataLoader::ProbeParser::ParseLine(QByteArrayView line)
+{
+    line = line.trimmed();
+
+    // sections look like "[STREAM]", a field per line, then "[/STREAM]"
+    if (line.startsWith('[') && line.endsWith(']'))
+    {
+        if (!line.startsWith("[/"))
         {
-            video = stream;
+            sectionName = line.sliced(1, line.size() - 2).toByteArray();
+            section.clear();
+            return;
         }
 
-        if (type == "audio" && audio.isEmpty())
+        const QString type = section.value("codec_type");
+        if (sectionName == "FORMAT")
+            format = section;
+        else if (sectionName == "STREAM")
         {
-            audio = stream;
-            isAudio = true;
+            streams.append(section);
+
+            if (type == "video" && video.isEmpty())
+                video = section;
+            else if (type == "audio" && audio.isEmpty())
+                audio = section;
         }
+
+        sectionName.clear();
+        section.clear();
+        return;
     }
 
-    if (format.isEmpty() || (video.isEmpty() && audio.isEmpty()))
+    const qsizetype separator = line.indexOf('=');
+    if (sectionName.isEmpty() || separator <= 0)
+        return;
+
+    section.insert(QString::fromUtf8(line.first(separator)), QString::fromUtf8(line.sliced(separator + 1)));
+}
+
+MetadataResult MetadataLoader::fromProbed(const ProbedStreams& probed, const QByteArray& outputStart)
+{
+    const bool hasVideo = !probed.video.isEmpty();
+
+    if (probed.format.isEmpty() || (probed.video.isEmpty() && probed.audio.isEmpty()))
     {
         return Message(
             Severity::Error,
             QObject::tr("Media metadata is incomplete."),
-            QObject::tr("Found metadata: %1").arg(data)
+            QObject::tr("Found metadata: %1").arg(outputStart)
         );
     }
 
     Metadata metadata;
     QList<QString> errors;
-    std::pair<double, double> aspectRatio = getAspectRatio(errors);
+    std::pair<double, double> aspectRatio = getAspectRatio(probed, errors);
+
+    QList<MediaStream> streams;
+    for (const Fields& stream : probed.streams)
+    {
+        streams.append({
+            .index = value(errors, stream, "index", true).toInt(),
+            .type = value(errors, stream, "codec_type").toString(),
+            .codec = value(errors, stream, "codec_name").toString(),
+            .language = value(errors, stream, "TAG:language").toString(),
+            .bitrateKbps = getBitrateKbps(errors, stream),
+            .channelsCount = value(errors, stream, "channels").toInt(),
+        });
+    }
 
     metadata = Metadata {
-        .width = value(errors, video, "width", true).toDouble(),
-        .height = value(errors, video, "height", true).toDouble(),
-        .sizeKbps = value(errors, format, "size", true).toDouble() * 0.001,
-        .audioBitrateKbps = value(errors, audio, "bit_rate").toDouble() * 0.001,
-        .durationSeconds = value(errors, format, "duration", true).toDouble(),
+        .width = value(errors, probed.video, "width", true).toDouble(),
+        .height = value(errors, probed.video, "height", true).toDouble(),
+        .sizeKbps = value(errors, probed.format, "size", true).toDouble() * 0.001,
+        .audioBitrateKbps = getBitrateKbps(errors, probed.audio),
+        .durationSeconds = value(errors, probed.format, "duration", true).toDouble(),
         .aspectRatioX = aspectRatio.first,
         .aspectRatioY = aspectRatio.second,
-        .frameRate = isAudio ? 0 : getFrameRate(errors),
-        .videoCodec = value(errors, video, "codec_name", true).toString(),
-        .audioCodec = value(errors, audio, "codec_name", true).toString(),
-        .container = "" // TODO: Find a reliable way to query format type
+        .frameRate = hasVideo ? getFrameRate(probed, errors) : 0,
+        .videoCodec = value(errors, probed.video, "codec_name", true).toString(),
+        .audioCodec = value(errors, probed.audio, "codec_name", true).toString(),
+        .container = "", // TODO: Find a reliable way to query format type
+        .streams = streams,
     };
 
     if (!errors.isEmpty())
@@ -80,68 +151,275 @@ MetadataResult MetadataLoader::parse(QByteArray data)
             Severity::Error,
             "Missing metadata fields",
             "The following metadata fields could not be found: " + errors.join("\n"),
-            QObject::tr("Raw metadata: %1").arg(data)
+            QObject::tr("Raw metadata: %1").arg(outputStart)
         );
     }
 
     return metadata;
 }
 
-void MetadataLoader::handleResult()
+MetadataLoader::MetadataLoader()
+    : maxProbes(qBound(2, QThread::idealThreadCount(), 8))
+    , saveTimer(new QTimer(this))
+{
+    // probes tend to come in bursts, which are written to disk at once
+    saveTimer->setSingleShot(true);
+    saveTimer->setInterval(saveDelayMs);
+    connect(saveTimer, &QTimer::timeout, this, &MetadataLoader::SaveDiskCache);
+}
+
+MetadataLoader::~MetadataLoader()
 {
-    if (ffprobe.exitCode() != 0)
+    if (saveTimer->isActive())
+        SaveDiskCache();
+}
+
+int MetadataLoader::loadAsync(const QString& path)
+{
+    const int requestId = nextRequestId++;
+    const QString cacheKey = cacheKeyFor(QFileInfo(path));
+
+    if (const optional<Metadata> metadata = cached(cacheKey); metadata.has_value())
+    {
+        QMetaObject::invokeMethod(this, [this, requestId, path, metadata]
+                                  { emit loadAsyncComplete(requestId, path, *metadata); }, Qt::QueuedConnection);
+        return requestId;
+    }
+
+    if (probes.contains(cacheKey))
     {
-        emit loadAsyncComplete(Message(
+        probes[cacheKey].requests.append({ requestId, path });
+        return requestId;
+    }
+
+    probes.insert(cacheKey, { .path = path, .requests = { { requestId, path } } });
+    pendingKeys.enqueue(cacheKey);
+
+    // deferred, as failing to start is reported synchronously
+    QMetaObject::invokeMethod(this, &MetadataLoader::StartProbes, Qt::QueuedConnection);
+
+    return requestId;
+}
+
+void MetadataLoader::StartProbes()
+{
+    while (runningProbes < maxProbes && !pendingKeys.isEmpty())
+    {
+        const QString cacheKey = pendingKeys.dequeue();
+        auto* process = new QProcess(this);
+        runningProbes++;
+
+        connect(process, &QProcess::finished, this, [this, process, cacheKey]
+                { HandleResult(process, cacheKey); });
+        connect(process, &QProcess::errorOccurred, this, [this, process, cacheKey](QProcess::ProcessError error)
+                {
+            // other errors are followed by finished()
+            if (error == QProcess::FailedToStart)
+                HandleResult(process, cacheKey); });
+
+        probes[cacheKey].runTimer.start();
+
+        // output is parsed as it arrives, so that it never piles up
+        connect(process, &QProcess::readyReadStandardOutput, this, [this, process, cacheKey]
+                { probes[cacheKey].parser.Feed(process->readAllStandardOutput()); });
+
+        // the program is looked up like a shell would, which finds ffprobe.exe on Windows as well
+        process->startCommand(
+            QString(R"(ffprobe %1 "%2")").arg(ffprobeArguments.join(' '), probes.value(cacheKey).path)
+        );
+    }
+}
+
+void MetadataLoader::HandleResult(QProcess* process, const QString& cacheKey)
+{
+    runningProbes--;
+    process->deleteLater();
+
+    if (process->error() == QProcess::FailedToStart || process->exitStatus() == QProcess::CrashExit || process->exitCode() != 0)
+    {
+        Complete(cacheKey, Message(
             Severity::Error,
             tr("Could not retrieve media metadata."),
-            tr("FFprobe failed: %1").arg(ffprobe.errorString())
+            tr("FFprobe failed: %1").arg(process->errorString()),
+            process->readAllStandardError()
         ));
+    }
+    else
+    {
+        ProbeParser& parser = probes[cacheKey].parser;
+        parser.Feed(process->readAllStandardOutput());
+        const MetadataResult result = parser.finish();
 
-        return;
+        if (std::holds_alternative<Metadata>(result))
+            Cache(cacheKey, std::get<Metadata>(result));
+
+        Complete(cacheKey, result);
     }
 
-    QByteArray data = ffprobe.readAll();
-    MetadataResult result = parse(data);
-    emit loadAsyncComplete(result);
+    StartProbes();
+}
+
+void MetadataLoader::Complete(const QString& cacheKey, const MetadataResult& result)
+{
+    const Probe probe = probes.take(cacheKey);
+
+    if (probe.runTimer.isValid())
+        emit probeTimed(probe.path, probe.runTimer.elapsed() / 1000.0);
+
+    for (const auto& [requestId, path] : probe.requests)
+        emit loadAsyncComplete(requestId, path, result);
 }
 
-MetadataLoader::MetadataLoader(const PlatformInfo& platformInfo)
-    : platform(platformInfo)
+QString MetadataLoader::cacheKeyFor(const QFileInfo& file)
 {
+    return QString("%1|%2|%3").arg(file.absoluteFilePath(), QString::number(file.size()), QString::number(file.lastModified().toMSecsSinceEpoch()));
 }
 
-void MetadataLoader::loadAsync(const QString& path)
+optional<Metadata> MetadataLoader::cached(const QString& cacheKey)
 {
-    if (ffprobe.state() == QProcess::Running)
+    if (const Metadata* metadata = memoryCache.object(cacheKey))
+        return *metadata;
+
+    LoadDiskCache();
+
+    if (!diskCache.contains(cacheKey))
+        return {};
+
+    QJsonObject entry = diskCache.value(cacheKey).toObject();
+    const Metadata metadata = fromJson(entry.value("metadata").toObject());
+
+    // persisted along with the next new entry, which is enough to keep recently used ones
+    entry.insert("usedAt", QDateTime::currentMSecsSinceEpoch());
+    diskCache.insert(cacheKey, entry);
+    memoryCache.insert(cacheKey, new Metadata(metadata));
+
+    return metadata;
+}
+
+void MetadataLoader::Cache(const QString& cacheKey, const Metadata& metadata)
+{
+    memoryCache.insert(cacheKey, new Metadata(metadata));
+
+    LoadDiskCache();
+    diskCache.insert(cacheKey, QJsonObject {
+        { "metadata", toJson(metadata) },
+        { "usedAt", QDateTime::currentMSecsSinceEpoch() },
+    });
+
+    saveTimer->start();
+}
+
+void MetadataLoader::LoadDiskCache()
+{
+    if (isDiskCacheLoaded)
+        return;
+
+    isDiskCacheLoaded = true;
+
+    QFile file(QDir(FFmpegFormatSupportLoader::cacheDirectory()).filePath("metadata_cache.json"));
+    if (!file.open(QIODevice::ReadOnly))
         return;
 
-    ffprobe.start(
-        QString(R"(ffprobe%1 -v error -print_format json -show_format -show_streams "%2")")
-            .arg(platform.isWindows() ? ".exe" : "", path)
-    );
+    const QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+    if (root.value("version").toInt() == cacheFormatVersion)
+        diskCache = root.value("entries").toObject();
+}
 
-    if (!ffprobe.waitForStarted())
+void MetadataLoader::SaveDiskCache()
+{
+    if (diskCache.size() > maxDiskEntries)
     {
-        emit loadAsyncComplete(Message(
-            Severity::Error,
-            tr("Could not retrieve media metadata."),
-            tr("FFprobe failed: %1").arg(ffprobe.errorString())
-        ));
+        QList<std::pair<qint64, QString>> entries;
+        for (auto it = diskCache.constBegin(); it != diskCache.constEnd(); ++it)
+            entries.append({ it.value().toObject().value("usedAt").toInteger(), it.key() });
 
+        std::sort(entries.begin(), entries.end());
+
+        for (qsizetype i = 0; i < entries.size() - maxDiskEntries; i++)
+            diskCache.remove(entries.at(i).second);
+    }
+
+    QDir().mkpath(FFmpegFormatSupportLoader::cacheDirectory());
+
+    QSaveFile file(QDir(FFmpegFormatSupportLoader::cacheDirectory()).filePath("metadata_cache.json"));
+    if (!file.open(QIODevice::WriteOnly))
         return;
+
+    file.write(QJsonDocument(QJsonObject { { "version", cacheFormatVersion }, { "entries", diskCache } }).toJson(QJsonDocument::Compact));
+    file.commit();
+}
+
+QJsonObject MetadataLoader::toJson(const Metadata& metadata)
+{
+    QJsonArray streams;
+    for (const MediaStream& stream : metadata.streams)
+    {
+        streams.append(QJsonObject {
+            { "index", stream.index },
+            { "type", stream.type },
+            { "codec", stream.codec },
+            { "language", stream.language },
+            { "bitrateKbps", stream.bitrateKbps },
+            { "channelsCount", stream.channelsCount },
+        });
     }
 
-    connect(&ffprobe, &QProcess::finished, this, &MetadataLoader::handleResult, Qt::UniqueConnection);
+    return {
+        { "width", metadata.width },
+        { "height", metadata.height },
+        { "sizeKbps", metadata.sizeKbps },
+        { "audioBitrateKbps", metadata.audioBitrateKbps },
+        { "durationSeconds", metadata.durationSeconds },
+        { "aspectRatioX", metadata.aspectRatioX },
+        { "aspectRatioY", metadata.aspectRatioY },
+        { "frameRate", metadata.frameRate },
+        { "videoCodec", metadata.videoCodec },
+        { "audioCodec", metadata.audioCodec },
+        { "container", metadata.container },
+        { "streams", streams },
+    };
 }
 
-double MetadataLoader::getFrameRate(QList<QString>& errors)
+Metadata MetadataLoader::fromJson(const QJsonObject& json)
 {
-    QVariant frameRateData = value(errors, video, "r_frame_rate");
+    QList<MediaStream> streams;
+    for (const QJsonValue& value : json.value("streams").toArray())
+    {
+        const QJsonObject stream = value.toObject();
+        streams.append({
+            .index = stream.value("index").toInt(),
+            .type = stream.value("type").toString(),
+            .codec = stream.value("codec").toString(),
+            .language = stream.value("language").toString(),
+            .bitrateKbps = stream.value("bitrateKbps").toDouble(),
+            .channelsCount = stream.value("channelsCount").toInt(),
+        });
+    }
+
+    return {
+        .width = json.value("width").toDouble(),
+        .height = json.value("height").toDouble(),
+        .sizeKbps = json.value("sizeKbps").toDouble(),
+        .audioBitrateKbps = json.value("audioBitrateKbps").toDouble(),
+        .durationSeconds = json.value("durationSeconds").toDouble(),
+        .aspectRatioX = json.value("aspectRatioX").toDouble(),
+        .aspectRatioY = json.value("aspectRatioY").toDouble(),
+        .frameRate = json.value("frameRate").toDouble(),
+        .videoCodec = json.value("videoCodec").toString(),
+        .audioCodec = json.value("audioCodec").toString(),
+        .container = json.value("container").toString(),
+        .streams = streams,
+    };
+}
+
+double MetadataLoader::getFrameRate(const ProbedStreams& streams, QList<QString>& errors)
+{
+    QVariant frameRateData = value(errors, streams.video, "r_frame_rate");
 
     if (frameRateData.isNull())
     {
-        QVariant nbrFramesData = value(errors, video, "nb_frames");
-        QVariant durationData = value(errors, format, "duration");
+        QVariant nbrFramesData = value(errors, streams.video, "nb_frames");
+        QVariant durationData = value(errors, streams.format, "duration");
 
         if (nbrFramesData.isNull() || durationData.isNull())
         {
@@ -166,14 +444,14 @@ double MetadataLoader::getFrameRate(QList<QString>& errors)
     return frameRateRatio.first().toDouble() / frameRateRatio.last().toDouble();
 }
 
-std::pair<double, double> MetadataLoader::getAspectRatio(QList<QString>& errors)
+std::pair<double, double> MetadataLoader::getAspectRatio(const ProbedStreams& streams, QList<QString>& errors)
 {
-    QVariant aspectRatioData = value(errors, video, "display_aspect_ratio");
+    QVariant aspectRatioData = value(errors, streams.video, "display_aspect_ratio");
 
     if (aspectRatioData.isNull())
     {
-        double width = value(errors, video, "width").toDouble();
-        double height = value(errors, video, "height").toDouble();
+        double width = value(errors, streams.video, "width").toDouble();
+        double height = value(errors, streams.video, "height").toDouble();
         double ratio = width / height;
 
         return { ratio, 1 };
@@ -189,3 +467,9 @@ std::pair<double, double> MetadataLoader::getAspectRatio(QList<QString>& errors)
 
     return { aspectRatio.first().toDouble(), aspectRatio.last().toDouble() };
 }
+
+double MetadataLoader::getBitrateKbps(QList<QString>& errors, const Fields& stream)
+{
+    const QVariant bitrate = value(errors, stream, "bit_rate");
+    return (bitrate.isNull() ? value(errors, stream, "TAG:BPS") : bitrate).toDouble() * 0.001;
+}
@@ -2,42 +2,133 @@
 #define METADATA_LOADER_H
 
 #include <QByteArray>
+#include <QCache>
 #include <QCoreApplication>
+#include <QElapsedTimer>
 #include <QEventLoop>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonObject>
 #include <QProcess>
+#include <QQueue>
+#include <QTimer>
+#include <optional>
 #include <variant>
 
 #include "metadata.hpp"
 #include "core/notifier/message.hpp"
-#include "core/utils/platform_info.hpp"
+
+using std::optional;
 
 typedef std::variant<Metadata, Message> MetadataResult;
 
+//!
+//! \brief Probes media files with a pool of concurrent ffprobe processes.
+//! \details Results are cached in memory and on disk, keyed by path, size and modification time,
+//! so probing a file again is free until it changes. Concurrent requests for the same file share a probe.
+//!
 class MetadataLoader : public QObject
 {
     Q_OBJECT
 public:
-    MetadataLoader(const PlatformInfo& platformInfo);
-
-    void loadAsync(const QString& path);
+    MetadataLoader();
+    ~MetadataLoader() override;
+
+    //! Queues a probe of the file at path and returns the id its result is delivered with.
+    //! The result is never delivered before this returns, even when cached.
+    int loadAsync(const QString& path);
+
+    //! The fields of ffprobe sections, as printed.
+    typedef QHash<QString, QString> Fields;
+
+    //!
+    //! \brief Reads the output of the targeted probe as it arrives, keeping only the sections Metadata is made of.
+    //! \details Lines are parsed as soon as they are complete, so the output is never held whole; only the start of it
+    //! is kept, to be shown when it cannot be read.
+    //!
+    class ProbeParser
+    {
+    public:
+        void Feed(QByteArrayView chunk);
+        //! Parses what is left of the output, and makes metadata of it.
+        [[nodiscard]] MetadataResult finish();
+
+    private:
+        void ParseLine(QByteArrayView line);
+
+        QByteArray partialLine;
+        QByteArray outputStart;
+        //! The section being read, with the name of its header; empty between sections.
+        QByteArray sectionName;
+        Fields section;
+        Fields format;
+        Fields video;
+        Fields audio;
+        QList<Fields> streams;
+
+        static constexpr qsizetype keptOutputBytes = 4096;
+    };
+
+    //! Parses the whole output of ffprobeArguments at once.
+    static MetadataResult parse(const QByteArray& data);
+    //! Only prints the fields Metadata needs, with the default writer, whose sections are read line by line:
+    //! attachments, chapters and tags other than the language and bitrate of streams, which can weigh megabytes, are left out.
+    static const QStringList ffprobeArguments;
+
+    static constexpr int maxMemoryEntries = 512;
+    static constexpr int maxDiskEntries = 4096;
 
 signals:
-    void loadAsyncComplete(MetadataResult result);
+    void loadAsyncComplete(int requestId, const QString& path, MetadataResult result);
+    //! Emitted once ffprobe ended, with the wall time it took; cached results take none and are not reported.
+    void probeTimed(const QString& path, double probeSeconds);
 
 private:
-    void handleResult();
-    MetadataResult parse(QByteArray data);
-
-    double getFrameRate(QList<QString>& errors);
-    std::pair<double, double> getAspectRatio(QList<QString>& errors);
+    //! The first stream of each type, which the fields of Metadata describe, and every stream in order.
+    struct ProbedStreams
+    {
+        Fields format;
+        Fields video;
+        Fields audio;
+        QList<Fields> streams;
+    };
 
-    inline QVariant value(QList<QString>& errors, QJsonObject& source, const QString& key, bool required = false)
+    struct Probe
+    {
+        QString path;
+        //! Ids of the requests waiting on this probe, with the path each of them asked for.
+        QList<std::pair<int, QString>> requests;
+        QElapsedTimer runTimer;
+        ProbeParser parser;
+    };
+
+    void StartProbes();
+    void HandleResult(QProcess* process, const QString& cacheKey);
+    void Complete(const QString& cacheKey, const MetadataResult& result);
+
+    [[nodiscard]] static QString cacheKeyFor(const QFileInfo& file);
+    [[nodiscard]] optional<Metadata> cached(const QString& cacheKey);
+    void Cache(const QString& cacheKey, const Metadata& metadata);
+    void LoadDiskCache();
+    void SaveDiskCache();
+
+    static QJsonObject toJson(const Metadata& metadata);
+    static Metadata fromJson(const QJsonObject& json);
+
+    static MetadataResult fromProbed(const ProbedStreams& probed, const QByteArray& outputStart);
+    static double getFrameRate(const ProbedStreams& streams, QList<QString>& errors);
+    static std::pair<double, double> getAspectRatio(const ProbedStreams& streams, QList<QString>& errors);
+    //! The bitrate of a stream, from the statistics Matroska muxers tag streams with when the stream has none.
+    static double getBitrateKbps(QList<QString>& errors, const Fields& stream);
+
+    static inline QVariant value(QList<QString>& errors, const Fields& source, const QString& key, bool required = false)
     {
         if (source.isEmpty())
             return {};
 
-        if (source.contains(key))
-            return source.value(key).toVariant();
+        // ffprobe prints N/A for the fields a stream does not know
+        if (source.contains(key) && source.value(key) != "N/A")
+            return source.value(key);
 
         if (required)
             NotFound(errors, key);
@@ -45,17 +136,25 @@ private:
         return {};
     }
 
-    inline void NotFound(QList<QString>& errors, const QString& key)
+    static inline void NotFound(QList<QString>& errors, const QString& key)
     {
         errors.append(QString("Could not find %1 in metadata.").arg(key));
     }
 
-    QProcess ffprobe;
-    PlatformInfo platform;
+    int nextRequestId = 0;
+    int maxProbes;
+
+    QQueue<QString> pendingKeys;
+    QHash<QString, Probe> probes;
+    int runningProbes = 0;
+
+    QCache<QString, Metadata> memoryCache { maxMemoryEntries };
+    QJsonObject diskCache;
+    bool isDiskCacheLoaded = false;
+    QTimer* saveTimer;
 
-    QJsonObject format;
-    QJsonObject video;
-    QJsonObject audio;
+    static constexpr int saveDelayMs = 2000;
+    static constexpr int cacheFormatVersion = 3;
 };
 
 #endif
@@ -18,11 +18,15 @@ int main(int argc, char* argv[])
 
     QSettings::setPath(QSettings::IniFormat, QSettings::UserScope, QDir::current().absolutePath());
 
+    // opened once and shared, as each store holds its own snapshot of the file
+    const auto settings = std::make_shared<IniSettings>("config.ini", "config_default.ini");
+    const auto presets = std::make_shared<IniSettings>("presets.ini");
+
     const auto injector = make_injector(
-        di::bind<Settings>.named(di_settings).to([]
-                                                 { return std::make_shared<IniSettings>("config.ini", "config_default.ini"); }),
-        di::bind<Settings>.named(di_presets).to([]
-                                                { return std::make_shared<IniSettings>("presets.ini"); }),
+        di::bind<Settings>.named(di_settings).to([settings]
+                                                 { return settings; }),
+        di::bind<Settings>.named(di_presets).to([presets]
+                                                { return presets; }),
         di::bind<Notifier>.to<MessageBoxNotifier>(), di::bind<FormatSupportLoader>.to<FFmpegFormatSupportLoader>()
     );
 
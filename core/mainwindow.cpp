@@ -2,9 +2,9 @@
 #include <QFileDialog>
 #include <QMenu>
 #include <QMimeData>
-#include <QMimeDatabase>
 #include <QMovie>
 #include <QThread>
+#include <QTime>
 #include <QTimer>
 #include <QWhatsThis>
 #include <utility>
@@ -18,27 +18,33 @@
 using std::optional;
 
 MainWindow::MainWindow(
-    MediaEncoder& encoder,
+    EncoderThread& encoderThread,
     std::shared_ptr<Settings> settings,
     std::shared_ptr<Settings> presetsSettings,
     std::shared_ptr<Serializer> serializer,
     MetadataLoader& metadata,
+    MediaFileScanner& mediaScanner,
     Notifier& notifier,
     PlatformInfo& platformInfo,
-    FormatSupportLoader& formatSupportLoader
+    FormatSupportLoader& formatSupportLoader,
+    HardwareEncoderProbe& hardwareProbe,
+    TelemetryRecorder& telemetry
 )
     : ui(new Ui::MainWindow)
     , overlay(new OverlayWidget(this))
     , warnings(new Warnings(ui->warningTooltipButton))
     , menu(new QMenu(this))
-    , encoder(encoder)
+    , encoderThread(encoderThread)
     , settings(settings)
     , presetsSettings(std::move(presetsSettings))
     , serializer(std::move(serializer))
     , metadataLoader(metadata)
+    , mediaScanner(mediaScanner)
     , notifier(notifier)
     , platformInfo(platformInfo)
     , formatSupport(formatSupportLoader)
+    , hardwareProbe(hardwareProbe)
+    , telemetry(telemetry)
 {
     CheckForFFmpeg();
 
@@ -69,6 +75,9 @@ MainWindow::MainWindow(
         ui->outputFileNameSuffixCheckBox,
         ui->playOnSuccessCheckBox,
         ui->warnOnOverwriteCheckBox,
+        ui->preferHardwareEncoderCheckBox,
+        ui->parallelSegmentsCheckBox,
+        ui->analyzeComplexityCheckBox,
     });
 
     presetWidgets = std::make_unique<const QList<QObject*>>(QList<QObject*> {
@@ -86,6 +95,7 @@ MainWindow::MainWindow(
         ui->videoCodecComboBox,
         ui->widthSpinBox,
         ui->audioChannelCountSpinbox,
+        ui->twoPassCheckBox,
     });
 
     videoControls = std::make_unique<const QList<QWidget*>>(QList<QWidget*> {
@@ -107,6 +117,23 @@ MainWindow::MainWindow(
     SetupMenu();
     SetupEventCallbacks();
 
+    const QString telemetryLog = settings->get("Main/sTelemetryLog").toString();
+    telemetry.setLogPath(telemetryLog);
+
+    // settings are read here, so that the encoder's thread only gets their values
+    encoderThread.Configure([threadsPerJob = settings->get("Main/iThreadsPerEncoder").toInt(),
+                             remoteWorkers = settings->get("Main/sRemoteWorkers").toStringList(),
+                             remoteWorkerCommand = settings->get("Main/sRemoteWorkerCommand").toString(),
+                             isInProcessEncoding = settings->get("Main/bInProcessEncoding").toBool(),
+                             stagingDirectory = settings->get("Main/sStagingDirectory").toString(),
+                             measuresResourceUsage = !telemetryLog.isEmpty()](MediaEncoder& encoder)
+                            {
+        encoder.setThreadsPerJob(threadsPerJob);
+        encoder.setRemoteWorkers(remoteWorkers, remoteWorkerCommand);
+        encoder.setInProcessEncoding(isInProcessEncoding);
+        encoder.setStagingDirectory(stagingDirectory);
+        encoder.setMeasuresResourceUsage(measuresResourceUsage); });
+
     QuerySupportedFormatsAsync();
 }
 
@@ -132,6 +159,8 @@ void MainWindow::CheckForFFmpeg() const
 
 void MainWindow::SetupMenu()
 {
+    menu->addAction(tr("Open folder..."), this, &MainWindow::OpenInputFolder);
+    menu->addSeparator();
     menu->addAction(tr("Help"), &QWhatsThis::enterWhatsThisMode);
     menu->addSeparator();
     menu->addAction(tr("About"), this, &MainWindow::ShowAbout);
@@ -144,11 +173,18 @@ void MainWindow::SetupEventCallbacks()
 {
     connect(&formatSupport, &FormatSupportLoader::queryCompleted, this, &MainWindow::HandleFormatsQueryResult);
 
-    connect(&encoder, &MediaEncoder::encodingStarted, this, &MainWindow::HandleStart);
-    connect(&encoder, &MediaEncoder::encodingSucceeded, this, &MainWindow::HandleSuccess);
-    connect(&encoder, &MediaEncoder::encodingFailed, this, &MainWindow::HandleFailure);
-    connect(&encoder, &MediaEncoder::encodingProgressUpdate, this, [this](int progress)
-            { SetProgressShown({ .status = tr("Compressing..."), .progressPercent = progress }); });
+    connect(&encoderThread.encoder(), &MediaEncoder::jobStarted, this, &MainWindow::HandleStart);
+    connect(&encoderThread.encoder(), &MediaEncoder::jobProgressUpdate, this, &MainWindow::HandleProgress);
+    connect(&encoderThread.encoder(), &MediaEncoder::jobSucceeded, this, &MainWindow::HandleSuccess);
+    connect(&encoderThread.encoder(), &MediaEncoder::jobFailed, this, &MainWindow::HandleFailure);
+    connect(&encoderThread.encoder(), &MediaEncoder::jobCancelled, this, &MainWindow::HandleCancelled);
+    connect(&encoderThread.encoder(), &MediaEncoder::queueFinished, this, &MainWindow::HandleQueueFinished);
+    connect(&encoderThread.encoder(), &MediaEncoder::previewCompleted, this, &MainWindow::HandlePreviewCompleted);
+    connect(&encoderThread.encoder(), &MediaEncoder::previewFailed, this, &MainWindow::HandlePreviewFailed);
+
+    connect(&metadataLoader, &MetadataLoader::loadAsyncComplete, this, &MainWindow::ReceiveMediaMetadata);
+    connect(&mediaScanner, &MediaFileScanner::mediaFound, this, &MainWindow::AddInputFiles);
+    connect(&mediaScanner, &MediaFileScanner::finished, this, &MainWindow::HandleScanFinished);
 }
 
 void MainWindow::QuerySupportedFormatsAsync()
@@ -187,6 +223,9 @@ void MainWindow::LoadState()
         ui->outputFileNameSuffixCheckBox,
         ui->playOnSuccessCheckBox,
         ui->warnOnOverwriteCheckBox,
+        ui->preferHardwareEncoderCheckBox,
+        ui->parallelSegmentsCheckBox,
+        ui->analyzeComplexityCheckBox,
     };
 
     serializer->deserializeMany(widgets, settings, key);
@@ -213,17 +252,15 @@ void MainWindow::dragEnterEvent(QDragEnterEvent* event)
         return;
     }
 
-    const QMimeDatabase database;
-    const QUrl url = event->mimeData()->urls().first();
-    const QMimeType mimeType = database.mimeTypeForFile(url.toLocalFile());
+    // folders are accepted as they are, their content is only looked at once dropped
+    const QList<QUrl> urls = event->mimeData()->urls();
+    isValidMimeForDrop = std::any_of(urls.cbegin(), urls.cend(), [](const QUrl& url)
+                                     { return url.isLocalFile() && MediaFileScanner::isMediaPath(url.toLocalFile()); });
 
-    isValidMimeForDrop = mimeType.name().startsWith("image/")
-                      || mimeType.name().startsWith("video/")
-                      || mimeType.name().startsWith("audio/");
     if (isValidMimeForDrop)
     {
         overlay->setBackgroundColor(QColor(0, 0, 0, 128));
-        overlay->setText("Drop to select file");
+        overlay->setText(urls.size() > 1 || QFileInfo(urls.first().toLocalFile()).isDir() ? "Drop to select files" : "Drop to select file");
     }
     else
     {
@@ -246,10 +283,7 @@ void MainWindow::dropEvent(QDropEvent* event)
         return;
 
     if (isValidMimeForDrop)
-    {
-        const QUrl url = event->mimeData()->urls().first();
-        LoadInputFile(url);
-    }
+        LoadInputFiles(event->mimeData()->urls());
 
     overlay->hideWithFade();
     isDragging = false;
@@ -275,10 +309,8 @@ void MainWindow::closeEvent(QCloseEvent* event)
 
 void MainWindow::StartEncoding()
 {
-    EncoderOptionsBuilder builder;
-
-    const QString inputPath = ui->inputFileLineEdit->text();
-    const QString outputPath = getOutputPath(inputPath);
+    const QString selectedPath = ui->inputFileLineEdit->text();
+    const QStringList inputs = !inputPaths.isEmpty() && inputPaths.first() == selectedPath ? inputPaths : QStringList { selectedPath };
 
     // FIXME: emit fileExists() signal
     // if (QFile::exists(outputPath + "." + container->formatName) && ui->warnOnOverwriteCheckBox->isChecked()
@@ -289,7 +321,109 @@ void MainWindow::StartEncoding()
     //     return;
     // }
 
-    if (metadata.has_value())
+    std::vector<EncoderOptions> jobs;
+    QStringList errors;
+    QStringList awaitedInputs;
+
+    for (const QString& inputPath : inputs)
+    {
+        // inputs still being probed join the batch once they are, rather than holding up the others
+        if (inputs.size() > 1 && !inputsMetadata.contains(inputPath))
+        {
+            awaitedInputs.append(inputPath);
+            continue;
+        }
+
+        QStringList inputErrors;
+        optional<EncoderOptions> options = BuildEncoderOptions(inputPath, inputErrors);
+
+        if (options.has_value())
+            jobs.push_back(*options);
+        else if (inputs.size() == 1)
+            errors.append(inputErrors);
+        else
+            errors.append(QString("%1:\n%2").arg(inputPath, inputErrors.join("\n")));
+    }
+
+    if (!errors.isEmpty())
+    {
+        notifier.Notify(Severity::Error, "Invalid encoding options", errors.join("\n"));
+        return;
+    }
+
+    batch = {
+        .jobsCount = static_cast<int>(jobs.size()),
+        .isStreamed = mediaScanner.isScanning() || !awaitedInputs.isEmpty(),
+        .awaitedInputs = awaitedInputs,
+    };
+    SetProgressShown({ .status = tr("Compressing..."), .progressPercent = 0, .isCancellable = true });
+
+    if (jobs.empty())
+        return;
+
+    const QList<int> jobIds = encoderThread.EncodeBatch(jobs);
+    for (qsizetype i = 0; i < jobIds.size(); i++)
+        batch.inputPaths.insert(jobIds.at(i), jobs.at(i).inputPath);
+}
+
+void MainWindow::PreviewEncoding()
+{
+    QStringList errors;
+    const optional<EncoderOptions> options = BuildEncoderOptions(ui->inputFileLineEdit->text(), errors);
+
+    if (!options.has_value())
+    {
+        notifier.Notify(Severity::Error, "Invalid encoding options", errors.join("\n"));
+        return;
+    }
+
+    // a preview is not part of any batch, whose summary would otherwise be shown again when the queue empties
+    batch = {};
+    previewId = encoderThread.Preview(*options);
+
+    SetProgressShown({ .status = tr("Previewing...") });
+    ui->progressBarLabel->setText(tr("Encoding samples of the input..."));
+}
+
+void MainWindow::PauseEncoding()
+{
+    batch.isPaused = !batch.isPaused;
+
+    for (const int jobId : batch.inputPaths.keys())
+    {
+        if (batch.isPaused)
+            encoderThread.Pause(jobId);
+        else
+            encoderThread.Resume(jobId);
+    }
+
+    ui->pauseButton->setText(batch.isPaused ? tr("Resume") : tr("Pause"));
+    if (batch.isPaused)
+        ui->progressBarLabel->setText(tr("Paused"));
+}
+
+void MainWindow::CancelEncoding()
+{
+    batch.isCancelling = true;
+    batch.awaitedInputs.clear();
+
+    for (const int jobId : batch.inputPaths.keys())
+        encoderThread.Cancel(jobId);
+
+    ui->pauseButton->setEnabled(false);
+    ui->cancelButton->setEnabled(false);
+    ui->progressBarLabel->setText(tr("Cancelling..."));
+}
+
+optional<EncoderOptions> MainWindow::BuildEncoderOptions(const QString& inputPath, QStringList& errors)
+{
+    EncoderOptionsBuilder builder;
+
+    const QString outputPath = getOutputPath(inputPath);
+
+    if (inputsMetadata.contains(inputPath))
+        builder.useMetadata(inputsMetadata.value(inputPath));
+    else if (metadata.has_value())
         builder.useMetadata(*metadata);
 
     const auto streamType = static_cast<StreamType>(ui->audioVideoButtonGroup->checkedId());
@@ -297,7 +431,22 @@ void MainWindow::StartEncoding()
     const bool hasAudio = streamType == VideoAudio || streamType == AudioOnly;
 
     if (hasVideo)
-        builder.withVideoCodec(ui->videoCodecComboBox->currentData().value<Codec>());
+    {
+        const Codec videoCodec = ui->videoCodecComboBox->currentData().value<Codec>();
+
+        if (ui->preferHardwareEncoderCheckBox->isChecked() && videoCodec.libraryName != "copy")
+        {
+            const HardwareEncoderProbe::ResolvedEncoder resolved = hardwareProbe.resolveEncoder(videoCodec);
+            builder.withVideoCodec(resolved.codec);
+
+            if (resolved.acceleration.has_value())
+                builder.withHardwareAcceleration(*resolved.acceleration);
+        }
+        else
+        {
+            builder.withVideoCodec(videoCodec);
+        }
+    }
 
     if (hasAudio)
         builder.withAudioCodec(ui->audioCodecComboBox->currentData().value<Codec>());
@@ -314,6 +463,11 @@ void MainWindow::StartEncoding()
         .atFps(ui->fpsSpinBox->value())
         .atSpeed(ui->speedSpinBox->value())
         .withCustomArguments(ui->customCommandTextEdit->toPlainText())
+        .withTwoPass(ui->twoPassCheckBox->isChecked())
+        .withChunkedEncoding(ui->parallelSegmentsCheckBox->isChecked())
+        .withResumableEncoding(settings->get("Main/bResumableEncodes").toBool())
+        .withComplexityAnalysis(ui->analyzeComplexityCheckBox->isChecked())
+        .withResourceLimits(ResourceLimits::fromSettings(*settings))
         .withMinVideoBitrate(settings->get("Main/dMinBitrateVideoKbps").toDouble())
         .withMinAudioBitrate(settings->get("Main/dMinBitrateAudioKbps").toDouble())
         .withMaxAudioBitrate(settings->get("Main/dMaxBitrateAudioKbps").toDouble());
@@ -321,40 +475,103 @@ void MainWindow::StartEncoding()
     const auto maybeOptions = builder.build();
     if (std::holds_alternative<QList<QString>>(maybeOptions))
     {
-        notifier.Notify(Severity::Error, "Invalid encoding options", std::get<QList<QString>>(maybeOptions).join("\n"));
+        errors.append(std::get<QList<QString>>(maybeOptions));
+        return {};
+    }
+
+    return std::get<EncoderOptions>(maybeOptions);
+}
+
+void MainWindow::HandleStart(int jobId, const MediaEncoder::ComputedOptions& computed)
+{
+    batch.progress.insert(jobId, {});
+
+    if (isBatch())
+    {
+        ShowJobsProgress();
         return;
     }
 
-    const EncoderOptions options = std::get<EncoderOptions>(maybeOptions);
-    encoder.Encode(options);
+    SetProgressShown({ .status = tr("Compressing..."), .progressPercent = 0, .isCancellable = true });
+
+    const QString videoSummary = computed.copiesVideo
+        ? tr("Video copied")
+        : tr("Video bitrate: %1 kbps").arg(QString::number(qRound(computed.videoBitrateKbps.value_or(0))));
+    const QString audioSummary = computed.copiesAudio
+        ? tr("Audio copied")
+        : tr("Audio bitrate: %1 kbps").arg(QString::number(qRound(computed.audioBitrateKbps.value_or(0))));
+
+    batch.bitratesSummary = videoSummary + " | " + audioSummary;
+    ui->progressBarLabel->setText(batch.bitratesSummary);
 }
 
-void MainWindow::HandleStart(double videoBitrateKbps, double audioBitrateKbps)
+void MainWindow::HandleProgress(int jobId, const EncodingProgress& progress)
 {
-    SetProgressShown({ .status = tr("Compressing..."), .progressPercent = 0 });
+    batch.progress.insert(jobId, progress);
+    ShowJobsProgress();
+}
 
-    ui->progressBarLabel->setText(
-        QString(tr("Video bitrate: %1 kbps | Audio bitrate: %2 kbps"))
-            .arg(QString::number(qRound(videoBitrateKbps)), QString::number(qRound(audioBitrateKbps)))
-    );
+void MainWindow::ShowJobsProgress()
+{
+    double totalPercent = 0;
+    double totalSpeed = 0;
+
+    for (const EncodingProgress& progress : std::as_const(batch.progress))
+    {
+        totalPercent += progress.percent;
+        totalSpeed += progress.speed;
+    }
+
+    if (!isBatch())
+    {
+        const EncodingProgress progress = batch.progress.isEmpty() ? EncodingProgress() : batch.progress.constBegin().value();
+        const QString eta = progress.etaSeconds.has_value() ? QTime(0, 0).addSecs(qRound(*progress.etaSeconds)).toString("hh:mm:ss") : "--:--:--";
+
+        SetProgressShown({ .status = tr("Compressing..."), .progressPercent = qRound(progress.percent), .isCancellable = true });
+        ui->progressBarLabel->setText(tr("%1\n%2 fps | %3x realtime | ETA %4")
+                                          .arg(batch.bitratesSummary, QString::number(qRound(progress.fps)), QString::number(progress.speed, 'f', 2), eta));
+        return;
+    }
+
+    const int finishedCount = batch.succeededCount + batch.cancelledCount + batch.failures.size();
+    SetProgressShown({ .status = tr("Compressing..."), .progressPercent = qRound(totalPercent / batch.jobsCount), .isCancellable = true });
+    ui->progressBarLabel->setText(tr("%1 of %2 files done | %3 encoding | %4x realtime")
+                                      .arg(QString::number(finishedCount), QString::number(batch.jobsCount), QString::number(batch.progress.size() - finishedCount), QString::number(totalSpeed, 'f', 2)));
 }
 
 void MainWindow::HandleSuccess(
-    const EncoderOptions& options, const MediaEncoder::ComputedOptions& computed, QFile& output
+    int jobId, const EncoderOptions& options, const MediaEncoder::ComputedOptions& computed, const EncodedOutput& output
 )
 {
-    SetProgressShown({ .status = tr("Compression complete"), .progressPercent = 100 });
+    batch.succeededCount++;
+
+    if (isBatch())
+    {
+        HandleProgress(jobId, { .percent = 100 });
+    }
+    else
+    {
+        SetProgressShown({ .status = tr("Compression complete"), .progressPercent = 100 });
+    }
 
     QString summary;
     QString videoBitrate = computed.videoBitrateKbps.has_value() ? QString::number(*computed.videoBitrateKbps) + "kbps"
                                                                  : "auto-set bitrate";
 
-    if (options.videoCodec.has_value())
+    if (options.videoCodec.has_value() && computed.copiesVideo)
+    {
+        summary += tr("Copied the video stream as is, with container %1.\n").arg(options.container.displayName);
+    }
+    else if (options.videoCodec.has_value())
     {
         summary += tr("Using video codec %1 at %2 with container %3.\n")
                        .arg(options.videoCodec->displayName, videoBitrate, options.container.displayName);
     }
-    if (options.audioCodec.has_value())
+    if (options.audioCodec.has_value() && computed.copiesAudio)
+    {
+        summary += tr("Copied the audio stream as is.\n");
+    }
+    else if (options.audioCodec.has_value())
     {
         summary += tr("Using audio codec %1 at %2kbps.\n")
                        .arg(options.audioCodec->displayName, QString::number(*computed.audioBitrateKbps));
@@ -363,15 +580,27 @@ void MainWindow::HandleSuccess(
     {
         summary += tr("Requested size was %1 kb.\nActual "
                       "compression achieved is %2 kb.")
-                       .arg(QString::number(*options.sizeKbps), QString::number(output.size() / 125.0));
+                       .arg(QString::number(*options.sizeKbps), QString::number(output.sizeBytes / 125.0));
+    }
+    if (computed.targetSizeKbps.has_value() && options.sizeKbps.has_value() && qRound(*computed.targetSizeKbps) != qRound(*options.sizeKbps))
+    {
+        summary += tr("\nAfter analyzing its complexity, %1 kb were allotted to it.").arg(QString::number(qRound(*computed.targetSizeKbps)));
     }
 
-    notifier.Notify(Severity::Info, tr("Compressed successfully"), summary);
+    QFileInfo fileInfo(output.path);
+    QString command = platformInfo.isWindows() ? "explorer.exe" : "xdg-open";
 
-    SetProgressShown({});
+    if (isBatch())
+    {
+        batch.summaries.append(QString("%1:\n%2").arg(fileInfo.fileName(), summary));
+        batch.lastOutputDir = fileInfo.dir().path();
+    }
+    else
+    {
+        notifier.Notify(Severity::Info, tr("Compressed successfully"), summary);
 
-    QFileInfo fileInfo(output);
-    QString command = platformInfo.isWindows() ? "explorer.exe" : "xdg-open";
+        SetProgressShown({});
+    }
 
     if (ui->deleteOnSuccessCheckBox->isChecked())
     {
@@ -381,10 +610,10 @@ void MainWindow::HandleSuccess(
         if (!(input.remove()))
         {
             notifier.Notify(
-                Severity::Error, tr("Failed to remove input file"), output.errorString() + "\n\n" + options.inputPath
+                Severity::Error, tr("Failed to remove input file"), input.errorString() + "\n\n" + options.inputPath
             );
         }
-        else
+        else if (ui->inputFileLineEdit->text() == options.inputPath)
         {
             ui->inputFileLineEdit->clear();
         }
@@ -392,6 +621,10 @@ void MainWindow::HandleSuccess(
         input.close();
     }
 
+    // batches report and run the on-success actions once, when the whole queue is done
+    if (isBatch())
+        return;
+
     if (ui->openExplorerOnSuccessCheckBox->isChecked())
     {
         QProcess::execute(QString(R"(%1 "%2")").arg(command, fileInfo.dir().path()));
@@ -408,12 +641,95 @@ void MainWindow::HandleSuccess(
     }
 }
 
-void MainWindow::HandleFailure(const QString& shortError, const QString& longError)
+void MainWindow::HandleFailure(int jobId, const QString& shortError, const QString& longError)
 {
+    if (isBatch())
+    {
+        batch.failures.append(QString("%1: %2").arg(batch.inputPaths.value(jobId), shortError));
+        HandleProgress(jobId, { .percent = 100 });
+        return;
+    }
+
     notifier.Notify(Severity::Warning, tr("Compression failed"), shortError, longError);
     SetProgressShown({});
 }
 
+void MainWindow::HandleCancelled(int jobId)
+{
+    batch.cancelledCount++;
+
+    if (isBatch())
+    {
+        HandleProgress(jobId, { .percent = 100 });
+        return;
+    }
+
+    SetProgressShown({});
+}
+
+void MainWindow::HandleQueueFinished()
+{
+    // the queue may run dry while more inputs are still being found
+    if (!isBatch() || isAwaitingInputs())
+        return;
+
+    SetProgressShown({});
+
+    // the whole batch was cancelled, which needs no report
+    if (batch.succeededCount == 0 && batch.failures.isEmpty())
+        return;
+
+    const QString summary = tr("%1 of %2 files were compressed successfully.")
+                                .arg(QString::number(batch.succeededCount), QString::number(batch.jobsCount));
+
+    if (batch.failures.isEmpty())
+    {
+        notifier.Notify(Severity::Info, tr("Compressed successfully"), summary, batch.summaries.join("\n\n"));
+    }
+    else
+    {
+        notifier.Notify(Severity::Warning, tr("Some compressions failed"), summary, batch.failures.join("\n"));
+    }
+
+    if (ui->openExplorerOnSuccessCheckBox->isChecked() && !batch.lastOutputDir.isEmpty())
+    {
+        const QString command = platformInfo.isWindows() ? "explorer.exe" : "xdg-open";
+        QProcess::execute(QString(R"(%1 "%2")").arg(command, batch.lastOutputDir));
+    }
+
+    if (ui->closeOnSuccessCheckBox->isChecked() && batch.failures.isEmpty())
+    {
+        QApplication::exit(0);
+    }
+}
+
+void MainWindow::HandlePreviewCompleted(const int previewId, const PreviewEncode::Result& result)
+{
+    if (previewId != this->previewId)
+        return;
+
+    this->previewId.reset();
+
+    const QString projectedTime = QTime(0, 0).addSecs(qRound(result.projectedWallSeconds)).toString("hh:mm:ss");
+
+    SetProgressShown({ .status = tr("Preview complete"), .progressPercent = 100, .keepsControlsEnabled = true });
+    ui->progressBarLabel->setText(tr("Projected size: %1 MB | Encoding time: %2\n%3 fps | %4x realtime | Preview took %5 s")
+                                      .arg(QString::number(result.projectedSizeKbps / 8000, 'f', 1), projectedTime,
+                                           QString::number(qRound(result.fps)), QString::number(result.speed, 'f', 2),
+                                           QString::number(result.wallSeconds, 'f', 1)));
+}
+
+void MainWindow::HandlePreviewFailed(const int previewId, const QString& shortError, const QString& longError)
+{
+    if (previewId != this->previewId)
+        return;
+
+    this->previewId.reset();
+
+    notifier.Notify(Severity::Warning, tr("Preview failed"), shortError, longError);
+    SetProgressShown({});
+}
+
 void MainWindow::CheckAspectRatioConflict()
 {
     bool hasCustomScale = ui->aspectRatioSpinBoxH->value() != 0 || ui->aspectRatioSpinBoxV->value() != 0;
@@ -477,9 +793,27 @@ void MainWindow::HandleFormatsQueryResult(const std::variant<QSharedPointer<Form
     }
 
     const auto formats = std::get<QSharedPointer<FormatSupport>>(maybeFormats);
+    const bool isRefresh = formatSupportCache != nullptr;
     formatSupportCache = formats;
     SetProgressShown({});
 
+    hardwareProbe.ProbeAsync(formats);
+
+    // ffmpeg changed since the cached formats were loaded, so only the lists are updated
+    if (isRefresh)
+    {
+        const QString videoCodec = ui->videoCodecComboBox->currentText();
+        const QString audioCodec = ui->audioCodecComboBox->currentText();
+        const QString container = ui->containerComboBox->currentText();
+
+        UpdateCodecsList(ui->commonFormatsOnlyCheckbox->isChecked());
+
+        ui->videoCodecComboBox->setCurrentText(videoCodec);
+        ui->audioCodecComboBox->setCurrentText(audioCodec);
+        ui->containerComboBox->setCurrentText(container);
+        return;
+    }
+
     LoadState();
     LoadSelectedUrl();
 }
@@ -560,22 +894,38 @@ void MainWindow::ShowAbout() const
 
 void MainWindow::SetProgressShown(const ProgressState& state) const
 {
-    if (state.status.has_value() && ui->progressWidget->maximumHeight() == 0)
+    // the progress panel stays usable, for its own buttons
+    const auto setControlsEnabled = [this](const bool enabled)
+    {
+        for (QWidget* widget : { ui->headerWidget, ui->mainWidget, static_cast<QWidget*>(ui->previewButton), static_cast<QWidget*>(ui->startCompressionButton) })
+            widget->setEnabled(enabled);
+    };
+
+    ui->pauseButton->setVisible(state.isCancellable);
+    ui->cancelButton->setVisible(state.isCancellable);
+    ui->pauseButton->setEnabled(!batch.isCancelling);
+    ui->cancelButton->setEnabled(!batch.isCancelling);
+    ui->pauseButton->setText(batch.isPaused ? tr("Resume") : tr("Pause"));
+
+    if (state.status.has_value())
     {
-        ui->centralWidget->setEnabled(false);
+        setControlsEnabled(state.keepsControlsEnabled);
 
-        const QString taskName = *state.status;
+        const QString taskName = state.keepsControlsEnabled ? tr("Start encoding") : *state.status;
         if (ui->startCompressionButton->text() != taskName)
             ui->startCompressionButton->setText(taskName);
 
-        ui->progressWidgetTopSpacer->changeSize(0, 10);
-        progressBarHeightAnim->setStartValue(0);
-        progressBarHeightAnim->setEndValue(500);
-        progressBarHeightAnim->start();
+        if (ui->progressWidget->maximumHeight() == 0)
+        {
+            ui->progressWidgetTopSpacer->changeSize(0, 10);
+            progressBarHeightAnim->setStartValue(0);
+            progressBarHeightAnim->setEndValue(500);
+            progressBarHeightAnim->start();
+        }
     }
     else if (!state.status)
     {
-        ui->centralWidget->setEnabled(true);
+        setControlsEnabled(true);
         ui->startCompressionButton->setText(tr("Start encoding"));
         ui->progressWidgetTopSpacer->changeSize(0, 0);
         progressBarHeightAnim->setStartValue(ui->progressWidget->height());
@@ -682,37 +1032,130 @@ void MainWindow::SelectAudioCodec(const int index) const
 
 void MainWindow::OpenInputFile()
 {
-    const QUrl fileUrl = QFileDialog::getOpenFileUrl(this, tr("Select file to compress"), QDir::currentPath(), "*");
-    if (fileUrl.isValid())
-        LoadInputFile(fileUrl);
+    const QList<QUrl> fileUrls = QFileDialog::getOpenFileUrls(this, tr("Select files to compress"), QDir::currentPath(), "*");
+    if (!fileUrls.isEmpty())
+        LoadInputFiles(fileUrls);
+}
+
+void MainWindow::OpenInputFolder()
+{
+    const QString folder = QFileDialog::getExistingDirectory(this, tr("Select folder to compress"), QDir::currentPath());
+    if (!folder.isEmpty())
+        LoadInputFiles({ QUrl::fromLocalFile(folder) });
 }
 
 void MainWindow::QueryMediaMetadataAsync(const QString& path)
 {
     SetProgressShown({ .status = tr("Parsing metadata...") });
+    pendingProbeIds.insert(metadataLoader.loadAsync(path));
+}
 
-    connect(
-        &metadataLoader, &MetadataLoader::loadAsyncComplete, this, &MainWindow::ReceiveMediaMetadata,
-        Qt::UniqueConnection
-    );
-
-    metadataLoader.loadAsync(path);
+void MainWindow::ProbeInputAsync(const QString& path)
+{
+    pendingInputProbeIds.insert(metadataLoader.loadAsync(path));
 }
 
-void MainWindow::ReceiveMediaMetadata(MetadataResult result)
+void MainWindow::ReceiveMediaMetadata(const int requestId, const QString& path, MetadataResult result)
 {
-    SetProgressShown({});
+    const bool isShown = pendingProbeIds.remove(requestId);
+    if (!isShown && !pendingInputProbeIds.remove(requestId))
+        return;
+
+    if (isShown && pendingProbeIds.isEmpty())
+        SetProgressShown({});
 
     if (std::holds_alternative<Message>(result))
     {
         Message error = std::get<Message>(result);
 
-        notifier.Notify(error);
-        ui->inputFileLineEdit->clear();
+        // a file of a scanned folder that turns out not to be media is only left out
+        if (isShown)
+            notifier.Notify(error);
+        else if (batch.awaitedInputs.contains(path))
+            batch.failures.append(QString("%1: %2").arg(path, error.title));
+
+        inputPaths.removeAll(path);
+        batch.awaitedInputs.removeOne(path);
+        if (ui->inputFileLineEdit->text() == path)
+            ui->inputFileLineEdit->clear();
+
+        UpdateInputsToolTip();
+        CheckStreamedBatchFinished();
         return;
     }
 
-    metadata = std::get<Metadata>(result);
+    inputsMetadata.insert(path, std::get<Metadata>(result));
+
+    if (ui->inputFileLineEdit->text() == path)
+        metadata = std::get<Metadata>(result);
+
+    if (batch.awaitedInputs.removeOne(path))
+        EncodeAwaitedInput(path);
+}
+
+void MainWindow::AddInputFiles(const QStringList& paths)
+{
+    for (const QString& path : paths)
+    {
+        if (inputPaths.contains(path))
+            continue;
+
+        // the first file found becomes the selected one, whose metadata fills in the controls
+        if (inputPaths.isEmpty() && !isAwaitingInputs())
+        {
+            LoadInputFile(QUrl::fromLocalFile(path));
+            continue;
+        }
+
+        inputPaths.append(path);
+        ProbeInputAsync(path);
+
+        if (isAwaitingInputs())
+            batch.awaitedInputs.append(path);
+    }
+
+    UpdateInputsToolTip();
+}
+
+void MainWindow::HandleScanFinished()
+{
+    if (inputPaths.isEmpty())
+        notifier.Notify(Severity::Warning, tr("No media files found"), tr("None of the selected files or folders hold audio, video or images."));
+
+    UpdateInputsToolTip();
+    CheckStreamedBatchFinished();
+}
+
+void MainWindow::EncodeAwaitedInput(const QString& inputPath)
+{
+    QStringList errors;
+    const optional<EncoderOptions> options = BuildEncoderOptions(inputPath, errors);
+
+    if (!options.has_value())
+    {
+        batch.failures.append(QString("%1: %2").arg(inputPath, errors.join(" ")));
+        CheckStreamedBatchFinished();
+        return;
+    }
+
+    const int jobId = encoderThread.Encode(*options);
+    batch.jobsCount++;
+    batch.inputPaths.insert(jobId, inputPath);
+
+    if (batch.isPaused)
+        encoderThread.Pause(jobId);
+}
+
+void MainWindow::CheckStreamedBatchFinished()
+{
+    // the failed and succeeded jobs were already reported when the queue ran dry, but not the end of the batch
+    if (batch.isStreamed && !isAwaitingInputs() && encoderThread.isIdle())
+        HandleQueueFinished();
+}
+
+bool MainWindow::isAwaitingInputs() const
+{
+    return batch.isStreamed && !batch.isCancelling && (mediaScanner.isScanning() || !batch.awaitedInputs.isEmpty());
 }
 
 QString MainWindow::getOutputPath(QString inputFilePath)
@@ -759,6 +1202,8 @@ void MainWindow::LoadInputFile(const QUrl& url)
 {
     const QString path = url.toLocalFile();
     ui->inputFileLineEdit->setText(path);
+    ui->inputFileLineEdit->setToolTip("");
+    inputPaths = { path };
 
     QueryMediaMetadataAsync(path);
 
@@ -778,6 +1223,48 @@ void MainWindow::LoadInputFile(const QUrl& url)
     }
 }
 
+void MainWindow::LoadInputFiles(const QList<QUrl>& urls)
+{
+    QStringList paths;
+    for (const QUrl& url : urls)
+    {
+        if (url.isLocalFile())
+            paths.append(url.toLocalFile());
+    }
+
+    if (paths.isEmpty())
+        return;
+
+    if (paths.size() == 1 && !QFileInfo(paths.first()).isDir())
+    {
+        LoadInputFile(QUrl::fromLocalFile(paths.first()));
+        return;
+    }
+
+    // folders may hold thousands of files, which are walked on a worker thread and added as they are found
+    inputPaths.clear();
+    ui->inputFileLineEdit->clear();
+    ui->inputFileLineEdit->setToolTip(tr("Looking for media files..."));
+
+    mediaScanner.ScanAsync(paths);
+}
+
+void MainWindow::UpdateInputsToolTip() const
+{
+    if (inputPaths.size() <= 1)
+    {
+        ui->inputFileLineEdit->setToolTip(mediaScanner.isScanning() ? tr("Looking for media files...") : "");
+        return;
+    }
+
+    QStringList listed = inputPaths.first(qMin(inputPaths.size(), maxListedInputs));
+    if (inputPaths.size() > maxListedInputs)
+        listed.append(tr("and %1 more").arg(QString::number(inputPaths.size() - maxListedInputs)));
+
+    const QString status = mediaScanner.isScanning() ? tr("%1 files found so far:\n%2") : tr("%1 files selected:\n%2");
+    ui->inputFileLineEdit->setToolTip(status.arg(QString::number(inputPaths.size()), listed.join("\n")));
+}
+
 void MainWindow::ValidateSelectedDir() const
 {
     const QString selectedDir = ui->outputFolderLineEdit->text();
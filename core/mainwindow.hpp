@@ -1,10 +1,14 @@
 #pragma once
 
 #include "encoder/encoder.hpp"
+#include "encoder/encoder_thread.hpp"
 #include "formats/format_support_loader.hpp"
+#include "formats/hardware_encoder_probe.hpp"
+#include "formats/media_file_scanner.hpp"
 #include "notifier/notifier.hpp"
 #include "settings/serializer.hpp"
 #include "settings/settings.hpp"
+#include "telemetry/telemetry_recorder.hpp"
 #include "ui/overlay_widget.hpp"
 #include "utils/platform_info.hpp"
 #include "utils/warnings.hpp"
@@ -12,6 +16,7 @@
 #include <QMainWindow>
 #include <QMessageBox>
 #include <QPropertyAnimation>
+#include <QSet>
 #include <QSettings>
 #include <QSpinBox>
 #include <di.hpp>
@@ -23,9 +28,6 @@ class MainWindow;
 }
 QT_END_NAMESPACE
 
-inline auto di_settings = [] {};
-inline auto di_presets = [] {};
-
 class MainWindow final : public QMainWindow
 {
     Q_OBJECT
@@ -33,14 +35,17 @@ class MainWindow final : public QMainWindow
 public:
     BOOST_DI_INJECT(
         MainWindow,
-        MediaEncoder& encoder,
+        EncoderThread& encoderThread,
         (named = di_settings) std::shared_ptr<Settings> settings,
         (named = di_presets) std::shared_ptr<Settings> presetsSettings,
         std::shared_ptr<Serializer> serializer,
         MetadataLoader& metadata,
+        MediaFileScanner& mediaScanner,
         Notifier& notifier,
         PlatformInfo& platformInfo,
-        FormatSupportLoader& formatSupportLoader
+        FormatSupportLoader& formatSupportLoader,
+        HardwareEncoderProbe& hardwareProbe,
+        TelemetryRecorder& telemetry
     );
     ~MainWindow() override;
 
@@ -67,16 +72,25 @@ protected:
     void resizeEvent(QResizeEvent* event) override;
     void closeEvent(QCloseEvent* event) override;
 
-    void HandleStart(double videoBitrateKbps, double audioBitrateKbps);
-    void HandleSuccess(const EncoderOptions& options, const MediaEncoder::ComputedOptions& computed, QFile& output);
-    void HandleFailure(const QString& shortError, const QString& longError);
+    void HandleStart(int jobId, const MediaEncoder::ComputedOptions& computed);
+    void HandleProgress(int jobId, const EncodingProgress& progress);
+    void HandleSuccess(int jobId, const EncoderOptions& options, const MediaEncoder::ComputedOptions& computed, const EncodedOutput& output);
+    void HandleFailure(int jobId, const QString& shortError, const QString& longError);
+    void HandleCancelled(int jobId);
+    void HandleQueueFinished();
+    void HandlePreviewCompleted(int previewId, const PreviewEncode::Result& result);
+    void HandlePreviewFailed(int previewId, const QString& shortError, const QString& longError);
     void ShowAbout() const;
 
     // NOTE: const parameters are NOT supported by Qt slots setup from the designer!
 private slots:
     void StartEncoding();
+    void PreviewEncoding();
+    void PauseEncoding();
+    void CancelEncoding();
     void SetAdvancedMode(bool enabled);
     void OpenInputFile();
+    void OpenInputFolder();
     void SelectOutputDirectory();
     void ShowMetadata();
     void LoadPreset(int index) const;
@@ -95,15 +109,51 @@ private:
     {
         optional<QString> status = optional<QString>();
         optional<int> progressPercent = optional<int>();
+        //! Leaves the controls usable while the panel is shown, for results such as the ones of a preview.
+        bool keepsControlsEnabled = false;
+        //! Shows the buttons to pause and cancel the jobs of the batch.
+        bool isCancellable = false;
+    };
+
+    struct BatchState
+    {
+        int jobsCount = 0;
+        int succeededCount = 0;
+        int cancelledCount = 0;
+        bool isPaused = false;
+        bool isCancelling = false;
+        //! Started while inputs were still being found; those are encoded as they are probed.
+        bool isStreamed = false;
+        //! Inputs found or probed after the batch started, to be encoded once their metadata is known.
+        QStringList awaitedInputs;
+        QHash<int, QString> inputPaths;
+        QHash<int, EncodingProgress> progress;
+        QString bitratesSummary;
+        QStringList summaries;
+        QStringList failures;
+        QString lastOutputDir;
     };
 
     void QueryMediaMetadataAsync(const QString& path);
-    void ReceiveMediaMetadata(MetadataResult result);
+    //! Probes an input besides the selected one, without showing progress or reporting failures.
+    void ProbeInputAsync(const QString& path);
+    void ReceiveMediaMetadata(int requestId, const QString& path, MetadataResult result);
+    void AddInputFiles(const QStringList& paths);
+    void HandleScanFinished();
+    void EncodeAwaitedInput(const QString& inputPath);
+    //! Finishes a streamed batch once nothing is left to find, probe or encode.
+    void CheckStreamedBatchFinished();
+    [[nodiscard]] bool isAwaitingInputs() const;
+    optional<EncoderOptions> BuildEncoderOptions(const QString& inputPath, QStringList& errors);
+    [[nodiscard]] bool isBatch() const { return batch.jobsCount > 1 || batch.isStreamed; }
     QString getOutputPath(QString inputFilePath);
     inline bool isAutoValue(QAbstractSpinBox* spinBox);
     void SetProgressShown(const ProgressState& state) const;
+    void ShowJobsProgress();
     void LoadSelectedUrl();
     void LoadInputFile(const QUrl& url);
+    void LoadInputFiles(const QList<QUrl>& urls);
+    void UpdateInputsToolTip() const;
     void ValidateSelectedDir() const;
     void SetupAnimations();
     double getOutputSizeKbps() const;
@@ -113,6 +163,12 @@ private:
     QScopedPointer<Warnings> warnings;
 
     optional<Metadata> metadata;
+    QStringList inputPaths;
+    QHash<QString, Metadata> inputsMetadata;
+    QSet<int> pendingProbeIds;
+    QSet<int> pendingInputProbeIds;
+    BatchState batch;
+    optional<int> previewId;
 
     std::unique_ptr<const QList<QObject*>> preferenceWidgets;
     std::unique_ptr<const QList<QObject*>> presetWidgets;
@@ -128,17 +184,23 @@ private:
 
     QScopedPointer<QMenu> menu;
 
-    MediaEncoder& encoder;
+    //! Runs the encoder, whose signals are received here through queued connections.
+    EncoderThread& encoderThread;
     std::shared_ptr<Settings> settings;
     std::shared_ptr<Settings> presetsSettings;
     std::shared_ptr<Serializer> serializer;
     MetadataLoader& metadataLoader;
+    MediaFileScanner& mediaScanner;
     Notifier& notifier;
     PlatformInfo& platformInfo;
     FormatSupportLoader& formatSupport;
+    HardwareEncoderProbe& hardwareProbe;
+    TelemetryRecorder& telemetry;
 
     bool isDragging = false;
     bool isValidMimeForDrop = false;
 
     QSharedPointer<FormatSupport> formatSupportCache;
+
+    static constexpr qsizetype maxListedInputs = 20;
 };
@@ -1,13 +1,13 @@
 #ifndef MESSAGE_H
 #define MESSAGE_H
 
-#include <QMessageBox>
 #include <QString>
 
+// the values of QMessageBox::Icon, so that messages do not depend on widgets
 enum Severity {
-    Info = QMessageBox::Information,
-    Warning = QMessageBox::Warning,
-    Error = QMessageBox::Critical,
+    Info = 1,
+    Warning = 2,
+    Error = 3,
     Critical // should terminate program
 };
 
@@ -1,6 +1,10 @@
 #include "message_box_notifier.hpp"
 
 #include <QApplication>
+#include <QMessageBox>
+
+static_assert(Severity::Info == QMessageBox::Information && Severity::Warning == QMessageBox::Warning
+              && Severity::Error == QMessageBox::Critical);
 
 void MessageBoxNotifier::Notify(const Message& message) const
 {
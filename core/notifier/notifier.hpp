@@ -1,8 +1,6 @@
 #ifndef NOTIFIER_H
 #define NOTIFIER_H
 
-#include <QMessageBox>
-
 #include "message.hpp"
 
 class Notifier
@@ -3,47 +3,136 @@
 #include <QDir>
 #include <QFile>
 #include <QSettings>
+#include <QTimer>
+#include <algorithm>
+
+namespace
+{
+    //! QSettings writes changes back later, from an event on its thread, which has to wait for the other threads too.
+    class LockedSettings final : public QSettings
+    {
+    public:
+        LockedSettings(const QString& fileName, QMutex& mutex)
+            : QSettings(fileName, QSettings::IniFormat)
+            , mutex(mutex)
+        {
+        }
+
+    protected:
+        bool event(QEvent* event) override
+        {
+            const QMutexLocker lock(&mutex);
+            return QSettings::event(event);
+        }
+
+    private:
+        QMutex& mutex;
+    };
+
+    QHash<QString, QVariant> snapshotOf(const QSettings& settings)
+    {
+        QHash<QString, QVariant> values;
+        for (const QString& key : settings.allKeys())
+            values.insert(key, settings.value(key));
+
+        return values;
+    }
+}
 
 IniSettings::IniSettings(const QString& fileName, const QString& defaultFileName)
+    : flushTimer(std::make_unique<QTimer>())
 {
     if (const QFile file(defaultFileName); file.exists()) {
-        defaultSettings = new QSettings(defaultFileName, QSettings::IniFormat);
+        defaultValues = snapshotOf(QSettings(defaultFileName, QSettings::IniFormat));
     }
 
-    settings = new QSettings(fileName, QSettings::IniFormat);
+    settings = new LockedSettings(fileName, mutex);
+    values = snapshotOf(*settings);
+
+    // the controls of a window are saved one key at a time, and written at once
+    flushTimer->setSingleShot(true);
+    flushTimer->setInterval(flushDelayMs);
+    QObject::connect(flushTimer.get(), &QTimer::timeout, flushTimer.get(), [this]
+                     { Flush(); });
+}
+
+IniSettings::~IniSettings()
+{
+    Flush();
+    delete settings;
 }
 
 QVariant IniSettings::get(const QString& key) const
 {
-    if (settings->contains(key))
-        return settings->value(key);
+    const QMutexLocker lock(&mutex);
 
-    if (!defaultSettings.isNull() && defaultSettings->contains(key))
-        return defaultSettings->value(key);
+    if (const auto value = values.constFind(key); value != values.cend())
+        return *value;
 
-    return {};
+    return defaultValues.value(key);
 }
 
 QStringList IniSettings::keysInGroup(const QString& group) const
 {
-    settings->beginGroup(group);
-    QStringList keys = settings->childKeys();
-    settings->endGroup();
+    const QMutexLocker lock(&mutex);
+    const QString prefix = group + "/";
+    QStringList keys;
 
+    for (auto it = values.cbegin(); it != values.cend(); ++it)
+    {
+        if (it.key().startsWith(prefix) && !it.key().sliced(prefix.size()).contains('/'))
+            keys.append(it.key().sliced(prefix.size()));
+    }
+
+    std::sort(keys.begin(), keys.end());
     return keys;
 }
 
 QString IniSettings::fileName() const
 {
+    const QMutexLocker lock(&mutex);
     return settings->fileName();
 }
 
 void IniSettings::Set(const QString& key, const QVariant& value)
 {
-    settings->setValue(key, value);
+    {
+        const QMutexLocker lock(&mutex);
+        values.insert(key, value);
+        changedKeys.insert(key);
+    }
+
+    // restarted on the thread of the timer, which a write from any other one is queued to
+    QMetaObject::invokeMethod(flushTimer.get(), [timer = flushTimer.get()]
+                              { timer->start(); });
 }
 
 QStringList IniSettings::groups() const
 {
-    return settings->childGroups();
+    const QMutexLocker lock(&mutex);
+    QStringList groups;
+
+    for (auto it = values.cbegin(); it != values.cend(); ++it)
+    {
+        if (const qsizetype separator = it.key().indexOf('/'); separator > 0)
+            groups.append(it.key().first(separator));
+    }
+
+    std::sort(groups.begin(), groups.end());
+    groups.removeDuplicates();
+    return groups;
+}
+
+void IniSettings::Flush()
+{
+    const QMutexLocker lock(&mutex);
+
+    if (changedKeys.isEmpty())
+        return;
+
+    for (const QString& key : std::as_const(changedKeys))
+        settings->setValue(key, values.value(key));
+
+    changedKeys.clear();
+    settings->sync();
 }
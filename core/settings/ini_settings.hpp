@@ -2,15 +2,25 @@
 
 #include "settings.hpp"
 
+#include <QHash>
+#include <QMutex>
 #include <QPointer>
+#include <QSet>
+#include <memory>
 
 class QSettings;
 class QString;
+class QTimer;
 
+//! Reads the file once into memory, which every get is answered from; changes are written back together, a moment
+//! after the last of a batch. Safe to share between threads: every access, and the writes, hold one lock.
+//! \remark Edits made to the file by another program while it is open are not seen, and are overwritten by the next flush.
 class IniSettings final : public Settings
 {
 public:
     explicit IniSettings(const QString& fileName, const QString& defaultFileName = "");
+    //! Flushes the changes not written yet.
+    ~IniSettings() override;
 
     [[nodiscard]] QVariant get(const QString& key) const override;
     void Set(const QString& key, const QVariant& value) override;
@@ -19,7 +29,19 @@ public:
     [[nodiscard]] QStringList keysInGroup(const QString& group) const override;
     [[nodiscard]] QString fileName() const override;
 
+    //! Writes the changes to the file now, rather than once the batch they are part of ends.
+    void Flush();
+
 private:
+    mutable QMutex mutex;
     QPointer<QSettings> settings;
-    QPointer<QSettings> defaultSettings;
-};
\ No newline at end of file
+    //! Every key of the file and of the defaults, as read when opened and changed since.
+    QHash<QString, QVariant> values;
+    QHash<QString, QVariant> defaultValues;
+    //! Keys set since the last flush.
+    QSet<QString> changedKeys;
+    //! Lives on the thread the settings were opened on, where flushes run.
+    std::unique_ptr<QTimer> flushTimer;
+
+    static constexpr int flushDelayMs = 500;
+};
@@ -2,6 +2,10 @@
 
 #include <QVariant>
 
+// boost-di names of the application configuration and of the presets store
+inline auto di_settings = [] {};
+inline auto di_presets = [] {};
+
 struct Settings {
     virtual ~Settings() = default;
 
@@ -0,0 +1,47 @@
+#ifndef JOB_TELEMETRY_H
+#define JOB_TELEMETRY_H
+
+#include <QDateTime>
+#include <QString>
+#include <optional>
+
+using std::optional;
+
+//!
+//! \brief What one job cost and achieved, from its queuing to its end.
+//! \details Times are wall times. CPU time and peak memory are the ones of the ffmpeg processes, which are only
+//! known for jobs that succeeded; parts of chunked jobs are not included. Sizes are in kilobits, like size targets.
+//!
+struct JobTelemetry
+{
+    int jobId = 0;
+    QString inputPath;
+    QString outputPath;
+    //! "done", "failed" or "cancelled".
+    QString outcome;
+    QString error;
+
+    QDateTime queuedAt;
+    //! Spent in ffprobe for the input; 0 when its metadata was cached.
+    double probeSeconds = 0;
+    double queueWaitSeconds = 0;
+    double encodeSeconds = 0;
+    //! Duration of the output, in media seconds.
+    double mediaSeconds = 0;
+    double realtimeFactor = 0;
+    double averageFps = 0;
+    optional<double> cpuSeconds;
+    optional<qint64> peakRssKb;
+
+    optional<double> requestedSizeKb;
+    //! The size the bitrate was computed for, which differs from the requested one when a batch shares its budget.
+    optional<double> targetSizeKb;
+    optional<double> achievedSizeKb;
+
+    QString videoCodec;
+    QString audioCodec;
+    QString hardwareAcceleration;
+    QString container;
+};
+
+#endif
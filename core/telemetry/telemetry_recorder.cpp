@@ -0,0 +1,179 @@
+#include "telemetry_recorder.hpp"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+
+TelemetryRecorder::TelemetryRecorder(MediaEncoder& encoder, MetadataLoader& metadataLoader)
+{
+    connect(&metadataLoader, &MetadataLoader::probeTimed, this, [this](const QString& path, const double seconds)
+            {
+        if (probeSeconds.size() >= maxRememberedProbes)
+            probeSeconds.clear();
+        probeSeconds.insert(path, seconds); });
+
+    // records are built from what the signals carry, as the encoder may run on a thread of its own
+    connect(&encoder, &MediaEncoder::jobQueued, this, &TelemetryRecorder::HandleQueued);
+    connect(&encoder, &MediaEncoder::jobStarted, this, &TelemetryRecorder::HandleStarted);
+    connect(&encoder, &MediaEncoder::jobProgressUpdate, this, [this](const int jobId, const EncodingProgress& progress)
+            {
+        if (pendingRecords.contains(jobId))
+            pendingRecords[jobId].lastProgress = progress; });
+    connect(&encoder, &MediaEncoder::jobResourceUsage, this, [this](const int jobId, const ResourceUsage& usage)
+            {
+        if (!pendingRecords.contains(jobId))
+            return;
+
+        JobTelemetry& record = pendingRecords[jobId].record;
+        record.cpuSeconds = usage.cpuSeconds();
+        record.peakRssKb = usage.peakRssKb; });
+    connect(&encoder, &MediaEncoder::jobSucceeded, this, &TelemetryRecorder::HandleSucceeded);
+    connect(&encoder, &MediaEncoder::jobFailed, this, [this](const int jobId, const QString& error)
+            { End(jobId, "failed", error); });
+    connect(&encoder, &MediaEncoder::jobCancelled, this, [this](const int jobId)
+            { End(jobId, "cancelled"); });
+}
+
+void TelemetryRecorder::HandleQueued(const int jobId, const EncoderOptions& options)
+{
+    PendingRecord& pending = pendingRecords[jobId];
+    pending.queueTimer.start();
+
+    JobTelemetry& record = pending.record;
+    record.jobId = jobId;
+    record.inputPath = options.inputPath;
+    record.queuedAt = QDateTime::currentDateTimeUtc();
+    record.probeSeconds = probeSeconds.value(options.inputPath);
+    record.requestedSizeKb = options.sizeKbps.has_value() ? optional<double>(*options.sizeKbps) : std::nullopt;
+    record.videoCodec = options.videoCodec.has_value() ? options.videoCodec->libraryName : "";
+    record.audioCodec = options.audioCodec.has_value() ? options.audioCodec->libraryName : "";
+    record.hardwareAcceleration = options.hardwareAcceleration.has_value() ? options.hardwareAcceleration->hwaccel : "";
+    record.container = options.container.formatName;
+}
+
+void TelemetryRecorder::HandleStarted(const int jobId, const MediaEncoder::ComputedOptions& computed)
+{
+    if (!pendingRecords.contains(jobId))
+        return;
+
+    PendingRecord& pending = pendingRecords[jobId];
+
+    // jobs searching for a quality level start again once it is found, which is still their first encode
+    if (pending.encodeTimer.isValid())
+        return;
+
+    pending.encodeTimer.start();
+    pending.record.queueWaitSeconds = pending.queueTimer.elapsed() / 1000.0;
+    pending.record.targetSizeKb = computed.targetSizeKbps;
+}
+
+void TelemetryRecorder::HandleSucceeded(const int jobId, const EncoderOptions& options, const MediaEncoder::ComputedOptions& computed,
+                                        const EncodedOutput& output)
+{
+    Q_UNUSED(computed)
+
+    if (!pendingRecords.contains(jobId))
+        return;
+
+    PendingRecord& pending = pendingRecords[jobId];
+    pending.record.outputPath = output.path;
+    pending.record.achievedSizeKb = output.sizeBytes / 125.0;
+    pending.record.mediaSeconds = options.inputMetadata.durationSeconds / options.speed.value_or(1);
+
+    End(jobId, "done");
+}
+
+void TelemetryRecorder::End(const int jobId, const QString& outcome, const QString& error)
+{
+    if (!pendingRecords.contains(jobId))
+        return;
+
+    const PendingRecord pending = pendingRecords.take(jobId);
+    JobTelemetry record = pending.record;
+    record.outcome = outcome;
+    record.error = error;
+
+    // cancelled before it started, a job spent all its time waiting
+    if (pending.encodeTimer.isValid())
+        record.encodeSeconds = pending.encodeTimer.elapsed() / 1000.0;
+    else
+        record.queueWaitSeconds = pending.queueTimer.elapsed() / 1000.0;
+
+    if (record.mediaSeconds <= 0)
+        record.mediaSeconds = pending.lastProgress.encodedSeconds;
+    if (record.encodeSeconds > 0)
+        record.realtimeFactor = record.mediaSeconds / record.encodeSeconds;
+
+    // ffmpeg reports the average rate since it started, rather than the current one
+    record.averageFps = pending.lastProgress.fps;
+
+    sums.jobsByOutcome[outcome]++;
+    sums.probeSeconds += record.probeSeconds;
+    sums.queueWaitSeconds += record.queueWaitSeconds;
+    sums.encodeSeconds += record.encodeSeconds;
+    sums.mediaSeconds += record.mediaSeconds;
+    sums.cpuSeconds += record.cpuSeconds.value_or(0);
+    sums.outputBytes += record.achievedSizeKb.has_value() ? qRound64(*record.achievedSizeKb * 125) : 0;
+
+    if (outcome == "done")
+    {
+        sums.lastRealtimeFactor = record.realtimeFactor;
+        sums.lastAverageFps = record.averageFps;
+    }
+
+    Append(record);
+    emit recorded(record);
+}
+
+void TelemetryRecorder::Append(const JobTelemetry& record)
+{
+    if (logPath.isEmpty())
+        return;
+
+    QDir().mkpath(QFileInfo(logPath).absolutePath());
+
+    // appended and closed every time, so that the log can be rotated or tailed while the application runs
+    QFile log(logPath);
+    if (!log.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+        return;
+
+    log.write(QJsonDocument(toJson(record)).toJson(QJsonDocument::Compact) + '\n');
+}
+
+QJsonObject TelemetryRecorder::toJson(const JobTelemetry& record)
+{
+    QJsonObject json {
+        { "jobId", record.jobId },
+        { "input", record.inputPath },
+        { "output", record.outputPath },
+        { "outcome", record.outcome },
+        { "queuedAt", record.queuedAt.toString(Qt::ISODateWithMs) },
+        { "probeSeconds", record.probeSeconds },
+        { "queueWaitSeconds", record.queueWaitSeconds },
+        { "encodeSeconds", record.encodeSeconds },
+        { "mediaSeconds", record.mediaSeconds },
+        { "realtimeFactor", record.realtimeFactor },
+        { "averageFps", record.averageFps },
+        { "videoCodec", record.videoCodec },
+        { "audioCodec", record.audioCodec },
+        { "hardwareAcceleration", record.hardwareAcceleration },
+        { "container", record.container },
+    };
+
+    // unknown values are left out rather than written as zeros, which would skew averages over the log
+    if (!record.error.isEmpty())
+        json.insert("error", record.error);
+    if (record.cpuSeconds.has_value())
+        json.insert("cpuSeconds", *record.cpuSeconds);
+    if (record.peakRssKb.has_value())
+        json.insert("peakRssKb", *record.peakRssKb);
+    if (record.requestedSizeKb.has_value())
+        json.insert("requestedSizeKb", *record.requestedSizeKb);
+    if (record.targetSizeKb.has_value())
+        json.insert("targetSizeKb", *record.targetSizeKb);
+    if (record.achievedSizeKb.has_value())
+        json.insert("achievedSizeKb", *record.achievedSizeKb);
+
+    return json;
+}
@@ -0,0 +1,75 @@
+#ifndef TELEMETRY_RECORDER_H
+#define TELEMETRY_RECORDER_H
+
+#include "core/encoder/encoder.hpp"
+#include "core/formats/metadata_loader.hpp"
+#include "job_telemetry.hpp"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonObject>
+#include <QObject>
+
+//!
+//! \brief Follows the jobs of a MediaEncoder, and records what each one cost once it ended.
+//! \details Records are appended to a JSON Lines log, one object per line, and summed up into totals that
+//! MetricsServer exports. The CPU time and memory of jobs are only measured with MediaEncoder::setMeasuresResourceUsage().
+//!
+class TelemetryRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    TelemetryRecorder(MediaEncoder& encoder, MetadataLoader& metadataLoader);
+
+    //! What all the recorded jobs add up to, since the recorder was created.
+    struct Totals
+    {
+        QHash<QString, qint64> jobsByOutcome;
+        double probeSeconds = 0;
+        double queueWaitSeconds = 0;
+        double encodeSeconds = 0;
+        double mediaSeconds = 0;
+        double cpuSeconds = 0;
+        qint64 outputBytes = 0;
+        //! Of the last job that succeeded, to alert on throughput regressions without a query over the totals.
+        double lastRealtimeFactor = 0;
+        double lastAverageFps = 0;
+    };
+
+    //! Appends records to this file; empty only keeps the totals.
+    void setLogPath(const QString& path) { logPath = path; }
+    [[nodiscard]] const Totals& totals() const { return sums; }
+    //! Jobs queued that did not end yet.
+    [[nodiscard]] qsizetype jobsInFlight() const { return pendingRecords.size(); }
+
+    static QJsonObject toJson(const JobTelemetry& record);
+
+signals:
+    void recorded(const JobTelemetry& record);
+
+private:
+    void HandleQueued(int jobId, const EncoderOptions& options);
+    void HandleStarted(int jobId, const MediaEncoder::ComputedOptions& computed);
+    void HandleSucceeded(int jobId, const EncoderOptions& options, const MediaEncoder::ComputedOptions& computed, const EncodedOutput& output);
+    void End(int jobId, const QString& outcome, const QString& error = {});
+    void Append(const JobTelemetry& record);
+
+    struct PendingRecord
+    {
+        JobTelemetry record;
+        QElapsedTimer queueTimer;
+        QElapsedTimer encodeTimer;
+        EncodingProgress lastProgress;
+    };
+
+    QString logPath;
+    QHash<int, PendingRecord> pendingRecords;
+    //! The last probe time of each input, which jobs pick up once queued.
+    QHash<QString, double> probeSeconds;
+    Totals sums;
+
+    static constexpr qsizetype maxRememberedProbes = 4096;
+};
+
+#endif
@@ -1,28 +1,164 @@
 #include "platform_info.hpp"
+#include "core/formats/ffmpeg_format_support_loader.hpp"
 
-#include <QOffscreenSurface>
-#include <QOpenGLFunctions>
-#include <QProcess>
-#include <QString>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
 
-PlatformInfo::PlatformInfo() { m_isNvidia = DetectNvidia(); }
+PlatformInfo::PlatformInfo(std::shared_ptr<Settings> settings)
+    : settings(std::move(settings))
+{
+}
+
+void PlatformInfo::DetectAsync()
+{
+    if (m_isDetecting)
+        return;
+
+    if (m_isDetected || LoadCache())
+    {
+        m_isDetected = true;
+        // callers connect after asking, so the result is always reported from the event loop
+        QMetaObject::invokeMethod(this, &PlatformInfo::detected, Qt::QueuedConnection);
+        return;
+    }
+
+    m_isDetecting = true;
+    m_devices.clear();
+
+    auto* process = new QProcess(this);
+    connect(process, &QProcess::finished, this, [this, process](int exitCode, QProcess::ExitStatus exitStatus)
+            {
+        process->deleteLater();
+        HandleHwaccelsQueried(process, exitCode, exitStatus); });
+    connect(process, &QProcess::errorOccurred, this, [this, process](QProcess::ProcessError error)
+            {
+        if (error != QProcess::FailedToStart)
+            return;
+        process->deleteLater();
+        CompleteDetection(false); });
+
+    process->startCommand("ffmpeg -hide_banner -hwaccels");
+}
+
+QStringList PlatformInfo::parseHwaccels(const QString& output)
+{
+    // a header line followed by one method per line
+    QStringList hwaccels;
+    bool isListing = false;
+
+    for (const QString& line : output.split('\n'))
+    {
+        const QString name = line.trimmed();
+        if (name.startsWith("Hardware acceleration methods"))
+            isListing = true;
+        else if (isListing && !name.isEmpty())
+            hwaccels.append(name);
+    }
+
+    return hwaccels;
+}
+
+void PlatformInfo::HandleHwaccelsQueried(QProcess* process, const int exitCode, const QProcess::ExitStatus exitStatus)
+{
+    if (exitStatus != QProcess::NormalExit || exitCode != 0)
+    {
+        CompleteDetection(false);
+        return;
+    }
+
+    for (const QString& hwaccel : parseHwaccels(QString::fromUtf8(process->readAllStandardOutput())))
+        ProbeDevice(hwaccel);
+
+    if (m_runningProbes == 0)
+        CompleteDetection(true);
+}
+
+void PlatformInfo::ProbeDevice(const QString& hwaccel)
+{
+    // methods are compiled in whether or not the hardware exists, so a device of each kind is actually opened
+    auto* process = new QProcess(this);
+    auto* timeout = new QTimer(process);
+    timeout->setSingleShot(true);
+    connect(timeout, &QTimer::timeout, process, &QProcess::kill);
+
+    connect(process, &QProcess::finished, this, [this, process, hwaccel](int exitCode, QProcess::ExitStatus exitStatus)
+            {
+        if (exitStatus == QProcess::NormalExit && exitCode == 0)
+            m_devices.append(hwaccel);
+
+        process->deleteLater();
+        if (--m_runningProbes == 0)
+            CompleteDetection(true); });
+    connect(process, &QProcess::errorOccurred, this, [this, process](QProcess::ProcessError error)
+            {
+        if (error != QProcess::FailedToStart)
+            return;
+        process->deleteLater();
+        if (--m_runningProbes == 0)
+            CompleteDetection(true); });
+
+    ++m_runningProbes;
+    timeout->start(probeTimeoutMs);
+    process->start("ffmpeg", { "-hide_banner", "-v", "error", "-init_hw_device", hwaccel, "-f", "lavfi", "-i", "nullsrc=s=64x64", "-frames:v", "1", "-f", "null", "-" });
+}
+
+void PlatformInfo::CompleteDetection(const bool isConclusive)
+{
+    m_devices.sort();
+    m_isDetecting = false;
+    m_isDetected = true;
+
+    // a missing ffmpeg is not remembered, so that installing it is picked up on the next launch
+    if (isConclusive)
+        SaveCache();
+
+    emit detected();
+}
+
+bool PlatformInfo::LoadCache()
+{
+    QFile file(QDir(FFmpegFormatSupportLoader::cacheDirectory()).filePath("platform_info.json"));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    const QJsonObject cache = QJsonDocument::fromJson(file.readAll()).object();
+    const QJsonObject key = FFmpegFormatSupportLoader::binaryIdentity();
+
+    if (cache["key"].toObject() != key || key["path"].toString().isEmpty())
+        return false;
+
+    const QDateTime detectedAt = QDateTime::fromString(cache["detectedAt"].toString(), Qt::ISODate);
+    const int cacheDays = settings->get("Main/iHardwareProbeCacheDays").toInt();
+    if (!detectedAt.isValid() || detectedAt.daysTo(QDateTime::currentDateTime()) >= cacheDays)
+        return false;
+
+    m_devices = cache["hardwareDevices"].toVariant().toStringList();
+    return true;
+}
 
-bool PlatformInfo::DetectNvidia()
+void PlatformInfo::SaveCache() const
 {
-    QOpenGLContext context;
-    context.create();
+    const QJsonObject key = FFmpegFormatSupportLoader::binaryIdentity();
+    if (key["path"].toString().isEmpty())
+        return;
 
-    QOffscreenSurface surface;
-    surface.setFormat(context.format());
-    surface.create();
-    context.makeCurrent(&surface);
+    const QJsonObject cache {
+        { "key", key },
+        { "detectedAt", QDateTime::currentDateTime().toString(Qt::ISODate) },
+        { "hardwareDevices", QJsonArray::fromStringList(m_devices) },
+    };
 
-    QOpenGLFunctions functions;
-    functions.initializeOpenGLFunctions();
+    QDir().mkpath(FFmpegFormatSupportLoader::cacheDirectory());
 
-    const GLubyte* vendor = functions.glGetString(GL_VENDOR);
-    QString vendorString
-        = QString::fromUtf8(reinterpret_cast<const char*>(vendor));
+    QSaveFile file(QDir(FFmpegFormatSupportLoader::cacheDirectory()).filePath("platform_info.json"));
+    if (!file.open(QIODevice::WriteOnly))
+        return;
 
-    return vendorString.contains("NVIDIA", Qt::CaseInsensitive);
+    file.write(QJsonDocument(cache).toJson(QJsonDocument::Compact));
+    file.commit();
 }
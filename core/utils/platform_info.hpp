@@ -1,22 +1,61 @@
 #ifndef PLATFORM_INFO_HPP
 #define PLATFORM_INFO_HPP
 
+#include "core/settings/settings.hpp"
+
+#include <QObject>
+#include <QProcess>
 #include <QString>
+#include <QStringList>
 #include <QSysInfo>
+#include <QTimer>
+#include <di.hpp>
 
-class PlatformInfo
+//!
+//! \brief Describes the operating system and the hardware devices ffmpeg can use.
+//! \details Nothing is detected on construction: DetectAsync() asks ffmpeg for its hardware acceleration methods
+//! and tries to open a device for each one. Results are cached next to the supported formats, keyed by the ffmpeg binary,
+//! and detected again after as many days as the hardware encoder probe results, for drivers or devices that changed.
+//!
+class PlatformInfo : public QObject
 {
+    Q_OBJECT
+
 public:
-    PlatformInfo();
+    BOOST_DI_INJECT(PlatformInfo, (named = di_settings) std::shared_ptr<Settings> settings);
 
     bool isWindows() const { return m_isWindows; };
-    bool isNvidia() const { return m_isNvidia; };
+
+    //! Starts detecting the hardware devices, unless they are known already; detected() is emitted either way.
+    void DetectAsync();
+    [[nodiscard]] bool isDetected() const { return m_isDetected; }
+
+    //! The hwaccel names, e.g. cuda or vaapi, for which a device could be opened. Empty until detected.
+    [[nodiscard]] const QStringList& hardwareDevices() const { return m_devices; }
+    [[nodiscard]] bool hasHardwareDevice(const QString& hwaccel) const { return m_devices.contains(hwaccel); }
+    [[nodiscard]] bool isNvidia() const { return hasHardwareDevice("cuda"); };
+
+    [[nodiscard]] static QStringList parseHwaccels(const QString& output);
+
+signals:
+    void detected();
 
 private:
-    bool DetectNvidia();
+    void HandleHwaccelsQueried(QProcess* process, int exitCode, QProcess::ExitStatus exitStatus);
+    void ProbeDevice(const QString& hwaccel);
+    void CompleteDetection(bool isConclusive);
 
+    [[nodiscard]] bool LoadCache();
+    void SaveCache() const;
+
+    std::shared_ptr<Settings> settings;
     const bool m_isWindows = QSysInfo::kernelType() == "winnt";
-    bool m_isNvidia;
+    bool m_isDetected = false;
+    bool m_isDetecting = false;
+    QStringList m_devices;
+    int m_runningProbes = 0;
+
+    static constexpr int probeTimeoutMs = 10000;
 };
 
 #endif
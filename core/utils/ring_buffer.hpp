@@ -0,0 +1,58 @@
+#ifndef RING_BUFFER_HPP
+#define RING_BUFFER_HPP
+
+#include <QList>
+
+//!
+//! \brief A fixed-capacity buffer which overwrites its oldest items once full.
+//!
+template<typename T>
+class RingBuffer
+{
+public:
+    explicit RingBuffer(qsizetype capacity)
+        : capacity(qMax<qsizetype>(1, capacity))
+    {
+        items.reserve(this->capacity);
+    }
+
+    void push(const T& item)
+    {
+        if (items.size() < capacity)
+        {
+            items.append(item);
+            return;
+        }
+
+        items[head] = item;
+        head = (head + 1) % capacity;
+    }
+
+    void clear()
+    {
+        items.clear();
+        head = 0;
+    }
+
+    [[nodiscard]] qsizetype size() const { return items.size(); }
+    [[nodiscard]] bool isEmpty() const { return items.isEmpty(); }
+
+    //! The items from oldest to newest.
+    [[nodiscard]] QList<T> toList() const
+    {
+        QList<T> ordered;
+        ordered.reserve(items.size());
+
+        for (qsizetype i = 0; i < items.size(); i++)
+            ordered.append(items.at((head + i) % items.size()));
+
+        return ordered;
+    }
+
+private:
+    const qsizetype capacity;
+    qsizetype head = 0;
+    QList<T> items;
+};
+
+#endif // RING_BUFFER_HPP
@@ -0,0 +1,52 @@
+#include "allocation_counter.hpp"
+
+#include <atomic>
+
+static std::atomic<bool> isCounting = false;
+static std::atomic<qint64> allocationsCount = 0;
+
+void AllocationCounter::Start()
+{
+    allocationsCount = 0;
+    isCounting = true;
+}
+
+qint64 AllocationCounter::Stop()
+{
+    isCounting = false;
+    return allocationsCount;
+}
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+
+static void Count()
+{
+    if (isCounting.load(std::memory_order_relaxed))
+        allocationsCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+// the allocator of glibc, under the names it keeps for programs replacing malloc()
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+
+// also what operator new calls, and freed by the free() of glibc
+extern "C" void* malloc(size_t size) noexcept
+{
+    Count();
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) noexcept
+{
+    Count();
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size) noexcept
+{
+    Count();
+    return __libc_realloc(pointer, size);
+}
+
+#endif
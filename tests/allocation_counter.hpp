@@ -0,0 +1,26 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <QtGlobal>
+#include <cstdlib>
+
+//!
+//! \brief Counts the heap allocations made between Start() and Stop(), on every thread.
+//! \details Qt containers allocate through malloc() rather than operator new, so both are counted by replacing
+//! malloc(), calloc() and realloc() of the test binary with ones forwarding to glibc. Elsewhere, and under sanitizers
+//! that replace them already, nothing is counted.
+//!
+struct AllocationCounter
+{
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+    static constexpr bool isSupported = true;
+#else
+    static constexpr bool isSupported = false;
+#endif
+
+    static void Start();
+    //! The allocations since Start(); reallocations count as one each.
+    [[nodiscard]] static qint64 Stop();
+};
+
+#endif
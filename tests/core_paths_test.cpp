@@ -0,0 +1,419 @@
+#include "allocation_counter.hpp"
+#include "memory_settings.hpp"
+
+#include "core/encoder/encoder.hpp"
+#include "core/encoder/encoder_options_builder.hpp"
+#include "core/formats/ffmpeg_format_support_loader.hpp"
+#include "core/formats/metadata_loader.hpp"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTest>
+#include <memory>
+
+//!
+//! \brief Checks the paths every job goes through against recorded ffmpeg and ffprobe outputs, and benchmarks them.
+//! \details The fixtures are transcribed from ffmpeg 6.1: the listings of -encoders and -muxers, the output of
+//! MetadataLoader::ffprobeArguments, and the logs of failed encodes. Each benchmark is measured over measuredRuns
+//! calls, in ns and allocations per call. With SME_CHECK_BASELINES set, it fails past its baseline in baselines.json by
+//! more than the tolerance; with SME_RECORD_BASELINES set, the measured figures are written there. Otherwise only the
+//! results are checked, as the figures depend on the machine and the build type.
+//!
+class CorePathsTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void parseCodecs();
+    void parseContainers();
+    void parseListingWithoutLegend();
+    void parseMovieMetadata();
+    void parseClipMetadata();
+    void parseTruncatedMetadata();
+    void parseOutput_data();
+    void parseOutput();
+    void buildBaseParams();
+    void buildVideoFilterParams();
+
+    void parseCodecsBenchmark();
+    void parseContainersBenchmark();
+    void parseMetadataBenchmark();
+    void parseOutputBenchmark();
+    void buildBaseParamsBenchmark();
+    void buildVideoFilterParamsBenchmark();
+
+private:
+    [[nodiscard]] static QByteArray fixture(const QString& name);
+    [[nodiscard]] static QString baselinesPath() { return QDir(SME_FIXTURES_DIR).filePath("baselines.json"); }
+
+    [[nodiscard]] Codec codec(const QString& libraryName) const;
+    [[nodiscard]] Container container(const QString& formatName) const;
+    //! A builder for the recorded clip, which the options of each case are added to.
+    [[nodiscard]] EncoderOptionsBuilder clipOptions() const;
+
+    //! Times the calls and counts their allocations, then checks or records the baseline of the benchmark.
+    template<typename Call>
+    void CheckBaseline(const QString& name, Call call);
+
+    QByteArray encodersOutput;
+    QByteArray muxersOutput;
+    QList<Codec> codecs;
+    QList<Container> containers;
+    optional<Metadata> clipMetadata;
+    std::unique_ptr<MediaEncoder> encoder;
+
+    QJsonObject baselines;
+    bool isChecking = false;
+    bool isRecording = false;
+
+    static constexpr int measuredRuns = 200;
+    //! Time depends on the machine and its load; allocations only on the code and the version of Qt.
+    static constexpr double timeTolerance = 1.0;
+    static constexpr double allocationsTolerance = 0.25;
+};
+
+//! Keeps the results of benchmarked calls, which could otherwise be optimized away.
+static volatile qsizetype sink = 0;
+
+void CorePathsTest::initTestCase()
+{
+    encodersOutput = fixture("encoders.txt");
+    muxersOutput = fixture("muxers.txt");
+    QVERIFY(!encodersOutput.isEmpty());
+    QVERIFY(!muxersOutput.isEmpty());
+
+    const auto [videoCodecs, audioCodecs] = FFmpegFormatSupportLoader::parseCodecs(encodersOutput);
+    codecs = videoCodecs + audioCodecs;
+    containers = FFmpegFormatSupportLoader::parseContainers(muxersOutput);
+
+    const MetadataResult clip = MetadataLoader::parse(fixture("probe_clip.txt"));
+    QVERIFY(std::holds_alternative<Metadata>(clip));
+    clipMetadata = std::get<Metadata>(clip);
+
+    // nothing configured: no size calibration is learned, and no result is cached
+    const auto settings = std::make_shared<MemorySettings>();
+    encoder = std::make_unique<MediaEncoder>(std::make_shared<SizeCalibration>(settings), std::make_shared<QualityLevelCache>(),
+                                             std::make_shared<ResultCache>(settings));
+
+    isRecording = qEnvironmentVariableIsSet("SME_RECORD_BASELINES");
+    isChecking = !isRecording && qEnvironmentVariableIsSet("SME_CHECK_BASELINES");
+
+    QFile file(baselinesPath());
+    if (file.open(QIODevice::ReadOnly))
+        baselines = QJsonDocument::fromJson(file.readAll()).object().value("benchmarks").toObject();
+}
+
+void CorePathsTest::cleanupTestCase()
+{
+    if (!isRecording)
+        return;
+
+    QFile file(baselinesPath());
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write(QJsonDocument(QJsonObject { { "version", 1 }, { "benchmarks", baselines } }).toJson());
+}
+
+void CorePathsTest::parseCodecs()
+{
+    const auto [videoCodecs, audioCodecs] = FFmpegFormatSupportLoader::parseCodecs(encodersOutput);
+
+    // the legend and the subtitle encoders are left out
+    QCOMPARE(videoCodecs.size(), qsizetype(52));
+    QCOMPARE(audioCodecs.size(), qsizetype(21));
+
+    QCOMPARE(videoCodecs.first().libraryName, QString("a64multi"));
+    QCOMPARE(videoCodecs.first().displayName, QString("Multicolor charset for Commodore 64 (codec a64_multi)"));
+    QVERIFY(!videoCodecs.first().isAudioCodec);
+
+    QCOMPARE(codec("libx264").displayName, QString("libx264 H.264 / AVC / MPEG-4 AVC / MPEG-4 part 10 (codec h264)"));
+    QCOMPARE(codec("libsvtav1").displayName, QString("SVT-AV1(Scalable Video Technology for AV1) encoder (codec av1)"));
+    QVERIFY(codec("libopus").isAudioCodec);
+    QCOMPARE(codec("opus").displayName, QString("Opus"));
+
+    for (const QString& name : { "srt", "webvtt", "=", "Video" })
+        QVERIFY2(codec(name).libraryName.isEmpty(), qPrintable(name));
+}
+
+void CorePathsTest::parseContainers()
+{
+    QCOMPARE(containers.size(), qsizetype(51));
+
+    QCOMPARE(containers.first().formatName, QString("3g2"));
+    QCOMPARE(containers.first().displayName, QString("3GP2 (3GPP2 file format)"));
+    QCOMPARE(container("matroska").displayName, QString("Matroska"));
+    QCOMPARE(container("stream_segment,ssegment").displayName, QString("streaming segment muxer"));
+    QCOMPARE(container("webm_dash_manifest").displayName, QString("WebM DASH Manifest"));
+
+    // extensions are asked for muxer by muxer, once listed
+    QVERIFY(container("mp4").extensions.isEmpty());
+}
+
+void CorePathsTest::parseListingWithoutLegend()
+{
+    // what a shell prints in place of a listing
+    const QByteArray output = "/bin/sh: line 1: ffmpeg: command not found\n";
+
+    QVERIFY(FFmpegFormatSupportLoader::parseCodecs(output).first.isEmpty());
+    QVERIFY(FFmpegFormatSupportLoader::parseContainers(output).isEmpty());
+}
+
+void CorePathsTest::parseMovieMetadata()
+{
+    const MetadataResult result = MetadataLoader::parse(fixture("probe_movie.txt"));
+    QVERIFY(std::holds_alternative<Metadata>(result));
+    const Metadata& metadata = std::get<Metadata>(result);
+
+    QCOMPARE(metadata.width, 1920.0);
+    QCOMPARE(metadata.height, 1080.0);
+    QCOMPARE(metadata.durationSeconds, 5421.376);
+    QCOMPARE(metadata.sizeKbps, 6428145.276);
+    QCOMPARE(metadata.aspectRatioX, 16.0);
+    QCOMPARE(metadata.aspectRatioY, 9.0);
+    // the video stream tells the frame rate, whichever other streams there are
+    QCOMPARE(metadata.frameRate, 24000.0 / 1001);
+    QCOMPARE(metadata.videoCodec, QString("h264"));
+    QCOMPARE(metadata.audioCodec, QString("eac3"));
+    QCOMPARE(metadata.audioBitrateKbps, 640.0);
+
+    // streams tagged with their statistics by a Matroska muxer take their bitrate from them
+    QCOMPARE(metadata.streams.size(), qsizetype(4));
+    QCOMPARE(metadata.streams.at(0).bitrateKbps, 8735.296);
+    QCOMPARE(metadata.streams.at(2).type, QString("audio"));
+    QCOMPARE(metadata.streams.at(2).language, QString("fre"));
+    QCOMPARE(metadata.streams.at(2).bitrateKbps, 128.0);
+    QCOMPARE(metadata.streams.at(2).channelsCount, 2);
+    QCOMPARE(metadata.streams.at(3).type, QString("subtitle"));
+    QCOMPARE(metadata.streams.at(3).codec, QString("subrip"));
+}
+
+void CorePathsTest::parseClipMetadata()
+{
+    const Metadata& metadata = *clipMetadata;
+
+    QCOMPARE(metadata.width, 1280.0);
+    QCOMPARE(metadata.height, 720.0);
+    QCOMPARE(metadata.frameRate, 30.0);
+    QCOMPARE(metadata.durationSeconds, 10.0);
+    QCOMPARE(metadata.videoCodec, QString("h264"));
+    QVERIFY(metadata.audioCodec.isEmpty());
+    QCOMPARE(metadata.streams.size(), qsizetype(1));
+    QCOMPARE(metadata.streams.first().bitrateKbps, 2499.506);
+}
+
+void CorePathsTest::parseTruncatedMetadata()
+{
+    // ffprobe stopped before the format section
+    QVERIFY(std::holds_alternative<Message>(MetadataLoader::parse(fixture("probe_truncated.txt"))));
+}
+
+void CorePathsTest::parseOutput_data()
+{
+    QTest::addColumn<QString>("log");
+
+    QTest::newRow("encoder option") << "failure_encoder_option";
+    QTest::newRow("disk full") << "failure_disk_full";
+}
+
+void CorePathsTest::parseOutput()
+{
+    QFETCH(QString, log);
+
+    const QString output = QString::fromUtf8(fixture(log + ".log"));
+    const QString expected = QString::fromUtf8(fixture(log + ".expected.txt"));
+
+    QCOMPARE(MediaEncoder::parseOutput(output), expected);
+}
+
+void CorePathsTest::buildBaseParams()
+{
+    const EncoderOptions movie = std::get<EncoderOptions>(
+        clipOptions().withVideoCodec(codec("libx264")).withAudioCodec(codec("aac")).withContainer(container("mp4")).build()
+    );
+    QCOMPARE(encoder->BuildBaseParams(movie, { .videoBitrateKbps = 2000, .audioBitrateKbps = 128 }),
+             QString("-c:v libx264 -c:a aac -b:v 2000k -b:a 128k -f mp4"));
+    QCOMPARE(encoder->BuildBaseParams(movie, { .audioBitrateKbps = 128, .copiesVideo = true }),
+             QString("-c:v copy -c:a aac -b:a 128k -f mp4"));
+
+    const EncoderOptions audio = std::get<EncoderOptions>(
+        clipOptions().withAudioCodec(codec("libopus")).withAudioChannelsCount(2).withContainer(container("ogg")).build()
+    );
+    QCOMPARE(encoder->BuildBaseParams(audio, { .audioBitrateKbps = 96 }), QString("-vn -c:a libopus -b:a 96k -ac 2 -f ogg"));
+
+    const EncoderOptions threaded = std::get<EncoderOptions>(
+        clipOptions().withVideoCodec(codec("libsvtav1")).withContainer(container("webm")).withResourceLimits({ .threadsCount = 8 }).build()
+    );
+    QCOMPARE(encoder->BuildBaseParams(threaded, { .videoBitrateKbps = 1500 }), QString("-c:v libsvtav1 -an -b:v 1500k -threads 8 -f webm"));
+}
+
+void CorePathsTest::buildVideoFilterParams()
+{
+    const auto filtersOf = [this](EncoderOptionsBuilder builder)
+    {
+        const EncoderOptions options = std::get<EncoderOptions>(builder.withContainer(container("mp4")).build());
+        return encoder->BuildVideoFilterParams(options, {});
+    };
+    const Codec x264 = codec("libx264");
+
+    QCOMPARE(filtersOf(clipOptions().withVideoCodec(x264)), QString(""));
+    QCOMPARE(filtersOf(clipOptions().withVideoCodec(x264).withOutputWidth(640)), QString("-filter:v scale=640:-2"));
+    QCOMPARE(filtersOf(clipOptions().withVideoCodec(x264).withOutputWidth(640).withOutputHeight(480)), QString("-filter:v scale=640:480,setsar=1/1"));
+    QCOMPARE(filtersOf(clipOptions().withVideoCodec(x264).atSpeed(2).atFps(30)), QString("-filter:v setpts=0.5*PTS,fps=60"));
+
+    // frames are sampled down to what a GIF can afford, and mapped to the palette read as the second input
+    QCOMPARE(filtersOf(clipOptions().withVideoCodec(codec("gif"))),
+             QString(R"(-filter_complex "[0:v]fps=15,scale=640:-2:flags=lanczos[frames];[frames][1:v]paletteuse=dither=bayer:bayer_scale=5:diff_mode=rectangle" -loop 0)"));
+}
+
+void CorePathsTest::parseCodecsBenchmark()
+{
+    const auto call = [this]
+    { sink = FFmpegFormatSupportLoader::parseCodecs(encodersOutput).first.size(); };
+
+    QBENCHMARK { call(); }
+    CheckBaseline("parseCodecs", call);
+}
+
+void CorePathsTest::parseContainersBenchmark()
+{
+    const auto call = [this]
+    { sink = FFmpegFormatSupportLoader::parseContainers(muxersOutput).size(); };
+
+    QBENCHMARK { call(); }
+    CheckBaseline("parseContainers", call);
+}
+
+void CorePathsTest::parseMetadataBenchmark()
+{
+    const QByteArray probe = fixture("probe_movie.txt");
+    const auto call = [&probe]
+    { sink = static_cast<qsizetype>(MetadataLoader::parse(probe).index()); };
+
+    QBENCHMARK { call(); }
+    CheckBaseline("parseMetadata", call);
+}
+
+void CorePathsTest::parseOutputBenchmark()
+{
+    const QString log = QString::fromUtf8(fixture("failure_encoder_option.log"));
+    const auto call = [&log]
+    { sink = MediaEncoder::parseOutput(log).size(); };
+
+    QBENCHMARK { call(); }
+    CheckBaseline("parseOutput", call);
+}
+
+void CorePathsTest::buildBaseParamsBenchmark()
+{
+    const EncoderOptions options = std::get<EncoderOptions>(
+        clipOptions().withVideoCodec(codec("libx264")).withAudioCodec(codec("aac")).withContainer(container("mp4")).build()
+    );
+    const MediaEncoder::ComputedOptions computed { .videoBitrateKbps = 2000, .audioBitrateKbps = 128 };
+    const auto call = [this, &options, &computed]
+    { sink = encoder->BuildBaseParams(options, computed).size(); };
+
+    QBENCHMARK { call(); }
+    CheckBaseline("buildBaseParams", call);
+}
+
+void CorePathsTest::buildVideoFilterParamsBenchmark()
+{
+    const EncoderOptions options = std::get<EncoderOptions>(
+        clipOptions().withVideoCodec(codec("libx264")).withOutputWidth(640).atFps(30).withContainer(container("mp4")).build()
+    );
+    const MediaEncoder::ComputedOptions computed;
+    const auto call = [this, &options, &computed]
+    { sink = encoder->BuildVideoFilterParams(options, computed).size(); };
+
+    QBENCHMARK { call(); }
+    CheckBaseline("buildVideoFilterParams", call);
+}
+
+QByteArray CorePathsTest::fixture(const QString& name)
+{
+    QFile file(QDir(SME_FIXTURES_DIR).filePath(name));
+    if (!file.open(QIODevice::ReadOnly))
+        qWarning("Could not read the fixture %s: %s", qPrintable(name), qPrintable(file.errorString()));
+
+    return file.readAll();
+}
+
+Codec CorePathsTest::codec(const QString& libraryName) const
+{
+    for (const Codec& codec : codecs)
+    {
+        if (codec.libraryName == libraryName)
+            return codec;
+    }
+
+    return {};
+}
+
+Container CorePathsTest::container(const QString& formatName) const
+{
+    for (const Container& container : containers)
+    {
+        if (container.formatName == formatName)
+            return container;
+    }
+
+    return {};
+}
+
+EncoderOptionsBuilder CorePathsTest::clipOptions() const
+{
+    // the input only has to exist, as nothing reads it
+    EncoderOptionsBuilder builder;
+    builder.useMetadata(*clipMetadata).inputFrom(QDir(SME_FIXTURES_DIR).filePath("probe_clip.txt")).outputTo("clip.out");
+    return builder;
+}
+
+template<typename Call>
+void CorePathsTest::CheckBaseline(const QString& name, Call call)
+{
+    if (!isChecking && !isRecording)
+        return;
+
+    // once first, for the statics built on the first call
+    call();
+
+    QElapsedTimer timer;
+    AllocationCounter::Start();
+    timer.start();
+    for (int i = 0; i < measuredRuns; i++)
+        call();
+    const double nsPerOp = static_cast<double>(timer.nsecsElapsed()) / measuredRuns;
+    const double allocationsPerOp = static_cast<double>(AllocationCounter::Stop()) / measuredRuns;
+
+    qInfo("%s: %.0f ns/op, %.1f allocations/op", qPrintable(name), nsPerOp, allocationsPerOp);
+
+    if (isRecording)
+    {
+        QJsonObject baseline { { "nsPerOp", qRound64(nsPerOp) } };
+        if (AllocationCounter::isSupported)
+            baseline.insert("allocationsPerOp", allocationsPerOp);
+        baselines.insert(name, baseline);
+        return;
+    }
+
+    const QJsonObject baseline = baselines.value(name).toObject();
+    QVERIFY2(!baseline.isEmpty(), qPrintable("No baseline for " + name + "; record one with SME_RECORD_BASELINES set."));
+
+    const double maxNsPerOp = baseline.value("nsPerOp").toDouble() * (1 + timeTolerance);
+    QVERIFY2(nsPerOp <= maxNsPerOp, qPrintable(QString("%1 ns/op is past the %2 allowed").arg(qRound64(nsPerOp)).arg(qRound64(maxNsPerOp))));
+
+    if (AllocationCounter::isSupported && baseline.contains("allocationsPerOp"))
+    {
+        const double maxAllocationsPerOp = baseline.value("allocationsPerOp").toDouble() * (1 + allocationsTolerance);
+        QVERIFY2(allocationsPerOp <= maxAllocationsPerOp,
+                 qPrintable(QString("%1 allocations/op is past the %2 allowed").arg(allocationsPerOp).arg(maxAllocationsPerOp)));
+    }
+}
+
+QTEST_GUILESS_MAIN(CorePathsTest)
+#include "core_paths_test.moc"
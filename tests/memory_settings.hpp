@@ -0,0 +1,47 @@
+#ifndef MEMORY_SETTINGS_H
+#define MEMORY_SETTINGS_H
+
+#include "core/settings/settings.hpp"
+
+#include <QHash>
+#include <QStringList>
+
+//! Settings held in memory, so that tests neither read the configuration of the user nor write to it.
+class MemorySettings final : public Settings
+{
+public:
+    [[nodiscard]] QVariant get(const QString& key) const override { return values.value(key); }
+    void Set(const QString& key, const QVariant& value) override { values.insert(key, value); }
+
+    [[nodiscard]] QStringList groups() const override
+    {
+        QStringList groups;
+        for (const QString& key : values.keys())
+        {
+            const QString group = key.section('/', 0, 0);
+            if (key.contains('/') && !groups.contains(group))
+                groups.append(group);
+        }
+
+        return groups;
+    }
+
+    [[nodiscard]] QStringList keysInGroup(const QString& group) const override
+    {
+        QStringList keys;
+        for (const QString& key : values.keys())
+        {
+            if (key.startsWith(group + '/'))
+                keys.append(key.sliced(group.size() + 1));
+        }
+
+        return keys;
+    }
+
+    [[nodiscard]] QString fileName() const override { return {}; }
+
+private:
+    QHash<QString, QVariant> values;
+};
+
+#endif